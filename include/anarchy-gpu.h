@@ -36,12 +36,16 @@
 
 /* Reset Control Bits */
 #define GPU_MEM_RESET_BIT      0x00000001  /* Memory controller reset */
+#define GPU_MEM_RESET_ACK      0x00000002  /* Read back: controller is held in reset */
 #define GPU_ENGINE_RESET_BIT   0x00000001  /* Engine reset */
+#define GPU_ENGINE_RESET_ACK   0x00000002  /* Read back: engines are held in reset */
 
 /* GPU Reset Timeouts (in milliseconds) */
 #define GPU_RESET_TIMEOUT      5000        /* Maximum time for reset sequence */
 #define GPU_LINK_TIMEOUT       1000        /* Maximum time for link training */
 #define GPU_INIT_TIMEOUT       2000        /* Maximum time for initialization */
+#define GPU_D3_TIMEOUT         100         /* Maximum time to reach D3 */
+#define GPU_RESET_ACK_TIMEOUT  100         /* Maximum time for a reset bit to take */
 
 /* GPU Temperature Thresholds (in degrees Celsius) */
 #define GPU_TEMP_WARN          80          /* Warning temperature */
@@ -54,6 +58,9 @@
 #define GPU_MEM_MIN_ALLOC      4096        /* Minimum allocation size */
 
 /* Function Declarations */
+struct anarchy_device;
+enum anarchy_gpu_error;
+
 int anarchy_gpu_init(struct anarchy_device *adev);
 void anarchy_gpu_exit(struct anarchy_device *adev);
 void anarchy_gpu_handle_error(struct anarchy_device *adev, enum anarchy_gpu_error error);
@@ -0,0 +1,238 @@
+#ifndef _ANARCHY_IOCTL_H_
+#define _ANARCHY_IOCTL_H_
+
+/*
+ * Control interface of /dev/anarchy-egpu, shared by the kernel driver and
+ * userspace. Only fixed-width types, so the layout is identical on both sides.
+ *
+ * Versioning: ANARCHY_IOC_GET_VERSION reports the ABI major/minor and a
+ * feature mask. A major bump means incompatible layouts; minor bumps only
+ * add ioctls or append fields. Structs that may grow carry a leading size
+ * field, the driver fills min(size, its own sizeof) bytes.
+ *
+ * Once the eGPU is removed every call on a file that is still open fails
+ * with -ENODEV, and poll() reports EPOLLHUP. Close it and reopen the node.
+ */
+
+#include <linux/types.h>
+#ifdef __KERNEL__
+#include <linux/ioctl.h>
+#else
+#include <sys/ioctl.h>
+#endif
+
+#define ANARCHY_IOC_MAGIC 'A'
+
+#define ANARCHY_ABI_MAJOR  1
+#define ANARCHY_ABI_MINOR  2
+
+/* Feature bits reported in struct anarchy_ioc_version */
+#define ANARCHY_FEAT_CONFIG   (1U << 0)
+#define ANARCHY_FEAT_STATS    (1U << 1)
+#define ANARCHY_FEAT_DMA      (1U << 2)
+#define ANARCHY_FEAT_EVENTS   (1U << 3)
+#define ANARCHY_FEAT_QUEUES   (1U << 4)
+
+struct anarchy_ioc_version {
+    __u32 major;
+    __u32 minor;
+    __u32 features;           /* ANARCHY_FEAT_* */
+    __u32 reserved;
+    char driver_version[32];
+};
+
+/* Configuration limits, validated before anything is applied */
+#define ANARCHY_CFG_MIN_DMA_CHANNELS   1
+#define ANARCHY_CFG_MAX_DMA_CHANNELS   16
+#define ANARCHY_CFG_MIN_RING_SIZE      16
+#define ANARCHY_CFG_MAX_RING_SIZE      4096
+#define ANARCHY_CFG_MAX_LINK_SPEED     4     /* Gen4 */
+#define ANARCHY_CFG_MIN_TB_TIMEOUT     100   /* ms */
+#define ANARCHY_CFG_MAX_TB_TIMEOUT     5000  /* ms */
+#define ANARCHY_CFG_DEFAULT_READY_MS   2000
+
+/* Fields carried by struct anarchy_ioc_config (valid / failed_field) */
+#define ANARCHY_CFG_DMA_CHANNELS   (1U << 0)
+#define ANARCHY_CFG_RING_SIZE      (1U << 1)
+#define ANARCHY_CFG_LINK_SPEED     (1U << 2)
+#define ANARCHY_CFG_TB_TIMEOUT     (1U << 3)
+#define ANARCHY_CFG_ALL            0xF
+
+/* Complete device configuration, applied all-or-nothing */
+struct anarchy_ioc_config {
+    __u32 valid;              /* ANARCHY_CFG_* fields to apply */
+    __u32 dma_channels;
+    __u32 ring_size;          /* Entries, power of two */
+    __u32 link_speed;         /* 0 = auto, 1-4 = Gen1-Gen4 */
+    __u32 tb_timeout_ms;
+    __u32 ready_timeout_ms;   /* Max wait for ready, 0 = default */
+    __u32 failed_field;       /* Out: field that failed validation or apply */
+    __u32 ready_time_us;      /* Out: time from apply until device ready */
+};
+
+/* Device reset, returns once the device is ready again */
+struct anarchy_ioc_reset {
+    __u32 timeout_ms;         /* Max wait for ready, 0 = default */
+    __u32 ready_time_us;      /* Out: time from reset until device ready */
+};
+
+/* Stats snapshot flags */
+#define ANARCHY_STATS_LINK_UP      (1U << 0)
+#define ANARCHY_STATS_CONNECTED    (1U << 1)
+#define ANARCHY_STATS_THROTTLING   (1U << 2)
+
+/*
+ * Point-in-time counters. Byte counters are cumulative; rates are left to
+ * the reader, which divides counter deltas by timestamp deltas.
+ */
+struct anarchy_ioc_stats {
+    __u32 size;               /* In: caller's sizeof, out: bytes filled */
+    __u32 flags;              /* ANARCHY_STATS_* */
+    __u64 timestamp_ns;       /* CLOCK_MONOTONIC */
+
+    /* DMA */
+    __u64 tx_bytes;
+    __u64 rx_bytes;
+    __u32 tx_pending;
+    __u32 rx_pending;
+    __u32 transfer_errors;
+    __u32 dma_channels;
+    __u32 ring_size;
+    __u32 latency_ns;         /* Submit to completion, averaged, 0 = not measured */
+
+    /* PCIe */
+    __u32 link_speed;         /* Gen */
+    __u32 link_width;         /* Lanes */
+    __u32 pcie_errors;
+    __u32 pcie_utilization;   /* Percent */
+
+    /* GPU */
+    __u32 gpu_utilization;    /* Percent */
+    __u32 mem_utilization;    /* Percent */
+    __s32 temperature;        /* Celsius */
+    __u32 fan_speed;          /* Percent */
+    __u32 power_draw;         /* Watts */
+    __u32 gpu_clock;          /* MHz */
+
+    /* Thunderbolt */
+    __u32 tb_link_speed;      /* Gbps, 0 = unknown */
+    __u32 tb_hop_count;
+    __u32 tb_errors;          /* Descriptors the device failed over the link */
+    __u32 reserved;
+    char tb_device_path[64];
+
+    /* PCIe throughput over the last sampling interval, ABI 1.2 */
+    __u64 pcie_rx_rate;       /* Bytes/sec */
+    __u64 pcie_tx_rate;       /* Bytes/sec */
+};
+
+/*
+ * DMA submission. ANARCHY_EVENT_DMA_COMPLETE follows once the device has
+ * completed the last page: data[0] is the cookie, data[1] the size or,
+ * if a page failed, a negative errno. A failed ioctl raises no event.
+ */
+#define ANARCHY_DMA_TO_DEVICE      (1U << 0)
+
+struct anarchy_ioc_dma {
+    __u64 addr;               /* User buffer */
+    __u32 size;               /* Bytes */
+    __u32 flags;              /* ANARCHY_DMA_* */
+    __u64 cookie;             /* Echoed in the completion event */
+};
+
+/* Events, delivered through read() once subscribed */
+#define ANARCHY_EVENT_LINK_DOWN       (1U << 0)
+#define ANARCHY_EVENT_LINK_UP         (1U << 1)
+#define ANARCHY_EVENT_PCIE_ERROR      (1U << 2)
+#define ANARCHY_EVENT_THERMAL         (1U << 3)
+#define ANARCHY_EVENT_DMA_COMPLETE    (1U << 4)
+#define ANARCHY_EVENT_CONFIG_CHANGED  (1U << 5)
+#define ANARCHY_EVENT_RESET           (1U << 6)
+#define ANARCHY_EVENT_OVERFLOW        (1U << 31)  /* Events were dropped */
+
+struct anarchy_ioc_event {
+    __u32 type;               /* One ANARCHY_EVENT_* bit */
+    __u32 reserved;
+    __u64 timestamp_ns;       /* CLOCK_MONOTONIC */
+    __u64 data[2];            /* Type specific, e.g. DMA cookie and size */
+};
+
+/*
+ * Shared submission/completion queues. ANARCHY_IOC_QUEUE_SETUP creates a
+ * region that is mmap()ed at offset 0 and laid out as described by the
+ * returned offsets: SQ and CQ ring headers, SQE and CQE arrays and a data
+ * area that SQEs point into. Userspace owns sq.tail and cq.head, the
+ * driver owns sq.head and cq.tail; indices run freely and are masked.
+ * The data is copied when sq.head passes an SQE, its CQE is posted once
+ * the device has completed every page. With SQPOLL, an SQE that finds
+ * the DMA ring full for 10 ms completes with -EAGAIN instead of waiting.
+ */
+#define ANARCHY_QUEUE_MAX_ENTRIES  4096
+#define ANARCHY_QUEUE_MAX_DATA     (64U << 20)
+
+/* Setup flags */
+#define ANARCHY_QUEUE_SQPOLL       (1U << 0)  /* Kernel thread drains the SQ */
+
+/* SQ ring flags, written by the driver */
+#define ANARCHY_SQ_NEED_WAKEUP     (1U << 0)  /* Poll thread idle, kick it */
+
+struct anarchy_queue_ring {
+    __u32 head;
+    __u32 tail;
+    __u32 mask;
+    __u32 entries;
+    __u32 flags;              /* ANARCHY_SQ_* */
+    __u32 dropped;            /* SQ: invalid entries, CQ: lost completions */
+    __u32 reserved[10];       /* Pad to a cache line */
+};
+
+struct anarchy_sqe {
+    __u64 data_offset;        /* Into the data area */
+    __u32 size;               /* Bytes */
+    __u32 flags;              /* ANARCHY_DMA_* */
+    __u64 cookie;             /* Echoed in the CQE */
+};
+
+struct anarchy_cqe {
+    __u64 cookie;
+    __s32 result;             /* Bytes transferred or -errno */
+    __u32 flags;
+};
+
+struct anarchy_ioc_queue_setup {
+    __u32 sq_entries;         /* In: power of two, out: actual */
+    __u32 cq_entries;         /* Out: twice sq_entries */
+    __u32 flags;              /* ANARCHY_QUEUE_* */
+    __u32 sq_idle_ms;         /* SQPOLL: idle time before the thread sleeps */
+    __u32 data_size;          /* In: data area bytes, page aligned */
+    __u32 reserved;
+    __u64 sq_ring_off;        /* Out: offsets into the mapping */
+    __u64 cq_ring_off;
+    __u64 sqes_off;
+    __u64 cqes_off;
+    __u64 data_off;
+    __u64 mmap_size;
+};
+
+/* Queue enter flags */
+#define ANARCHY_ENTER_GETEVENTS    (1U << 0)  /* Wait for min_complete CQEs */
+#define ANARCHY_ENTER_SQ_WAKEUP    (1U << 1)  /* Wake an idle poll thread */
+
+struct anarchy_ioc_queue_enter {
+    __u32 to_submit;          /* SQEs to consume, 0 = all pending */
+    __u32 min_complete;
+    __u32 flags;              /* ANARCHY_ENTER_* */
+    __u32 submitted;          /* Out: SQEs consumed */
+};
+
+#define ANARCHY_IOC_GET_VERSION   _IOR(ANARCHY_IOC_MAGIC, 0x00, struct anarchy_ioc_version)
+#define ANARCHY_IOC_APPLY_CONFIG  _IOWR(ANARCHY_IOC_MAGIC, 0x01, struct anarchy_ioc_config)
+#define ANARCHY_IOC_GET_CONFIG    _IOR(ANARCHY_IOC_MAGIC, 0x02, struct anarchy_ioc_config)
+#define ANARCHY_IOC_RESET         _IOWR(ANARCHY_IOC_MAGIC, 0x03, struct anarchy_ioc_reset)
+#define ANARCHY_IOC_GET_STATS     _IOWR(ANARCHY_IOC_MAGIC, 0x04, struct anarchy_ioc_stats)
+#define ANARCHY_IOC_SUBMIT_DMA    _IOW(ANARCHY_IOC_MAGIC, 0x05, struct anarchy_ioc_dma)
+#define ANARCHY_IOC_SUBSCRIBE     _IOW(ANARCHY_IOC_MAGIC, 0x06, __u32)
+#define ANARCHY_IOC_QUEUE_SETUP   _IOWR(ANARCHY_IOC_MAGIC, 0x07, struct anarchy_ioc_queue_setup)
+#define ANARCHY_IOC_QUEUE_ENTER   _IOWR(ANARCHY_IOC_MAGIC, 0x08, struct anarchy_ioc_queue_enter)
+
+#endif /* _ANARCHY_IOCTL_H_ */
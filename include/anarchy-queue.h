@@ -0,0 +1,99 @@
+#ifndef ANARCHY_QUEUE_USER_H
+#define ANARCHY_QUEUE_USER_H
+
+/*
+ * Userspace side of the shared submission/completion queues. Binds a
+ * mapping returned by ANARCHY_IOC_QUEUE_SETUP + mmap() and provides the
+ * producer/consumer steps with the required memory ordering:
+ *
+ *   sqe = anarchy_sq_get(&uq);      fill it, repeat
+ *   anarchy_sq_commit(&uq);         publish the new tail
+ *   if (anarchy_sq_needs_enter(&uq)) ioctl(fd, ANARCHY_IOC_QUEUE_ENTER, ...)
+ *   while ((cqe = anarchy_cq_peek(&uq))) { ...; anarchy_cq_advance(&uq, 1); }
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "anarchy-ioctl.h"
+
+struct anarchy_uqueue {
+    struct anarchy_queue_ring *sq;
+    struct anarchy_queue_ring *cq;
+    struct anarchy_sqe *sqes;
+    struct anarchy_cqe *cqes;
+    uint8_t *data;
+    uint32_t data_size;
+    uint32_t sq_mask;
+    uint32_t cq_mask;
+    uint32_t sq_entries;
+    uint32_t sq_tail;       /* Local tail, published by anarchy_sq_commit() */
+    uint32_t flags;         /* Setup flags */
+};
+
+static inline void anarchy_uqueue_bind(struct anarchy_uqueue *uq, void *mem,
+                                       const struct anarchy_ioc_queue_setup *setup)
+{
+    uint8_t *base = mem;
+
+    uq->sq = (struct anarchy_queue_ring *)(base + setup->sq_ring_off);
+    uq->cq = (struct anarchy_queue_ring *)(base + setup->cq_ring_off);
+    uq->sqes = (struct anarchy_sqe *)(base + setup->sqes_off);
+    uq->cqes = (struct anarchy_cqe *)(base + setup->cqes_off);
+    uq->data = base + setup->data_off;
+    uq->data_size = setup->data_size;
+    uq->sq_mask = setup->sq_entries - 1;
+    uq->cq_mask = setup->cq_entries - 1;
+    uq->sq_entries = setup->sq_entries;
+    uq->sq_tail = __atomic_load_n(&uq->sq->tail, __ATOMIC_RELAXED);
+    uq->flags = setup->flags;
+}
+
+/* Next free SQE, or NULL when the driver has not consumed enough yet */
+static inline struct anarchy_sqe *anarchy_sq_get(struct anarchy_uqueue *uq)
+{
+    uint32_t head = __atomic_load_n(&uq->sq->head, __ATOMIC_ACQUIRE);
+
+    if (uq->sq_tail - head >= uq->sq_entries)
+        return NULL;
+    return &uq->sqes[uq->sq_tail++ & uq->sq_mask];
+}
+
+static inline void anarchy_sq_commit(struct anarchy_uqueue *uq)
+{
+    __atomic_store_n(&uq->sq->tail, uq->sq_tail, __ATOMIC_RELEASE);
+}
+
+/* Entries published but not yet consumed by the driver */
+static inline uint32_t anarchy_sq_pending(const struct anarchy_uqueue *uq)
+{
+    return uq->sq_tail - __atomic_load_n(&uq->sq->head, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Whether a QUEUE_ENTER call is needed to get committed entries consumed:
+ * always without a poll thread, only when it went idle with one.
+ */
+static inline int anarchy_sq_needs_enter(const struct anarchy_uqueue *uq)
+{
+    if (!(uq->flags & ANARCHY_QUEUE_SQPOLL))
+        return 1;
+    /* Pairs with the driver's barrier between setting the flag and rechecking tail */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return __atomic_load_n(&uq->sq->flags, __ATOMIC_RELAXED) & ANARCHY_SQ_NEED_WAKEUP;
+}
+
+static inline struct anarchy_cqe *anarchy_cq_peek(struct anarchy_uqueue *uq)
+{
+    uint32_t head = uq->cq->head;
+
+    if (head == __atomic_load_n(&uq->cq->tail, __ATOMIC_ACQUIRE))
+        return NULL;
+    return &uq->cqes[head & uq->cq_mask];
+}
+
+static inline void anarchy_cq_advance(struct anarchy_uqueue *uq, uint32_t count)
+{
+    __atomic_store_n(&uq->cq->head, uq->cq->head + count, __ATOMIC_RELEASE);
+}
+
+#endif /* ANARCHY_QUEUE_USER_H */
@@ -0,0 +1,107 @@
+#ifndef _ANARCHY_TRACE_H_
+#define _ANARCHY_TRACE_H_
+
+/*
+ * Command and DMA traffic trace, shared by the kernel driver and the
+ * replayer in tests/sim/trace_replay. Reading debugfs <device>/trace/data
+ * returns one struct anarchy_trace_header per open, then records as they
+ * are drained. Each record is followed by
+ * payload_len sampled payload bytes, padded to ANARCHY_TRACE_ALIGN.
+ * Records of different CPUs are not interleaved in time order; sort by
+ * ts_ns.
+ */
+
+#include <linux/types.h>
+
+#define ANARCHY_TRACE_MAGIC        0x43525441  /* "ATRC" */
+#define ANARCHY_TRACE_VERSION      2
+#define ANARCHY_TRACE_ALIGN        8
+
+/* Payload bytes that feed the hash, and the most that can be sampled */
+#define ANARCHY_TRACE_HASH_BYTES   256
+#define ANARCHY_TRACE_MAX_SAMPLE   4096
+
+/* Record types */
+#define ANARCHY_TRACE_CMD          1   /* process_game_command() */
+#define ANARCHY_TRACE_RING_TX      2   /* anarchy_ring_transfer() on a TX ring */
+#define ANARCHY_TRACE_RING_RX      3
+#define ANARCHY_TRACE_DMA          4   /* anarchy_dma_transfer() */
+
+struct anarchy_trace_header {
+    __u32 magic;
+    __u16 version;
+    __u16 record_size;        /* sizeof(struct anarchy_trace_rec) */
+    __u32 hash_bytes;         /* ANARCHY_TRACE_HASH_BYTES */
+    __u32 reserved;
+    __u64 lost;               /* Records dropped on full buffers so far */
+};
+
+struct anarchy_trace_rec {
+    __u64 ts_ns;              /* CLOCK_MONOTONIC */
+    __u64 hash;               /* anarchy_trace_hash() of the payload, commands only */
+    __u32 size;               /* Payload bytes */
+    __u32 flags;              /* CMD_FLAG_* for commands */
+    __u16 payload_len;        /* Sampled bytes following the record */
+    __u8 type;                /* ANARCHY_TRACE_* */
+    __u8 category;            /* CMD_CAT_* for commands */
+    __u16 cpu;
+    __u16 reserved;
+};
+
+static inline __u32 anarchy_trace_rec_len(const struct anarchy_trace_rec *rec)
+{
+    return sizeof(*rec) + ((rec->payload_len + ANARCHY_TRACE_ALIGN - 1) &
+                           ~(ANARCHY_TRACE_ALIGN - 1));
+}
+
+/*
+ * Fingerprint of a payload: its size and first ANARCHY_TRACE_HASH_BYTES.
+ * Enough to find repeated commands for dedup studies, and cheap enough to
+ * run on every command; hashing whole payloads would not be. Eight
+ * independent lanes keep the multiplies from waiting on each other
+ * (version 1 traces used four, and hash differently).
+ */
+#define ANARCHY_TRACE_MIX(h, p) do {                                \
+    __u64 __w;                                                      \
+    __builtin_memcpy(&__w, p, 8);                                   \
+    h = (h ^ __w) * 0x9FB21C651E98DF25ULL;                          \
+    h ^= h >> 29;                                                   \
+} while (0)
+
+#define ANARCHY_TRACE_ROL(x, r) ((x) << (r) | (x) >> (64 - (r)))
+
+static inline __u64 anarchy_trace_hash(const void *data, __u32 size)
+{
+    const unsigned char *p = data;
+    __u32 n = size < ANARCHY_TRACE_HASH_BYTES ? size : ANARCHY_TRACE_HASH_BYTES;
+    __u64 a = 0x9E3779B97F4A7C15ULL ^ ((__u64)size * 0xC2B2AE3D27D4EB4FULL);
+    __u64 b = 0xC2B2AE3D27D4EB4FULL, c = 0x165667B19E3779F9ULL, d = 0x85EBCA77C2B2AE63ULL;
+    __u64 e = 0x27D4EB2F165667C5ULL, f = 0x94D049BB133111EBULL, g = 0xBF58476D1CE4E5B9ULL;
+    __u64 h = 0xFF51AFD7ED558CCDULL;
+    __u64 w;
+    __u32 i;
+
+    for (i = 0; i + 64 <= n; i += 64) {
+        ANARCHY_TRACE_MIX(a, p + i);
+        ANARCHY_TRACE_MIX(b, p + i + 8);
+        ANARCHY_TRACE_MIX(c, p + i + 16);
+        ANARCHY_TRACE_MIX(d, p + i + 24);
+        ANARCHY_TRACE_MIX(e, p + i + 32);
+        ANARCHY_TRACE_MIX(f, p + i + 40);
+        ANARCHY_TRACE_MIX(g, p + i + 48);
+        ANARCHY_TRACE_MIX(h, p + i + 56);
+    }
+    for (; i + 8 <= n; i += 8)
+        ANARCHY_TRACE_MIX(a, p + i);
+    for (w = 0; i < n; i++)
+        w = (w << 8) | p[i];
+
+    w ^= a ^ ANARCHY_TRACE_ROL(b, 8) ^ ANARCHY_TRACE_ROL(c, 16) ^ ANARCHY_TRACE_ROL(d, 24) ^
+         ANARCHY_TRACE_ROL(e, 32) ^ ANARCHY_TRACE_ROL(f, 40) ^ ANARCHY_TRACE_ROL(g, 48) ^
+         ANARCHY_TRACE_ROL(h, 56);
+    w *= 0x9FB21C651E98DF25ULL;
+    w ^= w >> 32;
+    return w;
+}
+
+#endif /* _ANARCHY_TRACE_H_ */
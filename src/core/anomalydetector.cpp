@@ -0,0 +1,201 @@
+#include "anomalydetector.h"
+#include <cmath>
+#include <algorithm>
+
+AnomalyDetector::AnomalyDetector()
+{
+}
+
+void AnomalyDetector::setConfig(const Config& newConfig)
+{
+    config = newConfig;
+}
+
+AnomalyDetector::Config AnomalyDetector::getConfig() const
+{
+    return config;
+}
+
+void AnomalyDetector::addMetric(const QString& name, Direction direction)
+{
+    MetricState state;
+    state.direction = direction;
+    metrics.insert(name, state);
+}
+
+QVector<AnomalyDetector::Alert> AnomalyDetector::update(const QMap<QString, double>& samples,
+                                                        const Context& context)
+{
+    QVector<Alert> alerts;
+
+    // Error counters are cumulative, correlate on what changed since last sample
+    if (haveLastContext) {
+        pcieErrorDelta = std::max<qint64>(0, context.pcieErrors - lastPcieErrors);
+        tbErrorDelta = std::max<qint64>(0, context.tbErrors - lastTbErrors);
+    }
+    lastPcieErrors = context.pcieErrors;
+    lastTbErrors = context.tbErrors;
+    haveLastContext = true;
+
+    for (auto it = samples.constBegin(); it != samples.constEnd(); ++it) {
+        auto metricIt = metrics.find(it.key());
+        if (metricIt == metrics.end()) {
+            continue;
+        }
+
+        MetricState& m = metricIt.value();
+        const double value = it.value();
+
+        // Warm-up: build the baseline before judging anything
+        if (m.samples < config.warmupSamples) {
+            if (m.samples == 0) {
+                m.mean = value;
+                m.variance = 0.0;
+            } else {
+                const double diff = value - m.mean;
+                const double alpha = std::max(config.ewmaAlpha, 1.0 / (m.samples + 1));
+                m.mean += alpha * diff;
+                m.variance = (1.0 - alpha) * (m.variance + alpha * diff * diff);
+            }
+            m.samples++;
+            continue;
+        }
+
+        const double sigma = std::max(std::sqrt(m.variance),
+                                      std::max(std::fabs(m.mean) * config.minRelativeSigma, 1e-9));
+        double z = (value - m.mean) / sigma;
+        if (m.direction == LowerIsWorse) {
+            z = -z;
+        }
+
+        // One-sided CUSUM towards degradation
+        m.cusum = std::max(0.0, m.cusum + z - config.cusumSlack);
+        const bool changePoint = m.cusum > config.cusumThreshold;
+        const bool outOfBand = z > config.zThreshold;
+        const bool anomalous = outOfBand || changePoint;
+        const bool clearlyNormal = z < config.zClear &&
+                                   m.cusum < config.cusumThreshold / 2.0;
+
+        if (anomalous) {
+            m.anomalousRun++;
+            m.normalRun = 0;
+        } else if (clearlyNormal) {
+            m.normalRun++;
+            m.anomalousRun = 0;
+        } else {
+            // Inside the hysteresis band: hold the current state
+            m.anomalousRun = 0;
+            m.normalRun = 0;
+        }
+
+        Severity severity = Warning;
+        if (z > 2.0 * config.zThreshold || (outOfBand && changePoint)) {
+            severity = Critical;
+        }
+
+        if (!m.alerting && m.anomalousRun >= config.raiseAfter) {
+            m.alerting = true;
+            m.severity = severity;
+            m.reason = changePoint && !outOfBand ? "sustained drift" : "deviation";
+
+            Alert alert;
+            alert.metric = it.key();
+            alert.severity = severity;
+            alert.rootCause = rootCauseHint(context);
+            alert.message = QString("%1 %2: %3 vs baseline %4 (z=%5)")
+                .arg(it.key(), m.reason)
+                .arg(value, 0, 'f', 2)
+                .arg(m.mean, 0, 'f', 2)
+                .arg(z, 0, 'f', 1);
+            alerts.append(alert);
+        } else if (m.alerting && m.anomalousRun > 0 && severity > m.severity) {
+            // Escalation while already alerting
+            m.severity = severity;
+
+            Alert alert;
+            alert.metric = it.key();
+            alert.severity = severity;
+            alert.rootCause = rootCauseHint(context);
+            alert.message = QString("%1 %2 escalated: %3 vs baseline %4 (z=%5)")
+                .arg(it.key(), m.reason)
+                .arg(value, 0, 'f', 2)
+                .arg(m.mean, 0, 'f', 2)
+                .arg(z, 0, 'f', 1);
+            alerts.append(alert);
+        } else if (m.alerting && m.normalRun >= config.clearAfter) {
+            m.alerting = false;
+            m.severity = Info;
+            m.cusum = 0.0;
+
+            Alert alert;
+            alert.metric = it.key();
+            alert.severity = Info;
+            alert.cleared = true;
+            alert.message = QString("%1 back within baseline").arg(it.key());
+            alerts.append(alert);
+        }
+
+        // Only learn from samples that look normal so the baseline does
+        // not chase the anomaly it is supposed to detect
+        if (!anomalous && !m.alerting) {
+            const double diff = value - m.mean;
+            m.mean += config.ewmaAlpha * diff;
+            m.variance = (1.0 - config.ewmaAlpha) *
+                         (m.variance + config.ewmaAlpha * diff * diff);
+        }
+        m.samples++;
+    }
+
+    return alerts;
+}
+
+QString AnomalyDetector::rootCauseHint(const Context& context) const
+{
+    QStringList causes;
+
+    if (pcieErrorDelta > 0) {
+        causes << QString("PCIe errors +%1 since last sample (link replays or retraining)")
+                  .arg(pcieErrorDelta);
+    }
+    if (tbErrorDelta > 0) {
+        causes << QString("Thunderbolt errors +%1 since last sample (cable or tunnel instability)")
+                  .arg(tbErrorDelta);
+    }
+    if (context.temperature >= context.maxTemperature - 5) {
+        causes << QString("GPU at %1°C, likely thermal throttling").arg(context.temperature);
+    }
+
+    if (causes.isEmpty()) {
+        return "no correlated link or thermal events, likely workload or host side";
+    }
+    return causes.join("; ");
+}
+
+QStringList AnomalyDetector::activeAnomalies() const
+{
+    QStringList active;
+    for (auto it = metrics.constBegin(); it != metrics.constEnd(); ++it) {
+        if (it.value().alerting) {
+            active << QString("%1 %2").arg(it.key(), it.value().reason);
+        }
+    }
+    return active;
+}
+
+bool AnomalyDetector::isAlerting(const QString& metric) const
+{
+    auto it = metrics.constFind(metric);
+    return it != metrics.constEnd() && it.value().alerting;
+}
+
+void AnomalyDetector::reset()
+{
+    for (auto it = metrics.begin(); it != metrics.end(); ++it) {
+        Direction direction = it.value().direction;
+        it.value() = MetricState();
+        it.value().direction = direction;
+    }
+    haveLastContext = false;
+    pcieErrorDelta = 0;
+    tbErrorDelta = 0;
+}
@@ -0,0 +1,100 @@
+#ifndef ANOMALYDETECTOR_H
+#define ANOMALYDETECTOR_H
+
+#include <QString>
+#include <QStringList>
+#include <QMap>
+#include <QVector>
+
+// Streaming anomaly detector for device performance metrics.
+//
+// Each metric keeps an EWMA baseline (mean and variance) and a one-sided
+// CUSUM accumulator in the "worse" direction. A sample is anomalous when its
+// z-score leaves the band or the CUSUM crosses its decision threshold, which
+// catches both sudden dips and slow degradation. Alerts are debounced (a run
+// of anomalous samples is needed to raise) and use hysteresis (a run of
+// clearly normal samples is needed to clear).
+class AnomalyDetector
+{
+public:
+    enum Severity {
+        Info = 0,
+        Warning = 1,
+        Critical = 2
+    };
+
+    enum Direction {
+        HigherIsWorse,  // e.g. latency
+        LowerIsWorse    // e.g. throughput
+    };
+
+    struct Config {
+        double ewmaAlpha = 0.05;      // Baseline smoothing factor
+        double zThreshold = 3.0;      // z-score band for raising
+        double zClear = 1.5;          // z-score band for clearing
+        double cusumSlack = 0.5;      // CUSUM reference value k (sigmas)
+        double cusumThreshold = 8.0;  // CUSUM decision interval h (sigmas)
+        double minRelativeSigma = 0.01; // Sigma floor as a fraction of the mean
+        int warmupSamples = 30;       // Samples before detection starts
+        int raiseAfter = 3;           // Consecutive anomalous samples to raise
+        int clearAfter = 5;           // Consecutive normal samples to clear
+    };
+
+    // Correlation inputs used to build the root-cause hint
+    struct Context {
+        qint64 pcieErrors = 0;
+        qint64 tbErrors = 0;
+        int temperature = 0;
+        int maxTemperature = 85;
+    };
+
+    struct Alert {
+        QString metric;
+        QString message;
+        QString rootCause;
+        Severity severity = Info;
+        bool cleared = false;
+    };
+
+    AnomalyDetector();
+
+    void setConfig(const Config& config);
+    Config getConfig() const;
+
+    void addMetric(const QString& name, Direction direction);
+
+    // Feed one sample per metric; returns alerts raised, escalated or cleared
+    QVector<Alert> update(const QMap<QString, double>& samples, const Context& context);
+
+    QStringList activeAnomalies() const;
+    bool isAlerting(const QString& metric) const;
+    void reset();
+
+private:
+    struct MetricState {
+        Direction direction = HigherIsWorse;
+        double mean = 0.0;
+        double variance = 0.0;
+        int samples = 0;
+        double cusum = 0.0;
+        int anomalousRun = 0;
+        int normalRun = 0;
+        bool alerting = false;
+        Severity severity = Info;
+        QString reason;
+    };
+
+    QString rootCauseHint(const Context& context) const;
+
+    Config config;
+    QMap<QString, MetricState> metrics;
+
+    // Error counters from the previous sample, for delta correlation
+    bool haveLastContext = false;
+    qint64 lastPcieErrors = 0;
+    qint64 lastTbErrors = 0;
+    qint64 pcieErrorDelta = 0;
+    qint64 tbErrorDelta = 0;
+};
+
+#endif // ANOMALYDETECTOR_H
@@ -0,0 +1,222 @@
+#include "autotuner.h"
+#include <QSettings>
+#include <cstdlib>
+#include <tuple>
+
+namespace {
+
+// Search grid for each axis; values outside the Device setter limits are
+// never proposed
+const int kChannelSteps[] = { 2, 4, 6, 8, 10, 12, 14, 16 };
+const int kRingSizeSteps[] = { 64, 128, 256, 512, 1024 };
+
+template <size_t N>
+int stepIndex(const int (&steps)[N], int value)
+{
+    int best = 0;
+    for (size_t i = 0; i < N; ++i) {
+        if (std::abs(steps[i] - value) < std::abs(steps[best] - value)) {
+            best = int(i);
+        }
+    }
+    return best;
+}
+
+QString settingsGroup(const QString& devicePath)
+{
+    QString key = devicePath.isEmpty() ? QString("default") : devicePath;
+    key.replace('/', '_');
+    return "autotune/" + key;
+}
+
+} // namespace
+
+bool AutoTuner::Candidate::operator<(const Candidate& other) const
+{
+    return std::tie(dmaChannels, ringBufferSize, pcieLinkSpeed) <
+           std::tie(other.dmaChannels, other.ringBufferSize, other.pcieLinkSpeed);
+}
+
+bool AutoTuner::Candidate::operator==(const Candidate& other) const
+{
+    return dmaChannels == other.dmaChannels &&
+           ringBufferSize == other.ringBufferSize &&
+           pcieLinkSpeed == other.pcieLinkSpeed;
+}
+
+AutoTuner::AutoTuner(ApplyFn apply, MeasureFn measure)
+    : applyFn(apply)
+    , measureFn(measure)
+{
+}
+
+void AutoTuner::setTrialBudget(int trials)
+{
+    trialBudget = trials;
+}
+
+void AutoTuner::setLatencyBudget(double microseconds)
+{
+    latencyBudget = microseconds;
+}
+
+void AutoTuner::setMaxLinkSpeed(int speed)
+{
+    maxLinkSpeed = speed;
+}
+
+double AutoTuner::score(const Measurement& measurement) const
+{
+    if (!measurement.valid) {
+        return -1.0;
+    }
+
+    // Throughput counts fully while p99 stays inside the latency budget,
+    // and is scaled down proportionally once it exceeds it
+    if (measurement.p99Latency <= latencyBudget || measurement.p99Latency <= 0.0) {
+        return measurement.throughput;
+    }
+    return measurement.throughput * (latencyBudget / measurement.p99Latency);
+}
+
+bool AutoTuner::evaluate(const Candidate& candidate, Measurement& measurement)
+{
+    auto cached = cache.constFind(candidate);
+    if (cached != cache.constEnd()) {
+        measurement = cached.value();
+        return true;
+    }
+
+    if (trialsUsed >= trialBudget) {
+        return false;
+    }
+    trialsUsed++;
+
+    measurement = Measurement();
+    if (applyFn(candidate)) {
+        measurement = measureFn();
+    }
+    cache.insert(candidate, measurement);
+    return true;
+}
+
+QVector<AutoTuner::Candidate> AutoTuner::neighbours(const Candidate& candidate) const
+{
+    QVector<Candidate> result;
+    const int channelCount = int(sizeof(kChannelSteps) / sizeof(kChannelSteps[0]));
+    const int ringCount = int(sizeof(kRingSizeSteps) / sizeof(kRingSizeSteps[0]));
+
+    int ci = stepIndex(kChannelSteps, candidate.dmaChannels);
+    for (int d : { -1, 1 }) {
+        if (ci + d >= 0 && ci + d < channelCount) {
+            Candidate next = candidate;
+            next.dmaChannels = kChannelSteps[ci + d];
+            result.append(next);
+        }
+    }
+
+    int ri = stepIndex(kRingSizeSteps, candidate.ringBufferSize);
+    for (int d : { -1, 1 }) {
+        if (ri + d >= 0 && ri + d < ringCount) {
+            Candidate next = candidate;
+            next.ringBufferSize = kRingSizeSteps[ri + d];
+            result.append(next);
+        }
+    }
+
+    // Link speed 0 (auto) is treated as the maximum for neighbour purposes
+    int speed = candidate.pcieLinkSpeed > 0 ? candidate.pcieLinkSpeed : maxLinkSpeed;
+    for (int d : { -1, 1 }) {
+        if (speed + d >= 1 && speed + d <= maxLinkSpeed) {
+            Candidate next = candidate;
+            next.pcieLinkSpeed = speed + d;
+            result.append(next);
+        }
+    }
+
+    return result;
+}
+
+AutoTuner::Result AutoTuner::tune(const Candidate& start)
+{
+    Result result;
+    trialsUsed = 0;
+    cache.clear();
+
+    Candidate current = start;
+    current.dmaChannels = kChannelSteps[stepIndex(kChannelSteps, start.dmaChannels)];
+    current.ringBufferSize = kRingSizeSteps[stepIndex(kRingSizeSteps, start.ringBufferSize)];
+
+    Measurement currentMeasurement;
+    if (!evaluate(current, currentMeasurement)) {
+        return result;
+    }
+
+    bool budgetExhausted = false;
+    for (;;) {
+        Candidate bestNeighbour = current;
+        Measurement bestMeasurement = currentMeasurement;
+
+        for (const Candidate& next : neighbours(current)) {
+            Measurement m;
+            if (!evaluate(next, m)) {
+                budgetExhausted = true;
+                break;
+            }
+            if (score(m) > score(bestMeasurement)) {
+                bestNeighbour = next;
+                bestMeasurement = m;
+            }
+        }
+
+        if (bestNeighbour == current) {
+            result.converged = !budgetExhausted;
+            break;
+        }
+
+        current = bestNeighbour;
+        currentMeasurement = bestMeasurement;
+
+        if (budgetExhausted) {
+            break;
+        }
+    }
+
+    result.best = current;
+    result.measurement = currentMeasurement;
+    result.trials = trialsUsed;
+
+    // Leave the device on the winning configuration
+    applyFn(current);
+    return result;
+}
+
+bool AutoTuner::loadPersisted(const QString& devicePath, Candidate& candidate,
+                              QString& linkSignature)
+{
+    QSettings settings("Anarchy", "eGPU");
+    settings.beginGroup(settingsGroup(devicePath));
+    if (!settings.contains("dmaChannels")) {
+        settings.endGroup();
+        return false;
+    }
+
+    candidate.dmaChannels = settings.value("dmaChannels").toInt();
+    candidate.ringBufferSize = settings.value("ringBufferSize").toInt();
+    candidate.pcieLinkSpeed = settings.value("pcieLinkSpeed").toInt();
+    linkSignature = settings.value("linkSignature").toString();
+    settings.endGroup();
+    return true;
+}
+
+void AutoTuner::persist(const QString& devicePath, const Candidate& candidate,
+                        const QString& linkSignature)
+{
+    QSettings settings("Anarchy", "eGPU");
+    settings.beginGroup(settingsGroup(devicePath));
+    settings.setValue("dmaChannels", candidate.dmaChannels);
+    settings.setValue("ringBufferSize", candidate.ringBufferSize);
+    settings.setValue("pcieLinkSpeed", candidate.pcieLinkSpeed);
+    settings.setValue("linkSignature", linkSignature);
+    settings.endGroup();
+}
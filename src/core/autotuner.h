@@ -0,0 +1,72 @@
+#ifndef AUTOTUNER_H
+#define AUTOTUNER_H
+
+#include <QString>
+#include <QMap>
+#include <QVector>
+#include <functional>
+
+// Closed-loop tuner for the DMA/PCIe configuration space.
+//
+// The tuner does not touch the device itself; it is handed an apply
+// callback (push a candidate configuration) and a measure callback (run a
+// synthetic load and report throughput and p99 latency). It hill-climbs
+// one axis step at a time from the starting configuration, caching every
+// measured point, until no neighbour improves or the trial budget runs out.
+class AutoTuner
+{
+public:
+    struct Candidate {
+        int dmaChannels = 8;
+        int ringBufferSize = 256;
+        int pcieLinkSpeed = 0;  // 0 = auto
+
+        bool operator<(const Candidate& other) const;
+        bool operator==(const Candidate& other) const;
+    };
+
+    struct Measurement {
+        bool valid = false;
+        double throughput = 0.0;   // MB/s
+        double p99Latency = 0.0;   // us
+    };
+
+    struct Result {
+        Candidate best;
+        Measurement measurement;
+        int trials = 0;
+        bool converged = false;
+    };
+
+    using ApplyFn = std::function<bool(const Candidate&)>;
+    using MeasureFn = std::function<Measurement()>;
+
+    AutoTuner(ApplyFn apply, MeasureFn measure);
+
+    void setTrialBudget(int trials);
+    void setLatencyBudget(double microseconds);
+    void setMaxLinkSpeed(int speed);
+
+    Result tune(const Candidate& start);
+
+    // Per-device persistence, keyed by Thunderbolt device path
+    static bool loadPersisted(const QString& devicePath, Candidate& candidate,
+                              QString& linkSignature);
+    static void persist(const QString& devicePath, const Candidate& candidate,
+                        const QString& linkSignature);
+
+private:
+    double score(const Measurement& measurement) const;
+    bool evaluate(const Candidate& candidate, Measurement& measurement);
+    QVector<Candidate> neighbours(const Candidate& candidate) const;
+
+    ApplyFn applyFn;
+    MeasureFn measureFn;
+    int trialBudget = 24;
+    double latencyBudget = 500.0;
+    int maxLinkSpeed = 4;
+    int trialsUsed = 0;
+    QMap<Candidate, Measurement> cache;
+};
+
+#endif // AUTOTUNER_H
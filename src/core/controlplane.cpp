@@ -0,0 +1,208 @@
+#include "controlplane.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+ControlPlane::ControlPlane()
+{
+}
+
+ControlPlane::~ControlPlane()
+{
+    // A subclass is already destroyed here, so doClose() would not reach its
+    // override; subclasses that route the descriptor elsewhere close() first
+    if (fd >= 0) {
+        ControlPlane::doClose(fd);
+    }
+}
+
+bool ControlPlane::open(const QString& path)
+{
+    close();
+
+    fd = doOpen(path);
+    if (fd < 0) {
+        errnoValue = errno;
+        errorString = QString("Failed to open %1: %2").arg(path, strerror(errnoValue));
+        return false;
+    }
+
+    anarchy_ioc_version ver;
+    memset(&ver, 0, sizeof(ver));
+    if (!call(ANARCHY_IOC_GET_VERSION, &ver, "query ABI version")) {
+        close();
+        return false;
+    }
+
+    if (ver.major != ANARCHY_ABI_MAJOR) {
+        errnoValue = EPROTO;
+        errorString = QString("Driver ABI %1.%2 is not compatible with %3.%4")
+            .arg(ver.major).arg(ver.minor)
+            .arg(ANARCHY_ABI_MAJOR).arg(ANARCHY_ABI_MINOR);
+        close();
+        return false;
+    }
+
+    abiVersion.major = int(ver.major);
+    abiVersion.minor = int(ver.minor);
+    abiVersion.features = ver.features;
+    abiVersion.driverVersion = QString::fromLatin1(ver.driver_version,
+                                                   int(strnlen(ver.driver_version,
+                                                               sizeof(ver.driver_version))));
+    return true;
+}
+
+void ControlPlane::close()
+{
+    if (fd >= 0) {
+        doClose(fd);
+        fd = -1;
+    }
+    abiVersion = Version();
+}
+
+bool ControlPlane::isOpen() const
+{
+    return fd >= 0;
+}
+
+const ControlPlane::Version& ControlPlane::version() const
+{
+    return abiVersion;
+}
+
+bool ControlPlane::hasFeature(quint32 feature) const
+{
+    return (abiVersion.features & feature) == feature;
+}
+
+bool ControlPlane::applyConfig(anarchy_ioc_config& config)
+{
+    if (!call(ANARCHY_IOC_APPLY_CONFIG, &config, "apply configuration")) {
+        if (config.failed_field) {
+            errorString += QString(" (field 0x%1)").arg(config.failed_field, 0, 16);
+        }
+        return false;
+    }
+    return true;
+}
+
+bool ControlPlane::getConfig(anarchy_ioc_config& config)
+{
+    return call(ANARCHY_IOC_GET_CONFIG, &config, "read configuration");
+}
+
+bool ControlPlane::reset(anarchy_ioc_reset& reset)
+{
+    return call(ANARCHY_IOC_RESET, &reset, "reset device");
+}
+
+bool ControlPlane::getStats(anarchy_ioc_stats& stats)
+{
+    memset(&stats, 0, sizeof(stats));
+    stats.size = sizeof(stats);
+    return call(ANARCHY_IOC_GET_STATS, &stats, "read stats");
+}
+
+bool ControlPlane::submitDma(const void* data, quint32 size, quint64 cookie)
+{
+    anarchy_ioc_dma req;
+    memset(&req, 0, sizeof(req));
+    req.addr = reinterpret_cast<quintptr>(data);
+    req.size = size;
+    req.flags = ANARCHY_DMA_TO_DEVICE;
+    req.cookie = cookie;
+    return call(ANARCHY_IOC_SUBMIT_DMA, &req, "submit DMA");
+}
+
+bool ControlPlane::subscribe(quint32 eventMask)
+{
+    return call(ANARCHY_IOC_SUBSCRIBE, &eventMask, "subscribe to events");
+}
+
+bool ControlPlane::readEvents(QVector<anarchy_ioc_event>& events, bool block)
+{
+    anarchy_ioc_event buffer[16];
+
+    events.clear();
+    if (fd < 0) {
+        errnoValue = EBADF;
+        errorString = "Control plane not open";
+        return false;
+    }
+
+    for (;;) {
+        ssize_t n = doRead(fd, buffer, sizeof(buffer), block && events.isEmpty());
+        if (n < 0) {
+            if (errno == EAGAIN) {
+                return true;
+            }
+            errnoValue = errno;
+            errorString = QString("Failed to read events: %1").arg(strerror(errnoValue));
+            return false;
+        }
+
+        for (size_t i = 0; i < size_t(n) / sizeof(anarchy_ioc_event); ++i) {
+            events.append(buffer[i]);
+        }
+        if (size_t(n) < sizeof(buffer)) {
+            return true;
+        }
+    }
+}
+
+int ControlPlane::lastErrno() const
+{
+    return errnoValue;
+}
+
+QString ControlPlane::lastError() const
+{
+    return errorString;
+}
+
+bool ControlPlane::call(unsigned long request, void* arg, const char* what)
+{
+    if (fd < 0) {
+        errnoValue = EBADF;
+        errorString = QString("Cannot %1: control plane not open").arg(what);
+        return false;
+    }
+
+    if (doIoctl(fd, request, arg) < 0) {
+        errnoValue = errno;
+        errorString = QString("Failed to %1: %2").arg(what, strerror(errnoValue));
+        return false;
+    }
+    return true;
+}
+
+int ControlPlane::doOpen(const QString& path)
+{
+    // Non-blocking so event reads never stall the caller unless asked to
+    return ::open(path.toLocal8Bit().constData(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+}
+
+void ControlPlane::doClose(int descriptor)
+{
+    ::close(descriptor);
+}
+
+int ControlPlane::doIoctl(int descriptor, unsigned long request, void* arg)
+{
+    return ::ioctl(descriptor, request, arg);
+}
+
+ssize_t ControlPlane::doRead(int descriptor, void* buffer, size_t length, bool block)
+{
+    if (block) {
+        struct pollfd pfd = { descriptor, POLLIN, 0 };
+        if (::poll(&pfd, 1, -1) < 0) {
+            return -1;
+        }
+    }
+    return ::read(descriptor, buffer, length);
+}
@@ -0,0 +1,65 @@
+#ifndef CONTROLPLANE_H
+#define CONTROLPLANE_H
+
+#include <QString>
+#include <QVector>
+#include <sys/types.h>
+#include "../../include/anarchy-ioctl.h"
+
+// Thin wrapper around the binary ioctl ABI of /dev/anarchy-egpu.
+//
+// Every call maps to exactly one ioctl/read on the char device; there is
+// no caching and no string parsing. The do* methods are the only places
+// that touch the kernel, so tests can subclass and route them to the
+// userspace mock driver instead. Such a subclass must call close() in its
+// own destructor, the base destructor only knows the real descriptor.
+class ControlPlane
+{
+public:
+    struct Version {
+        int major = 0;
+        int minor = 0;
+        quint32 features = 0;
+        QString driverVersion;
+    };
+
+    ControlPlane();
+    virtual ~ControlPlane();
+
+    // Opens the device and checks the ABI major version
+    bool open(const QString& path);
+    void close();
+    bool isOpen() const;
+
+    const Version& version() const;
+    bool hasFeature(quint32 feature) const;
+
+    bool applyConfig(anarchy_ioc_config& config);
+    bool getConfig(anarchy_ioc_config& config);
+    bool reset(anarchy_ioc_reset& reset);
+    bool getStats(anarchy_ioc_stats& stats);
+    bool submitDma(const void* data, quint32 size, quint64 cookie);
+    bool subscribe(quint32 eventMask);
+
+    // Drains pending events; blocks for the first one when block is set
+    bool readEvents(QVector<anarchy_ioc_event>& events, bool block = false);
+
+    int lastErrno() const;
+    QString lastError() const;
+
+protected:
+    virtual int doOpen(const QString& path);
+    virtual void doClose(int fd);
+    virtual int doIoctl(int fd, unsigned long request, void* arg);
+    virtual ssize_t doRead(int fd, void* buffer, size_t length, bool block);
+
+private:
+    bool call(unsigned long request, void* arg, const char* what);
+
+    int fd = -1;
+    Version abiVersion;
+    int errnoValue = 0;
+    QString errorString;
+};
+
+#endif // CONTROLPLANE_H
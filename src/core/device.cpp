@@ -4,19 +4,32 @@
 #include <QDebug>
 #include <QTextStream>
 #include <QDir>
+#include <QTimer>
+#include <QElapsedTimer>
 #include <cmath>
-#include <fcntl.h>
-#include <unistd.h>
-#include <sys/ioctl.h>
+#include <cstring>
+#include <algorithm>
+#include <numeric>
 
 Device::Device(QObject *parent)
+    : Device(new ControlPlane(), parent)
+{
+}
+
+Device::Device(ControlPlane *controlPlane, QObject *parent)
     : QObject(parent)
+    , controlPlane(controlPlane)
 {
     // Initialize default configuration
     config.dmaChannels = 8;
     config.ringBufferSize = 256;
     config.pcieLinkSpeed = 0;
     config.tbTimeout = 1000;
+
+    // Metrics tracked by the streaming anomaly detector
+    anomalyDetector.addMetric("tx_throughput", AnomalyDetector::LowerIsWorse);
+    anomalyDetector.addMetric("rx_throughput", AnomalyDetector::LowerIsWorse);
+    anomalyDetector.addMetric("latency", AnomalyDetector::HigherIsWorse);
 }
 
 Device::~Device()
@@ -39,18 +52,8 @@ bool Device::connect()
         return false;
     }
 
-    // Setup components in sequence
-    if (!setupThunderbolt()) {
-        cleanup();
-        return false;
-    }
-
-    if (!setupPCIe()) {
-        cleanup();
-        return false;
-    }
-
-    if (!setupDMA()) {
+    // Apply Thunderbolt, PCIe and DMA settings in one transaction
+    if (!applyConfiguration()) {
         cleanup();
         return false;
     }
@@ -81,20 +84,16 @@ bool Device::reset()
         return false;
     }
 
-    // Perform soft reset
-    if (!writeToSysfs("control", "reset")) {
-        return false;
-    }
-
-    // Wait for device to stabilize
-    QThread::msleep(1000);
-
-    // Reinitialize components
-    if (!setupDMA() || !setupPCIe()) {
-        cleanup();
+    // The driver keeps the configuration across a reset and only returns
+    // once the link and rings are back up
+    anarchy_ioc_reset rst;
+    memset(&rst, 0, sizeof(rst));
+    if (!controlPlane->reset(rst)) {
+        logError(controlPlane->lastError());
         return false;
     }
 
+    qDebug() << "Device ready" << rst.ready_time_us << "us after reset";
     return true;
 }
 
@@ -105,23 +104,134 @@ bool Device::optimize()
         return false;
     }
 
+    if (config.autoTune) {
+        return runAutoTune(false);
+    }
+
     // Read current PCIe link status
-    QString linkStatus = readFromSysfs("pcie/link_status");
-    if (linkStatus.contains("Gen4")) {
+    if (!readSnapshot()) {
+        return false;
+    }
+    if (state.stats.pcieLinkSpeed >= 4) {
         // Already at optimal speed
         return true;
     }
 
-    // Try to optimize PCIe link
-    writeToSysfs("pcie/link_speed", "4");
-    
-    // Optimize DMA settings
-    setDMAChannels(12);  // Increased parallelism
-    setRingBufferSize(512);  // Larger buffers
+    // Faster link, more parallelism and larger buffers in one transaction
+    return applyConfiguration(12, 512, 4, config.tbTimeout);
+}
+
+bool Device::runAutoTune(bool force)
+{
+    if (state.tuning) {
+        return false;
+    }
+
+    if (!readSnapshot()) {
+        return false;
+    }
+
+    const QString devicePath = state.stats.tbDevicePath;
+    const QString signature = currentLinkSignature();
+
+    // Reuse the stored result while the link looks the same as when it was tuned
+    AutoTuner::Candidate persisted;
+    QString persistedSignature;
+    if (!force && AutoTuner::loadPersisted(devicePath, persisted, persistedSignature) &&
+        persistedSignature == signature) {
+        if (!applyTuningCandidate(persisted)) {
+            return false;
+        }
+        state.tunedLinkSignature = signature;
+        return true;
+    }
+
+    state.tuning = true;
+
+    AutoTuner tuner([this](const AutoTuner::Candidate& candidate) {
+                        return applyTuningCandidate(candidate);
+                    },
+                    [this]() {
+                        return runSyntheticLoad();
+                    });
+    tuner.setTrialBudget(config.tuneTrialBudget);
+    tuner.setLatencyBudget(config.tuneLatencyBudget);
 
+    AutoTuner::Candidate start;
+    start.dmaChannels = config.dmaChannels;
+    start.ringBufferSize = config.ringBufferSize;
+    start.pcieLinkSpeed = config.pcieLinkSpeed;
+
+    AutoTuner::Result result = tuner.tune(start);
+    state.tuning = false;
+
+    if (!result.measurement.valid) {
+        logError("Auto-tuning failed: synthetic load could not run");
+        return false;
+    }
+
+    AutoTuner::persist(devicePath, result.best, signature);
+    state.tunedLinkSignature = signature;
+
+    qDebug() << "Auto-tune finished after" << result.trials << "trials"
+             << (result.converged ? "(converged)" : "(budget exhausted)");
+    emit autoTuneCompleted(result.best.dmaChannels, result.best.ringBufferSize,
+                           result.best.pcieLinkSpeed, result.measurement.throughput,
+                           result.measurement.p99Latency);
     return true;
 }
 
+bool Device::applyTuningCandidate(const AutoTuner::Candidate& candidate)
+{
+    return applyConfiguration(candidate.dmaChannels, candidate.ringBufferSize,
+                              candidate.pcieLinkSpeed, config.tbTimeout);
+}
+
+AutoTuner::Measurement Device::runSyntheticLoad()
+{
+    AutoTuner::Measurement measurement;
+    const int iterations = 64;
+    const int blockSize = 1024 * 1024;
+
+    if (!controlPlane->isOpen()) {
+        return measurement;
+    }
+
+    QByteArray block(blockSize, char(0xA5));
+    QVector<double> latencies;
+    latencies.reserve(iterations);
+
+    QElapsedTimer total;
+    total.start();
+    for (int i = 0; i < iterations; ++i) {
+        QElapsedTimer timer;
+        timer.start();
+        if (!controlPlane->submitDma(block.constData(), quint32(block.size()), quint64(i))) {
+            return measurement;
+        }
+        latencies.append(timer.nsecsElapsed() / 1000.0);
+    }
+    const double seconds = total.nsecsElapsed() / 1e9;
+
+    std::sort(latencies.begin(), latencies.end());
+    const int p99Index = std::max(0, int(std::ceil(0.99 * latencies.size())) - 1);
+
+    measurement.valid = seconds > 0.0;
+    measurement.throughput = (double(blockSize) * iterations / (1024.0 * 1024.0)) / seconds;
+    measurement.p99Latency = latencies.at(p99Index);
+    return measurement;
+}
+
+QString Device::currentLinkSignature() const
+{
+    // Only link properties the tuner does not control itself, so a tuned
+    // speed change does not look like a new link
+    return QString("x%1/tb%2/hops%3")
+        .arg(state.stats.pcieLinkWidth)
+        .arg(state.stats.tbLinkSpeed)
+        .arg(state.stats.tbHopCount);
+}
+
 DeviceStats Device::getStats() const
 {
     return state.stats;
@@ -143,21 +253,25 @@ void Device::setDMAChannels(int channels)
         logError("Invalid DMA channel count");
         return;
     }
-    config.dmaChannels = channels;
     if (state.isConnected) {
-        writeToSysfs("dma/channels", QString::number(channels));
+        applyConfiguration(channels, config.ringBufferSize, config.pcieLinkSpeed,
+                           config.tbTimeout);
+    } else {
+        config.dmaChannels = channels;
     }
 }
 
 void Device::setRingBufferSize(int size)
 {
-    if (size < 16 || size > 1024 || (size & (size - 1))) {
+    if (size < ANARCHY_CFG_MIN_RING_SIZE || size > ANARCHY_CFG_MAX_RING_SIZE ||
+        (size & (size - 1))) {
         logError("Invalid ring buffer size");
         return;
     }
-    config.ringBufferSize = size;
     if (state.isConnected) {
-        writeToSysfs("dma/ring_size", QString::number(size));
+        applyConfiguration(config.dmaChannels, size, config.pcieLinkSpeed, config.tbTimeout);
+    } else {
+        config.ringBufferSize = size;
     }
 }
 
@@ -167,10 +281,26 @@ void Device::setPCIeLinkSpeed(int speed)
         logError("Invalid PCIe link speed");
         return;
     }
-    config.pcieLinkSpeed = speed;
     if (state.isConnected) {
-        writeToSysfs("pcie/link_speed", QString::number(speed));
+        applyConfiguration(config.dmaChannels, config.ringBufferSize, speed, config.tbTimeout);
+    } else {
+        config.pcieLinkSpeed = speed;
+    }
+}
+
+void Device::setAutoTuning(bool enable)
+{
+    config.autoTune = enable;
+}
+
+void Device::setTuningBudget(int trials, double p99LatencyUs)
+{
+    if (trials < 1 || trials > 200 || p99LatencyUs <= 0.0) {
+        logError("Invalid tuning budget");
+        return;
     }
+    config.tuneTrialBudget = trials;
+    config.tuneLatencyBudget = p99LatencyUs;
 }
 
 void Device::setThunderboltTimeout(int ms)
@@ -179,78 +309,86 @@ void Device::setThunderboltTimeout(int ms)
         logError("Invalid Thunderbolt timeout");
         return;
     }
-    config.tbTimeout = ms;
     if (state.isConnected) {
-        writeToSysfs("thunderbolt/timeout", QString::number(ms));
+        applyConfiguration(config.dmaChannels, config.ringBufferSize, config.pcieLinkSpeed, ms);
+    } else {
+        config.tbTimeout = ms;
     }
 }
 
 bool Device::initializeDevice()
 {
-    // Open device file
-    state.deviceFd = open(DEVICE_PATH.toLocal8Bit().constData(), O_RDWR);
-    if (state.deviceFd < 0) {
-        logError("Failed to open device");
+    // Open the control interface, checks the ABI version
+    if (!controlPlane->open(DEVICE_PATH)) {
+        logError(controlPlane->lastError());
         return false;
     }
 
     // Check device status
-    if (!readFromSysfs("status").contains("ready")) {
+    if (!readSnapshot() || !(state.snapshot.flags & ANARCHY_STATS_LINK_UP)) {
         logError("Device not ready");
-        close(state.deviceFd);
-        state.deviceFd = -1;
+        controlPlane->close();
         return false;
     }
 
+    // Link and thermal events arrive between polls
+    controlPlane->subscribe(ANARCHY_EVENT_LINK_DOWN | ANARCHY_EVENT_LINK_UP |
+                            ANARCHY_EVENT_PCIE_ERROR | ANARCHY_EVENT_THERMAL);
     return true;
 }
 
-bool Device::setupDMA()
+bool Device::applyConfiguration()
 {
-    // Allocate DMA buffer
-    if (!writeToSysfs("dma/channels", QString::number(config.dmaChannels))) {
-        logError("Failed to set DMA channels");
-        return false;
-    }
-
-    if (!writeToSysfs("dma/ring_size", QString::number(config.ringBufferSize))) {
-        logError("Failed to set ring buffer size");
-        return false;
-    }
-
-    return true;
+    return applyConfiguration(config.dmaChannels, config.ringBufferSize,
+                              config.pcieLinkSpeed, config.tbTimeout);
 }
 
-bool Device::setupPCIe()
+// config only takes the values once the driver has, so it always matches
+// what the device runs with
+bool Device::applyConfiguration(int dmaChannels, int ringBufferSize, int pcieLinkSpeed,
+                                int tbTimeout)
 {
-    // Set PCIe link speed if specified
-    if (config.pcieLinkSpeed > 0) {
-        if (!writeToSysfs("pcie/link_speed", QString::number(config.pcieLinkSpeed))) {
-            logError("Failed to set PCIe link speed");
-            return false;
-        }
+    anarchy_ioc_config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.valid = ANARCHY_CFG_ALL;
+    cfg.dma_channels = dmaChannels;
+    cfg.ring_size = ringBufferSize;
+    cfg.link_speed = pcieLinkSpeed;
+    cfg.tb_timeout_ms = tbTimeout;
+
+    // Validated up front, rolled back on failure, returns once ready
+    if (!controlPlane->applyConfig(cfg)) {
+        logError(controlPlane->lastError());
+        reloadConfiguration();
+        return false;
     }
 
+    config.dmaChannels = dmaChannels;
+    config.ringBufferSize = ringBufferSize;
+    config.pcieLinkSpeed = pcieLinkSpeed;
+    config.tbTimeout = tbTimeout;
+    qDebug() << "Configuration applied, device ready after" << cfg.ready_time_us << "us";
     return true;
 }
 
-bool Device::setupThunderbolt()
+// After a failed apply, in case the driver's rollback did not get everything back
+void Device::reloadConfiguration()
 {
-    // Set Thunderbolt timeout
-    if (!writeToSysfs("thunderbolt/timeout", QString::number(config.tbTimeout))) {
-        logError("Failed to set Thunderbolt timeout");
-        return false;
+    anarchy_ioc_config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    if (!state.isConnected || !controlPlane->getConfig(cfg)) {
+        return;
     }
 
-    return true;
+    config.dmaChannels = int(cfg.dma_channels);
+    config.ringBufferSize = int(cfg.ring_size);
+    config.pcieLinkSpeed = int(cfg.link_speed);
+    config.tbTimeout = int(cfg.tb_timeout_ms);
 }
 
 void Device::cleanup()
 {
-    if (state.deviceFd >= 0) {
-        close(state.deviceFd);
-        state.deviceFd = -1;
-    }
+    controlPlane->close();
 
     if (state.dmaBuffer) {
         // Free DMA buffer
@@ -258,6 +396,7 @@ void Device::cleanup()
     }
 
     state.stats = DeviceStats();
+    state.haveSnapshot = false;
 }
 
 void Device::updateStats()
@@ -266,24 +405,20 @@ void Device::updateStats()
         return;
     }
 
-    // Read basic performance metrics
-    QString perfStats = readFromSysfs("performance/statistics");
-    QStringList lines = perfStats.split('\n');
-
-    for (const QString& line : lines) {
-        if (line.startsWith("TX:")) {
-            state.stats.txThroughput = line.mid(line.indexOf('(') + 1).split(' ').first().toDouble();
-        } else if (line.startsWith("RX:")) {
-            state.stats.rxThroughput = line.mid(line.indexOf('(') + 1).split(' ').first().toDouble();
-        } else if (line.startsWith("Latency:")) {
-            state.stats.latency = line.split(' ').at(1).toDouble();
-        }
+    // One snapshot covers DMA, PCIe, GPU and Thunderbolt
+    if (!readSnapshot()) {
+        return;
     }
+    handleDriverEvents();
 
-    // Monitor additional components
-    monitorPCIeStatus();
-    monitorNvidiaGPU();
-    monitorThunderboltStatus();
+    // Re-tune when the link comes back with different characteristics
+    if (config.autoTune && !state.tuning && !state.tunedLinkSignature.isEmpty() &&
+        currentLinkSignature() != state.tunedLinkSignature) {
+        state.tunedLinkSignature = currentLinkSignature();
+        QTimer::singleShot(0, this, [this]() {
+            runAutoTune(true);
+        });
+    }
 
     // Update performance history
     updatePerformanceHistory();
@@ -297,64 +432,137 @@ void Device::updateStats()
     emit statsUpdated(state.stats);
 }
 
-void Device::monitorPCIeStatus()
+bool Device::readSnapshot()
 {
-    // Read PCIe link status
-    QString pcieStatus = readFromSysfs("pcie/link_status");
-    if (pcieStatus.contains("Gen")) {
-        state.stats.pcieLinkSpeed = pcieStatus.split("Gen").at(1).split(' ').first().toInt();
-        state.stats.pcieLinkWidth = pcieStatus.split("x").at(1).split(' ').first().toInt();
+    anarchy_ioc_stats snapshot;
+    if (!controlPlane->getStats(snapshot)) {
+        logError(controlPlane->lastError());
+        return false;
+    }
+
+    // Throughput from byte counter deltas between two snapshots. A counter
+    // that went backwards was reset (driver reload, ring re-init), so that
+    // pair says nothing and the sample is skipped.
+    const bool countersReset = snapshot.tx_bytes < state.snapshot.tx_bytes ||
+                               snapshot.rx_bytes < state.snapshot.rx_bytes;
+    if (state.haveSnapshot && !countersReset &&
+        snapshot.timestamp_ns > state.snapshot.timestamp_ns) {
+        const double seconds = (snapshot.timestamp_ns - state.snapshot.timestamp_ns) / 1e9;
+        const double mb = 1024.0 * 1024.0;
+        state.stats.txThroughput = (snapshot.tx_bytes - state.snapshot.tx_bytes) / mb / seconds;
+        state.stats.rxThroughput = (snapshot.rx_bytes - state.snapshot.rx_bytes) / mb / seconds;
+    }
+    if (snapshot.latency_ns) {
+        state.stats.latency = snapshot.latency_ns;
     }
 
-    // Read PCIe errors
-    state.stats.pcieErrors = readFromSysfs("pcie/errors").toLongLong();
+    state.stats.activeChannels = int(snapshot.dma_channels);
+    state.stats.ringBufferSize = int(snapshot.ring_size);
+    state.stats.ringBufferUtilization = snapshot.ring_size ?
+        100.0 * snapshot.tx_pending / snapshot.ring_size : 0.0;
+    state.stats.totalBytesTransferred = qint64(snapshot.tx_bytes + snapshot.rx_bytes);
+    state.stats.transferErrors = snapshot.transfer_errors;
+
+    monitorPCIeStatus(snapshot);
+    monitorNvidiaGPU(snapshot);
+    monitorThunderboltStatus(snapshot);
 
-    // Calculate PCIe utilization
-    QString utilStr = readFromSysfs("pcie/utilization");
-    state.stats.pcieUtilization = utilStr.split('%').first().toDouble();
+    state.snapshot = snapshot;
+    state.haveSnapshot = true;
+    return true;
 }
 
-void Device::monitorNvidiaGPU()
+void Device::handleDriverEvents()
 {
-    // Read GPU utilization
-    state.stats.gpuUtilization = readFromSysfs("gpu/utilization").toInt();
+    QVector<anarchy_ioc_event> events;
+    if (!controlPlane->readEvents(events)) {
+        return;
+    }
 
-    // Read memory utilization
-    state.stats.memoryUtilization = readFromSysfs("gpu/memory_utilization").toInt();
+    for (const anarchy_ioc_event& event : events) {
+        switch (event.type) {
+        case ANARCHY_EVENT_LINK_DOWN:
+            emit performanceAlert("PCIe link lost, recovery failed", AnomalyDetector::Critical);
+            break;
+        case ANARCHY_EVENT_LINK_UP:
+            emit performanceAlert("PCIe link recovered", AnomalyDetector::Info);
+            break;
+        case ANARCHY_EVENT_PCIE_ERROR:
+            emit performanceAlert(QString("PCIe error (type %1), recovery attempt %2")
+                                  .arg(event.data[0]).arg(event.data[1]),
+                                  AnomalyDetector::Warning);
+            break;
+        case ANARCHY_EVENT_THERMAL:
+            emit performanceAlert(event.data[1] ?
+                                  QString("GPU at %1°C, power limited").arg(event.data[0]) :
+                                  QString("GPU cooled to %1°C").arg(event.data[0]),
+                                  event.data[1] ? AnomalyDetector::Critical : AnomalyDetector::Info);
+            break;
+        case ANARCHY_EVENT_OVERFLOW:
+            qDebug() << "Driver event queue overflowed, some events were dropped";
+            break;
+        default:
+            break;
+        }
+    }
+}
 
-    // Read temperature
-    state.stats.temperature = readFromSysfs("gpu/temperature").toInt();
+void Device::monitorPCIeStatus(const anarchy_ioc_stats& snapshot)
+{
+    state.stats.pcieLinkSpeed = int(snapshot.link_speed);
+    state.stats.pcieLinkWidth = int(snapshot.link_width);
+    state.stats.pcieErrors = snapshot.pcie_errors;
+    state.stats.pcieUtilization = snapshot.pcie_utilization;
+    state.stats.pcieRxRate = double(snapshot.pcie_rx_rate);
+    state.stats.pcieTxRate = double(snapshot.pcie_tx_rate);
+}
 
-    // Read fan speed
-    state.stats.fanSpeed = readFromSysfs("gpu/fan_speed").toInt();
+void Device::monitorNvidiaGPU(const anarchy_ioc_stats& snapshot)
+{
+    state.stats.gpuUtilization = int(snapshot.gpu_utilization);
+    state.stats.memoryUtilization = int(snapshot.mem_utilization);
+    state.stats.temperature = snapshot.temperature;
+    state.stats.fanSpeed = int(snapshot.fan_speed);
+    state.stats.powerUsage = int(snapshot.power_draw);
 
-    // Read power usage
-    state.stats.powerUsage = readFromSysfs("gpu/power_usage").toInt();
+    if (!(snapshot.flags & ANARCHY_STATS_LINK_UP)) {
+        state.stats.gpuState = "Off";
+    } else if (snapshot.flags & ANARCHY_STATS_THROTTLING) {
+        state.stats.gpuState = "Throttled";
+    } else {
+        state.stats.gpuState = "Active";
+    }
+}
 
-    // Read GPU state
-    state.stats.gpuState = readFromSysfs("gpu/power_state");
+void Device::monitorThunderboltStatus(const anarchy_ioc_stats& snapshot)
+{
+    state.stats.tbLinkSpeed = int(snapshot.tb_link_speed);
+    state.stats.tbHopCount = int(snapshot.tb_hop_count);
+    state.stats.tbErrors = snapshot.tb_errors;
+    state.stats.tbDevicePath = QString::fromLatin1(snapshot.tb_device_path,
+                                                   int(strnlen(snapshot.tb_device_path,
+                                                               sizeof(snapshot.tb_device_path))));
+    state.stats.tbControllerStatus = (snapshot.flags & ANARCHY_STATS_CONNECTED) ?
+        "connected" : "disconnected";
 }
 
-void Device::monitorThunderboltStatus()
+bool Device::probeHardware(DeviceStats& stats, QString& driverVersion)
 {
-    // Read Thunderbolt link speed
-    QString tbStatus = readFromSysfs("thunderbolt/status");
-    QStringList tbLines = tbStatus.split('\n');
-    
-    for (const QString& line : tbLines) {
-        if (line.contains("Speed:")) {
-            state.stats.tbLinkSpeed = line.split(':').at(1).trimmed().split(' ').first().toInt();
-        } else if (line.contains("Hop count:")) {
-            state.stats.tbHopCount = line.split(':').at(1).trimmed().toInt();
-        }
+    const bool opened = !controlPlane->isOpen();
+    if (opened && !controlPlane->open(DEVICE_PATH)) {
+        logError(controlPlane->lastError());
+        return false;
     }
 
-    // Read Thunderbolt errors
-    state.stats.tbErrors = readFromSysfs("thunderbolt/errors").toLongLong();
+    const bool ok = readSnapshot();
+    stats = state.stats;
+    driverVersion = controlPlane->version().driverVersion;
 
-    // Read device path and controller status
-    state.stats.tbDevicePath = readFromSysfs("thunderbolt/device_path");
-    state.stats.tbControllerStatus = readFromSysfs("thunderbolt/controller_status");
+    if (opened) {
+        controlPlane->close();
+        state.haveSnapshot = false;
+    }
+    return ok;
 }
 
 void Device::updatePerformanceHistory()
@@ -389,52 +597,61 @@ void Device::updatePerformanceHistory()
     }
 }
 
-void Device::calculateStatistics()
+DeviceStats::Stats Device::calculateStats(const QVector<DeviceStats::PerformancePoint>& history) const
 {
-    // Helper lambda for calculating statistics
-    auto calcStats = [this](const QVector<DeviceStats::PerformancePoint>& history) -> DeviceStats::Stats {
-        if (history.isEmpty()) return DeviceStats::Stats();
+    if (history.isEmpty()) return DeviceStats::Stats();
 
-        QVector<double> values;
-        values.reserve(history.size());
-        for (const auto& point : history) {
-            values.append(point.value);
-        }
+    QVector<double> values;
+    values.reserve(history.size());
+    for (const auto& point : history) {
+        values.append(point.value);
+    }
 
-        DeviceStats::Stats stats;
-        stats.min = *std::min_element(values.begin(), values.end());
-        stats.max = *std::max_element(values.begin(), values.end());
-        
-        // Calculate average
-        double sum = std::accumulate(values.begin(), values.end(), 0.0);
-        stats.avg = sum / values.size();
-        
-        // Calculate standard deviation
-        stats.stdDev = calculateStdDev(values, stats.avg);
-        
-        return stats;
-    };
+    DeviceStats::Stats stats;
+    stats.min = *std::min_element(values.begin(), values.end());
+    stats.max = *std::max_element(values.begin(), values.end());
+    
+    // Calculate average
+    double sum = std::accumulate(values.begin(), values.end(), 0.0);
+    stats.avg = sum / values.size();
+    
+    // Calculate standard deviation
+    stats.stdDev = calculateStdDev(values, stats.avg);
+    
+    return stats;
+}
 
+void Device::calculateStatistics()
+{
     // Calculate statistics for each metric
-    state.stats.txStats = calcStats(state.stats.txHistory);
-    state.stats.rxStats = calcStats(state.stats.rxHistory);
-    state.stats.latencyStats = calcStats(state.stats.latencyHistory);
-    state.stats.temperatureStats = calcStats(state.stats.temperatureHistory);
+    state.stats.txStats = calculateStats(state.stats.txHistory);
+    state.stats.rxStats = calculateStats(state.stats.rxHistory);
+    state.stats.latencyStats = calculateStats(state.stats.latencyHistory);
+    state.stats.temperatureStats = calculateStats(state.stats.temperatureHistory);
 }
 
 void Device::checkPerformanceThresholds()
 {
-    // Check latency threshold
-    if (state.stats.latency > config.thresholds.maxLatency) {
-        emit performanceThresholdExceeded("latency", state.stats.latency, config.thresholds.maxLatency);
-    }
-
-    // Check throughput threshold
-    if (state.stats.txThroughput < config.thresholds.minThroughput ||
-        state.stats.rxThroughput < config.thresholds.minThroughput) {
-        emit performanceThresholdExceeded("throughput",
-            std::min(state.stats.txThroughput, state.stats.rxThroughput),
-            config.thresholds.minThroughput);
+    // Throughput and latency go through the streaming detector so that
+    // transient dips are debounced and slow degradation is still caught
+    QMap<QString, double> samples;
+    samples.insert("tx_throughput", state.stats.txThroughput);
+    samples.insert("rx_throughput", state.stats.rxThroughput);
+    samples.insert("latency", state.stats.latency);
+
+    AnomalyDetector::Context context;
+    context.pcieErrors = state.stats.pcieErrors;
+    context.tbErrors = state.stats.tbErrors;
+    context.temperature = state.stats.temperature;
+    context.maxTemperature = config.thresholds.maxTemperature;
+
+    const QVector<AnomalyDetector::Alert> alerts = anomalyDetector.update(samples, context);
+    for (const AnomalyDetector::Alert& alert : alerts) {
+        if (alert.cleared) {
+            emit performanceAlert(alert.message, alert.severity);
+        } else {
+            emit performanceAlert(alert.message + " - " + alert.rootCause, alert.severity);
+        }
     }
 
     // Check temperature threshold
@@ -489,6 +706,13 @@ void Device::clearHistory()
     state.stats.latencyHistory.clear();
     state.stats.temperatureHistory.clear();
     state.monitoringStartTime = QDateTime::currentDateTime();
+    anomalyDetector.reset();
+}
+
+void Device::setAnomalyDetectorConfig(const AnomalyDetector::Config& detectorConfig)
+{
+    anomalyDetector.setConfig(detectorConfig);
+    anomalyDetector.reset();
 }
 
 void Device::exportStats(const QString& filename) const
@@ -562,19 +786,11 @@ bool Device::detectPerformanceIssues(QStringList& issues) const
 {
     bool hasIssues = false;
 
-    // Check for throughput issues
-    if (state.stats.txThroughput < config.thresholds.minThroughput) {
-        issues << "Low TX throughput detected";
-        hasIssues = true;
-    }
-    if (state.stats.rxThroughput < config.thresholds.minThroughput) {
-        issues << "Low RX throughput detected";
-        hasIssues = true;
-    }
-
-    // Check for latency issues
-    if (state.stats.latency > config.thresholds.maxLatency) {
-        issues << "High latency detected";
+    // Throughput and latency issues come from the anomaly detector rather
+    // than the latest sample, so a single dip is not reported
+    const QStringList anomalies = anomalyDetector.activeAnomalies();
+    for (const QString& anomaly : anomalies) {
+        issues << QString("Anomalous %1 detected").arg(anomaly);
         hasIssues = true;
     }
 
@@ -605,33 +821,6 @@ bool Device::detectPerformanceIssues(QStringList& issues) const
     return hasIssues;
 }
 
-bool Device::writeToSysfs(const QString& file, const QString& value)
-{
-    QFile f(SYSFS_PATH + file);
-    if (!f.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        logError("Failed to open " + file + " for writing");
-        return false;
-    }
-
-    if (f.write(value.toLocal8Bit()) < 0) {
-        logError("Failed to write to " + file);
-        return false;
-    }
-
-    return true;
-}
-
-QString Device::readFromSysfs(const QString& file)
-{
-    QFile f(SYSFS_PATH + file);
-    if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        logError("Failed to open " + file + " for reading");
-        return QString();
-    }
-
-    return QString::fromLocal8Bit(f.readAll()).trimmed();
-}
-
 void Device::logError(const QString& error)
 {
     state.lastError = error;
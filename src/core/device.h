@@ -5,6 +5,10 @@
 #include <QString>
 #include <QMap>
 #include <QDateTime>
+#include <QScopedPointer>
+#include "anomalydetector.h"
+#include "autotuner.h"
+#include "controlplane.h"
 
 struct DeviceStats {
     // Basic metrics
@@ -21,6 +25,8 @@ struct DeviceStats {
     int pcieLinkWidth;
     qint64 pcieErrors;
     double pcieUtilization;
+    double pcieRxRate;        // Bytes/sec
+    double pcieTxRate;
     
     // DMA metrics
     int activeChannels;
@@ -72,6 +78,8 @@ class Device : public QObject
 
 public:
     explicit Device(QObject *parent = nullptr);
+    // Takes ownership; tests pass a ControlPlane backed by the mock driver
+    Device(ControlPlane *controlPlane, QObject *parent = nullptr);
     ~Device();
 
     // Connection management
@@ -84,6 +92,8 @@ public:
     DeviceStats getStats() const;
     bool isConnected() const;
     QString getLastError() const;
+    // One-shot status read, works before connect()
+    bool probeHardware(DeviceStats& stats, QString& driverVersion);
 
     // Configuration
     void setDMAChannels(int channels);
@@ -91,6 +101,10 @@ public:
     void setPCIeLinkSpeed(int speed);
     void setThunderboltTimeout(int ms);
 
+    // Auto-tuning
+    void setAutoTuning(bool enable);
+    void setTuningBudget(int trials, double p99LatencyUs);
+
     // Monitoring control
     void setMonitoringInterval(int ms);
     void enableMetric(const QString& metric, bool enable);
@@ -101,6 +115,7 @@ public:
     DeviceStats::Stats calculateStats(const QVector<DeviceStats::PerformancePoint>& history) const;
     QString generatePerformanceReport() const;
     bool detectPerformanceIssues(QStringList& issues) const;
+    void setAnomalyDetectorConfig(const AnomalyDetector::Config& detectorConfig);
 
 signals:
     void connected();
@@ -109,17 +124,26 @@ signals:
     void statsUpdated(const DeviceStats& stats);
     void performanceAlert(const QString& message, int severity);
     void performanceThresholdExceeded(const QString& metric, double value, double threshold);
+    void autoTuneCompleted(int dmaChannels, int ringBufferSize, int pcieLinkSpeed,
+                           double throughput, double p99Latency);
 
 private:
     bool initializeDevice();
-    bool setupDMA();
-    bool setupPCIe();
-    bool setupThunderbolt();
+    bool applyConfiguration();
+    bool applyConfiguration(int dmaChannels, int ringBufferSize, int pcieLinkSpeed,
+                            int tbTimeout);
+    void reloadConfiguration();
+    bool readSnapshot();
+    void handleDriverEvents();
     void cleanup();
     void updateStats();
     void updatePerformanceHistory();
     void checkPerformanceThresholds();
     void calculateStatistics();
+    bool runAutoTune(bool force);
+    bool applyTuningCandidate(const AutoTuner::Candidate& candidate);
+    AutoTuner::Measurement runSyntheticLoad();
+    QString currentLinkSignature() const;
 
     // Device configuration
     struct {
@@ -128,6 +152,9 @@ private:
         int pcieLinkSpeed = 0;  // 0 = auto
         int tbTimeout = 1000;
         int monitoringInterval = 1000;
+        bool autoTune = false;
+        int tuneTrialBudget = 24;
+        double tuneLatencyBudget = 500.0;  // us, p99
         QSet<QString> enabledMetrics;
         struct {
             double maxLatency = 1000.0;  // ns
@@ -142,24 +169,30 @@ private:
         bool isConnected = false;
         QString lastError;
         DeviceStats stats;
-        int deviceFd = -1;
         void* dmaBuffer = nullptr;
+        anarchy_ioc_stats snapshot;
+        bool haveSnapshot = false;
         QDateTime monitoringStartTime;
+        bool tuning = false;
+        QString tunedLinkSignature;
     } state;
 
+    // Streaming baseline/change-point detector for throughput and latency
+    AnomalyDetector anomalyDetector;
+
+    // Binary ioctl interface of the driver
+    QScopedPointer<ControlPlane> controlPlane;
+
     // System paths
-    const QString SYSFS_PATH = "/sys/kernel/debug/anarchy-egpu/";
     const QString DEVICE_PATH = "/dev/anarchy-egpu";
     const QString NVIDIA_SYSFS_PATH = "/sys/class/nvidia/";
 
     // Helper functions
-    bool writeToSysfs(const QString& file, const QString& value);
-    QString readFromSysfs(const QString& file);
     void logError(const QString& error);
     double calculateStdDev(const QVector<double>& values, double mean) const;
-    void monitorNvidiaGPU();
-    void monitorPCIeStatus();
-    void monitorThunderboltStatus();
+    void monitorNvidiaGPU(const anarchy_ioc_stats& snapshot);
+    void monitorPCIeStatus(const anarchy_ioc_stats& snapshot);
+    void monitorThunderboltStatus(const anarchy_ioc_stats& snapshot);
 };
 
 #endif // DEVICE_H 
\ No newline at end of file
@@ -1,108 +1,261 @@
 #include <linux/module.h>
-#include <linux/workqueue.h>
-#include <linux/io.h>
-#include <linux/delay.h>
+#include <linux/math64.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <linux/thunderbolt.h>
 #include "include/anarchy_device.h"
 #include "include/common.h"
 #include "include/pcie_types.h"
+#include "include/pcie_state.h"
 #include "include/perf_monitor.h"
 #include "include/dma.h"
 #include "include/thunderbolt_utils.h"
+#include "include/link_policy.h"
+#include "include/bandwidth.h"
+#include "include/telemetry.h"
 
-/* PCIe bandwidth counters */
-#define PCIE_RX_COUNTER      0x5000
-#define PCIE_TX_COUNTER      0x5004
+/* Thunderbolt bandwidth needed for gaming, bytes/sec (10 Gbps) */
+#define MIN_GAMING_BANDWIDTH (10ULL * 125000000ULL)
 
-/* Bandwidth monitoring interval (in milliseconds) */
-#define BANDWIDTH_UPDATE_INTERVAL 1000
+static u32 anarchy_bandwidth_percent(u64 bytes, u64 capacity_bps, u64 period_ns)
+{
+    u64 possible;
+
+    if (!capacity_bps || !period_ns)
+        return 0;
+
+    possible = mul_u64_u64_div_u64(capacity_bps, period_ns, NSEC_PER_SEC);
+    if (!possible)
+        return 0;
+    return min_t(u64, div64_u64(bytes * 100, possible), 100);
+}
+
+/* Close the second being accumulated and push it into the history ring */
+static const struct anarchy_bw_second *
+anarchy_bandwidth_push_second(struct bandwidth_config *bw, u64 now_ns)
+{
+    struct anarchy_bw_second *slot;
+    u64 busier = max(bw->acc.rx_bytes, bw->acc.tx_bytes);
+
+    bw->acc.timestamp_ns = now_ns;
+    bw->acc.util = anarchy_bandwidth_percent(busier, bw->capacity,
+                                             now_ns - bw->acc_start_ns);
+
+    slot = &bw->history[(bw->history_head + bw->history_count) % ANARCHY_BW_HISTORY_LEN];
+    *slot = bw->acc;
+    if (bw->history_count < ANARCHY_BW_HISTORY_LEN)
+        bw->history_count++;
+    else
+        bw->history_head = (bw->history_head + 1) % ANARCHY_BW_HISTORY_LEN;
+
+    memset(&bw->acc, 0, sizeof(bw->acc));
+    bw->acc_start_ns = now_ns;
+    return slot;
+}
+
+/* Telemetry subscriber, called for every sample */
+static void bandwidth_sample(struct anarchy_device *adev, struct anarchy_telemetry_sub *sub,
+                             const struct anarchy_telemetry_sample *sample)
+{
+    struct bandwidth_config *bw = container_of(sub, struct bandwidth_config, sub);
+    u64 now_ns = sample->timestamp_ns;
+    u64 period_ns, span_ns, available, second_demand = 0, start;
+    const struct anarchy_bw_second *second;
+    u32 rx = sample->pcie_rx_counter, tx = sample->pcie_tx_counter;
+    u32 rx_delta, tx_delta, util;
+    bool second_done = false, was_critical;
+
+    available = (u64)tb_port_get_bandwidth(adev->tb_port) * 125000000ULL;
+
+    spin_lock(&bw->lock);
+    start = anarchy_hold_begin();
+
+    /* First sample, or one after a gap too long for a delta, only sets the baseline */
+    if (!bw->last_sample_ns || sample->counter_gap) {
+        bw->last_rx = rx;
+        bw->last_tx = tx;
+        bw->last_sample_ns = now_ns;
+        memset(&bw->acc, 0, sizeof(bw->acc));
+        bw->acc_start_ns = now_ns;
+        anarchy_hold_end(&bw->hold, start);
+        spin_unlock(&bw->lock);
+        return;
+    }
+
+    /* Unsigned 32-bit subtraction is exact across one wrap */
+    rx_delta = rx - bw->last_rx;
+    tx_delta = tx - bw->last_tx;
+    period_ns = now_ns - bw->last_sample_ns;
+    bw->last_rx = rx;
+    bw->last_tx = tx;
+    bw->last_sample_ns = now_ns;
+
+    if (period_ns) {
+        bw->rx_rate = div64_u64((u64)rx_delta * NSEC_PER_SEC, period_ns);
+        bw->tx_rate = div64_u64((u64)tx_delta * NSEC_PER_SEC, period_ns);
+    }
+    bw->current_bandwidth = max(bw->rx_rate, bw->tx_rate);
+    util = anarchy_bandwidth_percent(max(rx_delta, tx_delta), bw->capacity, period_ns);
+    bw->utilization = util;
+
+    bw->acc.rx_bytes += rx_delta;
+    bw->acc.tx_bytes += tx_delta;
+    bw->acc.peak_util = max(bw->acc.peak_util, util);
+    bw->acc.samples++;
+    span_ns = now_ns - bw->acc_start_ns;
+    if (span_ns >= NSEC_PER_SEC) {
+        second = anarchy_bandwidth_push_second(bw, now_ns);
+        second_demand = div64_u64(max(second->rx_bytes, second->tx_bytes) * NSEC_PER_SEC,
+                                  span_ns);
+        second_done = true;
+    }
+
+    bw->available_bandwidth = available;
+    was_critical = bw->bandwidth_critical;
+    bw->bandwidth_critical = available < MIN_GAMING_BANDWIDTH;
+
+    bw->last_update = jiffies;
+    anarchy_hold_end(&bw->hold, start);
+    spin_unlock(&bw->lock);
+
+    if (bw->bandwidth_critical && !was_critical)
+        dev_warn(adev->dev, "Low bandwidth detected (%llu Gbps)\n",
+                 div_u64(available, 125000000));
+    else if (!bw->bandwidth_critical && was_critical)
+        dev_info(adev->dev, "Bandwidth restored to normal levels\n");
+
+    if (second_done) {
+        /* Once a second: refresh capacity and let the link policy look */
+        WRITE_ONCE(bw->capacity, anarchy_pcie_get_link_capacity(adev));
+        anarchy_link_policy_sample(adev, second_demand);
 
-/* TB4/USB4 bandwidth configuration */
-#define TB4_MAX_BANDWIDTH    40000  /* 40 Gbps max */
-#define PCIE_X8_BANDWIDTH    16000  /* ~16 GB/s for PCIe 4.0 x8 */
-#define MIN_GAMING_BANDWIDTH 10000  /* 10 Gbps minimum for gaming */
+        if (bw->bandwidth_critical) {
+            anarchy_dma_optimize_transfers(adev);
+            if (!adev->texture_compression_enabled) {
+                dev_info(adev->dev, "Enabling texture compression\n");
+                adev->texture_compression_enabled = true;
+            }
+        }
+    }
+}
 
-/* Get current PCIe bandwidth usage */
-u32 anarchy_pcie_get_bandwidth_usage(struct anarchy_device *adev)
+/* Measured demand in bytes/sec, busier direction */
+u64 anarchy_pcie_get_bandwidth_usage(struct anarchy_device *adev)
 {
     struct bandwidth_config *bw = &adev->bandwidth;
-    unsigned long flags;
-    u32 usage;
-    
-    spin_lock_irqsave(&bw->lock, flags);
+    u64 usage;
+
+    spin_lock(&bw->lock);
     usage = bw->current_bandwidth;
-    spin_unlock_irqrestore(&bw->lock, flags);
-    
+    spin_unlock(&bw->lock);
+
     return usage;
 }
 
-static void bandwidth_update_work(struct work_struct *work)
+/* Latest sample's utilization of the negotiated link, percent */
+u32 anarchy_bandwidth_get_utilization(struct anarchy_device *adev)
+{
+    return READ_ONCE(adev->bandwidth.utilization);
+}
+
+void anarchy_bandwidth_get_rates(struct anarchy_device *adev, u64 *rx_bps, u64 *tx_bps)
+{
+    struct bandwidth_config *bw = &adev->bandwidth;
+
+    spin_lock(&bw->lock);
+    *rx_bps = bw->rx_rate;
+    *tx_bps = bw->tx_rate;
+    spin_unlock(&bw->lock);
+}
+
+/*
+ * Copy up to @max completed seconds, oldest first, into @out. Returns the
+ * number copied.
+ */
+unsigned int anarchy_bandwidth_get_history(struct anarchy_device *adev,
+                                           struct anarchy_bw_second *out,
+                                           unsigned int max)
+{
+    struct bandwidth_config *bw = &adev->bandwidth;
+    unsigned int i, n, first;
+
+    spin_lock(&bw->lock);
+    n = min(max, bw->history_count);
+    first = bw->history_head + bw->history_count - n;
+    for (i = 0; i < n; i++)
+        out[i] = bw->history[(first + i) % ANARCHY_BW_HISTORY_LEN];
+    spin_unlock(&bw->lock);
+
+    return n;
+}
+
+#ifdef CONFIG_DEBUG_FS
+
+static int anarchy_bandwidth_show(struct seq_file *m, void *unused)
+{
+    struct anarchy_device *adev = m->private;
+    struct anarchy_bw_second *hist;
+    u64 rx_bps, tx_bps;
+    unsigned int i, n;
+
+    hist = kcalloc(ANARCHY_BW_HISTORY_LEN, sizeof(*hist), GFP_KERNEL);
+    if (!hist)
+        return -ENOMEM;
+
+    anarchy_bandwidth_get_rates(adev, &rx_bps, &tx_bps);
+    n = anarchy_bandwidth_get_history(adev, hist, ANARCHY_BW_HISTORY_LEN);
+
+    seq_printf(m, "interval_ms %u capacity %llu rx_bps %llu tx_bps %llu util %u\n",
+               anarchy_telemetry_interval_ms(), adev->bandwidth.capacity,
+               rx_bps, tx_bps, anarchy_bandwidth_get_utilization(adev));
+    seq_puts(m, "timestamp_ns rx_bytes tx_bytes util peak samples\n");
+    for (i = 0; i < n; i++)
+        seq_printf(m, "%llu %llu %llu %u %u %u\n", hist[i].timestamp_ns,
+                   hist[i].rx_bytes, hist[i].tx_bytes, hist[i].util,
+                   hist[i].peak_util, hist[i].samples);
+
+    kfree(hist);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(anarchy_bandwidth);
+
+void anarchy_bandwidth_debugfs_init(struct anarchy_device *adev, struct dentry *parent)
+{
+    debugfs_create_file("bandwidth", 0444, parent, adev, &anarchy_bandwidth_fops);
+}
+
+#else
+
+void anarchy_bandwidth_debugfs_init(struct anarchy_device *adev, struct dentry *parent)
 {
-    struct delayed_work *delayed_work = to_delayed_work(work);
-    struct bandwidth_config *bw = container_of(delayed_work,
-                                             struct bandwidth_config,
-                                             update_work);
-    struct anarchy_device *adev = container_of(bw, struct anarchy_device,
-                                             bandwidth);
-    unsigned long flags;
-    u32 rx_bandwidth, tx_bandwidth;
-    
-    /* Read PCIe counters */
-    rx_bandwidth = readl(adev->mmio_base + PCIE_RX_COUNTER);
-    tx_bandwidth = readl(adev->mmio_base + PCIE_TX_COUNTER);
-    
-    spin_lock_irqsave(&bw->lock, flags);
-    bw->current_bandwidth = rx_bandwidth + tx_bandwidth;
-    bw->available_bandwidth = tb_port_get_bandwidth(adev->tb_port);
-    
-    if (bw->available_bandwidth < MIN_GAMING_BANDWIDTH) {
-        if (!bw->bandwidth_critical) {
-            dev_warn(adev->dev, "Low bandwidth detected (%d Gbps)\n",
-                    bw->available_bandwidth / 1000);
-            bw->bandwidth_critical = true;
-        }
-        
-        /* Apply optimizations */
-        anarchy_dma_optimize_transfers(adev);
-        if (!adev->texture_compression_enabled) {
-            dev_info(adev->dev, "Enabling texture compression\n");
-            adev->texture_compression_enabled = true;
-        }
-    } else if (bw->bandwidth_critical && 
-               bw->available_bandwidth >= MIN_GAMING_BANDWIDTH) {
-        dev_info(adev->dev, "Bandwidth restored to normal levels\n");
-        bw->bandwidth_critical = false;
-    }
-    
-    bw->last_update = jiffies;
-    spin_unlock_irqrestore(&bw->lock, flags);
-    
-    /* Schedule next update */
-    schedule_delayed_work(&bw->update_work, 
-                         msecs_to_jiffies(BANDWIDTH_UPDATE_INTERVAL));
 }
 
+#endif /* CONFIG_DEBUG_FS */
+
 /* Initialize bandwidth monitoring */
 int init_bandwidth_monitoring(struct anarchy_device *adev)
 {
     struct bandwidth_config *bw = &adev->bandwidth;
-    
-    /* Initialize bandwidth monitoring state */
-    bw->required_bandwidth = PCIE_X8_BANDWIDTH;
+
+    spin_lock_init(&bw->lock);
+
+    bw->required_bandwidth = 0;
     bw->current_bandwidth = 0;
-    bw->available_bandwidth = TB4_MAX_BANDWIDTH;
+    bw->available_bandwidth = (u64)tb_port_get_bandwidth(adev->tb_port) * 125000000ULL;
     bw->bandwidth_critical = false;
-    
-    /* Initialize synchronization */
-    spin_lock_init(&bw->lock);
-    
-    /* Initialize work queue */
-    INIT_DELAYED_WORK(&bw->update_work, bandwidth_update_work);
-    
-    /* Start monitoring */
-    schedule_delayed_work(&bw->update_work,
-                         msecs_to_jiffies(BANDWIDTH_UPDATE_INTERVAL));
-    
+    bw->capacity = anarchy_pcie_get_link_capacity(adev);
+    bw->history_head = 0;
+    bw->history_count = 0;
+    memset(&bw->acc, 0, sizeof(bw->acc));
+    memset(&bw->hold, 0, sizeof(bw->hold));
+
+    /* The first sample sets the counter baseline */
+    bw->last_sample_ns = 0;
+
+    bw->sub.name = "bandwidth";
+    bw->sub.interval_ms = 0;
+    bw->sub.fn = bandwidth_sample;
+    anarchy_telemetry_subscribe(adev, &bw->sub);
     return 0;
 }
 
@@ -110,10 +263,14 @@ int init_bandwidth_monitoring(struct anarchy_device *adev)
 void cleanup_bandwidth_monitoring(struct anarchy_device *adev)
 {
     struct bandwidth_config *bw = &adev->bandwidth;
-    
-    cancel_delayed_work_sync(&bw->update_work);
+
+    anarchy_telemetry_unsubscribe(adev, &bw->sub);
 }
 
 EXPORT_SYMBOL_GPL(anarchy_pcie_get_bandwidth_usage);
+EXPORT_SYMBOL_GPL(anarchy_bandwidth_get_utilization);
+EXPORT_SYMBOL_GPL(anarchy_bandwidth_get_rates);
+EXPORT_SYMBOL_GPL(anarchy_bandwidth_get_history);
+EXPORT_SYMBOL_GPL(anarchy_bandwidth_debugfs_init);
 EXPORT_SYMBOL_GPL(init_bandwidth_monitoring);
 EXPORT_SYMBOL_GPL(cleanup_bandwidth_monitoring);
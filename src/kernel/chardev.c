@@ -0,0 +1,844 @@
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/uaccess.h>
+#include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/kfifo.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/srcu.h>
+#include "include/chardev.h"
+#include "include/anarchy_device.h"
+#include "include/common.h"
+#include "include/pcie_state.h"
+#include "include/ring.h"
+#include "include/queue.h"
+
+/* Readiness polling interval bounds */
+#define READY_POLL_MIN_US   50
+#define READY_POLL_MAX_US   1000
+
+/* How long a submission waits for the device to free a descriptor */
+#define SUBMIT_CREDIT_TIMEOUT_US    (100 * USEC_PER_MSEC)
+
+/* Per-open-file event queue depth, must be a power of two */
+#define EVENT_QUEUE_LEN     64
+
+/* Per-open-file state: event subscription and pending events */
+struct anarchy_chardev_file {
+    struct anarchy_device *adev;
+    struct list_head node;
+    u32 event_mask;
+    bool overflow;
+    DECLARE_KFIFO(events, struct anarchy_ioc_event, EVENT_QUEUE_LEN);
+    wait_queue_head_t wait;
+    struct anarchy_queue *queue;    /* Shared SQ/CQ, set up once */
+};
+
+/*
+ * One configuration field and how to apply it. Fields are applied in
+ * table order and rolled back in reverse order.
+ */
+struct anarchy_cfg_field {
+    u32 mask;
+    int (*apply)(struct anarchy_device *adev, u32 value);
+};
+
+static int cfg_apply_dma_channels(struct anarchy_device *adev, u32 value)
+{
+    adev->dma_channels = value;
+    return 0;
+}
+
+static int cfg_apply_ring_size(struct anarchy_device *adev, u32 value)
+{
+    unsigned int old = adev->ring_buffer_size;
+    int ret;
+
+    if (value == adev->ring_buffer_size)
+        return 0;
+
+    /* Resized in place, the rings keep running and keep their counters */
+    ret = anarchy_ring_resize(adev, &adev->tx_ring, value);
+    if (ret)
+        return ret;
+
+    ret = anarchy_ring_resize(adev, &adev->rx_ring, value);
+    if (ret) {
+        anarchy_ring_resize(adev, &adev->tx_ring, old);
+        return ret;
+    }
+
+    adev->ring_buffer_size = value;
+    return 0;
+}
+
+static int cfg_apply_link_speed(struct anarchy_device *adev, u32 value)
+{
+    int ret;
+
+    if (value == adev->link_speed)
+        return 0;
+
+    ret = anarchy_pcie_set_speed(adev, (enum anarchy_pcie_speed)value);
+    if (ret)
+        return ret;
+
+    adev->link_speed = value;
+    return 0;
+}
+
+static int cfg_apply_tb_timeout(struct anarchy_device *adev, u32 value)
+{
+    adev->tb_timeout_ms = value;
+    return 0;
+}
+
+static const struct anarchy_cfg_field cfg_fields[] = {
+    { ANARCHY_CFG_DMA_CHANNELS, cfg_apply_dma_channels },
+    { ANARCHY_CFG_RING_SIZE,    cfg_apply_ring_size },
+    { ANARCHY_CFG_LINK_SPEED,   cfg_apply_link_speed },
+    { ANARCHY_CFG_TB_TIMEOUT,   cfg_apply_tb_timeout },
+};
+
+static u32 cfg_value(const struct anarchy_ioc_config *cfg, u32 mask)
+{
+    switch (mask) {
+    case ANARCHY_CFG_DMA_CHANNELS:
+        return cfg->dma_channels;
+    case ANARCHY_CFG_RING_SIZE:
+        return cfg->ring_size;
+    case ANARCHY_CFG_LINK_SPEED:
+        return cfg->link_speed;
+    case ANARCHY_CFG_TB_TIMEOUT:
+        return cfg->tb_timeout_ms;
+    default:
+        return 0;
+    }
+}
+
+static void cfg_snapshot(struct anarchy_device *adev, struct anarchy_ioc_config *cfg)
+{
+    cfg->valid = ANARCHY_CFG_ALL;
+    cfg->dma_channels = adev->dma_channels;
+    cfg->ring_size = adev->ring_buffer_size;
+    cfg->link_speed = adev->link_speed;
+    cfg->tb_timeout_ms = adev->tb_timeout_ms;
+}
+
+/* Check every requested field before anything touches the hardware */
+static int cfg_validate(const struct anarchy_ioc_config *cfg, u32 *failed)
+{
+    if (cfg->valid & ~ANARCHY_CFG_ALL) {
+        *failed = cfg->valid & ~ANARCHY_CFG_ALL;
+        return -EINVAL;
+    }
+
+    if ((cfg->valid & ANARCHY_CFG_DMA_CHANNELS) &&
+        (cfg->dma_channels < ANARCHY_CFG_MIN_DMA_CHANNELS ||
+         cfg->dma_channels > ANARCHY_CFG_MAX_DMA_CHANNELS)) {
+        *failed = ANARCHY_CFG_DMA_CHANNELS;
+        return -EINVAL;
+    }
+
+    if ((cfg->valid & ANARCHY_CFG_RING_SIZE) &&
+        (cfg->ring_size < ANARCHY_CFG_MIN_RING_SIZE ||
+         cfg->ring_size > ANARCHY_CFG_MAX_RING_SIZE ||
+         !is_power_of_2(cfg->ring_size))) {
+        *failed = ANARCHY_CFG_RING_SIZE;
+        return -EINVAL;
+    }
+
+    if ((cfg->valid & ANARCHY_CFG_LINK_SPEED) &&
+        cfg->link_speed > ANARCHY_CFG_MAX_LINK_SPEED) {
+        *failed = ANARCHY_CFG_LINK_SPEED;
+        return -EINVAL;
+    }
+
+    if ((cfg->valid & ANARCHY_CFG_TB_TIMEOUT) &&
+        (cfg->tb_timeout_ms < ANARCHY_CFG_MIN_TB_TIMEOUT ||
+         cfg->tb_timeout_ms > ANARCHY_CFG_MAX_TB_TIMEOUT)) {
+        *failed = ANARCHY_CFG_TB_TIMEOUT;
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+static bool anarchy_device_ready(struct anarchy_device *adev)
+{
+    if (!pcie_link_is_up(adev->pdev))
+        return false;
+
+    if ((adev->flags & ANARCHY_DEVICE_FLAG_CONNECTED) &&
+        (adev->tx_ring.state != ANARCHY_RING_STATE_RUNNING ||
+         adev->rx_ring.state != ANARCHY_RING_STATE_RUNNING))
+        return false;
+
+    return true;
+}
+
+/*
+ * Poll until the link is active and the rings run again, backing off from
+ * READY_POLL_MIN_US to READY_POLL_MAX_US. Returns the time it took in us.
+ */
+static int anarchy_wait_ready(struct anarchy_device *adev, u32 timeout_ms,
+                              u32 *ready_us)
+{
+    ktime_t start = ktime_get();
+    ktime_t deadline;
+    unsigned int delay = READY_POLL_MIN_US;
+
+    if (!timeout_ms)
+        timeout_ms = ANARCHY_CFG_DEFAULT_READY_MS;
+    deadline = ktime_add_ms(start, timeout_ms);
+
+    while (!anarchy_device_ready(adev)) {
+        if (ktime_after(ktime_get(), deadline))
+            return -ETIMEDOUT;
+        usleep_range(delay, delay * 2);
+        delay = min(delay * 2, (unsigned int)READY_POLL_MAX_US);
+    }
+
+    if (adev->pcie_state.state == ANARCHY_PCIE_STATE_TRAINING) {
+        anarchy_pcie_update_link_status(adev);
+        anarchy_pcie_set_state(adev, ANARCHY_PCIE_STATE_ACTIVE);
+    }
+
+    *ready_us = ktime_us_delta(ktime_get(), start);
+    return 0;
+}
+
+/*
+ * Apply a full configuration as one transaction: validate everything,
+ * snapshot the current values, apply field by field and restore the
+ * snapshot if any step or the final readiness wait fails.
+ */
+static int anarchy_apply_config(struct anarchy_device *adev,
+                                struct anarchy_ioc_config *cfg)
+{
+    struct anarchy_ioc_config old;
+    u32 ready_us = 0;
+    int i, applied, ret;
+
+    cfg->failed_field = 0;
+    cfg->ready_time_us = 0;
+
+    ret = cfg_validate(cfg, &cfg->failed_field);
+    if (ret)
+        return ret;
+
+    mutex_lock(&adev->lock);
+
+    cfg_snapshot(adev, &old);
+
+    for (applied = 0; applied < ARRAY_SIZE(cfg_fields); applied++) {
+        const struct anarchy_cfg_field *field = &cfg_fields[applied];
+
+        if (!(cfg->valid & field->mask))
+            continue;
+
+        ret = field->apply(adev, cfg_value(cfg, field->mask));
+        if (ret) {
+            cfg->failed_field = field->mask;
+            /* The failed step may be half done, restore it as well */
+            applied++;
+            goto rollback;
+        }
+    }
+
+    ret = anarchy_wait_ready(adev, cfg->ready_timeout_ms, &ready_us);
+    if (ret) {
+        /* Nothing failed individually, the combination did not come up */
+        cfg->failed_field = cfg->valid;
+        goto rollback;
+    }
+
+    cfg->ready_time_us = ready_us;
+    mutex_unlock(&adev->lock);
+    anarchy_chardev_notify(adev, ANARCHY_EVENT_CONFIG_CHANGED, cfg->valid, ready_us);
+    return 0;
+
+rollback:
+    for (i = applied - 1; i >= 0; i--) {
+        const struct anarchy_cfg_field *field = &cfg_fields[i];
+
+        if (cfg->valid & field->mask)
+            field->apply(adev, cfg_value(&old, field->mask));
+    }
+    if (cfg->valid & ANARCHY_CFG_LINK_SPEED)
+        anarchy_wait_ready(adev, cfg->ready_timeout_ms, &ready_us);
+
+    dev_warn(adev->dev, "config apply failed (field 0x%x): %d, rolled back\n",
+             cfg->failed_field, ret);
+    mutex_unlock(&adev->lock);
+    return ret;
+}
+
+static int anarchy_reset(struct anarchy_device *adev, struct anarchy_ioc_reset *rst)
+{
+    bool connected;
+    u32 ready_us = 0;
+    int ret;
+
+    mutex_lock(&adev->lock);
+
+    connected = adev->flags & ANARCHY_DEVICE_FLAG_CONNECTED;
+    /* Submissions retry with -EBUSY meanwhile; in-flight work is replayed */
+    anarchy_ring_checkpoint(adev, &adev->tx_ring);
+    anarchy_ring_checkpoint(adev, &adev->rx_ring);
+
+    ret = anarchy_pcie_request_retrain(adev);
+    if (ret || !connected) {
+        anarchy_ring_stop(adev, &adev->tx_ring);
+        anarchy_ring_stop(adev, &adev->rx_ring);
+        if (ret)
+            goto unlock;
+    } else {
+        anarchy_ring_restore(adev, &adev->tx_ring);
+        anarchy_ring_restore(adev, &adev->rx_ring);
+    }
+
+    ret = anarchy_wait_ready(adev, rst->timeout_ms, &ready_us);
+    rst->ready_time_us = ready_us;
+
+unlock:
+    mutex_unlock(&adev->lock);
+    if (!ret)
+        anarchy_chardev_notify(adev, ANARCHY_EVENT_RESET, ready_us, 0);
+    return ret;
+}
+
+/* The caller's struct size decides how much is copied back */
+static long anarchy_ioctl_get_stats(struct anarchy_device *adev,
+                                    struct anarchy_ioc_stats __user *ustats)
+{
+    struct anarchy_ioc_stats st;
+    u32 size;
+
+    if (get_user(size, &ustats->size))
+        return -EFAULT;
+    if (size < offsetofend(struct anarchy_ioc_stats, timestamp_ns))
+        return -EINVAL;
+
+    anarchy_fill_stats(adev, &st);
+    st.size = min_t(u32, size, sizeof(st));
+
+    if (copy_to_user(ustats, &st, st.size))
+        return -EFAULT;
+    return 0;
+}
+
+/*
+ * One SUBMIT_DMA request. Every page shares @xfer, so the ring calls back
+ * once per page; the completion event follows the last one.
+ */
+struct anarchy_dma_op {
+    struct anarchy_transfer xfer;
+    struct anarchy_device *adev;
+    u64 cookie;
+    u32 size;
+    bool queued;                    /* Fully submitted, so report it */
+    u64 start_ns;
+    atomic_t pages;                 /* Outstanding, plus one until fully queued */
+    int status;                     /* First error, 0 = none */
+};
+
+static void anarchy_dma_op_put(struct anarchy_dma_op *op)
+{
+    int status;
+
+    if (!atomic_dec_and_test(&op->pages))
+        return;
+
+    status = READ_ONCE(op->status);
+    if (op->queued) {
+        if (!status)
+            anarchy_ring_account_latency(&op->adev->tx_ring, op->start_ns);
+        anarchy_chardev_notify(op->adev, ANARCHY_EVENT_DMA_COMPLETE, op->cookie,
+                               status ? (u64)(s64)status : op->size);
+    }
+    kfree(op);
+}
+
+/* Ring callback, once per page */
+static void anarchy_dma_op_done(struct anarchy_transfer *xfer, int status)
+{
+    struct anarchy_dma_op *op = container_of(xfer, struct anarchy_dma_op, xfer);
+
+    if (status)
+        cmpxchg(&op->status, 0, status);
+    anarchy_dma_op_put(op);
+}
+
+static long anarchy_ioctl_submit_dma(struct anarchy_device *adev,
+                                     const struct anarchy_ioc_dma *req)
+{
+    struct anarchy_dma_op *op;
+    size_t done = 0, chunk;
+    void *bounce;
+    int ret = 0;
+
+    if (!req->size || req->flags != ANARCHY_DMA_TO_DEVICE)
+        return -EINVAL;
+
+    /* Descriptor buffers are one page each, feed the ring page by page */
+    bounce = kmalloc(PAGE_SIZE, GFP_KERNEL);
+    op = kzalloc(sizeof(*op), GFP_KERNEL);
+    if (!bounce || !op) {
+        kfree(bounce);
+        kfree(op);
+        return -ENOMEM;
+    }
+    op->xfer.done = anarchy_dma_op_done;
+    op->adev = adev;
+    op->cookie = req->cookie;
+    op->size = req->size;
+    op->start_ns = ktime_get_ns();
+    atomic_set(&op->pages, 1);
+
+    ret = anarchy_rpm_get(adev);
+    if (ret) {
+        kfree(bounce);
+        kfree(op);
+        return ret;
+    }
+
+    while (done < req->size) {
+        /* Unplug waits for this ioctl, do not make it wait for the whole buffer */
+        if (READ_ONCE(adev->unplugged)) {
+            ret = -ENODEV;
+            break;
+        }
+        chunk = min_t(size_t, req->size - done, PAGE_SIZE);
+        if (copy_from_user(bounce, u64_to_user_ptr(req->addr + done), chunk)) {
+            ret = -EFAULT;
+            break;
+        }
+
+        /* Larger than the ring, so wait for the device to retire pages as we go */
+        ret = anarchy_ring_wait_credits(adev, &adev->tx_ring, 1, SUBMIT_CREDIT_TIMEOUT_US);
+        if (ret < 0)
+            break;
+        atomic_inc(&op->pages);
+        ret = anarchy_ring_transfer(adev, &adev->tx_ring, bounce, chunk, &op->xfer);
+        if (ret) {
+            atomic_dec(&op->pages);
+            break;
+        }
+        done += chunk;
+    }
+    anarchy_rpm_put(adev);
+    kfree(bounce);
+
+    /*
+     * The ioctl's return value reports a failed submission, pages it did
+     * queue still complete but raise no event.
+     */
+    if (ret)
+        atomic_inc(&adev->tx_ring.transfer_errors);
+    else
+        op->queued = true;
+    anarchy_dma_op_put(op);
+    return ret;
+}
+
+/* Queue an event for every open file subscribed to @type; atomic safe */
+void anarchy_chardev_notify(struct anarchy_device *adev, u32 type, u64 data0, u64 data1)
+{
+    struct anarchy_chardev_file *cf;
+    struct anarchy_ioc_event ev = {
+        .type = type,
+        .timestamp_ns = ktime_get_ns(),
+        .data = { data0, data1 },
+    };
+    unsigned long flags;
+
+    if (!adev || !adev->miscdev.fops)
+        return;
+
+    spin_lock_irqsave(&adev->event_lock, flags);
+    list_for_each_entry(cf, &adev->event_files, node) {
+        if (!(cf->event_mask & type))
+            continue;
+        if (!kfifo_put(&cf->events, ev))
+            cf->overflow = true;
+        wake_up_interruptible(&cf->wait);
+    }
+    spin_unlock_irqrestore(&adev->event_lock, flags);
+}
+EXPORT_SYMBOL_GPL(anarchy_chardev_notify);
+
+static bool anarchy_chardev_pending(struct anarchy_chardev_file *cf)
+{
+    return cf->overflow || !kfifo_is_empty(&cf->events);
+}
+
+static int anarchy_chardev_open(struct inode *inode, struct file *file)
+{
+    struct miscdevice *misc = file->private_data;
+    struct anarchy_device *adev = container_of(misc, struct anarchy_device, miscdev);
+    struct anarchy_chardev_file *cf;
+    unsigned long flags;
+
+    cf = kzalloc(sizeof(*cf), GFP_KERNEL);
+    if (!cf)
+        return -ENOMEM;
+
+    /* misc_open() holds misc_mtx, so this cannot race the deregister */
+    anarchy_device_get(adev);
+    cf->adev = adev;
+    INIT_KFIFO(cf->events);
+    init_waitqueue_head(&cf->wait);
+
+    mutex_lock(&adev->files_lock);
+    spin_lock_irqsave(&adev->event_lock, flags);
+    list_add_tail(&cf->node, &adev->event_files);
+    spin_unlock_irqrestore(&adev->event_lock, flags);
+    mutex_unlock(&adev->files_lock);
+
+    file->private_data = cf;
+    return nonseekable_open(inode, file);
+}
+
+static int anarchy_chardev_release(struct inode *inode, struct file *file)
+{
+    struct anarchy_chardev_file *cf = file->private_data;
+    struct anarchy_device *adev = cf->adev;
+    unsigned long flags;
+
+    mutex_lock(&adev->files_lock);
+    spin_lock_irqsave(&adev->event_lock, flags);
+    list_del(&cf->node);
+    spin_unlock_irqrestore(&adev->event_lock, flags);
+    mutex_unlock(&adev->files_lock);
+
+    anarchy_queue_destroy(cf->queue);
+    kfree(cf);
+    anarchy_device_put(adev);
+    return 0;
+}
+
+/*
+ * Every file op but open and release runs between these two, so unplug
+ * can fail new ones and wait for those in flight before the device goes.
+ * Returns the SRCU index or -ENODEV.
+ */
+static int anarchy_chardev_enter(struct anarchy_device *adev)
+{
+    int idx = srcu_read_lock(&adev->chardev_srcu);
+
+    if (READ_ONCE(adev->unplugged)) {
+        srcu_read_unlock(&adev->chardev_srcu, idx);
+        return -ENODEV;
+    }
+    return idx;
+}
+
+static void anarchy_chardev_leave(struct anarchy_device *adev, int idx)
+{
+    srcu_read_unlock(&adev->chardev_srcu, idx);
+}
+
+/* Hand out whole struct anarchy_ioc_event records */
+static ssize_t anarchy_chardev_read_events(struct file *file, char __user *buf,
+                                           size_t count)
+{
+    struct anarchy_chardev_file *cf = file->private_data;
+    struct anarchy_device *adev = cf->adev;
+    struct anarchy_ioc_event ev;
+    unsigned long flags;
+    size_t done = 0;
+    bool got;
+    int ret;
+
+    if (count < sizeof(ev))
+        return -EINVAL;
+
+    if (!(file->f_flags & O_NONBLOCK)) {
+        ret = wait_event_interruptible(cf->wait, anarchy_chardev_pending(cf) ||
+                                                 READ_ONCE(adev->unplugged));
+        if (ret)
+            return ret;
+        if (READ_ONCE(adev->unplugged))
+            return -ENODEV;
+    }
+
+    while (done + sizeof(ev) <= count) {
+        spin_lock_irqsave(&adev->event_lock, flags);
+        if (cf->overflow) {
+            /* Report the drop first so the reader knows to resync */
+            memset(&ev, 0, sizeof(ev));
+            ev.type = ANARCHY_EVENT_OVERFLOW;
+            ev.timestamp_ns = ktime_get_ns();
+            cf->overflow = false;
+            got = true;
+        } else {
+            got = kfifo_get(&cf->events, &ev);
+        }
+        spin_unlock_irqrestore(&adev->event_lock, flags);
+
+        if (!got)
+            break;
+        if (copy_to_user(buf + done, &ev, sizeof(ev)))
+            return done ? done : -EFAULT;
+        done += sizeof(ev);
+    }
+
+    return done ? done : -EAGAIN;
+}
+
+static ssize_t anarchy_chardev_read(struct file *file, char __user *buf,
+                                    size_t count, loff_t *ppos)
+{
+    struct anarchy_chardev_file *cf = file->private_data;
+    ssize_t ret;
+    int idx;
+
+    idx = anarchy_chardev_enter(cf->adev);
+    if (idx < 0)
+        return idx;
+    ret = anarchy_chardev_read_events(file, buf, count);
+    anarchy_chardev_leave(cf->adev, idx);
+    return ret;
+}
+
+static __poll_t anarchy_chardev_poll(struct file *file, poll_table *wait)
+{
+    struct anarchy_chardev_file *cf = file->private_data;
+
+    poll_wait(file, &cf->wait, wait);
+    if (READ_ONCE(cf->adev->unplugged))
+        return EPOLLERR | EPOLLHUP;
+    return anarchy_chardev_pending(cf) ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+static long anarchy_ioctl_queue_setup(struct anarchy_chardev_file *cf,
+                                      struct anarchy_ioc_queue_setup __user *usetup)
+{
+    struct anarchy_ioc_queue_setup setup;
+    struct anarchy_queue *q;
+
+    /* One queue pair per open file */
+    if (READ_ONCE(cf->queue))
+        return -EBUSY;
+    if (copy_from_user(&setup, usetup, sizeof(setup)))
+        return -EFAULT;
+
+    q = anarchy_queue_create(cf->adev, &setup);
+    if (IS_ERR(q))
+        return PTR_ERR(q);
+
+    if (copy_to_user(usetup, &setup, sizeof(setup))) {
+        anarchy_queue_destroy(q);
+        return -EFAULT;
+    }
+
+    /* Lost a race with a concurrent setup */
+    if (cmpxchg(&cf->queue, NULL, q)) {
+        anarchy_queue_destroy(q);
+        return -EBUSY;
+    }
+    return 0;
+}
+
+static long anarchy_ioctl_queue_enter(struct anarchy_chardev_file *cf,
+                                      struct anarchy_ioc_queue_enter __user *uenter)
+{
+    struct anarchy_queue *q = READ_ONCE(cf->queue);
+    struct anarchy_ioc_queue_enter enter;
+    int ret;
+
+    if (!q)
+        return -ENXIO;
+    if (copy_from_user(&enter, uenter, sizeof(enter)))
+        return -EFAULT;
+
+    ret = anarchy_queue_enter(q, &enter);
+    if (put_user(enter.submitted, &uenter->submitted))
+        return -EFAULT;
+    return ret;
+}
+
+static int anarchy_chardev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    struct anarchy_chardev_file *cf = file->private_data;
+    struct anarchy_queue *q = READ_ONCE(cf->queue);
+    int idx, ret;
+
+    if (!q)
+        return -ENXIO;
+
+    idx = anarchy_chardev_enter(cf->adev);
+    if (idx < 0)
+        return idx;
+    ret = anarchy_queue_mmap(q, vma);
+    anarchy_chardev_leave(cf->adev, idx);
+    return ret;
+}
+
+static long anarchy_chardev_do_ioctl(struct file *file, unsigned int cmd,
+                                     unsigned long arg)
+{
+    struct anarchy_chardev_file *cf = file->private_data;
+    struct anarchy_device *adev = cf->adev;
+    void __user *uarg = (void __user *)arg;
+    struct anarchy_ioc_version ver;
+    struct anarchy_ioc_config cfg;
+    struct anarchy_ioc_reset rst;
+    struct anarchy_ioc_dma dma;
+    u32 mask;
+    int ret;
+
+    /* Stats grow by appending fields, so match them regardless of size */
+    if (_IOC_TYPE(cmd) == ANARCHY_IOC_MAGIC &&
+        _IOC_NR(cmd) == _IOC_NR(ANARCHY_IOC_GET_STATS))
+        return anarchy_ioctl_get_stats(adev, uarg);
+
+    switch (cmd) {
+    case ANARCHY_IOC_GET_VERSION:
+        memset(&ver, 0, sizeof(ver));
+        ver.major = ANARCHY_ABI_MAJOR;
+        ver.minor = ANARCHY_ABI_MINOR;
+        ver.features = ANARCHY_FEAT_CONFIG | ANARCHY_FEAT_STATS |
+                       ANARCHY_FEAT_DMA | ANARCHY_FEAT_EVENTS |
+                       ANARCHY_FEAT_QUEUES;
+        strscpy(ver.driver_version, ANARCHY_DRIVER_VERSION, sizeof(ver.driver_version));
+        if (copy_to_user(uarg, &ver, sizeof(ver)))
+            return -EFAULT;
+        return 0;
+
+    case ANARCHY_IOC_APPLY_CONFIG:
+        if (copy_from_user(&cfg, uarg, sizeof(cfg)))
+            return -EFAULT;
+        ret = anarchy_apply_config(adev, &cfg);
+        /* Copy back even on failure so userspace sees failed_field */
+        if (copy_to_user(uarg, &cfg, sizeof(cfg)))
+            return -EFAULT;
+        return ret;
+
+    case ANARCHY_IOC_GET_CONFIG:
+        memset(&cfg, 0, sizeof(cfg));
+        mutex_lock(&adev->lock);
+        cfg_snapshot(adev, &cfg);
+        mutex_unlock(&adev->lock);
+        if (copy_to_user(uarg, &cfg, sizeof(cfg)))
+            return -EFAULT;
+        return 0;
+
+    case ANARCHY_IOC_RESET:
+        if (copy_from_user(&rst, uarg, sizeof(rst)))
+            return -EFAULT;
+        ret = anarchy_reset(adev, &rst);
+        if (copy_to_user(uarg, &rst, sizeof(rst)))
+            return -EFAULT;
+        return ret;
+
+    case ANARCHY_IOC_SUBMIT_DMA:
+        if (copy_from_user(&dma, uarg, sizeof(dma)))
+            return -EFAULT;
+        return anarchy_ioctl_submit_dma(adev, &dma);
+
+    case ANARCHY_IOC_SUBSCRIBE:
+        if (get_user(mask, (u32 __user *)uarg))
+            return -EFAULT;
+        WRITE_ONCE(cf->event_mask, mask);
+        return 0;
+
+    case ANARCHY_IOC_QUEUE_SETUP:
+        return anarchy_ioctl_queue_setup(cf, uarg);
+
+    case ANARCHY_IOC_QUEUE_ENTER:
+        return anarchy_ioctl_queue_enter(cf, uarg);
+
+    default:
+        return -ENOTTY;
+    }
+}
+
+static long anarchy_chardev_ioctl(struct file *file, unsigned int cmd,
+                                  unsigned long arg)
+{
+    struct anarchy_chardev_file *cf = file->private_data;
+    long ret;
+    int idx;
+
+    idx = anarchy_chardev_enter(cf->adev);
+    if (idx < 0)
+        return idx;
+    ret = anarchy_chardev_do_ioctl(file, cmd, arg);
+    anarchy_chardev_leave(cf->adev, idx);
+    return ret;
+}
+
+static const struct file_operations anarchy_chardev_fops = {
+    .owner = THIS_MODULE,
+    .open = anarchy_chardev_open,
+    .release = anarchy_chardev_release,
+    .read = anarchy_chardev_read,
+    .poll = anarchy_chardev_poll,
+    .mmap = anarchy_chardev_mmap,
+    .unlocked_ioctl = anarchy_chardev_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+    .llseek = noop_llseek,
+};
+
+int anarchy_chardev_register(struct anarchy_device *adev)
+{
+    if (!adev)
+        return -EINVAL;
+
+    INIT_LIST_HEAD(&adev->event_files);
+    spin_lock_init(&adev->event_lock);
+    mutex_init(&adev->files_lock);
+    adev->unplugged = false;
+
+    adev->miscdev.minor = MISC_DYNAMIC_MINOR;
+    adev->miscdev.name = "anarchy-egpu";
+    adev->miscdev.fops = &anarchy_chardev_fops;
+    adev->miscdev.parent = adev->dev;
+
+    return misc_register(&adev->miscdev);
+}
+EXPORT_SYMBOL_GPL(anarchy_chardev_register);
+
+/*
+ * Files still open keep the structure (see anarchy_device_get()) but must
+ * not reach the device once this returns: new file ops fail, blocked ones
+ * are woken, those in flight are waited for and queue poll threads stop.
+ */
+void anarchy_chardev_unregister(struct anarchy_device *adev)
+{
+    struct anarchy_chardev_file *cf;
+    struct anarchy_queue *q;
+    unsigned long flags;
+
+    if (!adev || !adev->miscdev.fops)
+        return;
+
+    /* No new opens after this */
+    misc_deregister(&adev->miscdev);
+
+    WRITE_ONCE(adev->unplugged, true);
+    spin_lock_irqsave(&adev->event_lock, flags);
+    list_for_each_entry(cf, &adev->event_files, node) {
+        wake_up_interruptible(&cf->wait);
+        q = READ_ONCE(cf->queue);
+        if (q)
+            wake_up_interruptible(&q->cq_wait);
+    }
+    spin_unlock_irqrestore(&adev->event_lock, flags);
+
+    synchronize_srcu(&adev->chardev_srcu);
+
+    /* No setup can be in flight, so the queues seen here are all of them */
+    mutex_lock(&adev->files_lock);
+    list_for_each_entry(cf, &adev->event_files, node)
+        anarchy_queue_shutdown(cf->queue);
+    mutex_unlock(&adev->files_lock);
+
+    adev->miscdev.fops = NULL;
+}
+EXPORT_SYMBOL_GPL(anarchy_chardev_unregister);
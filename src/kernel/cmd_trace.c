@@ -0,0 +1,407 @@
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
+#include <linux/prefetch.h>
+#include <linux/cache.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include "include/anarchy_device.h"
+#include "include/command_types.h"
+#include "include/module_params.h"
+#include "include/cmd_trace.h"
+
+/* Copy in and out of a ring, wrapping at the end */
+static __always_inline void trace_put(struct anarchy_trace_cpu *tc, u64 pos,
+                                      const void *src, u32 len)
+{
+    u32 off = pos & (tc->size - 1);
+    u32 first;
+
+    /* Most copies stop short of the end */
+    if (likely(off + len <= tc->size)) {
+        memcpy(tc->buf + off, src, len);
+        return;
+    }
+    first = tc->size - off;
+    memcpy(tc->buf + off, src, first);
+    memcpy(tc->buf, (const char *)src + first, len - first);
+}
+
+static void trace_get(const struct anarchy_trace_cpu *tc, u64 pos, void *dst, u32 len)
+{
+    u32 off = pos & (tc->size - 1);
+    u32 first = min(len, tc->size - off);
+
+    memcpy(dst, tc->buf + off, first);
+    memcpy((char *)dst + first, tc->buf, len - first);
+}
+
+/*
+ * Reserve @len bytes at head, NULL when the reader is too far behind.
+ * Records are filled where they will be read, through @tmp only when
+ * they wrap: building one on the stack and copying it in costs more
+ * than the rest of the hook, as the wide loads of the copy cannot be
+ * forwarded from the narrow stores that filled in the fields. The
+ * buffer is too big to stay cached between records, so the line after
+ * next is fetched for writing while the submission path runs.
+ */
+static __always_inline struct anarchy_trace_rec *
+trace_reserve(struct anarchy_trace_cpu *tc, u32 len, struct anarchy_trace_rec *tmp)
+{
+    u32 off = tc->head & (tc->size - 1);
+
+    if (tc->head + len - smp_load_acquire(&tc->tail) > tc->size) {
+        tc->lost++;
+        return NULL;
+    }
+    prefetchw(tc->buf + ((off + 2 * L1_CACHE_BYTES) & (tc->size - 1)));
+    if (likely(off + sizeof(*tmp) <= tc->size))
+        return (struct anarchy_trace_rec *)(tc->buf + off);
+    return tmp;
+}
+
+/* Publish a reserved record and its @sample bytes of payload */
+static __always_inline void trace_commit(struct anarchy_trace_cpu *tc,
+                                         const struct anarchy_trace_rec *rec,
+                                         const struct anarchy_trace_rec *tmp,
+                                         const void *data, u16 sample)
+{
+    if (rec == tmp)
+        trace_put(tc, tc->head, tmp, sizeof(*tmp));
+    if (sample)
+        trace_put(tc, tc->head + sizeof(*rec), data, sample);
+    tc->records++;
+    smp_store_release(&tc->head, tc->head + sizeof(*rec) + ALIGN(sample, ANARCHY_TRACE_ALIGN));
+}
+
+/*
+ * Interrupts are off from the reservation to the commit so a completion
+ * on this CPU cannot interleave with the record.
+ */
+void __anarchy_trace_cmd(struct anarchy_device *adev, const struct command_batch *batch)
+{
+    struct anarchy_trace *t = &adev->trace;
+    struct anarchy_trace_rec *rec, tmp;
+    struct anarchy_trace_cpu *tc;
+    unsigned long flags;
+    u64 hash = 0;
+    u16 sample = 0;
+
+    if (batch->data)
+        hash = anarchy_trace_hash(batch->data, batch->total_size);
+
+    local_irq_save(flags);
+    tc = this_cpu_ptr(t->cpus);
+    if (batch->data && t->sample_every && ++tc->sample_seq >= t->sample_every) {
+        tc->sample_seq = 0;
+        sample = min3(batch->total_size, READ_ONCE(t->sample_bytes),
+                      (u32)ANARCHY_TRACE_MAX_SAMPLE);
+    }
+    rec = trace_reserve(tc, sizeof(*rec) + ALIGN(sample, ANARCHY_TRACE_ALIGN), &tmp);
+    if (!rec)
+        goto out;
+    *rec = (struct anarchy_trace_rec) {
+        .ts_ns = ktime_get_ns(),
+        .hash = hash,
+        .size = batch->total_size,
+        .flags = batch->flags,
+        .payload_len = sample,
+        .type = ANARCHY_TRACE_CMD,
+        .category = batch->category,
+        .cpu = smp_processor_id(),
+    };
+    trace_commit(tc, rec, &tmp, batch->data, sample);
+out:
+    local_irq_restore(flags);
+}
+EXPORT_SYMBOL_GPL(__anarchy_trace_cmd);
+
+void __anarchy_trace_xfer(struct anarchy_device *adev, u8 type, size_t size)
+{
+    struct anarchy_trace_rec *rec, tmp;
+    struct anarchy_trace_cpu *tc;
+    unsigned long flags;
+
+    local_irq_save(flags);
+    tc = this_cpu_ptr(adev->trace.cpus);
+    rec = trace_reserve(tc, sizeof(*rec), &tmp);
+    if (!rec)
+        goto out;
+    *rec = (struct anarchy_trace_rec) {
+        .ts_ns = ktime_get_ns(),
+        .size = size,
+        .type = type,
+        .cpu = smp_processor_id(),
+    };
+    trace_commit(tc, rec, &tmp, NULL, 0);
+out:
+    local_irq_restore(flags);
+}
+EXPORT_SYMBOL_GPL(__anarchy_trace_xfer);
+
+size_t anarchy_trace_drain(struct anarchy_device *adev, void *dst, size_t count)
+{
+    struct anarchy_trace *t = &adev->trace;
+    struct anarchy_trace_cpu *tc;
+    struct anarchy_trace_rec rec;
+    size_t copied = 0;
+    u64 head;
+    u32 len;
+    int cpu;
+
+    mutex_lock(&t->lock);
+    if (!t->cpus)
+        goto out;
+
+    for_each_possible_cpu(cpu) {
+        tc = per_cpu_ptr(t->cpus, cpu);
+        head = smp_load_acquire(&tc->head);
+        while (tc->tail < head) {
+            trace_get(tc, tc->tail, &rec, sizeof(rec));
+            len = anarchy_trace_rec_len(&rec);
+            if (copied + len > count)
+                goto out;
+            trace_get(tc, tc->tail, (char *)dst + copied, len);
+            copied += len;
+            smp_store_release(&tc->tail, tc->tail + len);
+        }
+    }
+out:
+    mutex_unlock(&t->lock);
+    return copied;
+}
+EXPORT_SYMBOL_GPL(anarchy_trace_drain);
+
+static void anarchy_trace_free(struct anarchy_trace *t)
+{
+    int cpu;
+
+    if (!t->cpus)
+        return;
+    for_each_possible_cpu(cpu)
+        kvfree(per_cpu_ptr(t->cpus, cpu)->buf);
+    free_percpu(t->cpus);
+    t->cpus = NULL;
+}
+
+static int anarchy_trace_alloc(struct anarchy_trace *t)
+{
+    u32 size = roundup_pow_of_two(max(READ_ONCE(trace_buf_kb), 64u) * 1024);
+    struct anarchy_trace_cpu *tc;
+    int cpu;
+
+    t->cpus = alloc_percpu(struct anarchy_trace_cpu);
+    if (!t->cpus)
+        return -ENOMEM;
+
+    /* Each CPU writes only its own buffer, keep it on its node */
+    for_each_possible_cpu(cpu) {
+        tc = per_cpu_ptr(t->cpus, cpu);
+        tc->buf = kvmalloc_node(size, GFP_KERNEL, cpu_to_node(cpu));
+        if (!tc->buf) {
+            anarchy_trace_free(t);
+            return -ENOMEM;
+        }
+        tc->size = size;
+    }
+    return 0;
+}
+
+int anarchy_trace_enable(struct anarchy_device *adev, bool enable)
+{
+    struct anarchy_trace *t = &adev->trace;
+    int ret = 0;
+
+    mutex_lock(&t->lock);
+    if (enable && !t->cpus)
+        ret = anarchy_trace_alloc(t);
+    if (!ret)
+        WRITE_ONCE(t->enabled, enable);
+    mutex_unlock(&t->lock);
+    return ret;
+}
+EXPORT_SYMBOL_GPL(anarchy_trace_enable);
+
+void anarchy_trace_init(struct anarchy_device *adev)
+{
+    struct anarchy_trace *t = &adev->trace;
+
+    mutex_init(&t->lock);
+    t->enabled = false;
+    t->sample_every = 0;
+    t->sample_bytes = ANARCHY_TRACE_HASH_BYTES;
+    t->cpus = NULL;
+}
+EXPORT_SYMBOL_GPL(anarchy_trace_init);
+
+/* After the submission paths have stopped */
+void anarchy_trace_exit(struct anarchy_device *adev)
+{
+    struct anarchy_trace *t = &adev->trace;
+
+    WRITE_ONCE(t->enabled, false);
+    mutex_lock(&t->lock);
+    anarchy_trace_free(t);
+    mutex_unlock(&t->lock);
+}
+EXPORT_SYMBOL_GPL(anarchy_trace_exit);
+
+#ifdef CONFIG_DEBUG_FS
+
+static u64 anarchy_trace_lost(struct anarchy_trace *t)
+{
+    u64 lost = 0;
+    int cpu;
+
+    if (t->cpus) {
+        for_each_possible_cpu(cpu)
+            lost += READ_ONCE(per_cpu_ptr(t->cpus, cpu)->lost);
+    }
+    return lost;
+}
+
+/* Every open starts with a header */
+struct anarchy_trace_reader {
+    struct anarchy_device *adev;
+    bool header_sent;
+};
+
+static int anarchy_trace_data_open(struct inode *inode, struct file *file)
+{
+    struct anarchy_trace_reader *r = kzalloc(sizeof(*r), GFP_KERNEL);
+
+    if (!r)
+        return -ENOMEM;
+    r->adev = inode->i_private;
+    file->private_data = r;
+    return nonseekable_open(inode, file);
+}
+
+static int anarchy_trace_data_release(struct inode *inode, struct file *file)
+{
+    kfree(file->private_data);
+    return 0;
+}
+
+static ssize_t anarchy_trace_data_read(struct file *file, char __user *ubuf, size_t count,
+                                       loff_t *ppos)
+{
+    struct anarchy_trace_reader *r = file->private_data;
+    struct anarchy_trace_header hdr = {
+        .magic = ANARCHY_TRACE_MAGIC,
+        .version = ANARCHY_TRACE_VERSION,
+        .record_size = sizeof(struct anarchy_trace_rec),
+        .hash_bytes = ANARCHY_TRACE_HASH_BYTES,
+    };
+    ssize_t len;
+    void *buf;
+
+    if (!r->header_sent) {
+        if (count < sizeof(hdr))
+            return -EINVAL;
+        mutex_lock(&r->adev->trace.lock);
+        hdr.lost = anarchy_trace_lost(&r->adev->trace);
+        mutex_unlock(&r->adev->trace.lock);
+        if (copy_to_user(ubuf, &hdr, sizeof(hdr)))
+            return -EFAULT;
+        r->header_sent = true;
+        return sizeof(hdr);
+    }
+
+    /* Whole records only, the largest has a full sample behind it */
+    if (count < sizeof(struct anarchy_trace_rec) + ANARCHY_TRACE_MAX_SAMPLE)
+        return -EINVAL;
+    count = min_t(size_t, count, SZ_1M);
+    buf = kvmalloc(count, GFP_KERNEL);
+    if (!buf)
+        return -ENOMEM;
+    len = anarchy_trace_drain(r->adev, buf, count);
+    if (len && copy_to_user(ubuf, buf, len))
+        len = -EFAULT;
+    kvfree(buf);
+    return len;
+}
+
+static const struct file_operations anarchy_trace_data_fops = {
+    .owner = THIS_MODULE,
+    .open = anarchy_trace_data_open,
+    .release = anarchy_trace_data_release,
+    .read = anarchy_trace_data_read,
+};
+
+static ssize_t anarchy_trace_enable_write(struct file *file, const char __user *ubuf,
+                                          size_t count, loff_t *ppos)
+{
+    struct anarchy_device *adev = file->private_data;
+    bool enable;
+    int ret;
+
+    ret = kstrtobool_from_user(ubuf, count, &enable);
+    if (ret)
+        return ret;
+    ret = anarchy_trace_enable(adev, enable);
+    return ret ? ret : count;
+}
+
+static ssize_t anarchy_trace_enable_read(struct file *file, char __user *ubuf, size_t count,
+                                         loff_t *ppos)
+{
+    struct anarchy_device *adev = file->private_data;
+    char buf[3] = { READ_ONCE(adev->trace.enabled) ? '1' : '0', '\n' };
+
+    return simple_read_from_buffer(ubuf, count, ppos, buf, 2);
+}
+
+static const struct file_operations anarchy_trace_enable_fops = {
+    .owner = THIS_MODULE,
+    .open = simple_open,
+    .read = anarchy_trace_enable_read,
+    .write = anarchy_trace_enable_write,
+    .llseek = default_llseek,
+};
+
+static int anarchy_trace_stats_show(struct seq_file *m, void *unused)
+{
+    struct anarchy_device *adev = m->private;
+    struct anarchy_trace *t = &adev->trace;
+    struct anarchy_trace_cpu *tc;
+    int cpu;
+
+    mutex_lock(&t->lock);
+    seq_printf(m, "enabled %d sample_every %u sample_bytes %u\n", READ_ONCE(t->enabled),
+               t->sample_every, t->sample_bytes);
+    if (t->cpus) {
+        for_each_possible_cpu(cpu) {
+            tc = per_cpu_ptr(t->cpus, cpu);
+            seq_printf(m, "cpu%d records %llu lost %llu used %llu/%u\n", cpu,
+                       READ_ONCE(tc->records), READ_ONCE(tc->lost),
+                       smp_load_acquire(&tc->head) - tc->tail, tc->size);
+        }
+    }
+    mutex_unlock(&t->lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(anarchy_trace_stats);
+
+void anarchy_trace_debugfs_init(struct anarchy_device *adev, struct dentry *parent)
+{
+    struct dentry *dir = debugfs_create_dir("trace", parent);
+
+    debugfs_create_file("enable", 0600, dir, adev, &anarchy_trace_enable_fops);
+    debugfs_create_u32("sample_every", 0600, dir, &adev->trace.sample_every);
+    debugfs_create_u32("sample_bytes", 0600, dir, &adev->trace.sample_bytes);
+    debugfs_create_file("stats", 0444, dir, adev, &anarchy_trace_stats_fops);
+    debugfs_create_file("data", 0400, dir, adev, &anarchy_trace_data_fops);
+}
+
+#else
+
+void anarchy_trace_debugfs_init(struct anarchy_device *adev, struct dentry *parent)
+{
+}
+
+#endif /* CONFIG_DEBUG_FS */
+EXPORT_SYMBOL_GPL(anarchy_trace_debugfs_init);
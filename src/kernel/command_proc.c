@@ -5,6 +5,10 @@
 #include "include/command_proc.h"
 #include "include/dma_config.h"
 #include "include/dma.h"
+#include "include/dma_path.h"
+#include "include/gpu_emu.h"
+#include "include/power_gov.h"
+#include "include/anarchy_events.h"
 
 /* Initialize command processor */
 int init_command_processor(struct anarchy_device *adev)
@@ -66,6 +70,12 @@ int process_game_command(struct anarchy_device *adev, struct command_batch *batc
     if (!cp || !batch)
         return -EINVAL;
 
+    anarchy_trace_cmd(adev, batch);
+
+    /* Frame boundary for the power governor */
+    if (batch->category == CMD_CAT_SYNC)
+        anarchy_power_gov_frame(adev);
+
     /* Handle low latency texture commands immediately */
     if (batch->category == CMD_CAT_TEXTURE &&
         (batch->flags & CMD_FLAG_LOWLAT)) {
@@ -90,25 +100,31 @@ int process_game_command(struct anarchy_device *adev, struct command_batch *batc
         }
 
         merge_command_batch(cp->current_batch, batch);
+        trace_anarchy_cmd_merge(adev, batch->category, batch->flags, batch->total_size,
+                                cp->current_batch->total_size);
     } else {
         /* Process immediately if batching disabled or NOSYNC flag set */
         ret = process_command_batch_immediate(adev, batch);
     }
 
     spin_unlock_irqrestore(&cp->lock, flags);
+
+    /* Accepted work loads the emulated GPU */
+    if (!ret)
+        anarchy_gpu_emu_submit(adev, batch->total_size);
     return ret;
 }
 
 /* Immediate command batch processing */
 int process_command_batch_immediate(struct anarchy_device *adev, struct command_batch *batch)
 {
-    int ret = 0;
+    int ret;
 
     /* TODO: Implement actual command processing
-     * For now just do a DMA transfer */
-    ret = anarchy_dma_transfer(adev, batch->data, batch->total_size);
-
-    return ret;
+     * For now just send it on whichever path suits its size */
+    ret = anarchy_dma_send(adev, batch->data, batch->total_size);
+    trace_anarchy_cmd_flush(adev, batch->category, batch->flags, batch->total_size, ret);
+    return ret ? -EIO : 0;
 }
 
 /* Optimize command processing based on load */
@@ -1,10 +1,13 @@
 #include <linux/module.h>
 #include <linux/device.h>
+#include <linux/slab.h>
 #include "include/anarchy_device.h"
 #include "include/common.h"
 #include "include/pcie_forward.h"
 #include "include/pcie_state.h"
 #include "include/pcie_types.h"
+#include "include/bandwidth.h"
+#include "include/thermal.h"
 
 int anarchy_device_init(struct anarchy_device *adev)
 {
@@ -28,39 +31,78 @@ int anarchy_device_init(struct anarchy_device *adev)
     if (ret)
         goto err_wq;
 
+    /* Shared register sampler, started once its subscribers are in */
+    ret = anarchy_telemetry_init(adev);
+    if (ret)
+        goto err_pcie;
+
+    /* Off until enabled through debugfs, nothing to undo before that */
+    anarchy_trace_init(adev);
+
+    /* Link idle tracking, holds a reference until the device is ready */
+    ret = anarchy_rpm_init(adev);
+    if (ret)
+        goto err_telemetry;
+
     /* Initialize ring buffers */
     ret = anarchy_ring_init(adev, &adev->tx_ring);
     if (ret)
-        goto err_pcie;
+        goto err_rpm;
 
     ret = anarchy_ring_init(adev, &adev->rx_ring);
     if (ret)
         goto err_tx_ring;
 
+    /* Transfer paths, limits measured once the link is up */
+    ret = anarchy_dma_path_init(adev);
+    if (ret)
+        goto err_rx_ring;
+
     /* Initialize performance monitoring */
     ret = anarchy_perf_init(adev);
     if (ret)
-        goto err_rx_ring;
+        goto err_dma_path;
 
     /* Initialize power management */
     ret = anarchy_power_init(adev);
     if (ret)
         goto err_perf;
 
+    /* Frame-aware limits on top of the profile */
+    ret = anarchy_power_gov_init(adev);
+    if (ret)
+        goto err_power;
+
     /* Start performance monitoring */
     ret = anarchy_perf_start(adev);
     if (ret)
-        goto err_power;
+        goto err_power_gov;
+
+    /* Thermal control runs off the telemetry samples */
+    ret = init_thermal_monitoring(adev);
+    if (ret)
+        goto err_perf_start;
 
     /* Train PCIe link */
     ret = anarchy_pcie_train_link(adev);
     if (ret)
-        goto err_perf_start;
+        goto err_thermal;
+
+    /* Sample throughput against the trained link */
+    ret = init_bandwidth_monitoring(adev);
+    if (ret)
+        goto err_pcie_train;
+
+    anarchy_telemetry_start(adev);
+
+    /* Without limits everything is mapped in place, which always works */
+    if (anarchy_dma_path_calibrate(adev))
+        dev_warn(adev->dev, "transfer path calibration failed, using zero-copy\n");
 
     /* Start ring buffers */
     ret = anarchy_ring_start(adev, &adev->tx_ring, true);
     if (ret)
-        goto err_pcie_train;
+        goto err_bandwidth;
 
     ret = anarchy_ring_start(adev, &adev->rx_ring, false);
     if (ret)
@@ -68,22 +110,38 @@ int anarchy_device_init(struct anarchy_device *adev)
 
     adev->state = ANARCHY_DEVICE_STATE_READY;
     adev->flags |= ANARCHY_DEVICE_FLAG_INITIALIZED;
+
+    /* Idle from here on until the first submission */
+    anarchy_rpm_put(adev);
     return 0;
 
 err_tx_start:
     anarchy_ring_stop(adev, &adev->tx_ring);
+err_bandwidth:
+    anarchy_telemetry_stop(adev);
+    cleanup_bandwidth_monitoring(adev);
 err_pcie_train:
     anarchy_pcie_disable(adev);
+err_thermal:
+    cleanup_thermal_monitoring(adev);
 err_perf_start:
     anarchy_perf_stop(adev);
+err_power_gov:
+    anarchy_power_gov_exit(adev);
 err_power:
     anarchy_power_exit(adev);
 err_perf:
     anarchy_perf_exit(adev);
+err_dma_path:
+    anarchy_dma_path_exit(adev);
 err_rx_ring:
     anarchy_ring_cleanup(adev, &adev->rx_ring);
 err_tx_ring:
     anarchy_ring_cleanup(adev, &adev->tx_ring);
+err_rpm:
+    anarchy_rpm_exit(adev);
+err_telemetry:
+    anarchy_telemetry_exit(adev);
 err_pcie:
     anarchy_pcie_exit(adev);
 err_wq:
@@ -98,17 +156,25 @@ void anarchy_device_exit(struct anarchy_device *adev)
         return;
 
     /* Stop services */
+    anarchy_rpm_exit(adev);
+    anarchy_telemetry_stop(adev);
+    cleanup_thermal_monitoring(adev);
     anarchy_perf_stop(adev);
+    cleanup_bandwidth_monitoring(adev);
     anarchy_ring_stop(adev, &adev->tx_ring);
     anarchy_ring_stop(adev, &adev->rx_ring);
     anarchy_pcie_disable(adev);
 
     /* Cleanup subsystems */
+    anarchy_power_gov_exit(adev);
     anarchy_power_exit(adev);
     anarchy_perf_exit(adev);
+    anarchy_dma_path_exit(adev);
     anarchy_ring_cleanup(adev, &adev->rx_ring);
     anarchy_ring_cleanup(adev, &adev->tx_ring);
+    anarchy_telemetry_exit(adev);
     anarchy_pcie_exit(adev);
+    anarchy_trace_exit(adev);
 
     /* Cleanup device */
     if (adev->wq)
@@ -119,6 +185,28 @@ void anarchy_device_exit(struct anarchy_device *adev)
 }
 EXPORT_SYMBOL_GPL(anarchy_device_exit);
 
+static void anarchy_device_release(struct kref *ref)
+{
+    struct anarchy_device *adev = container_of(ref, struct anarchy_device, ref);
+
+    cleanup_srcu_struct(&adev->chardev_srcu);
+    kfree(adev->dev);
+    kfree(adev);
+}
+
+/* Open control files keep the structure, not the device, past removal */
+void anarchy_device_get(struct anarchy_device *adev)
+{
+    kref_get(&adev->ref);
+}
+EXPORT_SYMBOL_GPL(anarchy_device_get);
+
+void anarchy_device_put(struct anarchy_device *adev)
+{
+    kref_put(&adev->ref, anarchy_device_release);
+}
+EXPORT_SYMBOL_GPL(anarchy_device_put);
+
 int anarchy_device_connect(struct anarchy_device *adev)
 {
     int ret;
@@ -133,6 +221,10 @@ int anarchy_device_connect(struct anarchy_device *adev)
     if (ret)
         goto unlock;
 
+    /* Another dock or cable, measure it again */
+    if (anarchy_dma_path_calibrate(adev))
+        dev_warn(adev->dev, "transfer path calibration failed, keeping the last limits\n");
+
     /* Start ring buffers */
     ret = anarchy_ring_start(adev, &adev->tx_ring, true);
     if (ret)
@@ -178,10 +270,13 @@ int anarchy_device_suspend(struct anarchy_device *adev)
     if (!adev)
         return -EINVAL;
 
+    /* Out of link idle, and kept out until resume */
+    anarchy_rpm_get(adev);
+
     mutex_lock(&adev->lock);
 
-    /* Stop performance monitoring */
-    anarchy_perf_stop(adev);
+    /* No register reads while the link is down */
+    anarchy_telemetry_stop(adev);
 
     /* Stop ring buffers */
     anarchy_ring_stop(adev, &adev->tx_ring);
@@ -219,23 +314,21 @@ int anarchy_device_resume(struct anarchy_device *adev)
     if (ret)
         goto stop_tx;
 
-    /* Resume performance monitoring */
-    ret = anarchy_perf_start(adev);
-    if (ret)
-        goto stop_rx;
+    /* Resume register sampling */
+    anarchy_telemetry_start(adev);
 
     adev->flags &= ~ANARCHY_DEVICE_FLAG_SUSPENDED;
     mutex_unlock(&adev->lock);
+    anarchy_rpm_put(adev);
     return 0;
 
-stop_rx:
-    anarchy_ring_stop(adev, &adev->rx_ring);
 stop_tx:
     anarchy_ring_stop(adev, &adev->tx_ring);
 disable_pcie:
     anarchy_pcie_disable(adev);
 unlock:
     mutex_unlock(&adev->lock);
+    anarchy_rpm_put(adev);
     return ret;
 }
 EXPORT_SYMBOL_GPL(anarchy_device_resume);
@@ -3,6 +3,7 @@
 #include "include/anarchy_device.h"
 #include "include/dma.h"
 #include "include/dma_types.h"
+#include "include/gpu_emu.h"
 
 /* DMA Register definitions */
 #define DMA_REG_BASE          0x10000
@@ -28,6 +29,9 @@ dma_addr_t anarchy_dma_transfer(struct anarchy_device *adev, void *data, size_t
     if (dma_mapping_error(&adev->pdev->dev, dma_addr))
         return 0;
 
+    /* Traced at submission, the way commands and ring transfers are */
+    anarchy_trace_xfer(adev, ANARCHY_TRACE_DMA, size);
+
     /* Start the transfer using device-specific function */
     ret = anarchy_dma_device_start_transfer(adev, 0, dma_addr, 0, size);
     if (ret) {
@@ -35,6 +39,7 @@ dma_addr_t anarchy_dma_transfer(struct anarchy_device *adev, void *data, size_t
         return 0;
     }
 
+    anarchy_gpu_emu_dma(adev, size, 0);
     return dma_addr;
 }
 
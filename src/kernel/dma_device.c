@@ -6,6 +6,7 @@
 #include "include/anarchy_device.h"
 #include "include/dma.h"
 #include "include/dma_types.h"
+#include "include/anarchy_events.h"
 
 /* DMA device-specific registers */
 #define DMA_DEV_CTRL_REG     0x20000
@@ -25,6 +26,13 @@
 #define DMA_CFG_PREFETCH     BIT(0)
 #define DMA_CFG_WRITE_COMB   BIT(1)
 
+/*
+ * Completion poll interval, about the time the transfer takes on the wire
+ * at 4 KiB/us, so small transfers are not held for a whole millisecond.
+ */
+#define DMA_POLL_MIN_US      1
+#define DMA_POLL_MAX_US      1000
+
 int anarchy_dma_device_start_transfer(struct anarchy_device *adev, int channel,
                                     dma_addr_t addr, u32 offset, size_t size)
 {
@@ -39,21 +47,20 @@ int anarchy_dma_device_start_transfer(struct anarchy_device *adev, int channel,
     writel(size, adev->mmio_base + DMA_DEV_SIZE_REG);
 
     /* Start the transfer */
+    trace_anarchy_dma_start(adev, channel, addr + offset, size);
     writel(DMA_CTRL_START, adev->mmio_base + DMA_DEV_CTRL_REG);
 
     /* Wait for completion or error */
     ret = readl_poll_timeout(adev->mmio_base + DMA_DEV_STATUS_REG,
                            status,
                            (status & (DMA_CTRL_COMPLETE | DMA_CTRL_ERROR)),
-                           1000, 1000000);
-
-    if (ret)
-        return ret;
-
-    if (status & DMA_CTRL_ERROR)
-        return -EIO;
+                           clamp_t(unsigned long, size >> 12, DMA_POLL_MIN_US, DMA_POLL_MAX_US),
+                           1000000);
+    if (!ret && (status & DMA_CTRL_ERROR))
+        ret = -EIO;
 
-    return 0;
+    trace_anarchy_dma_complete(adev, channel, addr + offset, size, ret);
+    return ret;
 }
 EXPORT_SYMBOL_GPL(anarchy_dma_device_start_transfer);
 
@@ -0,0 +1,313 @@
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/io.h>
+#include <linux/ktime.h>
+#include <linux/dma-mapping.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include "include/anarchy_device.h"
+#include "include/dma.h"
+#include "include/dma_path.h"
+#include "include/gpu_emu.h"
+#include "include/module_params.h"
+#include "include/upload.h"
+
+/* PIO window in BAR0, writing the length hands its contents to the device */
+#define DMA_PIO_WINDOW        0x30000
+#define DMA_DEV_PIO_LEN_REG   0x2001C
+
+#define DMA_PATH_PROBE_MIN    64
+#define DMA_PATH_PROBE_REPS   3         /* Best of, the link has jitter */
+
+static const char * const dma_path_names[ANARCHY_DMA_PATH_COUNT] = {
+    [ANARCHY_DMA_PATH_PIO] = "pio",
+    [ANARCHY_DMA_PATH_BOUNCE] = "bounce",
+    [ANARCHY_DMA_PATH_ZEROCOPY] = "zerocopy",
+};
+
+const char *anarchy_dma_path_name(enum anarchy_dma_path_kind kind)
+{
+    return kind < ANARCHY_DMA_PATH_COUNT ? dma_path_names[kind] : "unknown";
+}
+EXPORT_SYMBOL_GPL(anarchy_dma_path_name);
+
+static int dma_path_pio(struct anarchy_device *adev, const void *data, size_t size)
+{
+    void __iomem *win = adev->mmio_base + DMA_PIO_WINDOW;
+    size_t words = size / 4;
+    u32 tail = 0;
+
+    if (adev->upload.pio) {
+        /* Fenced, so the data is ahead of the length in the UC mapping */
+        anarchy_memcpy_toio_nt(adev->upload.pio, data, size);
+    } else {
+        __iowrite32_copy(win, data, words);
+        if (size % 4) {
+            memcpy(&tail, (const u8 *)data + words * 4, size % 4);
+            writel(tail, win + words * 4);
+        }
+    }
+    writel(size, adev->mmio_base + DMA_DEV_PIO_LEN_REG);
+
+    /* Posted writes have landed once a read behind them returns */
+    readl(adev->mmio_base + DMA_DEV_PIO_LEN_REG);
+    return 0;
+}
+
+static int dma_path_bounce(struct anarchy_device *adev, const void *data, size_t size)
+{
+    struct anarchy_dma_path *path = &adev->dma_path;
+    int ret;
+
+    /* One buffer; whoever finds it taken maps in place instead */
+    if (test_and_set_bit_lock(0, &path->bounce_busy))
+        return -EBUSY;
+    memcpy(path->bounce, data, size);
+    ret = anarchy_dma_device_start_transfer(adev, 0, path->bounce_dma, 0, size);
+    clear_bit_unlock(0, &path->bounce_busy);
+    return ret;
+}
+
+static int dma_path_zerocopy(struct anarchy_device *adev, const void *data, size_t size)
+{
+    struct device *dev = &adev->pdev->dev;
+    dma_addr_t addr;
+    int ret;
+
+    addr = dma_map_single(dev, (void *)data, size, DMA_TO_DEVICE);
+    if (dma_mapping_error(dev, addr))
+        return -ENOMEM;
+    ret = anarchy_dma_device_start_transfer(adev, 0, addr, 0, size);
+    dma_unmap_single(dev, addr, size, DMA_TO_DEVICE);
+    return ret;
+}
+
+static bool dma_path_fits(const struct anarchy_dma_path *path,
+                          enum anarchy_dma_path_kind kind, size_t size)
+{
+    switch (kind) {
+    case ANARCHY_DMA_PATH_PIO:
+        return size <= ANARCHY_DMA_PIO_WINDOW_SIZE;
+    case ANARCHY_DMA_PATH_BOUNCE:
+        return path->bounce && size <= ANARCHY_DMA_BOUNCE_SIZE;
+    default:
+        return true;
+    }
+}
+
+static int dma_path_run(struct anarchy_device *adev, enum anarchy_dma_path_kind kind,
+                        const void *data, size_t size)
+{
+    switch (kind) {
+    case ANARCHY_DMA_PATH_PIO:
+        return dma_path_pio(adev, data, size);
+    case ANARCHY_DMA_PATH_BOUNCE:
+        return dma_path_bounce(adev, data, size);
+    default:
+        return dma_path_zerocopy(adev, data, size);
+    }
+}
+
+enum anarchy_dma_path_kind anarchy_dma_path_select(struct anarchy_device *adev, size_t size)
+{
+    struct anarchy_dma_path *path = &adev->dma_path;
+
+    /* Limits may be written through debugfs, the buffers bound them */
+    if (size <= min_t(u32, READ_ONCE(path->pio_max), ANARCHY_DMA_PIO_WINDOW_SIZE))
+        return ANARCHY_DMA_PATH_PIO;
+    if (size <= READ_ONCE(path->bounce_max) && dma_path_fits(path, ANARCHY_DMA_PATH_BOUNCE, size))
+        return ANARCHY_DMA_PATH_BOUNCE;
+    return ANARCHY_DMA_PATH_ZEROCOPY;
+}
+EXPORT_SYMBOL_GPL(anarchy_dma_path_select);
+
+int anarchy_dma_send(struct anarchy_device *adev, const void *data, size_t size)
+{
+    struct anarchy_dma_path_stats *st;
+    enum anarchy_dma_path_kind kind;
+    u64 start, ns;
+    int ret;
+
+    if (!adev || !data || !size)
+        return -EINVAL;
+
+    /* Traced at submission, the way commands and ring transfers are */
+    anarchy_trace_xfer(adev, ANARCHY_TRACE_DMA, size);
+
+    kind = anarchy_dma_path_select(adev, size);
+    start = ktime_get_ns();
+    ret = dma_path_run(adev, kind, data, size);
+    if (ret == -EBUSY && kind == ANARCHY_DMA_PATH_BOUNCE) {
+        kind = ANARCHY_DMA_PATH_ZEROCOPY;
+        ret = dma_path_run(adev, kind, data, size);
+    }
+    if (ret)
+        return ret;
+    ns = ktime_get_ns() - start;
+
+    st = &adev->dma_path.stats[kind];
+    atomic64_inc(&st->hits);
+    atomic64_add(size, &st->bytes);
+    atomic64_add(ns, &st->ns);
+    if (ns > READ_ONCE(st->max_ns))
+        WRITE_ONCE(st->max_ns, ns);
+
+    anarchy_gpu_emu_dma(adev, size, 0);
+    return 0;
+}
+EXPORT_SYMBOL_GPL(anarchy_dma_send);
+
+/*
+ * Probe payloads are zeroes, which the command processor takes as NOPs.
+ * PIO is used while it beats both DMA paths, then the bounce buffer while
+ * it keeps up with mapping in place. Ties go to the bounce buffer: a
+ * mapping costs IOMMU and IOTLB work the clock does not always see.
+ */
+int anarchy_dma_path_calibrate(struct anarchy_device *adev)
+{
+    struct anarchy_dma_path *path = &adev->dma_path;
+    u64 (*probe)[ANARCHY_DMA_PATH_PROBES] = path->probe_ns;
+    u32 size, pio_max = 0, bounce_max;
+    unsigned int i, kind, rep;
+    u64 t, best;
+    void *buf;
+    int ret = 0;
+
+    if (path->pinned)
+        return 0;
+
+    buf = kzalloc(ANARCHY_DMA_BOUNCE_SIZE, GFP_KERNEL);
+    if (!buf)
+        return -ENOMEM;
+
+    for (i = 0, size = DMA_PATH_PROBE_MIN; i < ANARCHY_DMA_PATH_PROBES; i++, size *= 2) {
+        for (kind = 0; kind < ANARCHY_DMA_PATH_COUNT; kind++) {
+            probe[kind][i] = 0;
+            if (!dma_path_fits(path, kind, size))
+                continue;
+            best = U64_MAX;
+            for (rep = 0; rep < DMA_PATH_PROBE_REPS; rep++) {
+                t = ktime_get_ns();
+                ret = dma_path_run(adev, kind, buf, size);
+                if (ret)
+                    goto out;
+                best = min(best, ktime_get_ns() - t);
+            }
+            probe[kind][i] = max_t(u64, best, 1);
+        }
+    }
+
+    for (i = 0, size = DMA_PATH_PROBE_MIN; i < ANARCHY_DMA_PATH_PROBES; i++, size *= 2) {
+        if (!probe[ANARCHY_DMA_PATH_PIO][i] ||
+            (probe[ANARCHY_DMA_PATH_BOUNCE][i] &&
+             probe[ANARCHY_DMA_PATH_PIO][i] >= probe[ANARCHY_DMA_PATH_BOUNCE][i]) ||
+            probe[ANARCHY_DMA_PATH_PIO][i] >= probe[ANARCHY_DMA_PATH_ZEROCOPY][i])
+            break;
+        pio_max = size;
+    }
+    bounce_max = pio_max;
+    for (; i < ANARCHY_DMA_PATH_PROBES; i++, size *= 2) {
+        if (!probe[ANARCHY_DMA_PATH_BOUNCE][i] ||
+            probe[ANARCHY_DMA_PATH_BOUNCE][i] > probe[ANARCHY_DMA_PATH_ZEROCOPY][i])
+            break;
+        bounce_max = size;
+    }
+
+    WRITE_ONCE(path->pio_max, pio_max);
+    WRITE_ONCE(path->bounce_max, bounce_max);
+    path->calibrated_ns = ktime_get_ns();
+    dev_info(adev->dev, "transfers: PIO up to %u B, bounce buffer up to %u B\n",
+             pio_max, bounce_max);
+out:
+    kfree(buf);
+    return ret;
+}
+EXPORT_SYMBOL_GPL(anarchy_dma_path_calibrate);
+
+int anarchy_dma_path_init(struct anarchy_device *adev)
+{
+    struct anarchy_dma_path *path = &adev->dma_path;
+
+    memset(path, 0, sizeof(*path));
+
+    /* Either limit given on the command line pins both, unset ones mean off */
+    path->pinned = dma_pio_max >= 0 || dma_bounce_max >= 0;
+    if (path->pinned) {
+        path->pio_max = max(dma_pio_max, 0);
+        path->bounce_max = max(dma_bounce_max, 0);
+    }
+
+    path->bounce = dma_alloc_coherent(&adev->pdev->dev, ANARCHY_DMA_BOUNCE_SIZE,
+                                      &path->bounce_dma, GFP_KERNEL);
+    return path->bounce ? 0 : -ENOMEM;
+}
+EXPORT_SYMBOL_GPL(anarchy_dma_path_init);
+
+void anarchy_dma_path_exit(struct anarchy_device *adev)
+{
+    struct anarchy_dma_path *path = &adev->dma_path;
+
+    if (path->bounce)
+        dma_free_coherent(&adev->pdev->dev, ANARCHY_DMA_BOUNCE_SIZE, path->bounce,
+                          path->bounce_dma);
+    path->bounce = NULL;
+    path->pio_max = 0;
+    path->bounce_max = 0;
+}
+EXPORT_SYMBOL_GPL(anarchy_dma_path_exit);
+
+#ifdef CONFIG_DEBUG_FS
+
+static int anarchy_dma_path_stats_show(struct seq_file *m, void *unused)
+{
+    struct anarchy_device *adev = m->private;
+    struct anarchy_dma_path *path = &adev->dma_path;
+    struct anarchy_dma_path_stats *st;
+    unsigned int i, kind;
+    u64 hits;
+
+    seq_printf(m, "pio_max %u bounce_max %u pinned %d\n", READ_ONCE(path->pio_max),
+               READ_ONCE(path->bounce_max), path->pinned);
+    seq_printf(m, "%-9s %12s %14s %10s %10s\n", "path", "hits", "bytes", "avg_ns", "max_ns");
+    for (kind = 0; kind < ANARCHY_DMA_PATH_COUNT; kind++) {
+        st = &path->stats[kind];
+        hits = atomic64_read(&st->hits);
+        seq_printf(m, "%-9s %12llu %14llu %10llu %10llu\n", dma_path_names[kind], hits,
+                   atomic64_read(&st->bytes),
+                   hits ? div64_u64(atomic64_read(&st->ns), hits) : 0,
+                   READ_ONCE(st->max_ns));
+    }
+
+    if (!path->calibrated_ns)
+        return 0;
+    seq_printf(m, "calibration ns\n%-9s", "bytes");
+    for (kind = 0; kind < ANARCHY_DMA_PATH_COUNT; kind++)
+        seq_printf(m, " %10s", dma_path_names[kind]);
+    for (i = 0; i < ANARCHY_DMA_PATH_PROBES; i++) {
+        seq_printf(m, "\n%-9u", DMA_PATH_PROBE_MIN << i);
+        for (kind = 0; kind < ANARCHY_DMA_PATH_COUNT; kind++)
+            seq_printf(m, " %10llu", path->probe_ns[kind][i]);
+    }
+    seq_putc(m, '\n');
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(anarchy_dma_path_stats);
+
+void anarchy_dma_path_debugfs_init(struct anarchy_device *adev, struct dentry *parent)
+{
+    struct dentry *dir = debugfs_create_dir("dma_path", parent);
+
+    debugfs_create_u32("pio_max", 0600, dir, &adev->dma_path.pio_max);
+    debugfs_create_u32("bounce_max", 0600, dir, &adev->dma_path.bounce_max);
+    debugfs_create_bool("pinned", 0600, dir, &adev->dma_path.pinned);
+    debugfs_create_file("stats", 0444, dir, adev, &anarchy_dma_path_stats_fops);
+}
+
+#else
+
+void anarchy_dma_path_debugfs_init(struct anarchy_device *adev, struct dentry *parent)
+{
+}
+
+#endif /* CONFIG_DEBUG_FS */
+EXPORT_SYMBOL_GPL(anarchy_dma_path_debugfs_init);
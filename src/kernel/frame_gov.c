@@ -0,0 +1,214 @@
+#include "include/frame_gov.h"
+
+/*
+ * A frame starts at each sync/present. The GPU is busy for roughly
+ * util% of the frame interval, so the governor keeps the profile clocks
+ * for that long (plus margin and jitter) and relaxes for the rest, where
+ * the clock no longer affects when the frame lands. Boosting costs power
+ * roughly with the cube of the clock, so it is kept for frames at risk:
+ * the previous one came in late, or this one is running late. Those run
+ * boosted up to the next sync, at the boost clock within the ceiling;
+ * power over the ceiling (boost_w) is opt-in and never past power_max.
+ */
+
+/* Intervals needed before the loop is trusted */
+#define FRAME_GOV_WARMUP    4
+
+void frame_gov_default_params(struct frame_gov_params *p)
+{
+    p->boost_w = 0;
+    p->relax_w = 40;
+    p->power_min = 50;
+    p->power_max = 175;
+    p->clock_base = 1800;
+    p->clock_boost = 2400;
+    p->clock_relax = 1200;
+    p->boost_util = 90;
+    p->margin_pct = 25;
+    p->min_period_us = 2000;        /* 500 fps */
+    p->max_period_us = 100000;      /* 10 fps */
+}
+
+void frame_gov_init(struct frame_gov *gov, const struct frame_gov_params *p)
+{
+    gov->p = *p;
+    gov->level = FRAME_GOV_IDLE;
+    gov->last_sync_us = 0;
+    gov->period_us = 0;
+    gov->jitter_us = 0;
+    gov->util = 0;
+    gov->window_end_us = 0;
+    gov->late = false;
+    gov->frames = 0;
+    gov->late_frames = 0;
+    gov->windows = 0;
+    gov->boosts = 0;
+    gov->rescues = 0;
+}
+
+static void frame_gov_restart(struct frame_gov *gov)
+{
+    gov->level = FRAME_GOV_IDLE;
+    gov->frames = 0;
+    gov->period_us = 0;
+    gov->jitter_us = 0;
+    gov->late = false;
+}
+
+/* The window covers the whole interval */
+static bool frame_gov_full_window(const struct frame_gov *gov)
+{
+    return gov->window_end_us - gov->last_sync_us >= gov->period_us;
+}
+
+/* When the current frame counts as late, see frame_gov_interval() */
+static u64 frame_gov_late_us(const struct frame_gov *gov)
+{
+    return gov->last_sync_us + gov->period_us + 2 * gov->jitter_us;
+}
+
+static void frame_gov_interval(struct frame_gov *gov, unsigned int interval)
+{
+    unsigned int dev;
+
+    if (!gov->frames) {
+        gov->period_us = interval;
+        gov->jitter_us = interval / 8;
+    } else {
+        gov->late = interval > gov->period_us + 2 * gov->jitter_us;
+        if (gov->late)
+            gov->late_frames++;
+        dev = interval > gov->period_us ? interval - gov->period_us :
+                                          gov->period_us - interval;
+        /* EWMAs over eight frames */
+        gov->period_us = gov->period_us - gov->period_us / 8 + interval / 8;
+        gov->jitter_us = gov->jitter_us - gov->jitter_us / 8 + dev / 8;
+    }
+    gov->frames++;
+}
+
+enum frame_gov_level frame_gov_sync(struct frame_gov *gov, u64 now_us)
+{
+    u64 interval = gov->last_sync_us ? now_us - gov->last_sync_us : 0;
+    unsigned int window;
+
+    /* Several syncs in one frame: the first one counts */
+    if (gov->last_sync_us && interval < gov->p.min_period_us)
+        return gov->level;
+
+    gov->last_sync_us = now_us;
+    if (!interval || interval > gov->p.max_period_us) {
+        frame_gov_restart(gov);
+        return gov->level;
+    }
+
+    frame_gov_interval(gov, (unsigned int)interval);
+    if (gov->frames < FRAME_GOV_WARMUP)
+        return gov->level;
+
+    /* Unknown load or no slack: cover the whole interval */
+    if (!gov->util || gov->util >= gov->p.boost_util) {
+        window = gov->period_us;
+    } else {
+        window = (u64)gov->period_us * gov->util * (100 + gov->p.margin_pct) / 10000 +
+                 2 * gov->jitter_us;
+        if (window > gov->period_us)
+            window = gov->period_us;
+    }
+
+    /*
+     * A late frame behind a cap leaves the next one short of time. Without
+     * slack the loop is GPU bound and only the late frame's tail is boosted.
+     */
+    if (gov->late && window < gov->period_us) {
+        gov->level = FRAME_GOV_BOOST;
+        gov->boosts++;
+        return gov->level;
+    }
+
+    gov->window_end_us = now_us + window;
+    gov->level = FRAME_GOV_RUN;
+    gov->windows++;
+    return gov->level;
+}
+
+void frame_gov_util(struct frame_gov *gov, unsigned int util)
+{
+    gov->util = util > 100 ? 100 : util;
+}
+
+enum frame_gov_level frame_gov_tick(struct frame_gov *gov, u64 now_us)
+{
+    if (gov->level == FRAME_GOV_IDLE)
+        return gov->level;
+
+    if (now_us - gov->last_sync_us > gov->p.max_period_us) {
+        frame_gov_restart(gov);
+    } else if (gov->level == FRAME_GOV_RUN && frame_gov_full_window(gov)) {
+        /* No slack to relax in, boost only once the frame is late */
+        if (now_us >= frame_gov_late_us(gov)) {
+            gov->level = FRAME_GOV_BOOST;
+            gov->rescues++;
+        }
+    } else if (gov->level == FRAME_GOV_RUN && now_us >= gov->window_end_us) {
+        gov->level = FRAME_GOV_RELAX;
+    } else if (gov->level == FRAME_GOV_RELAX &&
+             now_us - gov->last_sync_us >= gov->period_us - gov->period_us / 8) {
+        /* Nearly due and no sync yet: the frame may still be rendering */
+        gov->level = FRAME_GOV_BOOST;
+        gov->rescues++;
+    }
+    return gov->level;
+}
+
+u64 frame_gov_next_event(const struct frame_gov *gov)
+{
+    switch (gov->level) {
+    case FRAME_GOV_RUN:
+        return frame_gov_full_window(gov) ? frame_gov_late_us(gov) : gov->window_end_us;
+    case FRAME_GOV_RELAX:
+        return gov->last_sync_us + gov->period_us - gov->period_us / 8;
+    case FRAME_GOV_BOOST:
+        return gov->last_sync_us + gov->p.max_period_us + 1;
+    default:
+        return 0;
+    }
+}
+
+unsigned int frame_gov_power(const struct frame_gov *gov, unsigned int ceiling,
+                             bool throttled)
+{
+    const struct frame_gov_params *p = &gov->p;
+    unsigned int limit = ceiling;
+
+    switch (gov->level) {
+    case FRAME_GOV_BOOST:
+        /* Never boost past a thermal cut */
+        if (!throttled)
+            limit = ceiling + p->boost_w;
+        break;
+    case FRAME_GOV_RELAX:
+        limit = ceiling > p->relax_w ? ceiling - p->relax_w : 0;
+        break;
+    default:
+        break;
+    }
+
+    if (limit > p->power_max)
+        limit = p->power_max;
+    if (limit < p->power_min)
+        limit = p->power_min;
+    return limit;
+}
+
+unsigned int frame_gov_clock(const struct frame_gov *gov)
+{
+    switch (gov->level) {
+    case FRAME_GOV_BOOST:
+        return gov->p.clock_boost;
+    case FRAME_GOV_RELAX:
+        return gov->p.clock_relax;
+    default:
+        return gov->p.clock_base;
+    }
+}
@@ -4,12 +4,15 @@
 #include <linux/workqueue.h>
 #include <linux/slab.h>
 #include <linux/pci.h>
+#include <linux/iopoll.h>
+#include <linux/math64.h>
 
 #include "anarchy-egpu.h"
 #include "anarchy-gpu.h"
 #include "anarchy-debug.h"
 #include "anarchy-perf.h"
 #include "pcie.h"
+#include "include/gpu_reset.h"
 
 /* Maximum number of reset attempts before giving up */
 #define ANARCHY_GPU_MAX_RESETS 3
@@ -114,22 +117,67 @@ static void anarchy_gpu_reset_work(struct work_struct *work)
     }
 }
 
+static int anarchy_gpu_reset_read(void *ctx, u32 reg, u32 *val)
+{
+    return anarchy_pcie_read_config(ctx, reg, 4, val);
+}
+
+static int anarchy_gpu_reset_write(void *ctx, u32 reg, u32 val)
+{
+    return anarchy_pcie_write_config(ctx, reg, 4, val);
+}
+
+static u64 anarchy_gpu_reset_now_us(void *ctx)
+{
+    return div_u64(ktime_get_ns(), NSEC_PER_USEC);
+}
+
+static void anarchy_gpu_reset_wait_us(void *ctx, unsigned int us)
+{
+    fsleep(us);
+}
+
+static const struct reset_ops anarchy_gpu_reset_ops = {
+    .read = anarchy_gpu_reset_read,
+    .write = anarchy_gpu_reset_write,
+    .now_us = anarchy_gpu_reset_now_us,
+    .wait_us = anarchy_gpu_reset_wait_us,
+};
+
+/* Returns as soon as the link is up */
+static int anarchy_gpu_reset_wait_link(void *ctx)
+{
+    struct anarchy_device *adev = ctx;
+    int link, ret;
+
+    ret = read_poll_timeout(anarchy_pcie_check_link, link, !link,
+                            USEC_PER_MSEC, GPU_LINK_TIMEOUT * USEC_PER_MSEC,
+                            false, adev);
+    if (ret)
+        dev_err(adev->dev, "PCIe link did not come back: %d\n", link);
+    return ret;
+}
+
 /**
  * anarchy_gpu_reset - Perform GPU reset sequence
  * @adev: Anarchy device structure
  *
- * This function implements the actual GPU reset sequence, including:
- * 1. PCIe link reset
- * 2. GPU power state management
+ * The rings are checkpointed rather than stopped: submissions see -EBUSY
+ * and retry, and descriptors the device had not completed are replayed
+ * once the GPU is idle again, so a hang costs the frames in flight a
+ * delay instead of losing them. The sequence itself, in gpu_reset.c, is:
+ * 1. PCIe link check
+ * 2. D3/D0 power cycle
  * 3. Memory controller reset
  * 4. Engine reset
- * 5. State recovery
+ * 5. Ring restore and replay
  */
 int anarchy_gpu_reset(struct anarchy_device *adev)
 {
-    unsigned long flags, timeout;
-    int ret = 0;
-    u32 status;
+    struct anarchy_gpu_reset_report rep;
+    unsigned long flags;
+    ktime_t start;
+    int ret;
 
     if (!adev)
         return -EINVAL;
@@ -139,143 +187,18 @@ int anarchy_gpu_reset(struct anarchy_device *adev)
     spin_unlock_irqrestore(&adev->gpu_reset_lock, flags);
 
     dev_info(adev->dev, "Starting GPU reset sequence\n");
+    start = ktime_get();
 
-    /* Stop all DMA transfers */
-    anarchy_ring_stop(adev, &adev->tx_ring);
-    anarchy_ring_stop(adev, &adev->rx_ring);
-
-    /* Step 1: PCIe link reset */
-    dev_dbg(adev->dev, "Resetting PCIe link\n");
-    ret = anarchy_pcie_check_link(adev);
-    if (ret) {
-        dev_err(adev->dev, "PCIe link reset failed: %d\n", ret);
-        goto fail;
-    }
-
-    /* Wait for PCIe link to stabilize */
-    msleep(GPU_LINK_TIMEOUT);
-
-    /* Step 2: Power state management */
-    dev_dbg(adev->dev, "Managing GPU power state\n");
-    
-    /* Mask all interrupts during reset */
-    ret = anarchy_pcie_write_config(adev, GPU_INTR_MASK_REG, 4, 0xFFFFFFFF);
+    ret = anarchy_gpu_reset_rings(adev, &anarchy_gpu_reset_ops, adev,
+                                  anarchy_gpu_reset_wait_link, &rep);
     if (ret) {
-        dev_err(adev->dev, "Failed to mask interrupts: %d\n", ret);
-        goto fail;
-    }
-
-    /* Force GPU to D3 state */
-    ret = anarchy_pcie_write_config(adev, PCI_POWER_CONTROL, 4, GPU_POWER_D3);
-    if (ret) {
-        dev_err(adev->dev, "Failed to set D3 state: %d\n", ret);
-        goto fail;
-    }
-
-    msleep(100);
-
-    /* Bring GPU back to D0 state */
-    ret = anarchy_pcie_write_config(adev, PCI_POWER_CONTROL, 4, GPU_POWER_D0);
-    if (ret) {
-        dev_err(adev->dev, "Failed to set D0 state: %d\n", ret);
-        goto fail;
-    }
-
-    /* Wait for power state transition */
-    timeout = jiffies + msecs_to_jiffies(GPU_INIT_TIMEOUT);
-    while (time_before(jiffies, timeout)) {
-        ret = anarchy_pcie_read_config(adev, PCI_POWER_STATUS, 4, &status);
-        if (ret) {
-            dev_err(adev->dev, "Failed to read power status: %d\n", ret);
-            goto fail;
-        }
-        
-        if ((status & GPU_POWER_STATE_MASK) == GPU_POWER_D0)
-            break;
-            
-        msleep(10);
-    }
-
-    if ((status & GPU_POWER_STATE_MASK) != GPU_POWER_D0) {
-        dev_err(adev->dev, "GPU failed to enter D0 state\n");
-        ret = -ETIMEDOUT;
-        goto fail;
-    }
-
-    /* Step 3: Memory controller reset */
-    dev_dbg(adev->dev, "Resetting memory controller\n");
-    ret = anarchy_pcie_write_config(adev, GPU_MEM_CTRL_RESET, 4, GPU_MEM_RESET_BIT);
-    if (ret) {
-        dev_err(adev->dev, "Failed to assert memory reset: %d\n", ret);
-        goto fail;
-    }
-
-    msleep(100);
-
-    ret = anarchy_pcie_write_config(adev, GPU_MEM_CTRL_RESET, 4, 0);
-    if (ret) {
-        dev_err(adev->dev, "Failed to deassert memory reset: %d\n", ret);
-        goto fail;
-    }
-
-    /* Step 4: Engine reset */
-    dev_dbg(adev->dev, "Resetting GPU engines\n");
-    ret = anarchy_pcie_write_config(adev, GPU_ENGINE_CTRL_RESET, 4, GPU_ENGINE_RESET_BIT);
-    if (ret) {
-        dev_err(adev->dev, "Failed to assert engine reset: %d\n", ret);
-        goto fail;
-    }
-
-    msleep(100);
-
-    ret = anarchy_pcie_write_config(adev, GPU_ENGINE_CTRL_RESET, 4, 0);
-    if (ret) {
-        dev_err(adev->dev, "Failed to deassert engine reset: %d\n", ret);
-        goto fail;
-    }
-
-    /* Step 5: Restart DMA rings */
-    dev_dbg(adev->dev, "Restarting DMA rings\n");
-    ret = anarchy_ring_start(adev, &adev->tx_ring, true);
-    if (ret) {
-        dev_err(adev->dev, "Failed to restart TX ring: %d\n", ret);
-        goto fail;
-    }
-
-    ret = anarchy_ring_start(adev, &adev->rx_ring, false);
-    if (ret) {
-        dev_err(adev->dev, "Failed to restart RX ring: %d\n", ret);
-        anarchy_ring_stop(adev, &adev->tx_ring);
-        goto fail;
-    }
-
-    /* Step 6: Wait for GPU to become responsive */
-    dev_dbg(adev->dev, "Waiting for GPU to initialize\n");
-    timeout = jiffies + msecs_to_jiffies(GPU_INIT_TIMEOUT);
-    while (time_before(jiffies, timeout)) {
-        ret = anarchy_pcie_read_config(adev, GPU_STATUS_REG, 4, &status);
-        if (ret) {
-            dev_err(adev->dev, "Failed to read GPU status: %d\n", ret);
-            goto fail_rings;
-        }
-            
-        if ((status & GPU_ENGINE_STATE_MASK) == GPU_ENGINE_IDLE)
-            break;
-            
-        msleep(10);
-    }
-
-    if ((status & GPU_ENGINE_STATE_MASK) != GPU_ENGINE_IDLE) {
-        dev_err(adev->dev, "GPU failed to enter idle state\n");
-        ret = -ETIMEDOUT;
-        goto fail_rings;
-    }
-
-    /* Step 7: Restore interrupt mask */
-    ret = anarchy_pcie_write_config(adev, GPU_INTR_MASK_REG, 4, 0);
-    if (ret) {
-        dev_err(adev->dev, "Failed to restore interrupt mask: %d\n", ret);
-        goto fail_rings;
+        spin_lock_irqsave(&adev->gpu_reset_lock, flags);
+        adev->gpu_errors.reset_state = ANARCHY_GPU_RESET_FAILED;
+        spin_unlock_irqrestore(&adev->gpu_reset_lock, flags);
+        dev_err(adev->dev, "GPU reset failed at '%s' with error %d after %lld us, "
+                "%d TX %d RX in flight lost\n", rep.failed, ret,
+                ktime_us_delta(ktime_get(), start), rep.tx_inflight, rep.rx_inflight);
+        return ret;
     }
 
     spin_lock_irqsave(&adev->gpu_reset_lock, flags);
@@ -283,18 +206,11 @@ int anarchy_gpu_reset(struct anarchy_device *adev)
     adev->gpu_errors.last_reset_time = ktime_get();
     spin_unlock_irqrestore(&adev->gpu_reset_lock, flags);
 
-    dev_info(adev->dev, "GPU reset sequence completed successfully\n");
+    dev_info(adev->dev,
+             "GPU reset completed in %lld us (%u polls), replayed %d/%d TX %d/%d RX\n",
+             ktime_us_delta(ktime_get(), start), rep.seq.polls,
+             rep.tx_replayed, rep.tx_inflight, rep.rx_replayed, rep.rx_inflight);
     return 0;
-
-fail_rings:
-    anarchy_ring_stop(adev, &adev->rx_ring);
-    anarchy_ring_stop(adev, &adev->tx_ring);
-fail:
-    spin_lock_irqsave(&adev->gpu_reset_lock, flags);
-    adev->gpu_errors.reset_state = ANARCHY_GPU_RESET_FAILED;
-    spin_unlock_irqrestore(&adev->gpu_reset_lock, flags);
-    dev_err(adev->dev, "GPU reset sequence failed with error %d\n", ret);
-    return ret;
 }
 
 /**
@@ -1,73 +1,234 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/io.h>
 #include "include/gpu_emu.h"
 #include "include/gpu_power.h"  // Added for GPU_POWER_LIMIT_* constants
 
-/* GPU Access Functions */
-u32 anarchy_gpu_get_clock(struct anarchy_device *adev)
+#include "include/endpoint.h"
+
+/* Emulated BAR0 register */
+struct gpu_emu_reg {
+    u32 offset;
+    const char *name;
+    /*
+     * Reads return the u32 at @field of the published perf state unless
+     * @read computes the value from it. Both run lock-free and may run
+     * more than once per access, so they must not have side effects.
+     */
+    size_t field;
+    u32 (*read)(const struct gpu_emu_perf_state *perf);
+    /*
+     * Registers without @write are read-only. Writes run under emu->lock
+     * with the model brought up to now, and are published afterwards.
+     */
+    int (*write)(struct gpu_emu_interface *emu, u32 value);
+};
+
+#define GPU_EMU_REG_RO(off, fld) \
+    { .offset = (off), .name = #off, .field = offsetof(struct gpu_emu_perf_state, fld) }
+#define GPU_EMU_REG_RW(off, fld, wr) \
+    { .offset = (off), .name = #off, .field = offsetof(struct gpu_emu_perf_state, fld), \
+      .write = (wr) }
+#define GPU_EMU_REG_FN(off, rd, wr) \
+    { .offset = (off), .name = #off, .read = (rd), .write = (wr) }
+
+static int gpu_emu_write_clock(struct gpu_emu_interface *emu, u32 value)
 {
-    if (!adev || !adev->gpu_emu)
-        return 0;
-    return adev->gpu_emu->perf.gpu_clock;
+    gpu_model_set_clock(&emu->model, value);
+    return 0;
 }
-EXPORT_SYMBOL_GPL(anarchy_gpu_get_clock);
 
-u32 anarchy_gpu_get_mem_clock(struct anarchy_device *adev)
+static int gpu_emu_write_mem_clock(struct gpu_emu_interface *emu, u32 value)
 {
-    if (!adev || !adev->gpu_emu)
-        return 0;
-    return adev->gpu_emu->perf.mem_clock;
+    emu->config.mem_clock = value;
+    return 0;
 }
-EXPORT_SYMBOL_GPL(anarchy_gpu_get_mem_clock);
 
-u32 anarchy_gpu_get_power(struct anarchy_device *adev)
+static int gpu_emu_write_fan(struct gpu_emu_interface *emu, u32 value)
 {
-    if (!adev || !adev->gpu_emu)
-        return 0;
-    return adev->gpu_emu->perf.power_draw;
+    gpu_model_set_fan(&emu->model, value);
+    return 0;
 }
-EXPORT_SYMBOL_GPL(anarchy_gpu_get_power);
 
-u32 anarchy_gpu_get_temp(struct anarchy_device *adev)
+/*
+ * Watts. PWR_LIMIT_OFFSET only latches the limit and reads back what was
+ * latched; writing 1 to PWR_LIMIT_UPDATE hands it to the model, and the
+ * status half reads back the limit in force.
+ */
+static int gpu_emu_write_limit(struct gpu_emu_interface *emu, u32 value)
 {
-    if (!adev || !adev->gpu_emu)
-        return 0;
-    return adev->gpu_emu->perf.temperature;
+    if (value < GPU_POWER_LIMIT_MIN || value > GPU_POWER_LIMIT_MAX)
+        return -EINVAL;
+    emu->limit_latched = value;
+    return 0;
 }
-EXPORT_SYMBOL_GPL(anarchy_gpu_get_temp);
 
-u32 anarchy_gpu_get_fan(struct anarchy_device *adev)
+static u32 gpu_emu_read_limit_status(const struct gpu_emu_perf_state *perf)
 {
-    if (!adev || !adev->gpu_emu)
-        return 0;
-    return adev->gpu_emu->perf.fan_speed;
+    return perf->power_limit & 0xFFFF;
 }
-EXPORT_SYMBOL_GPL(anarchy_gpu_get_fan);
 
-u32 anarchy_gpu_get_util(struct anarchy_device *adev)
+static int gpu_emu_write_limit_apply(struct gpu_emu_interface *emu, u32 value)
 {
-    if (!adev || !adev->gpu_emu)
-        return 0;
-    return adev->gpu_emu->perf.gpu_util;
+    if (value & GPU_EMU_LIMIT_APPLY)
+        gpu_model_set_power_limit(&emu->model, emu->limit_latched * 1000);
+    return 0;
 }
-EXPORT_SYMBOL_GPL(anarchy_gpu_get_util);
 
-u32 anarchy_gpu_get_mem_util(struct anarchy_device *adev)
+/* Sorted by offset, checked once at init */
+static const struct gpu_emu_reg gpu_emu_regs[] = {
+    GPU_EMU_REG_RW(GPU_EMU_CLOCK_OFFSET, gpu_clock, gpu_emu_write_clock),
+    GPU_EMU_REG_RW(GPU_EMU_MEM_OFFSET, mem_clock, gpu_emu_write_mem_clock),
+    GPU_EMU_REG_RO(GPU_EMU_POWER_OFFSET, power_draw),
+    GPU_EMU_REG_RO(GPU_EMU_TEMP_OFFSET, temperature),
+    GPU_EMU_REG_RW(GPU_EMU_FAN_OFFSET, fan_speed, gpu_emu_write_fan),
+    GPU_EMU_REG_RO(GPU_UTIL_OFFSET, gpu_util),
+    GPU_EMU_REG_RO(MEM_UTIL_OFFSET, mem_util),
+    GPU_EMU_REG_RO(VRAM_USED_OFFSET, vram_used),
+    GPU_EMU_REG_RO(GPU_PCIE_RX_COUNTER, pcie_rx),
+    GPU_EMU_REG_RO(GPU_PCIE_TX_COUNTER, pcie_tx),
+    GPU_EMU_REG_RW(PWR_LIMIT_OFFSET, limit_latched, gpu_emu_write_limit),
+    GPU_EMU_REG_FN(PWR_LIMIT_UPDATE, gpu_emu_read_limit_status, gpu_emu_write_limit_apply),
+};
+
+static int gpu_emu_check_regs(void)
 {
-    if (!adev || !adev->gpu_emu)
-        return 0;
-    return adev->gpu_emu->perf.mem_util;
+    const struct gpu_emu_reg *reg;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(gpu_emu_regs); i++) {
+        reg = &gpu_emu_regs[i];
+        if (reg->offset >= ENDPOINT_BAR0_SIZE || reg->offset & 3 ||
+            (i && reg->offset <= gpu_emu_regs[i - 1].offset)) {
+            pr_err("anarchy: gpu_emu register %s at 0x%x is out of order or outside BAR0\n",
+                   reg->name, reg->offset);
+            return -EINVAL;
+        }
+    }
+    return 0;
 }
-EXPORT_SYMBOL_GPL(anarchy_gpu_get_mem_util);
 
-u32 anarchy_gpu_get_vram_used(struct anarchy_device *adev)
+/* BAR0 is 16 MB and almost all of it unused: binary search the table */
+static const struct gpu_emu_reg *gpu_emu_find_reg(u32 offset)
 {
-    if (!adev || !adev->gpu_emu)
-        return 0;
-    return adev->gpu_emu->perf.vram_used;
+    int lo = 0, hi = ARRAY_SIZE(gpu_emu_regs) - 1;
+
+    if (offset >= ENDPOINT_BAR0_SIZE || offset & 3)
+        return NULL;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+
+        if (gpu_emu_regs[mid].offset == offset)
+            return &gpu_emu_regs[mid];
+        if (gpu_emu_regs[mid].offset < offset)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return NULL;
+}
+
+/*
+ * Copy the model into emu->perf for readers, with emu->lock held. The
+ * model only moves while the emulator runs.
+ */
+static void gpu_emu_sync(struct gpu_emu_interface *emu)
+{
+    struct gpu_model *m = &emu->model;
+    u64 now = ktime_get_ns();
+
+    if (emu->state == GPU_EMU_STATE_RUNNING)
+        gpu_model_advance(m, now);
+
+    write_seqcount_begin(&emu->seq);
+    emu->perf.gpu_clock = m->clock;
+    emu->perf.mem_clock = emu->config.mem_clock;
+    emu->perf.power_draw = m->power_mw / 1000;
+    emu->perf.temperature = max(gpu_model_temp_mc(m), 0) / 1000;
+    emu->perf.fan_speed = m->fan;
+    emu->perf.gpu_util = m->util / 10;
+    emu->perf.mem_util = m->util * m->p.mem_util_share / 10000;
+    emu->perf.pcie_rx = m->pcie_rx;
+    emu->perf.pcie_tx = m->pcie_tx;
+    emu->perf.power_limit = m->power_limit_mw / 1000;
+    emu->perf.limit_latched = emu->limit_latched;
+    write_seqcount_end(&emu->seq);
+    WRITE_ONCE(emu->synced_ns, now);
+}
+
+/*
+ * Readers share whatever was published in the last GPU_EMU_SYNC_NS. When
+ * it is older, one of them brings it forward; the rest do not wait for it.
+ */
+static void gpu_emu_refresh(struct gpu_emu_interface *emu)
+{
+    unsigned long flags;
+
+    if (READ_ONCE(emu->state) != GPU_EMU_STATE_RUNNING ||
+        ktime_get_ns() - READ_ONCE(emu->synced_ns) < GPU_EMU_SYNC_NS)
+        return;
+    if (!spin_trylock_irqsave(&emu->lock, flags))
+        return;
+    gpu_emu_sync(emu);
+    spin_unlock_irqrestore(&emu->lock, flags);
+}
+
+static u32 gpu_emu_read_reg(struct gpu_emu_interface *emu, const struct gpu_emu_reg *reg)
+{
+    unsigned int seq;
+    u32 val;
+
+    gpu_emu_refresh(emu);
+    do {
+        seq = read_seqcount_begin(&emu->seq);
+        if (reg->read)
+            val = reg->read(&emu->perf);
+        else
+            val = READ_ONCE(*(u32 *)((char *)&emu->perf + reg->field));
+    } while (read_seqcount_retry(&emu->seq, seq));
+    return val;
+}
+
+static int gpu_emu_write_reg(struct gpu_emu_interface *emu, const struct gpu_emu_reg *reg,
+                             u32 value)
+{
+    unsigned long flags;
+    int ret;
+
+    if (!reg->write)
+        return -EPERM;
+
+    spin_lock_irqsave(&emu->lock, flags);
+    if (emu->state == GPU_EMU_STATE_RUNNING)
+        gpu_model_advance(&emu->model, ktime_get_ns());
+    ret = reg->write(emu, value);
+    gpu_emu_sync(emu);
+    spin_unlock_irqrestore(&emu->lock, flags);
+    return ret;
 }
-EXPORT_SYMBOL_GPL(anarchy_gpu_get_vram_used);
+
+/* One register of the published state */
+#define GPU_EMU_GETTER(name, off)                                   \
+u32 name(struct anarchy_device *adev)                               \
+{                                                                   \
+    if (!adev || !adev->gpu_emu)                                    \
+        return 0;                                                   \
+    return gpu_emu_read_reg(adev->gpu_emu, gpu_emu_find_reg(off));  \
+}                                                                   \
+EXPORT_SYMBOL_GPL(name)
+
+/* GPU Access Functions */
+GPU_EMU_GETTER(anarchy_gpu_get_clock, GPU_EMU_CLOCK_OFFSET);
+GPU_EMU_GETTER(anarchy_gpu_get_mem_clock, GPU_EMU_MEM_OFFSET);
+GPU_EMU_GETTER(anarchy_gpu_get_power, GPU_EMU_POWER_OFFSET);
+GPU_EMU_GETTER(anarchy_gpu_get_temp, GPU_EMU_TEMP_OFFSET);
+GPU_EMU_GETTER(anarchy_gpu_get_fan, GPU_EMU_FAN_OFFSET);
+GPU_EMU_GETTER(anarchy_gpu_get_util, GPU_UTIL_OFFSET);
+GPU_EMU_GETTER(anarchy_gpu_get_mem_util, MEM_UTIL_OFFSET);
+GPU_EMU_GETTER(anarchy_gpu_get_vram_used, VRAM_USED_OFFSET);
 
 /* GPU Control Functions */
 int anarchy_gpu_set_fan_speed(struct anarchy_device *adev, u32 speed)
@@ -76,28 +237,47 @@ int anarchy_gpu_set_fan_speed(struct anarchy_device *adev, u32 speed)
         return -EINVAL;
     if (speed > 100)
         return -EINVAL;
-    adev->gpu_emu->perf.fan_speed = speed;
-    return 0;
+    return gpu_emu_write_reg(adev->gpu_emu, gpu_emu_find_reg(GPU_EMU_FAN_OFFSET), speed);
 }
 EXPORT_SYMBOL_GPL(anarchy_gpu_set_fan_speed);
 
 int anarchy_gpu_emu_set_power_limit(struct anarchy_device *adev, u32 limit)
 {
+    struct gpu_emu_interface *emu;
+    unsigned long flags;
+    int ret;
+
     if (!adev || !adev->gpu_emu)
         return -EINVAL;
-    if (limit < GPU_POWER_LIMIT_MIN || limit > GPU_POWER_LIMIT_MAX)
-        return -EINVAL;
-    adev->gpu_emu->perf.power_draw = limit;
-    return 0;
+    emu = adev->gpu_emu;
+    /* A limit, not a draw: the model settles under it. Latch and apply as one */
+    spin_lock_irqsave(&emu->lock, flags);
+    if (emu->state == GPU_EMU_STATE_RUNNING)
+        gpu_model_advance(&emu->model, ktime_get_ns());
+    ret = gpu_emu_write_limit(emu, limit);
+    if (!ret)
+        gpu_emu_write_limit_apply(emu, GPU_EMU_LIMIT_APPLY);
+    gpu_emu_sync(emu);
+    spin_unlock_irqrestore(&emu->lock, flags);
+    return ret;
 }
 EXPORT_SYMBOL_GPL(anarchy_gpu_emu_set_power_limit);
 
 int anarchy_gpu_set_clocks(struct anarchy_device *adev, u32 gpu_clock, u32 mem_clock)
 {
+    struct gpu_emu_interface *emu;
+    unsigned long flags;
+
     if (!adev || !adev->gpu_emu)
         return -EINVAL;
-    adev->gpu_emu->perf.gpu_clock = gpu_clock;
-    adev->gpu_emu->perf.mem_clock = mem_clock;
+    emu = adev->gpu_emu;
+    spin_lock_irqsave(&emu->lock, flags);
+    if (emu->state == GPU_EMU_STATE_RUNNING)
+        gpu_model_advance(&emu->model, ktime_get_ns());
+    gpu_emu_write_clock(emu, gpu_clock);
+    gpu_emu_write_mem_clock(emu, mem_clock);
+    gpu_emu_sync(emu);
+    spin_unlock_irqrestore(&emu->lock, flags);
     return 0;
 }
 EXPORT_SYMBOL_GPL(anarchy_gpu_set_clocks);
@@ -105,11 +285,17 @@ EXPORT_SYMBOL_GPL(anarchy_gpu_set_clocks);
 /* Emulation Functions */
 int anarchy_gpu_emu_init(struct anarchy_device *adev)
 {
+    struct gpu_model_params params;
     struct gpu_emu_interface *emu;
+    int ret;
 
     if (!adev)
         return -EINVAL;
 
+    ret = gpu_emu_check_regs();
+    if (ret)
+        return ret;
+
     emu = kzalloc(sizeof(*emu), GFP_KERNEL);
     if (!emu)
         return -ENOMEM;
@@ -117,6 +303,7 @@ int anarchy_gpu_emu_init(struct anarchy_device *adev)
     emu->adev = adev;
     emu->state = GPU_EMU_STATE_INIT;
     spin_lock_init(&emu->lock);
+    seqcount_init(&emu->seq);
 
     /* Set default configuration */
     emu->config.enabled = true;
@@ -126,6 +313,14 @@ int anarchy_gpu_emu_init(struct anarchy_device *adev)
     emu->config.base_clock = 1410;
     emu->config.boost_clock = 1665;
     emu->config.mem_clock = 1750;
+    emu->config.work_ns_per_kib = 1000;
+
+    gpu_model_default_params(&params);
+    params.base_clock = emu->config.base_clock;
+    params.boost_clock = emu->config.boost_clock;
+    gpu_model_init(&emu->model, &params);
+    emu->limit_latched = emu->model.power_limit_mw / 1000;
+    gpu_emu_sync(emu);
 
     adev->gpu_emu = emu;
     return 0;
@@ -137,6 +332,8 @@ void anarchy_gpu_emu_exit(struct anarchy_device *adev)
     if (!adev || !adev->gpu_emu)
         return;
 
+    if (adev->gpu_emu->fb_base)
+        iounmap(adev->gpu_emu->fb_base);
     kfree(adev->gpu_emu);
     adev->gpu_emu = NULL;
 }
@@ -144,90 +341,113 @@ EXPORT_SYMBOL_GPL(anarchy_gpu_emu_exit);
 
 int anarchy_gpu_emu_start(struct anarchy_device *adev)
 {
+    struct gpu_emu_interface *emu;
+    unsigned long flags;
+
     if (!adev || !adev->gpu_emu)
         return -EINVAL;
-    adev->gpu_emu->state = GPU_EMU_STATE_RUNNING;
+    emu = adev->gpu_emu;
+    spin_lock_irqsave(&emu->lock, flags);
+    /* Time stopped does not count */
+    emu->model.primed = false;
+    WRITE_ONCE(emu->state, GPU_EMU_STATE_RUNNING);
+    gpu_emu_sync(emu);
+    spin_unlock_irqrestore(&emu->lock, flags);
     return 0;
 }
 EXPORT_SYMBOL_GPL(anarchy_gpu_emu_start);
 
 int anarchy_gpu_emu_stop(struct anarchy_device *adev)
 {
+    struct gpu_emu_interface *emu;
+    unsigned long flags;
+
     if (!adev || !adev->gpu_emu)
         return -EINVAL;
-    adev->gpu_emu->state = GPU_EMU_STATE_DISABLED;
+    emu = adev->gpu_emu;
+    spin_lock_irqsave(&emu->lock, flags);
+    gpu_emu_sync(emu);
+    WRITE_ONCE(emu->state, GPU_EMU_STATE_DISABLED);
+    spin_unlock_irqrestore(&emu->lock, flags);
     return 0;
 }
 EXPORT_SYMBOL_GPL(anarchy_gpu_emu_stop);
 
 int anarchy_gpu_emu_handle_mmio(struct gpu_emu_interface *emu, u32 offset, u32 *value, bool is_write)
-{    
+{
+    const struct gpu_emu_reg *reg;
+
     if (!emu || !value)
         return -EINVAL;
-    
-    if (is_write) {
-        switch (offset) {
-        case GPU_EMU_CLOCK_OFFSET:
-            emu->perf.gpu_clock = *value;
-            break;
-        case GPU_EMU_MEM_OFFSET:
-            emu->perf.mem_clock = *value;
-            break;
-        case GPU_EMU_POWER_OFFSET:
-            emu->perf.power_draw = *value;
-            break;
-        case GPU_EMU_FAN_OFFSET:
-            emu->perf.fan_speed = *value;
-            break;
-        default:
-            return -EINVAL;
-        }
-    } else {
-        switch (offset) {
-        case GPU_EMU_CLOCK_OFFSET:
-            *value = emu->perf.gpu_clock;
-            break;
-        case GPU_EMU_MEM_OFFSET:
-            *value = emu->perf.mem_clock;
-            break;
-        case GPU_EMU_POWER_OFFSET:
-            *value = emu->perf.power_draw;
-            break;
-        case GPU_EMU_TEMP_OFFSET:
-            *value = emu->perf.temperature;
-            break;
-        case GPU_EMU_FAN_OFFSET:
-            *value = emu->perf.fan_speed;
-            break;
-        case GPU_UTIL_OFFSET:
-            *value = emu->perf.gpu_util;
-            break;
-        case MEM_UTIL_OFFSET:
-            *value = emu->perf.mem_util;
-            break;
-        case VRAM_USED_OFFSET:
-            *value = emu->perf.vram_used;
-            break;
-        default:
-            return -EINVAL;
-        }
-    }
-    
+
+    reg = gpu_emu_find_reg(offset);
+    if (!reg)
+        return -EINVAL;
+
+    if (is_write)
+        return gpu_emu_write_reg(emu, reg, *value);
+    *value = gpu_emu_read_reg(emu, reg);
     return 0;
 }
 EXPORT_SYMBOL_GPL(anarchy_gpu_emu_handle_mmio);
 
+/* @addr is a bus address; the framebuffer only ever takes bulk stores */
 int anarchy_gpu_emu_map_memory(struct anarchy_device *adev, u64 addr, size_t size)
 {
-    if (!adev || !adev->gpu_emu)
+    struct gpu_emu_interface *emu;
+    void __iomem *fb;
+
+    if (!adev || !adev->gpu_emu || !size)
         return -EINVAL;
-    
-    adev->gpu_emu->fb_base = (void *)addr;
-    adev->gpu_emu->fb_size = size;
+    emu = adev->gpu_emu;
+
+    fb = ioremap_wc(addr, size);
+    if (!fb)
+        return -ENOMEM;
+    if (emu->fb_base)
+        iounmap(emu->fb_base);
+    emu->fb_base = fb;
+    emu->fb_size = size;
     return 0;
 }
 EXPORT_SYMBOL_GPL(anarchy_gpu_emu_map_memory);
 
+void anarchy_gpu_emu_submit(struct anarchy_device *adev, size_t bytes)
+{
+    struct gpu_emu_interface *emu;
+    unsigned long flags;
+
+    if (!adev || !adev->gpu_emu)
+        return;
+    emu = adev->gpu_emu;
+    spin_lock_irqsave(&emu->lock, flags);
+    if (emu->state == GPU_EMU_STATE_RUNNING) {
+        gpu_model_advance(&emu->model, ktime_get_ns());
+        gpu_model_submit(&emu->model,
+                         (u64)bytes * emu->config.work_ns_per_kib / 1024);
+        gpu_emu_sync(emu);
+    }
+    spin_unlock_irqrestore(&emu->lock, flags);
+}
+EXPORT_SYMBOL_GPL(anarchy_gpu_emu_submit);
+
+void anarchy_gpu_emu_dma(struct anarchy_device *adev, u32 rx_bytes, u32 tx_bytes)
+{
+    struct gpu_emu_interface *emu;
+    unsigned long flags;
+
+    if (!adev || !adev->gpu_emu)
+        return;
+    emu = adev->gpu_emu;
+    spin_lock_irqsave(&emu->lock, flags);
+    if (emu->state == GPU_EMU_STATE_RUNNING) {
+        gpu_model_dma(&emu->model, rx_bytes, tx_bytes);
+        gpu_emu_sync(emu);
+    }
+    spin_unlock_irqrestore(&emu->lock, flags);
+}
+EXPORT_SYMBOL_GPL(anarchy_gpu_emu_dma);
+
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Anarchy eGPU Team");
 MODULE_DESCRIPTION("GPU Emulation Layer for Anarchy eGPU Driver");
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include "include/gpu_model.h"
+
+/* Integration step while busy, and once work and utilization died down */
+#define STEP_BUSY_US        1000
+#define STEP_IDLE_US        100000
+
+/* Longer gaps are integrated as this long, the die has settled by then */
+#define MAX_GAP_NS          (600ULL * 1000000000ULL)
+
+void gpu_model_default_params(struct gpu_model_params *p)
+{
+    p->base_clock = 1410;
+    p->boost_clock = 1665;
+    p->clock_bin = 15;
+    p->idle_mw = 25000;
+    p->max_mw = 250000;
+    p->ambient_mc = 25000;
+    p->slowdown_mc = 90000;
+    /* Same cooler as tests/sim/thermal_sim */
+    p->heat_capacity = 400000;
+    p->g_base = 1200;
+    p->g_per_fan = 35;
+    p->util_tau_us = 100000;
+    p->mem_util_share = 600;
+    p->max_backlog_ns = 1000000000ULL;
+}
+
+void gpu_model_init(struct gpu_model *m, const struct gpu_model_params *p)
+{
+    *m = (struct gpu_model){ .p = *p };
+    m->clock_req = p->boost_clock;
+    m->clock = p->boost_clock;
+    m->power_limit_mw = p->max_mw;
+    m->fan = 30;
+    m->power_mw = p->idle_mw;
+    m->temp_uc = (s64)p->ambient_mc * 1000;
+}
+
+/* Draw at @clock with the current utilization */
+static u32 gpu_model_power_at(const struct gpu_model *m, u32 clock)
+{
+    u64 b3 = (u64)m->p.boost_clock * m->p.boost_clock * m->p.boost_clock;
+    u64 f3 = (u64)clock * clock * clock;
+    u64 dyn = (u64)(m->p.max_mw - m->p.idle_mw) * m->util / 1000;
+
+    return m->p.idle_mw + (u32)(dyn * f3 / b3);
+}
+
+/* One boost decision per elapsed millisecond, a bin at a time */
+static void gpu_model_boost(struct gpu_model *m, u32 dt_us)
+{
+    u32 floor = m->p.base_clock / 2;
+    u32 n = dt_us / 1000 ? dt_us / 1000 : 1;
+    bool hot = gpu_model_temp_mc(m) >= m->p.slowdown_mc;
+
+    if (m->clock > m->clock_req)
+        m->clock = m->clock_req;
+
+    while (n--) {
+        if (hot || gpu_model_power_at(m, m->clock) > m->power_limit_mw) {
+            if (m->clock <= floor)
+                break;
+            m->clock = m->clock - m->p.clock_bin > floor ? m->clock - m->p.clock_bin : floor;
+        } else if (m->clock < m->clock_req &&
+                   gpu_model_power_at(m, m->clock + m->p.clock_bin) <= m->power_limit_mw) {
+            m->clock = m->clock + m->p.clock_bin < m->clock_req ?
+                       m->clock + m->p.clock_bin : m->clock_req;
+        } else {
+            break;
+        }
+    }
+}
+
+static void gpu_model_step(struct gpu_model *m, u32 dt_us)
+{
+    u64 dt_ns = (u64)dt_us * 1000;
+    u64 cap, done, busy;
+    s64 g, q;
+    u32 inst;
+
+    /* Work drains at the effective clock */
+    cap = dt_ns * m->clock / m->p.boost_clock;
+    done = m->backlog_ns < cap ? m->backlog_ns : cap;
+    m->backlog_ns -= done;
+    busy = m->clock ? done * m->p.boost_clock / m->clock : 0;
+    inst = (u32)(busy * 1000 / dt_ns);
+    if (inst > 1000)
+        inst = 1000;
+
+    if (dt_us >= m->p.util_tau_us) {
+        m->util_q = inst * 1000;
+    } else {
+        s64 diff = (s64)inst * 1000 - m->util_q;
+
+        m->util_q += (s64)(diff * dt_us / m->p.util_tau_us);
+    }
+    m->util = m->util_q / 1000;
+
+    gpu_model_boost(m, dt_us);
+    m->power_mw = gpu_model_power_at(m, m->clock);
+
+    /* mW * us / (mJ/K) is microkelvin */
+    g = m->p.g_base + (s64)m->p.g_per_fan * m->fan;
+    q = m->power_mw - g * (m->temp_uc - (s64)m->p.ambient_mc * 1000) / 1000000;
+    q = q * dt_us + m->heat_rem;
+    m->temp_uc += q / m->p.heat_capacity;
+    m->heat_rem = q % m->p.heat_capacity;
+}
+
+void gpu_model_advance(struct gpu_model *m, u64 now_ns)
+{
+    u64 left_us;
+    u32 step;
+
+    if (!m->primed) {
+        m->primed = true;
+        m->last_ns = now_ns;
+        return;
+    }
+    if (now_ns <= m->last_ns)
+        return;
+    if (now_ns - m->last_ns > MAX_GAP_NS)
+        m->last_ns = now_ns - MAX_GAP_NS;
+
+    left_us = (now_ns - m->last_ns) / 1000;
+    while (left_us) {
+        step = m->backlog_ns || m->util ? STEP_BUSY_US : STEP_IDLE_US;
+        if (step > left_us)
+            step = (u32)left_us;
+        gpu_model_step(m, step);
+        left_us -= step;
+        m->last_ns += (u64)step * 1000;
+    }
+}
+
+void gpu_model_submit(struct gpu_model *m, u64 work_ns)
+{
+    m->backlog_ns += work_ns;
+    if (m->backlog_ns > m->p.max_backlog_ns) {
+        m->dropped_ns += m->backlog_ns - m->p.max_backlog_ns;
+        m->backlog_ns = m->p.max_backlog_ns;
+    }
+}
+
+void gpu_model_dma(struct gpu_model *m, u32 rx_bytes, u32 tx_bytes)
+{
+    m->pcie_rx += rx_bytes;
+    m->pcie_tx += tx_bytes;
+}
+
+void gpu_model_set_clock(struct gpu_model *m, u32 mhz)
+{
+    if (mhz > m->p.boost_clock)
+        mhz = m->p.boost_clock;
+    if (mhz < m->p.base_clock / 2)
+        mhz = m->p.base_clock / 2;
+    m->clock_req = mhz;
+    if (m->clock > mhz)
+        m->clock = mhz;
+}
+
+void gpu_model_set_power_limit(struct gpu_model *m, u32 mw)
+{
+    m->power_limit_mw = mw;
+}
+
+void gpu_model_set_fan(struct gpu_model *m, u32 percent)
+{
+    m->fan = percent > 100 ? 100 : percent;
+}
@@ -0,0 +1,89 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include "include/anarchy_device.h"
+#include "include/ring.h"
+#include "include/gpu_reset.h"
+#include "../../include/anarchy-gpu.h"
+
+/*
+ * Reset steps after the link is back. Each one waits for the GPU to
+ * acknowledge rather than sleeping a fixed time, so a reset costs what
+ * the hardware needs, typically a few milliseconds.
+ */
+const struct reset_step anarchy_gpu_reset_steps[] = {
+    { "mask interrupts", GPU_INTR_MASK_REG, 0xFFFFFFFF, 0, 0, 0, 0 },
+    { "enter D3", PCI_POWER_CONTROL, GPU_POWER_D3,
+      PCI_POWER_STATUS, GPU_POWER_STATE_MASK, GPU_POWER_D3,
+      GPU_D3_TIMEOUT * USEC_PER_MSEC },
+    { "enter D0", PCI_POWER_CONTROL, GPU_POWER_D0,
+      PCI_POWER_STATUS, GPU_POWER_STATE_MASK, GPU_POWER_D0,
+      GPU_INIT_TIMEOUT * USEC_PER_MSEC },
+    { "assert memory reset", GPU_MEM_CTRL_RESET, GPU_MEM_RESET_BIT,
+      GPU_MEM_CTRL_RESET, GPU_MEM_RESET_ACK, GPU_MEM_RESET_ACK,
+      GPU_RESET_ACK_TIMEOUT * USEC_PER_MSEC },
+    { "deassert memory reset", GPU_MEM_CTRL_RESET, 0,
+      GPU_MEM_CTRL_RESET, GPU_MEM_RESET_ACK, 0,
+      GPU_RESET_ACK_TIMEOUT * USEC_PER_MSEC },
+    { "assert engine reset", GPU_ENGINE_CTRL_RESET, GPU_ENGINE_RESET_BIT,
+      GPU_ENGINE_CTRL_RESET, GPU_ENGINE_RESET_ACK, GPU_ENGINE_RESET_ACK,
+      GPU_RESET_ACK_TIMEOUT * USEC_PER_MSEC },
+    { "deassert engine reset", GPU_ENGINE_CTRL_RESET, 0,
+      GPU_STATUS_REG, GPU_ENGINE_STATE_MASK, GPU_ENGINE_IDLE,
+      GPU_INIT_TIMEOUT * USEC_PER_MSEC },
+};
+const unsigned int anarchy_gpu_reset_nsteps = ARRAY_SIZE(anarchy_gpu_reset_steps);
+EXPORT_SYMBOL_GPL(anarchy_gpu_reset_steps);
+EXPORT_SYMBOL_GPL(anarchy_gpu_reset_nsteps);
+
+int anarchy_gpu_reset_rings(struct anarchy_device *adev, const struct reset_ops *ops,
+                            void *ctx, int (*wait_link)(void *ctx),
+                            struct anarchy_gpu_reset_report *rep)
+{
+    int ret;
+
+    if (!adev || !ops || !rep)
+        return -EINVAL;
+
+    memset(rep, 0, sizeof(*rep));
+
+    /* Park the rings with the descriptors the device still owes */
+    rep->tx_inflight = anarchy_ring_checkpoint(adev, &adev->tx_ring);
+    rep->rx_inflight = anarchy_ring_checkpoint(adev, &adev->rx_ring);
+
+    if (wait_link) {
+        ret = wait_link(ctx);
+        if (ret) {
+            rep->failed = "link";
+            goto fail;
+        }
+    }
+
+    /* Power cycle, memory and engine reset */
+    ret = reset_seq_run(anarchy_gpu_reset_steps, anarchy_gpu_reset_nsteps, ops, ctx,
+                        &rep->seq);
+    if (ret) {
+        rep->failed = rep->seq.step < anarchy_gpu_reset_nsteps ?
+                      anarchy_gpu_reset_steps[rep->seq.step].name : "sequence";
+        goto fail;
+    }
+
+    /* Completions of replayed descriptors need interrupts */
+    ret = ops->write(ctx, GPU_INTR_MASK_REG, 0);
+    if (ret) {
+        rep->failed = "interrupt mask";
+        goto fail;
+    }
+
+    /* Replay what was in flight, oldest first */
+    rep->tx_replayed = anarchy_ring_restore(adev, &adev->tx_ring);
+    rep->rx_replayed = anarchy_ring_restore(adev, &adev->rx_ring);
+    return 0;
+
+fail:
+    /* Nothing to replay into; stopping counts the descriptors as lost */
+    anarchy_ring_stop(adev, &adev->rx_ring);
+    anarchy_ring_stop(adev, &adev->tx_ring);
+    return ret;
+}
+EXPORT_SYMBOL_GPL(anarchy_gpu_reset_rings);
@@ -5,6 +5,7 @@
 #include "include/anarchy_device.h"
 #include "include/hotplug.h"
 #include "include/pcie_types.h"
+#include "include/pcie_state.h"
 #include "include/game_opt.h"
 #include "include/perf_monitor.h"
 #include "include/gpu_offsets.h"
@@ -16,16 +17,13 @@ void handle_device_connect(struct anarchy_device *adev)
 
     pr_info("Anarchy eGPU: Device connected\n");
 
-    /* Initialize PCIe link */
+    /* Initialize PCIe link, returns once the link is active */
     ret = anarchy_pcie_enable_link(adev);
     if (ret) {
         pr_err("Failed to enable PCIe link: %d\n", ret);
         return;
     }
 
-    /* Wait for link to stabilize */
-    msleep(100);
-
     /* Optimize PCIe settings */
     ret = anarchy_pcie_optimize_settings(adev);
     if (ret) {
@@ -55,7 +53,7 @@ void handle_device_disconnect(struct anarchy_device *adev)
     anarchy_pcie_disable_link(adev);
 
     /* Reset device state */
-    adev->pcie_state.state = ANARCHY_PCIE_STATE_DOWN;
+    anarchy_pcie_set_state(adev, ANARCHY_PCIE_STATE_DOWN);
     adev->pcie_state.enabled = false;
 }
 
@@ -6,6 +6,9 @@
 #include <linux/thunderbolt.h>
 #include <linux/mutex.h>
 #include <linux/workqueue.h>
+#include <linux/miscdevice.h>
+#include <linux/kref.h>
+#include <linux/srcu.h>
 #include "anarchy_device_forward.h"
 #include "pcie_forward.h"
 #include "pcie_types.h"
@@ -16,6 +19,13 @@
 #include "gpu_emu_forward.h"
 #include "bandwidth.h"
 #include "bandwidth_config.h"
+#include "link_policy.h"
+#include "telemetry.h"
+#include "power_gov.h"
+#include "runtime_pm.h"
+#include "cmd_trace.h"
+#include "dma_path.h"
+#include "upload.h"
 
 /* Main device structure */
 struct anarchy_device {
@@ -38,11 +48,14 @@ struct anarchy_device {
     
     /* Configuration */
     unsigned int dma_channels;   /* Number of DMA channels */
-    unsigned int ring_buffer_size; /* Ring buffer size in bytes */
+    unsigned int ring_buffer_size; /* Descriptors per ring, 0 = default */
+    unsigned int link_speed;     /* Configured PCIe gen, 0 = auto */
+    unsigned int tb_timeout_ms;  /* Thunderbolt timeout */
     
     /* DMA configuration */
     u32 dma_batch_size;
     bool low_latency_mode;
+    struct anarchy_dma_path dma_path; /* PIO/bounce/zero-copy by size */
     
     /* Ring buffers */
     struct anarchy_ring tx_ring;
@@ -54,16 +67,34 @@ struct anarchy_device {
     /* Game compatibility */
     struct game_compat_layer *compat_layer;
     
+    /* Register sampling, feeds perf, thermal and bandwidth */
+    struct anarchy_telemetry telemetry;
+
     /* Performance monitoring */
     struct perf_monitor perf_monitor;
-    
+
     /* Power management */
     struct power_profile power_profile;
+    struct anarchy_power_gov power_gov; /* Frame-aware limit under the thermal ceiling */
     
     /* Bandwidth monitoring */
     struct bandwidth_config bandwidth;
     bool texture_compression_enabled;
+
+    /* Link speed policy */
+    struct anarchy_link_policy link_policy;
     
+    /* Control interface (/dev/anarchy-egpu) */
+    struct miscdevice miscdev;
+    struct list_head event_files;   /* Open files, for event delivery */
+    spinlock_t event_lock;
+    struct mutex files_lock;        /* Open files, for unplug, which sleeps */
+    struct srcu_struct chardev_srcu; /* File ops in flight */
+    bool unplugged;                 /* Removed, file ops fail with -ENODEV */
+
+    /* debugfs/<device name>, NULL when debugfs is unavailable */
+    struct dentry *debugfs_dir;
+
     /* Workqueues */
     struct workqueue_struct *wq;
     struct work_struct init_work;
@@ -72,15 +103,22 @@ struct anarchy_device {
     /* Memory mapping */
     void __iomem *mmio_base;    /* PCIe MMIO base address */
     resource_size_t mmio_size;   /* PCIe MMIO region size */
+    struct anarchy_upload upload; /* Write-combined framebuffer and PIO window */
     
-    /* Statistics */
-    atomic_t ref_count;
+    /* The service binding and each open control file */
+    struct kref ref;
     
     /* Private data */
     void *private_data;
 
     struct thermal_profile thermal_profile;
 
+    /* Link idle/runtime power state */
+    struct anarchy_rpm rpm;
+
+    /* Command/DMA traffic capture, see debugfs trace/ */
+    struct anarchy_trace trace;
+
     /* GPU Emulation */
     struct gpu_emu_interface *gpu_emu;
 };
@@ -88,6 +126,8 @@ struct anarchy_device {
 /* Device management functions */
 int anarchy_device_init(struct anarchy_device *adev);
 void anarchy_device_exit(struct anarchy_device *adev);
+void anarchy_device_get(struct anarchy_device *adev);
+void anarchy_device_put(struct anarchy_device *adev);
 int anarchy_device_connect(struct anarchy_device *adev);
 void anarchy_device_disconnect(struct anarchy_device *adev);
 int anarchy_device_suspend(struct anarchy_device *adev);
@@ -0,0 +1,241 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM anarchy_egpu
+
+#if !defined(ANARCHY_EVENTS_H) || defined(TRACE_HEADER_MULTI_READ)
+#define ANARCHY_EVENTS_H
+
+#include <linux/tracepoint.h>
+#include <linux/pci.h>
+#include "anarchy_device.h"
+
+/*
+ * Tracepoints on the hot paths, under events/anarchy_egpu/. Every event
+ * carries the device as its PCI id (bus << 8 | devfn) so one bpftrace map
+ * can key on it. Submit/complete pairs share a key, the descriptor index
+ * for the rings and the bus address for DMA, for latency breakdowns (see
+ * tools/bpftrace). Disabled, each costs a static branch.
+ */
+
+#ifndef ANARCHY_EVENTS_DEVID
+#define ANARCHY_EVENTS_DEVID
+#define anarchy_events_devid(adev) ((adev)->pdev ? pci_dev_id((adev)->pdev) : 0)
+#endif
+
+#define anarchy_show_pcie_state(state)                          \
+    __print_symbolic(state,                                     \
+        { ANARCHY_PCIE_STATE_UNKNOWN,   "unknown" },            \
+        { ANARCHY_PCIE_STATE_DOWN,      "down" },               \
+        { ANARCHY_PCIE_STATE_TRAINING,  "training" },           \
+        { ANARCHY_PCIE_STATE_ACTIVE,    "active" },             \
+        { ANARCHY_PCIE_STATE_ERROR,     "error" },              \
+        { ANARCHY_PCIE_STATE_NORMAL,    "normal" },             \
+        { ANARCHY_PCIE_STATE_RECOVERY,  "recovery" },           \
+        { ANARCHY_PCIE_STATE_INIT,      "init" },               \
+        { ANARCHY_PCIE_STATE_LINK_DOWN, "link_down" })
+
+#define ANARCHY_EVENTS_DEV_FMT "%02x:%02x.%u "
+#define ANARCHY_EVENTS_DEV_ARGS(dev) (dev) >> 8, PCI_SLOT((dev) & 0xff), PCI_FUNC((dev) & 0xff)
+
+TRACE_EVENT(anarchy_ring_submit,
+    TP_PROTO(struct anarchy_device *adev, bool tx, u32 idx, u32 size, u32 in_flight),
+    TP_ARGS(adev, tx, idx, size, in_flight),
+    TP_STRUCT__entry(
+        __field(u32, dev)
+        __field(bool, tx)
+        __field(u32, idx)
+        __field(u32, size)
+        __field(u32, in_flight)
+    ),
+    TP_fast_assign(
+        __entry->dev = anarchy_events_devid(adev);
+        __entry->tx = tx;
+        __entry->idx = idx;
+        __entry->size = size;
+        __entry->in_flight = in_flight;
+    ),
+    TP_printk(ANARCHY_EVENTS_DEV_FMT "%s idx=%u size=%u in_flight=%u",
+              ANARCHY_EVENTS_DEV_ARGS(__entry->dev), __entry->tx ? "tx" : "rx",
+              __entry->idx, __entry->size, __entry->in_flight)
+);
+
+TRACE_EVENT(anarchy_ring_complete,
+    TP_PROTO(struct anarchy_device *adev, bool tx, u32 idx, int pending),
+    TP_ARGS(adev, tx, idx, pending),
+    TP_STRUCT__entry(
+        __field(u32, dev)
+        __field(bool, tx)
+        __field(u32, idx)
+        __field(int, pending)
+    ),
+    TP_fast_assign(
+        __entry->dev = anarchy_events_devid(adev);
+        __entry->tx = tx;
+        __entry->idx = idx;
+        __entry->pending = pending;
+    ),
+    TP_printk(ANARCHY_EVENTS_DEV_FMT "%s idx=%u pending=%d",
+              ANARCHY_EVENTS_DEV_ARGS(__entry->dev), __entry->tx ? "tx" : "rx",
+              __entry->idx, __entry->pending)
+);
+
+TRACE_EVENT(anarchy_dma_start,
+    TP_PROTO(struct anarchy_device *adev, int channel, dma_addr_t addr, u32 size),
+    TP_ARGS(adev, channel, addr, size),
+    TP_STRUCT__entry(
+        __field(u32, dev)
+        __field(int, channel)
+        __field(u64, addr)
+        __field(u32, size)
+    ),
+    TP_fast_assign(
+        __entry->dev = anarchy_events_devid(adev);
+        __entry->channel = channel;
+        __entry->addr = addr;
+        __entry->size = size;
+    ),
+    TP_printk(ANARCHY_EVENTS_DEV_FMT "ch=%d addr=%#llx size=%u",
+              ANARCHY_EVENTS_DEV_ARGS(__entry->dev), __entry->channel,
+              __entry->addr, __entry->size)
+);
+
+TRACE_EVENT(anarchy_dma_complete,
+    TP_PROTO(struct anarchy_device *adev, int channel, dma_addr_t addr, u32 size, int ret),
+    TP_ARGS(adev, channel, addr, size, ret),
+    TP_STRUCT__entry(
+        __field(u32, dev)
+        __field(int, channel)
+        __field(u64, addr)
+        __field(u32, size)
+        __field(int, ret)
+    ),
+    TP_fast_assign(
+        __entry->dev = anarchy_events_devid(adev);
+        __entry->channel = channel;
+        __entry->addr = addr;
+        __entry->size = size;
+        __entry->ret = ret;
+    ),
+    TP_printk(ANARCHY_EVENTS_DEV_FMT "ch=%d addr=%#llx size=%u ret=%d",
+              ANARCHY_EVENTS_DEV_ARGS(__entry->dev), __entry->channel,
+              __entry->addr, __entry->size, __entry->ret)
+);
+
+/* A command joined the open batch, total is the batch size after it */
+TRACE_EVENT(anarchy_cmd_merge,
+    TP_PROTO(struct anarchy_device *adev, u32 category, u32 flags, u32 size, u32 total),
+    TP_ARGS(adev, category, flags, size, total),
+    TP_STRUCT__entry(
+        __field(u32, dev)
+        __field(u32, category)
+        __field(u32, flags)
+        __field(u32, size)
+        __field(u32, total)
+    ),
+    TP_fast_assign(
+        __entry->dev = anarchy_events_devid(adev);
+        __entry->category = category;
+        __entry->flags = flags;
+        __entry->size = size;
+        __entry->total = total;
+    ),
+    TP_printk(ANARCHY_EVENTS_DEV_FMT "cat=%u flags=%#x size=%u total=%u",
+              ANARCHY_EVENTS_DEV_ARGS(__entry->dev), __entry->category,
+              __entry->flags, __entry->size, __entry->total)
+);
+
+/* A batch went to the device and came back */
+TRACE_EVENT(anarchy_cmd_flush,
+    TP_PROTO(struct anarchy_device *adev, u32 category, u32 flags, u32 size, int ret),
+    TP_ARGS(adev, category, flags, size, ret),
+    TP_STRUCT__entry(
+        __field(u32, dev)
+        __field(u32, category)
+        __field(u32, flags)
+        __field(u32, size)
+        __field(int, ret)
+    ),
+    TP_fast_assign(
+        __entry->dev = anarchy_events_devid(adev);
+        __entry->category = category;
+        __entry->flags = flags;
+        __entry->size = size;
+        __entry->ret = ret;
+    ),
+    TP_printk(ANARCHY_EVENTS_DEV_FMT "cat=%u flags=%#x size=%u ret=%d",
+              ANARCHY_EVENTS_DEV_ARGS(__entry->dev), __entry->category,
+              __entry->flags, __entry->size, __entry->ret)
+);
+
+TRACE_EVENT(anarchy_pcie_state,
+    TP_PROTO(struct anarchy_device *adev, int old_state, int new_state, u32 speed, u32 width),
+    TP_ARGS(adev, old_state, new_state, speed, width),
+    TP_STRUCT__entry(
+        __field(u32, dev)
+        __field(int, old_state)
+        __field(int, new_state)
+        __field(u32, speed)
+        __field(u32, width)
+    ),
+    TP_fast_assign(
+        __entry->dev = anarchy_events_devid(adev);
+        __entry->old_state = old_state;
+        __entry->new_state = new_state;
+        __entry->speed = speed;
+        __entry->width = width;
+    ),
+    TP_printk(ANARCHY_EVENTS_DEV_FMT "%s -> %s gen%u x%u",
+              ANARCHY_EVENTS_DEV_ARGS(__entry->dev),
+              anarchy_show_pcie_state(__entry->old_state),
+              anarchy_show_pcie_state(__entry->new_state),
+              __entry->speed, __entry->width)
+);
+
+TRACE_EVENT(anarchy_thermal_action,
+    TP_PROTO(struct anarchy_device *adev, int temp_mc, u32 fan, u32 power_limit,
+             bool throttling),
+    TP_ARGS(adev, temp_mc, fan, power_limit, throttling),
+    TP_STRUCT__entry(
+        __field(u32, dev)
+        __field(int, temp_mc)
+        __field(u32, fan)
+        __field(u32, power_limit)
+        __field(bool, throttling)
+    ),
+    TP_fast_assign(
+        __entry->dev = anarchy_events_devid(adev);
+        __entry->temp_mc = temp_mc;
+        __entry->fan = fan;
+        __entry->power_limit = power_limit;
+        __entry->throttling = throttling;
+    ),
+    TP_printk(ANARCHY_EVENTS_DEV_FMT "temp=%d mC fan=%u%% limit=%u W%s",
+              ANARCHY_EVENTS_DEV_ARGS(__entry->dev), __entry->temp_mc, __entry->fan,
+              __entry->power_limit, __entry->throttling ? " throttling" : "")
+);
+
+TRACE_EVENT(anarchy_power_limit,
+    TP_PROTO(struct anarchy_device *adev, u32 old_limit, u32 new_limit),
+    TP_ARGS(adev, old_limit, new_limit),
+    TP_STRUCT__entry(
+        __field(u32, dev)
+        __field(u32, old_limit)
+        __field(u32, new_limit)
+    ),
+    TP_fast_assign(
+        __entry->dev = anarchy_events_devid(adev);
+        __entry->old_limit = old_limit;
+        __entry->new_limit = new_limit;
+    ),
+    TP_printk(ANARCHY_EVENTS_DEV_FMT "%u W -> %u W",
+              ANARCHY_EVENTS_DEV_ARGS(__entry->dev), __entry->old_limit, __entry->new_limit)
+);
+
+#endif /* ANARCHY_EVENTS_H */
+
+/* This part must be outside the multi-read protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE anarchy_events
+#include <trace/define_trace.h>
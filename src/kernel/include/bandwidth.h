@@ -4,8 +4,26 @@
 #include <linux/types.h>
 
 struct anarchy_device;
+struct anarchy_bw_second;
+struct dentry;
 
-/* Function to get PCIe bandwidth usage */
+int init_bandwidth_monitoring(struct anarchy_device *adev);
+void cleanup_bandwidth_monitoring(struct anarchy_device *adev);
+
+/* Measured PCIe throughput in bytes/sec, busier direction */
 u64 anarchy_pcie_get_bandwidth_usage(struct anarchy_device *adev);
 
+/* Utilization of the negotiated link in percent, busier direction */
+u32 anarchy_bandwidth_get_utilization(struct anarchy_device *adev);
+
+/* Per-direction throughput in bytes/sec from the latest sample */
+void anarchy_bandwidth_get_rates(struct anarchy_device *adev, u64 *rx_bps, u64 *tx_bps);
+
+/* Per-second history, oldest first */
+unsigned int anarchy_bandwidth_get_history(struct anarchy_device *adev,
+                                           struct anarchy_bw_second *out,
+                                           unsigned int max);
+
+void anarchy_bandwidth_debugfs_init(struct anarchy_device *adev, struct dentry *parent);
+
 #endif /* ANARCHY_BANDWIDTH_H */
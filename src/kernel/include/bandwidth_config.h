@@ -2,15 +2,51 @@
 #define ANARCHY_BANDWIDTH_CONFIG_H
 
 #include <linux/types.h>
+#include <linux/spinlock.h>
+#include "hold_stat.h"
+#include "telemetry.h"
+
+/* Seconds of throughput history kept for consumers */
+#define ANARCHY_BW_HISTORY_LEN  60
+
+/* One second of PCIe traffic */
+struct anarchy_bw_second {
+    u64 timestamp_ns;             /* End of the second (ktime_get_ns) */
+    u64 rx_bytes;
+    u64 tx_bytes;
+    u32 util;                     /* Average utilization, percent */
+    u32 peak_util;                /* Highest single sample, percent */
+    u32 samples;
+};
 
 /* Bandwidth configuration structure */
 struct bandwidth_config {
     u64 available_bandwidth;      /* Current available bandwidth in bytes/sec */
     u64 total_bandwidth;          /* Total link bandwidth in bytes/sec */
     u64 min_bandwidth;           /* Minimum required bandwidth for operation */
+    u64 required_bandwidth;       /* Bandwidth the workload is expected to need */
+    u64 current_bandwidth;        /* Measured demand in bytes/sec, busier direction */
+    u64 capacity;                 /* Negotiated PCIe link capacity in bytes/sec */
+    u64 rx_rate;                  /* Latest sample, bytes/sec */
+    u64 tx_rate;
+    u32 utilization;              /* Latest sample, percent of capacity */
     bool bandwidth_critical;      /* Flag indicating if bandwidth is critically low */
     unsigned long last_update;    /* Last bandwidth update timestamp */
     spinlock_t lock;             /* Lock for protecting bandwidth updates */
+    struct anarchy_telemetry_sub sub; /* Fed every telemetry sample */
+    struct anarchy_hold_stat hold;   /* Sampler side of lock */
+
+    /* Raw 32-bit counter values and time of the previous sample */
+    u32 last_rx;
+    u32 last_tx;
+    u64 last_sample_ns;
+
+    /* Second being accumulated, and the ring of completed ones */
+    struct anarchy_bw_second acc;
+    u64 acc_start_ns;
+    struct anarchy_bw_second history[ANARCHY_BW_HISTORY_LEN];
+    unsigned int history_head;
+    unsigned int history_count;
 };
 
 #endif /* ANARCHY_BANDWIDTH_CONFIG_H */
@@ -0,0 +1,15 @@
+#ifndef ANARCHY_CHARDEV_H
+#define ANARCHY_CHARDEV_H
+
+#include "anarchy_device.h"
+#include "../../../include/anarchy-ioctl.h"
+
+/* /dev/anarchy-egpu control interface */
+int anarchy_chardev_register(struct anarchy_device *adev);
+void anarchy_chardev_unregister(struct anarchy_device *adev);
+void anarchy_chardev_notify(struct anarchy_device *adev, u32 type, u64 data0, u64 data1);
+
+/* ANARCHY_IOC_GET_STATS snapshot, everything but size */
+void anarchy_fill_stats(struct anarchy_device *adev, struct anarchy_ioc_stats *st);
+
+#endif /* ANARCHY_CHARDEV_H */
@@ -0,0 +1,69 @@
+#ifndef ANARCHY_CMD_TRACE_H
+#define ANARCHY_CMD_TRACE_H
+
+#include <linux/types.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include "../../../include/anarchy-trace.h"
+
+struct anarchy_device;
+struct command_batch;
+struct dentry;
+
+/*
+ * Per-CPU byte ring. Only its own CPU writes, with interrupts off, and
+ * only the debugfs reader consumes, so head and tail are the only shared
+ * state. A record that does not fit is dropped and counted, the reader
+ * never waits on the hot path.
+ */
+struct anarchy_trace_cpu {
+    char *buf;
+    u32 size;                       /* Bytes, power of two */
+    u64 head;                       /* Bytes written, owner CPU */
+    u64 tail;                       /* Bytes consumed, reader */
+    u64 records;
+    u64 lost;
+    u32 sample_seq;                 /* Commands since the last sampled payload */
+};
+
+struct anarchy_trace {
+    bool enabled;
+    unsigned int sample_every;      /* Payload of every Nth command, 0 = none */
+    unsigned int sample_bytes;      /* Up to ANARCHY_TRACE_MAX_SAMPLE */
+    struct anarchy_trace_cpu __percpu *cpus;
+    struct mutex lock;              /* Allocation and the reader */
+};
+
+void anarchy_trace_init(struct anarchy_device *adev);
+void anarchy_trace_exit(struct anarchy_device *adev);
+
+/* Allocates the buffers on first use; 0 or -ENOMEM */
+int anarchy_trace_enable(struct anarchy_device *adev, bool enable);
+
+void __anarchy_trace_cmd(struct anarchy_device *adev, const struct command_batch *batch);
+void __anarchy_trace_xfer(struct anarchy_device *adev, u8 type, size_t size);
+
+/*
+ * Hooks for the submission paths. Disabled tracing costs one load and a
+ * branch.
+ */
+#define anarchy_trace_cmd(adev, batch) do {                         \
+    if (unlikely(READ_ONCE((adev)->trace.enabled)))                 \
+        __anarchy_trace_cmd(adev, batch);                           \
+} while (0)
+
+#define anarchy_trace_xfer(adev, type, size) do {                   \
+    if (unlikely(READ_ONCE((adev)->trace.enabled)))                 \
+        __anarchy_trace_xfer(adev, type, size);                     \
+} while (0)
+
+/*
+ * Copy up to @count bytes of whole records into @dst (a kernel buffer),
+ * consuming them. Returns the bytes copied. Used by the debugfs reader
+ * and by userspace builds of the driver.
+ */
+size_t anarchy_trace_drain(struct anarchy_device *adev, void *dst, size_t count);
+
+void anarchy_trace_debugfs_init(struct anarchy_device *adev, struct dentry *parent);
+
+#endif /* ANARCHY_CMD_TRACE_H */
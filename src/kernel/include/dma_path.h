@@ -0,0 +1,63 @@
+#ifndef ANARCHY_DMA_PATH_H
+#define ANARCHY_DMA_PATH_H
+
+#include <linux/types.h>
+#include <linux/atomic.h>
+
+struct anarchy_device;
+struct dentry;
+
+/*
+ * How a synchronous host to device transfer travels. Small ones are
+ * stored straight into the PIO window, medium ones are copied into a
+ * preallocated bounce buffer the device already knows, large ones are
+ * mapped in place. Which is cheapest depends on the link, so the size
+ * limits are measured when the device connects.
+ */
+enum anarchy_dma_path_kind {
+    ANARCHY_DMA_PATH_PIO,
+    ANARCHY_DMA_PATH_BOUNCE,
+    ANARCHY_DMA_PATH_ZEROCOPY,
+    ANARCHY_DMA_PATH_COUNT
+};
+
+#define ANARCHY_DMA_PIO_WINDOW_SIZE     4096
+#define ANARCHY_DMA_BOUNCE_SIZE         (64 << 10)
+#define ANARCHY_DMA_PATH_PROBES         11      /* Sizes from 64 B to the bounce buffer */
+
+struct anarchy_dma_path_stats {
+    atomic64_t hits;
+    atomic64_t bytes;
+    atomic64_t ns;                  /* Start to completion, summed */
+    u64 max_ns;                     /* Racy, a lost update only understates it */
+};
+
+struct anarchy_dma_path {
+    u32 pio_max;                    /* Largest size sent through the PIO window */
+    u32 bounce_max;                 /* Largest size copied through the bounce buffer */
+    bool pinned;                    /* Limits set by hand, calibration leaves them */
+    u64 calibrated_ns;              /* When the limits were last measured, 0 = never */
+    u64 probe_ns[ANARCHY_DMA_PATH_COUNT][ANARCHY_DMA_PATH_PROBES]; /* 0 = path not usable */
+
+    void *bounce;
+    dma_addr_t bounce_dma;
+    unsigned long bounce_busy;      /* Bit 0 while a transfer owns the buffer */
+
+    struct anarchy_dma_path_stats stats[ANARCHY_DMA_PATH_COUNT];
+};
+
+int anarchy_dma_path_init(struct anarchy_device *adev);
+void anarchy_dma_path_exit(struct anarchy_device *adev);
+
+/* Time every path over the live link and pick the limits, unless pinned */
+int anarchy_dma_path_calibrate(struct anarchy_device *adev);
+
+/* Send @size bytes on the cheapest path and wait for the device to have them */
+int anarchy_dma_send(struct anarchy_device *adev, const void *data, size_t size);
+
+enum anarchy_dma_path_kind anarchy_dma_path_select(struct anarchy_device *adev, size_t size);
+const char *anarchy_dma_path_name(enum anarchy_dma_path_kind kind);
+
+void anarchy_dma_path_debugfs_init(struct anarchy_device *adev, struct dentry *parent);
+
+#endif /* ANARCHY_DMA_PATH_H */
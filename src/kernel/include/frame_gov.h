@@ -0,0 +1,80 @@
+#ifndef ANARCHY_FRAME_GOV_H
+#define ANARCHY_FRAME_GOV_H
+
+/*
+ * Frame-aware power governor. Plain integer C with no kernel calls, so
+ * the same file builds into the module and into tests/sim.
+ *
+ * Units: time in microseconds, power in watts, clocks in MHz, utilization
+ * in percent.
+ */
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdbool.h>
+#include <stdint.h>
+typedef uint64_t u64;
+#endif
+
+enum frame_gov_level {
+    FRAME_GOV_IDLE = 0,             /* No frame loop, run at the ceiling */
+    FRAME_GOV_RUN,                  /* Render window of a frame with slack */
+    FRAME_GOV_BOOST,                /* Frame at risk of missing, until the next sync */
+    FRAME_GOV_RELAX,                /* Between the window and the next frame */
+};
+
+struct frame_gov_params {
+    unsigned int boost_w;           /* Watts a boost adds to the ceiling, 0 = none */
+    unsigned int relax_w;           /* Watts taken off between windows */
+    unsigned int power_min;
+    unsigned int power_max;         /* Hard limit, the profile limit plus boost_w */
+    unsigned int clock_base;        /* Clock outside a frame loop */
+    unsigned int clock_boost;
+    unsigned int clock_relax;
+    unsigned int boost_util;        /* Utilization that leaves no slack */
+    unsigned int margin_pct;        /* Window slack over the expected busy time */
+    unsigned int min_period_us;     /* Shorter intervals are not frames */
+    unsigned int max_period_us;     /* No frame for this long ends the loop */
+};
+
+struct frame_gov {
+    struct frame_gov_params p;
+    enum frame_gov_level level;
+    u64 last_sync_us;
+    unsigned int period_us;         /* Frame interval, EWMA */
+    unsigned int jitter_us;         /* Mean deviation of the interval, EWMA */
+    unsigned int util;              /* Latest GPU utilization */
+    u64 window_end_us;
+    bool late;                      /* Last frame overran the average */
+    unsigned int frames;            /* Frames since the loop started */
+    u64 late_frames;
+    u64 windows;
+    u64 boosts;
+    u64 rescues;                    /* Relaxed frames boosted near the deadline */
+};
+
+void frame_gov_default_params(struct frame_gov_params *p);
+void frame_gov_init(struct frame_gov *gov, const struct frame_gov_params *p);
+
+/* Frame boundary (present/sync) at @now_us; returns the new level */
+enum frame_gov_level frame_gov_sync(struct frame_gov *gov, u64 now_us);
+
+/* GPU utilization over the last sampling period */
+void frame_gov_util(struct frame_gov *gov, unsigned int util);
+
+/* Re-evaluate at @now_us, e.g. when the window ends; returns the level */
+enum frame_gov_level frame_gov_tick(struct frame_gov *gov, u64 now_us);
+
+/* When frame_gov_tick() next has work to do, 0 = not before the next sync */
+u64 frame_gov_next_event(const struct frame_gov *gov);
+
+/*
+ * Targets for the current level. @ceiling is the limit the thermal
+ * controller allows, @throttled whether it is cutting below the profile.
+ */
+unsigned int frame_gov_power(const struct frame_gov *gov, unsigned int ceiling,
+                             bool throttled);
+unsigned int frame_gov_clock(const struct frame_gov *gov);
+
+#endif /* ANARCHY_FRAME_GOV_H */
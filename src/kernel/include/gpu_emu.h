@@ -3,7 +3,10 @@
 
 #include <linux/types.h>
 #include <linux/spinlock.h>
+#include <linux/seqlock.h>
+#include <linux/bits.h>
 #include "anarchy_device.h"
+#include "gpu_model.h"
 
 /* GPU Emulation States */
 #define GPU_EMU_STATE_DISABLED  0
@@ -22,6 +25,10 @@ struct gpu_emu_perf_state {
     u32 vram_used;
     u32 pcie_rx_bw;
     u32 pcie_tx_bw;
+    u32 pcie_rx;                    /* Byte counters, wrap */
+    u32 pcie_tx;
+    u32 power_limit;                /* W, in force */
+    u32 limit_latched;              /* W, applied by PWR_LIMIT_UPDATE */
 };
 
 /* GPU Emulation Config */
@@ -38,6 +45,7 @@ struct gpu_emu_config {
     unsigned int base_clock;
     unsigned int boost_clock;
     unsigned int mem_clock;
+    unsigned int work_ns_per_kib;   /* GPU time per KiB of submitted commands */
 };
 
 /* GPU Emulation Interface */
@@ -46,8 +54,12 @@ struct gpu_emu_interface {
     spinlock_t lock;
     int state;
     struct gpu_emu_config config;
-    struct gpu_emu_perf_state perf;
-    void *fb_base;
+    seqcount_t seq;                     /* Writers hold lock, readers retry */
+    struct gpu_emu_perf_state perf;     /* Published from the model under seq */
+    u32 limit_latched;                  /* Last PWR_LIMIT_OFFSET write, W */
+    u64 synced_ns;                      /* When perf was last published */
+    struct gpu_model model;
+    void __iomem *fb_base;              /* Write-combined, see map_memory */
     size_t fb_size;
 };
 
@@ -66,6 +78,15 @@ struct gpu_emu_interface {
 #define PWR_LIMIT_UPDATE    0x102C
 #define FAN_CONTROL_UPDATE  0x1030
 
+#define GPU_EMU_LIMIT_APPLY BIT(0)  /* PWR_LIMIT_UPDATE: apply the latched limit */
+
+/*
+ * Register reads never take emu->lock: they copy from emu->perf under
+ * emu->seq, and only bring the model forward (with a trylock) when the
+ * published state is older than this.
+ */
+#define GPU_EMU_SYNC_NS     NSEC_PER_MSEC
+
 /* GPU State Functions */
 u32 anarchy_gpu_get_clock(struct anarchy_device *adev);
 u32 anarchy_gpu_get_mem_clock(struct anarchy_device *adev);
@@ -91,4 +112,12 @@ int anarchy_gpu_emu_handle_mmio(struct gpu_emu_interface *emu, u32 offset,
 int anarchy_gpu_emu_map_memory(struct anarchy_device *adev, u64 addr,
                               size_t size);
 
+/*
+ * Load for the model: submitted command bytes become GPU work, DMA bytes
+ * advance the PCIe counters (RX is host to GPU). No-ops unless the
+ * emulator is running.
+ */
+void anarchy_gpu_emu_submit(struct anarchy_device *adev, size_t bytes);
+void anarchy_gpu_emu_dma(struct anarchy_device *adev, u32 rx_bytes, u32 tx_bytes);
+
 #endif /* ANARCHY_GPU_EMU_H */
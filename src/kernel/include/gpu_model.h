@@ -0,0 +1,90 @@
+#ifndef ANARCHY_GPU_MODEL_H
+#define ANARCHY_GPU_MODEL_H
+
+/*
+ * Dynamic GPU model behind the emulator. Plain integer C with no kernel
+ * calls, so the same file builds into the module and into tests/sim.
+ *
+ * Work is queued in nanoseconds of GPU time at the boost clock and drains
+ * at the effective clock; utilization is the busy share, smoothed. Power
+ * follows utilization and clock, and the clock steps down in 15 MHz bins
+ * while power is over the limit or the die is at the slowdown temperature.
+ * Temperature is a lumped RC: heat capacity plus a fan-dependent
+ * conductance to ambient, so it lags power by tens of seconds.
+ *
+ * Units: time in nanoseconds (microseconds for the step), temperature in
+ * millidegrees C, power in milliwatts, clocks in MHz, utilization in
+ * permille, fan in percent.
+ */
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdbool.h>
+#include <stdint.h>
+typedef uint32_t u32;
+typedef int64_t s64;
+typedef uint64_t u64;
+#endif
+
+struct gpu_model_params {
+    u32 base_clock;
+    u32 boost_clock;
+    u32 clock_bin;                  /* MHz per boost step */
+    u32 idle_mw;
+    u32 max_mw;                     /* Full utilization at boost clock */
+    int ambient_mc;
+    int slowdown_mc;                /* Clock steps down at or above this */
+    u32 heat_capacity;              /* mJ/K, die and heatsink */
+    u32 g_base;                     /* mW/K to ambient with the fan stopped */
+    u32 g_per_fan;                  /* mW/K per fan percent */
+    u32 util_tau_us;                /* Utilization smoothing */
+    u32 mem_util_share;             /* Memory utilization per permille of GPU */
+    u64 max_backlog_ns;             /* Queued work beyond this is dropped */
+};
+
+struct gpu_model {
+    struct gpu_model_params p;
+    u64 last_ns;
+    bool primed;
+
+    /* Inputs */
+    u32 clock_req;                  /* Requested clock, capped at boost */
+    u32 power_limit_mw;
+    u32 fan;
+
+    /* State */
+    u64 backlog_ns;
+    u64 dropped_ns;
+    u32 clock;                      /* Effective clock */
+    u32 util;                       /* Permille, smoothed */
+    u32 util_q;                     /* Same, x1000 so the smoothing keeps precision */
+    u32 power_mw;
+    s64 temp_uc;                    /* Microdegrees, for integration precision */
+    s64 heat_rem;                   /* Heat below a microdegree, carried over */
+    u32 pcie_rx;                    /* Bytes received by the GPU, wraps */
+    u32 pcie_tx;                    /* Bytes sent by the GPU, wraps */
+};
+
+void gpu_model_default_params(struct gpu_model_params *p);
+void gpu_model_init(struct gpu_model *m, const struct gpu_model_params *p);
+
+/* Integrate up to @now_ns; earlier times are ignored */
+void gpu_model_advance(struct gpu_model *m, u64 now_ns);
+
+/* Queue @work_ns of GPU time at boost clock, call after advancing to now */
+void gpu_model_submit(struct gpu_model *m, u64 work_ns);
+
+/* Count DMA bytes in the PCIe counters */
+void gpu_model_dma(struct gpu_model *m, u32 rx_bytes, u32 tx_bytes);
+
+void gpu_model_set_clock(struct gpu_model *m, u32 mhz);
+void gpu_model_set_power_limit(struct gpu_model *m, u32 mw);
+void gpu_model_set_fan(struct gpu_model *m, u32 percent);
+
+static inline int gpu_model_temp_mc(const struct gpu_model *m)
+{
+    return (int)(m->temp_uc / 1000);
+}
+
+#endif /* ANARCHY_GPU_MODEL_H */
@@ -29,4 +29,7 @@
 #define PCIE_UTIL_OFFSET     0x5004
 #define PCIE_ERROR_OFFSET    0x5008
 
+#define PCIE_RX_COUNTER_OFFSET 0x5000  /* Free-running byte counters */
+#define PCIE_TX_COUNTER_OFFSET 0x5004
+
 #endif /* ANARCHY_GPU_OFFSETS_H */
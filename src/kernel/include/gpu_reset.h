@@ -0,0 +1,31 @@
+#ifndef ANARCHY_GPU_RESET_H
+#define ANARCHY_GPU_RESET_H
+
+#include "reset_seq.h"
+
+struct anarchy_device;
+
+/*
+ * The part of anarchy_gpu_reset() that touches the rings. Both rings are
+ * checkpointed, the link wait and the reset steps run, interrupts are
+ * unmasked and whatever the device had not completed is replayed. On
+ * failure the rings are stopped, which counts their contents as lost.
+ * Register access and the link wait come from the caller, config space
+ * in the driver and a model GPU in tests/sim/reset_sim.
+ */
+extern const struct reset_step anarchy_gpu_reset_steps[];
+extern const unsigned int anarchy_gpu_reset_nsteps;
+
+struct anarchy_gpu_reset_report {
+    struct reset_result seq;
+    const char *failed;             /* What failed, NULL on success */
+    int tx_inflight, rx_inflight;   /* Not completed at the checkpoint */
+    int tx_replayed, rx_replayed;
+};
+
+/* @wait_link may be NULL; returns 0 or the error that stopped the rings */
+int anarchy_gpu_reset_rings(struct anarchy_device *adev, const struct reset_ops *ops,
+                            void *ctx, int (*wait_link)(void *ctx),
+                            struct anarchy_gpu_reset_report *rep);
+
+#endif /* ANARCHY_GPU_RESET_H */
@@ -0,0 +1,42 @@
+#ifndef ANARCHY_HOLD_STAT_H
+#define ANARCHY_HOLD_STAT_H
+
+#include <linux/types.h>
+#include <linux/ktime.h>
+#include <linux/irqflags.h>
+
+/*
+ * Time spent inside a lock section, split out for the part run with
+ * interrupts disabled. Only the lock holder updates it, so no atomics;
+ * debugfs readers may see a torn but harmless view.
+ */
+struct anarchy_hold_stat {
+    u64 count;
+    u64 total_ns;
+    u64 max_ns;
+    u64 irqoff_count;
+    u64 irqoff_max_ns;
+};
+
+static inline u64 anarchy_hold_begin(void)
+{
+    return ktime_get_ns();
+}
+
+/* Call before dropping the lock */
+static inline void anarchy_hold_end(struct anarchy_hold_stat *s, u64 start)
+{
+    u64 ns = ktime_get_ns() - start;
+
+    s->count++;
+    s->total_ns += ns;
+    if (ns > s->max_ns)
+        s->max_ns = ns;
+    if (irqs_disabled()) {
+        s->irqoff_count++;
+        if (ns > s->irqoff_max_ns)
+            s->irqoff_max_ns = ns;
+    }
+}
+
+#endif /* ANARCHY_HOLD_STAT_H */
@@ -0,0 +1,44 @@
+#ifndef ANARCHY_LINK_CTL_H
+#define ANARCHY_LINK_CTL_H
+
+/*
+ * Link Control sequences on the port above the GPU: taking the link down
+ * and bringing it back. Plain C with no kernel calls; the register access
+ * and the wait for the link come from the caller, so the same file builds
+ * into the module and into tests/sim.
+ *
+ * Units: time in milliseconds.
+ */
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/errno.h>
+#include <linux/pci_regs.h>
+#else
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+typedef uint16_t u16;
+#define PCI_EXP_LNKCTL_LD   0x0010  /* Link Disable */
+#define PCI_EXP_LNKCTL_RL   0x0020  /* Retrain Link */
+#endif
+
+struct link_ctl_ops {
+    int (*read_ctl)(void *ctx, u16 *val);
+    int (*write_ctl)(void *ctx, u16 val);
+    /* Poll until the link is up or down, 0 or -ETIMEDOUT */
+    int (*wait_link)(void *ctx, bool up, unsigned int timeout_ms);
+};
+
+/* Set Link Disable and wait for the link to drop */
+int link_ctl_down(const struct link_ctl_ops *ops, void *ctx, unsigned int timeout_ms);
+
+/*
+ * Clear Link Disable, also setting Retrain Link when @retrain, and wait
+ * for the link to come up. Retrain Link alone is ignored by a port whose
+ * link is disabled, so this is the way back from link_ctl_down().
+ */
+int link_ctl_up(const struct link_ctl_ops *ops, void *ctx, bool retrain,
+                unsigned int timeout_ms);
+
+#endif /* ANARCHY_LINK_CTL_H */
@@ -0,0 +1,42 @@
+#ifndef ANARCHY_LINK_POLICY_H
+#define ANARCHY_LINK_POLICY_H
+
+#include <linux/types.h>
+#include <linux/workqueue.h>
+#include "pcie_forward.h"
+
+struct anarchy_device;
+
+/*
+ * Link speed policy state. The target speed follows bandwidth demand and
+ * is capped while the corrected-error rate says the link is not clean at
+ * the higher rate. All fields are owned by the sampling context, except
+ * that apply_work reads target/why and counts changes while applying is
+ * set, and the sampler leaves everything alone until it clears.
+ */
+struct anarchy_link_policy {
+    bool enabled;
+    enum anarchy_pcie_speed max_speed;  /* From LNKCAP */
+    enum anarchy_pcie_speed ceiling;    /* Lowered by error storms */
+    unsigned int up_votes;              /* Consecutive samples wanting more */
+    unsigned int down_votes;            /* Consecutive samples wanting less */
+    unsigned int err_votes;             /* Consecutive noisy samples */
+    unsigned long hold_until;           /* No change before this (jiffies) */
+    unsigned long quiet_since;          /* Last noisy sample (jiffies) */
+    unsigned long last_sample;          /* jiffies */
+    u32 last_error_count;
+    u32 cor_status;                     /* Replay bits set at the last sample */
+    u32 err_rate;                       /* Corrected errors per second, EWMA */
+    u32 changes;
+
+    struct work_struct apply_work;      /* Retrains outside the sampler */
+    enum anarchy_pcie_speed target;
+    const char *why;
+    bool applying;
+};
+
+int anarchy_link_policy_init(struct anarchy_device *adev);
+void anarchy_link_policy_exit(struct anarchy_device *adev);
+void anarchy_link_policy_sample(struct anarchy_device *adev, u64 demand_bps);
+
+#endif /* ANARCHY_LINK_POLICY_H */
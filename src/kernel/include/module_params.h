@@ -5,5 +5,14 @@
 extern int power_limit;
 extern int num_dma_channels;
 extern int test_mode;
+extern bool link_policy;
+extern unsigned int telemetry_ms;
+extern bool frame_governor;
+extern unsigned int frame_boost_w;
+extern unsigned int idle_timeout_ms;
+extern unsigned int trace_buf_kb;
+extern unsigned int ring_buffer_size;
+extern int dma_pio_max;
+extern int dma_bounce_max;
 
 #endif /* ANARCHY_MODULE_PARAMS_H */
@@ -2,6 +2,7 @@
 #define __ANARCHY_PCIE_STATE_H__
 
 #include <linux/types.h>
+#include <linux/debugfs.h>
 #include "pcie_forward.h"
 #include "pcie_types.h"
 
@@ -18,6 +19,7 @@ void anarchy_pcie_disable_link(struct anarchy_device *adev);
 void anarchy_pcie_disable(struct anarchy_device *adev);
 
 /* PCIe state management */
+void anarchy_pcie_set_state(struct anarchy_device *adev, enum anarchy_pcie_link_state state);
 int anarchy_pcie_init_state(struct anarchy_device *adev);
 void anarchy_pcie_cleanup_state(struct anarchy_device *adev);
 void anarchy_pcie_handle_error(struct anarchy_device *adev, enum anarchy_pcie_error_type error);
@@ -25,6 +27,10 @@ void anarchy_pcie_handle_error(struct anarchy_device *adev, enum anarchy_pcie_er
 /* PCIe configuration */
 int anarchy_pcie_optimize_settings(struct anarchy_device *adev);
 bool pcie_link_is_up(struct pci_dev *pdev);
+int anarchy_pcie_update_link_status(struct anarchy_device *adev);
+int anarchy_pcie_request_retrain(struct anarchy_device *adev);
+int anarchy_pcie_wait_link(struct anarchy_device *adev, bool up, unsigned int timeout_ms);
+void anarchy_pcie_debugfs_init(struct anarchy_device *adev, struct dentry *parent);
 
 /* PCIe error handling */
 int anarchy_pcie_get_error_stats(struct anarchy_device *adev, u32 *error_count);
@@ -33,5 +39,7 @@ void anarchy_pcie_clear_errors(struct anarchy_device *adev);
 /* PCIe configuration */
 int anarchy_pcie_set_speed(struct anarchy_device *adev, enum anarchy_pcie_speed speed);
 int anarchy_pcie_set_width(struct anarchy_device *adev, enum anarchy_pcie_width width);
+u64 anarchy_pcie_speed_capacity(enum anarchy_pcie_speed speed, u32 width);
+u64 anarchy_pcie_get_link_capacity(struct anarchy_device *adev);
 
 #endif /* __ANARCHY_PCIE_STATE_H__ */
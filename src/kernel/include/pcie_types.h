@@ -5,6 +5,7 @@
 #include <linux/pci.h>
 #include <linux/spinlock.h>
 #include <linux/workqueue.h>
+#include <linux/ktime.h>
 #include "pcie_forward.h"
 
 /* PCIe constants */
@@ -26,12 +27,57 @@
 #define ANARCHY_PCIE_GEN5  ANARCHY_PCIE_SPEED_32GT
 #define ANARCHY_PCIE_GEN6  ANARCHY_PCIE_SPEED_64GT
 
+/* Time-to-link-up histogram, bucket n counts [2^n, 2^(n+1)) microseconds */
+#define ANARCHY_PCIE_LINK_HIST_BUCKETS  24
+
+struct anarchy_pcie_link_stats {
+    u32 hist[ANARCHY_PCIE_LINK_HIST_BUCKETS];
+    u32 samples;
+    u32 timeouts;
+    u32 last_us;
+    u32 max_us;
+    u64 total_us;
+};
+
+/* Recovery ladder rungs, cheapest first */
+enum anarchy_pcie_rung {
+    ANARCHY_PCIE_RUNG_RETRAIN = 0,     /* Retrain at the current speed */
+    ANARCHY_PCIE_RUNG_DOWNSHIFT,       /* Retrain one generation lower */
+    ANARCHY_PCIE_RUNG_BUS_RESET,       /* Secondary bus reset */
+    ANARCHY_PCIE_RUNG_TB_RESET,        /* Thunderbolt service reset */
+    ANARCHY_PCIE_RUNG_COUNT
+};
+
+/* Outcome history of one rung on this link */
+struct anarchy_pcie_rung_stats {
+    u32 attempts;
+    u32 successes;
+    u32 score;          /* EWMA of success, 0..1024 */
+    u32 skipped;        /* Recoveries that passed over it since it last ran */
+    u64 total_us;       /* Time spent in the rung */
+};
+
 /* PCIe recovery state */
 struct anarchy_pcie_recovery {
     spinlock_t recovery_lock;
-    atomic_t retries;
-    struct work_struct recovery_work;
+    atomic_t retries;                  /* Failed passes over the whole ladder */
+    struct delayed_work recovery_work;
     unsigned long last_down;
+
+    /* Current recovery */
+    bool active;
+    enum anarchy_pcie_rung rung;
+    unsigned int step;                 /* Back-off exponent */
+    ktime_t started;
+    bool downshifted;                  /* Speed was lowered, cap the link policy there */
+    bool device_reset;                 /* Device lost its state, restore it on link up */
+
+    /* History, under recovery_lock */
+    struct anarchy_pcie_rung_stats rungs[ANARCHY_PCIE_RUNG_COUNT];
+    u32 recoveries;
+    u32 failures;
+    u32 last_recovery_us;
+    u64 total_recovery_us;
 };
 
 /* PCIe link state structure */
@@ -46,8 +92,10 @@ struct anarchy_pcie_state {
     bool enabled;                      /* Link enabled flag */
     bool needs_retrain;               /* Link needs retraining flag */
     u32 error_count;                  /* Link error counter */
+    u32 corrected_errors;             /* Correctable errors reported */
     enum anarchy_pcie_error_type last_error; /* Last error type */
     struct anarchy_pcie_recovery recovery;  /* Recovery state */
+    struct anarchy_pcie_link_stats link_stats; /* Under recovery_lock */
 };
 
 #endif /* ANARCHY_PCIE_TYPES_H */
@@ -3,6 +3,7 @@
 
 #include <linux/types.h>
 #include "forward.h"
+#include "telemetry.h"
 
 /* Performance state structure */
 struct perf_state {
@@ -17,14 +18,16 @@ struct perf_state {
     u32 pcie_util;      /* PCIe bandwidth utilization percentage */
 };
 
-/* Performance monitor structure */
+/*
+ * Performance monitor structure. Readings come from the telemetry
+ * snapshot; the monitor itself only reports threshold crossings.
+ */
 struct perf_monitor {
     struct anarchy_device *adev;
     bool enabled;
     unsigned int update_interval;
-    struct delayed_work update_work;
-    spinlock_t lock;
-    struct perf_state current_state;
+    struct anarchy_telemetry_sub sub;
+    u32 last_temperature;               /* Subscriber callback only */
 };
 
 /* Performance monitoring interface */
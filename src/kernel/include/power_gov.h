@@ -0,0 +1,46 @@
+#ifndef ANARCHY_POWER_GOV_H
+#define ANARCHY_POWER_GOV_H
+
+#include <linux/types.h>
+#include <linux/spinlock.h>
+#include <linux/hrtimer.h>
+#include <linux/workqueue.h>
+#include "frame_gov.h"
+#include "telemetry.h"
+
+struct anarchy_device;
+struct dentry;
+
+/*
+ * Frame-aware power limit and clock selection on top of the thermal
+ * ceiling. Frame boundaries come from CMD_CAT_SYNC commands, utilization
+ * from telemetry; the register writes happen in apply_work.
+ */
+struct anarchy_power_gov {
+    spinlock_t lock;                /* gov and the inputs below */
+    struct frame_gov gov;
+    struct hrtimer timer;           /* Window end, rescue point, loop timeout */
+    struct work_struct apply_work;
+    struct anarchy_telemetry_sub sub;
+    bool enabled;
+    unsigned int ceiling;           /* From the thermal controller */
+    bool throttled;
+    bool clock_control;             /* GPU reports clocks we can scale */
+    u32 mem_clock;
+    unsigned int applied_power;     /* Owned by apply_work */
+    unsigned int applied_clock;
+};
+
+int anarchy_power_gov_init(struct anarchy_device *adev);
+void anarchy_power_gov_exit(struct anarchy_device *adev);
+
+/* A frame boundary was submitted; safe from any context */
+void anarchy_power_gov_frame(struct anarchy_device *adev);
+
+/* New thermal/profile ceiling; the governor applies it */
+void anarchy_power_gov_set_ceiling(struct anarchy_device *adev, unsigned int limit,
+                                   bool throttled);
+
+void anarchy_power_gov_debugfs_init(struct anarchy_device *adev, struct dentry *parent);
+
+#endif /* ANARCHY_POWER_GOV_H */
@@ -8,6 +8,12 @@
 #define GPU_POWER_LIMIT_MAX     300  /* Maximum power limit in watts */
 #define GPU_POWER_LIMIT_DEFAULT 175  /* Default power limit in watts */
 
+/* Clock limits in MHz */
+#define MIN_GPU_CLOCK        300
+#define MAX_GPU_CLOCK        2640
+#define MIN_MEM_CLOCK        810
+#define MAX_MEM_CLOCK        21000
+
 /* Power profile structure */
 struct power_profile {
     u32 power_limit;        /* Power limit in watts */
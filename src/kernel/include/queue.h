@@ -0,0 +1,44 @@
+#ifndef ANARCHY_QUEUE_H
+#define ANARCHY_QUEUE_H
+
+#include <linux/types.h>
+#include <linux/wait.h>
+#include "anarchy_device.h"
+#include "../../../include/anarchy-ioctl.h"
+
+struct task_struct;
+struct vm_area_struct;
+
+/*
+ * Shared submission/completion queue pair for one open file. The whole
+ * region is a single vmalloc_user() allocation mapped into the caller.
+ */
+struct anarchy_queue {
+    struct anarchy_device *adev;
+    void *mem;
+    size_t mem_size;
+
+    struct anarchy_queue_ring *sq;
+    struct anarchy_queue_ring *cq;
+    struct anarchy_sqe *sqes;
+    struct anarchy_cqe *cqes;
+    u8 *data;
+    u32 data_size;
+
+    u32 flags;
+    u32 sq_idle_ms;
+    struct task_struct *sq_thread;
+    wait_queue_head_t sq_wait;    /* Idle poll thread */
+    wait_queue_head_t cq_wait;    /* Completion waiters */
+    struct mutex drain_lock;      /* One SQ consumer at a time */
+};
+
+struct anarchy_queue *anarchy_queue_create(struct anarchy_device *adev,
+                                           struct anarchy_ioc_queue_setup *setup);
+void anarchy_queue_shutdown(struct anarchy_queue *q);
+void anarchy_queue_destroy(struct anarchy_queue *q);
+int anarchy_queue_mmap(struct anarchy_queue *q, struct vm_area_struct *vma);
+int anarchy_queue_enter(struct anarchy_queue *q, struct anarchy_ioc_queue_enter *enter);
+bool anarchy_queue_cq_ready(struct anarchy_queue *q);
+
+#endif /* ANARCHY_QUEUE_H */
@@ -0,0 +1,57 @@
+#ifndef ANARCHY_RESET_SEQ_H
+#define ANARCHY_RESET_SEQ_H
+
+/*
+ * Table-driven GPU reset sequence. Each step writes a register and then
+ * polls for the hardware to acknowledge, so the sequence takes as long
+ * as the GPU needs instead of a fixed sleep per step. Plain C with no
+ * kernel calls; register access, time and waiting come from the caller,
+ * so the same file builds into the module and into tests/sim.
+ *
+ * Units: time in microseconds.
+ */
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/errno.h>
+#else
+#include <errno.h>
+#include <stdint.h>
+typedef uint32_t u32;
+typedef uint64_t u64;
+#endif
+
+#define RESET_SEQ_MAX_STEPS     16
+
+struct reset_step {
+    const char *name;
+    u32 reg;                        /* Written with val first */
+    u32 val;
+    u32 poll_reg;                   /* Then polled until (value & mask) == expect */
+    u32 mask;                       /* 0 = nothing to wait for */
+    u32 expect;
+    unsigned int timeout_us;
+};
+
+struct reset_ops {
+    int (*read)(void *ctx, u32 reg, u32 *val);
+    int (*write)(void *ctx, u32 reg, u32 val);
+    u64 (*now_us)(void *ctx);
+    void (*wait_us)(void *ctx, unsigned int us);
+};
+
+struct reset_result {
+    unsigned int step;              /* Step that failed, the step count on success */
+    unsigned int polls;             /* Register reads spent waiting */
+    u64 total_us;
+    u64 step_us[RESET_SEQ_MAX_STEPS];
+};
+
+/*
+ * Run @n steps in order. Returns 0, the error from a failed register
+ * access, or -ETIMEDOUT when a step is not acknowledged in time.
+ */
+int reset_seq_run(const struct reset_step *steps, unsigned int n,
+                  const struct reset_ops *ops, void *ctx, struct reset_result *res);
+
+#endif /* ANARCHY_RESET_SEQ_H */
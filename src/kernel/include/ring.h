@@ -12,14 +12,21 @@ struct dma_ring;
 enum anarchy_ring_state {
     ANARCHY_RING_STATE_STOPPED,
     ANARCHY_RING_STATE_RUNNING,
-    ANARCHY_RING_STATE_ERROR
+    ANARCHY_RING_STATE_ERROR,
+    ANARCHY_RING_STATE_PAUSED       /* Checkpointed for a reset, submits get -EBUSY */
 };
 
-/* Transfer structure */
+/*
+ * Transfer structure. @done and @context belong to the caller: when @done
+ * is set the transfer must stay valid until it is called, once, with 0 or
+ * -EIO after the device retired the descriptor.
+ */
 struct anarchy_transfer {
     void *buffer;
     size_t size;
     u32 flags;
+    void (*done)(struct anarchy_transfer *transfer, int status);
+    void *context;
 };
 
 /* Ring buffer structure */
@@ -32,10 +39,15 @@ struct anarchy_ring {
     struct dma_ring *dma;
     spinlock_t lock;
     wait_queue_head_t wait;
-    atomic_t bytes_transferred;
+    atomic64_t bytes_transferred;
     atomic_t transfer_errors;
-    atomic_t error_count;
+    atomic_t error_count;           /* Descriptors the device failed on the link */
     atomic_t pending;
+    atomic64_t completed;           /* Descriptors reaped */
+    atomic_t credit_waits;          /* Submitters that had to sleep for a slot */
+    atomic_t replayed;              /* In-flight transfers resubmitted after a reset */
+    atomic_t lost;                  /* In-flight transfers dropped by a stop */
+    atomic64_t latency_ns;          /* Submit to completion, 1/8 EWMA, 0 = no sample */
     void *transfers;
 };
 
@@ -49,4 +61,41 @@ int anarchy_ring_transfer(struct anarchy_device *adev, struct anarchy_ring *ring
 void anarchy_ring_complete(struct anarchy_device *adev, struct anarchy_ring *ring,
                          struct anarchy_transfer *transfer);
 
+/*
+ * Completion and back-pressure. Reaping retires descriptors whose status
+ * the device has written back, oldest first and at most @budget (0 = all),
+ * moves the tail once per batch, wakes ring->wait and then runs the
+ * transfers' callbacks. A credit is a free descriptor; a submitter that
+ * needs more than are free sleeps on ring->wait, reaping as it goes,
+ * until it has them, the ring stops or @timeout_us runs out.
+ */
+int anarchy_ring_reap(struct anarchy_device *adev, struct anarchy_ring *ring,
+                      unsigned int budget);
+unsigned int anarchy_ring_credits(struct anarchy_ring *ring);
+
+/* Fold one request's submit to completion time, from @start_ns, into latency_ns */
+void anarchy_ring_account_latency(struct anarchy_ring *ring, u64 start_ns);
+int anarchy_ring_wait_credits(struct anarchy_device *adev, struct anarchy_ring *ring,
+                              unsigned int credits, unsigned int timeout_us);
+
+/*
+ * Change the number of descriptors without stopping the ring. Storage
+ * for the new size is allocated first and swapped in while nothing is in
+ * flight, -EBUSY otherwise; on any error the ring is left as it was.
+ * @size is rounded like ring_buffer_size, 0 selects the default depth.
+ */
+int anarchy_ring_resize(struct anarchy_device *adev, struct anarchy_ring *ring,
+                        unsigned int size);
+
+/*
+ * Reset support. A checkpoint reaps what completed, pauses the ring and
+ * saves the descriptors still in flight; restore rewrites the ones the
+ * device never wrote back with a clear status, resumes the ring and, for
+ * TX, kicks them again in order. Descriptors that completed meanwhile
+ * are retired instead of replayed. Returns the number of descriptors
+ * not completed/replayed.
+ */
+int anarchy_ring_checkpoint(struct anarchy_device *adev, struct anarchy_ring *ring);
+int anarchy_ring_restore(struct anarchy_device *adev, struct anarchy_ring *ring);
+
 #endif /* __ANARCHY_RING_H__ */
@@ -0,0 +1,63 @@
+#ifndef __ANARCHY_RING_POOL_H__
+#define __ANARCHY_RING_POOL_H__
+
+#include <linux/types.h>
+#include <linux/dma-mapping.h>
+
+struct device;
+struct page;
+struct pci_dev;
+
+/* Largest slab, one PMD so the page allocator can hand out a huge page */
+#define ANARCHY_RING_POOL_SLAB_ORDER  9
+
+/*
+ * Descriptor and bounce buffer storage for one ring. The descriptors are
+ * one coherent block. The page sized buffers are carved out of physically
+ * contiguous slabs allocated on the NUMA node of the Thunderbolt
+ * controller and mapped once, so a ring of several thousand entries costs
+ * a handful of allocations instead of one per entry. Slabs shrink towards
+ * single pages when memory is fragmented.
+ */
+struct anarchy_ring_slab {
+    struct page *page;
+    void *cpu;
+    dma_addr_t dma;
+};
+
+struct anarchy_ring_pool {
+    struct device *dev;
+    int node;
+    unsigned int entries;
+    unsigned int slab_order;        /* Pages per slab, log2 */
+    unsigned int nr_slabs;
+    struct anarchy_ring_slab *slabs;
+    void *descs;
+    dma_addr_t desc_dma;
+    size_t desc_bytes;
+};
+
+int anarchy_ring_pool_create(struct anarchy_ring_pool *pool, struct device *dev, int node,
+                             unsigned int entries, size_t desc_size);
+void anarchy_ring_pool_destroy(struct anarchy_ring_pool *pool);
+
+/* Closest NUMA node with a known placement, walking up from @pdev */
+int anarchy_ring_pool_node(struct pci_dev *pdev);
+
+static inline void *anarchy_ring_pool_buf(const struct anarchy_ring_pool *pool,
+                                          unsigned int idx)
+{
+    const struct anarchy_ring_slab *slab = &pool->slabs[idx >> pool->slab_order];
+
+    return (char *)slab->cpu + ((idx & ((1U << pool->slab_order) - 1)) << PAGE_SHIFT);
+}
+
+static inline dma_addr_t anarchy_ring_pool_buf_dma(const struct anarchy_ring_pool *pool,
+                                                   unsigned int idx)
+{
+    const struct anarchy_ring_slab *slab = &pool->slabs[idx >> pool->slab_order];
+
+    return slab->dma + ((dma_addr_t)(idx & ((1U << pool->slab_order) - 1)) << PAGE_SHIFT);
+}
+
+#endif /* __ANARCHY_RING_POOL_H__ */
@@ -0,0 +1,52 @@
+#ifndef ANARCHY_RUNTIME_PM_H
+#define ANARCHY_RUNTIME_PM_H
+
+#include <linux/types.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+
+struct anarchy_device;
+struct dentry;
+
+/* Resume latency histogram bucket upper bounds, in microseconds */
+#define ANARCHY_RPM_LAT_BUCKETS 8
+
+/*
+ * Link idle state. While no submission holds a reference, an idle
+ * predictor picks how long to wait before the link drops to ASPM L1 and
+ * register sampling slows to the thermal loop's period. Rings,
+ * descriptors and link training are left alone, so resuming is one config
+ * write, the L1 exit and a return to full-rate sampling.
+ */
+struct anarchy_rpm {
+    struct mutex lock;
+    struct delayed_work idle_work;
+    unsigned int usage;             /* Submissions in flight */
+    bool idle;                      /* Link in low power */
+    bool l1_capable;
+    u64 busy_end_ns;                /* Last reference dropped */
+    u64 idle_start_ns;
+
+    /* Predictor */
+    unsigned int gap_avg_us;        /* EWMA of gaps shorter than the max timeout */
+    unsigned int penalty;           /* Timeout multiplier after early wakeups */
+    unsigned int timeout_us;
+
+    /* Statistics */
+    u64 entries;
+    u64 early_wakeups;              /* Resumed within the break-even time */
+    u64 idle_ns;                    /* Residency in low power */
+    u64 resume_max_ns;             /* ASPM disable through the first read back */
+    u64 resume_hist[ANARCHY_RPM_LAT_BUCKETS];
+};
+
+int anarchy_rpm_init(struct anarchy_device *adev);
+void anarchy_rpm_exit(struct anarchy_device *adev);
+
+/* Bracket hardware access from process context; get resumes if idle */
+int anarchy_rpm_get(struct anarchy_device *adev);
+void anarchy_rpm_put(struct anarchy_device *adev);
+
+void anarchy_rpm_debugfs_init(struct anarchy_device *adev, struct dentry *parent);
+
+#endif /* ANARCHY_RUNTIME_PM_H */
@@ -0,0 +1,84 @@
+#ifndef ANARCHY_TELEMETRY_H
+#define ANARCHY_TELEMETRY_H
+
+#include <linux/types.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/workqueue.h>
+
+struct anarchy_device;
+struct dentry;
+
+/*
+ * One burst of GPU and PCIe register reads. Raw values, converted to the
+ * units below; rates are left to the consumers.
+ */
+struct anarchy_telemetry_sample {
+    u64 seq;
+    u64 timestamp_ns;       /* ktime_get_ns() after the burst */
+    u32 read_ns;            /* Time the burst took */
+    u32 gpu_clock;          /* MHz */
+    u32 mem_clock;          /* MHz */
+    u32 power_draw;         /* Watts */
+    u32 temperature;        /* Celsius */
+    u32 fan_speed;          /* Percent */
+    u32 gpu_util;           /* Percent */
+    u32 mem_util;           /* Percent */
+    u32 vram_used;          /* Megabytes */
+    u32 pcie_rx_counter;    /* Free-running byte counters, wrap at 32 bits */
+    u32 pcie_tx_counter;
+    bool counter_gap;       /* First sample or a long gap, counters may have wrapped twice */
+    struct rcu_head rcu;
+};
+
+/*
+ * A consumer called from the sampler, in process context, at most every
+ * interval_ms (0 = every sample). Callbacks run one at a time and must not
+ * (un)subscribe.
+ */
+struct anarchy_telemetry_sub {
+    struct list_head node;
+    const char *name;
+    unsigned int interval_ms;
+    void (*fn)(struct anarchy_device *adev, struct anarchy_telemetry_sub *sub,
+               const struct anarchy_telemetry_sample *sample);
+    u64 next_ns;            /* Owned by the sampler */
+    u64 calls;
+};
+
+struct anarchy_telemetry {
+    struct anarchy_telemetry_sample __rcu *current_sample;
+    struct delayed_work work;
+    struct mutex sub_lock;  /* Subscriber list; held while callbacks run */
+    struct list_head subs;
+    bool running;
+    bool idle;              /* Link idle, sampling at the thermal period */
+    u64 samples;
+    u32 read_max_ns;
+    u64 read_total_ns;
+};
+
+int anarchy_telemetry_init(struct anarchy_device *adev);
+void anarchy_telemetry_exit(struct anarchy_device *adev);
+void anarchy_telemetry_start(struct anarchy_device *adev);
+void anarchy_telemetry_stop(struct anarchy_device *adev);
+
+/* Slow sampling down to THERMAL_MONITOR_INTERVAL while the link idles */
+void anarchy_telemetry_set_idle(struct anarchy_device *adev, bool idle);
+
+/* Sampling period in ms, from the telemetry_ms module parameter */
+unsigned int anarchy_telemetry_interval_ms(void);
+
+void anarchy_telemetry_subscribe(struct anarchy_device *adev,
+                                 struct anarchy_telemetry_sub *sub);
+void anarchy_telemetry_unsubscribe(struct anarchy_device *adev,
+                                   struct anarchy_telemetry_sub *sub);
+
+/* Copy of the latest sample, -ENODATA before the first one */
+int anarchy_telemetry_get(struct anarchy_device *adev,
+                          struct anarchy_telemetry_sample *out);
+
+void anarchy_telemetry_debugfs_init(struct anarchy_device *adev, struct dentry *parent);
+
+#endif /* ANARCHY_TELEMETRY_H */
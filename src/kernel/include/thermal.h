@@ -5,8 +5,9 @@
 #include "thermal_forward.h"
 #include "gpu_config.h"  /* For fan speed thresholds */
 
-/* Thermal threshold constants */
+/* Thermal threshold constants, millidegrees C */
 #define THERMAL_THRESHOLD_NORMAL   70000  /* 70°C */
+#define THERMAL_THRESHOLD_TARGET   75000  /* 75°C, controller setpoint */
 #define THERMAL_THRESHOLD_WARNING  80000  /* 80°C */
 #define THERMAL_THRESHOLD_CRITICAL 87000  /* 87°C */
 
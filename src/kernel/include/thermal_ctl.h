@@ -0,0 +1,62 @@
+#ifndef ANARCHY_THERMAL_CTL_H
+#define ANARCHY_THERMAL_CTL_H
+
+/*
+ * Predictive thermal controller. Plain integer C with no kernel calls, so
+ * the same file builds into the module and into tests/sim.
+ *
+ * Units: temperature in millidegrees C, power in watts, fan in percent,
+ * time in milliseconds.
+ */
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdbool.h>
+#endif
+
+struct thermal_ctl_params {
+    int target_mc;                  /* Temperature the fan regulates to */
+    int power_target_mc;            /* Power is cut to hold this, fan at max */
+    int critical_mc;                /* Above this the power slew is faster */
+    unsigned int horizon_ms;        /* How far ahead the slope is projected */
+    int rth_mc_per_w;               /* Steady-state rise per watt, feed-forward */
+    int kp;                         /* Effort permille per degree of error */
+    int ki;                         /* Effort permille per degree-second */
+    unsigned int fan_share;         /* Effort permille at which the fan is at max */
+    unsigned int fan_min;
+    unsigned int fan_max;
+    unsigned int fan_slew;          /* Percent per second */
+    unsigned int power_min;
+    unsigned int power_max;         /* Limit when thermals allow */
+    unsigned int power_margin;      /* Cuts start this far above the draw */
+    unsigned int power_slew;        /* Watts per second */
+    unsigned int power_slew_critical;
+};
+
+struct thermal_ctl {
+    struct thermal_ctl_params p;
+    bool primed;
+    int last_mc;
+    int slope;                      /* Millidegrees per second, EWMA */
+    unsigned int power_avg;         /* Slow EWMA of the draw */
+    int integral;                   /* Effort permille x 1000 */
+    int effort;                     /* Fan loop, fan_share and up = fan max */
+    int power_integral;
+    int power_effort;               /* Power loop, 1000 = power_min */
+    int predicted_mc;
+    unsigned int fan;
+    unsigned int power_limit;
+};
+
+void thermal_ctl_default_params(struct thermal_ctl_params *p);
+void thermal_ctl_init(struct thermal_ctl *ctl, const struct thermal_ctl_params *p);
+
+/*
+ * Feed one sample taken @dt_ms after the previous one. Updates ctl->fan
+ * and ctl->power_limit, which the caller applies.
+ */
+void thermal_ctl_step(struct thermal_ctl *ctl, int temp_mc, unsigned int power_w,
+                      unsigned int dt_ms);
+
+#endif /* ANARCHY_THERMAL_CTL_H */
@@ -3,6 +3,10 @@
 
 #include <linux/types.h>
 #include <linux/workqueue.h>
+#include <linux/seqlock.h>
+#include "thermal_ctl.h"
+#include "hold_stat.h"
+#include "telemetry.h"
 
 /* Forward declarations */
 struct anarchy_device;
@@ -13,16 +17,23 @@ typedef void (*thermal_callback_t)(struct anarchy_device *adev);
 /* Thermal profile structure */
 struct thermal_profile {
     struct workqueue_struct *wq;
-    struct delayed_work update_work;
-    spinlock_t lock;
+    struct anarchy_telemetry_sub sub;   /* Sampling, telemetry context */
+    struct work_struct actuate_work;    /* Register writes, no lock held */
+    seqlock_t lock;                     /* Published fields below */
     bool monitoring_enabled;
-    bool throttling;
-    int current_temp;
+    bool throttling;                /* Controller holds power below the ceiling */
+    int current_temp;               /* Millidegrees C */
     int target_fan_speed;
+    unsigned int target_power_limit;
     unsigned long last_update;
-    int max_temp;
-    int warning_threshold;
-    int critical_threshold;
+    u64 last_sample_ns;             /* Telemetry timestamp of the last step */
+    int max_temp;                   /* Millidegrees C */
+    int warning_threshold;          /* Millidegrees C */
+    int critical_threshold;         /* Millidegrees C */
+    struct thermal_ctl ctl;         /* Sampling worker only */
+    unsigned int applied_fan;       /* Last values written, actuate_work only */
+    unsigned int applied_power_limit;
+    struct anarchy_hold_stat hold;  /* Writer side of lock */
     thermal_callback_t warning_callback;
     thermal_callback_t critical_callback;
 };
@@ -0,0 +1,53 @@
+#ifndef ANARCHY_UPLOAD_H
+#define ANARCHY_UPLOAD_H
+
+#include <linux/types.h>
+#include <linux/atomic.h>
+
+struct anarchy_device;
+struct dentry;
+
+/*
+ * CPU stores into device memory. The framebuffer BAR and the PIO window
+ * are mapped write-combined so consecutive stores leave as full 64 byte
+ * TLPs instead of one per store; registers stay in the uncached BAR 2
+ * mapping. Bulk copies use non-temporal stores and a store fence before
+ * anything that tells the device the data is there.
+ */
+#define ANARCHY_FB_BAR                  1
+#define ANARCHY_UPLOAD_BENCH_SIZE       (1 << 20)   /* Top of the aperture */
+
+enum anarchy_upload_mode {
+    ANARCHY_UPLOAD_UC,              /* memcpy_toio() through an uncached mapping */
+    ANARCHY_UPLOAD_WC,              /* memcpy_toio() through the WC mapping */
+    ANARCHY_UPLOAD_WC_NT,           /* anarchy_memcpy_toio_nt() through the WC mapping */
+    ANARCHY_UPLOAD_MODES
+};
+
+struct anarchy_upload {
+    void __iomem *fb;               /* NULL without the BAR */
+    resource_size_t fb_size;
+    bool fb_wc;                     /* Prefetchable, so mapped write-combined */
+    void __iomem *pio;              /* WC alias of the PIO window, NULL = use BAR 2 */
+    atomic64_t bytes;
+    atomic64_t ns;
+    u64 bench_mbps[ANARCHY_UPLOAD_MODES];   /* Last bench run, 0 = not run */
+};
+
+int anarchy_upload_map(struct anarchy_device *adev);
+void anarchy_upload_unmap(struct anarchy_device *adev);
+
+/* Copy @len bytes to I/O memory with streaming stores, fenced on return */
+void anarchy_memcpy_toio_nt(void __iomem *dst, const void *src, size_t len);
+
+/* Store @len bytes at @offset into the framebuffer aperture */
+int anarchy_upload(struct anarchy_device *adev, u64 offset, const void *src, size_t len);
+
+/* Time one mode over the top ANARCHY_UPLOAD_BENCH_SIZE of the aperture */
+int anarchy_upload_bench(struct anarchy_device *adev, enum anarchy_upload_mode mode,
+                         u64 *mbps);
+const char *anarchy_upload_mode_name(enum anarchy_upload_mode mode);
+
+void anarchy_upload_debugfs_init(struct anarchy_device *adev, struct dentry *parent);
+
+#endif /* ANARCHY_UPLOAD_H */
@@ -0,0 +1,33 @@
+#include "include/link_ctl.h"
+
+static int link_ctl_update(const struct link_ctl_ops *ops, void *ctx, u16 clear, u16 set)
+{
+    u16 val;
+    int ret;
+
+    ret = ops->read_ctl(ctx, &val);
+    if (ret)
+        return ret;
+    return ops->write_ctl(ctx, (val & ~clear) | set);
+}
+
+int link_ctl_down(const struct link_ctl_ops *ops, void *ctx, unsigned int timeout_ms)
+{
+    int ret;
+
+    ret = link_ctl_update(ops, ctx, 0, PCI_EXP_LNKCTL_LD);
+    if (ret)
+        return ret;
+    return ops->wait_link(ctx, false, timeout_ms);
+}
+
+int link_ctl_up(const struct link_ctl_ops *ops, void *ctx, bool retrain,
+                unsigned int timeout_ms)
+{
+    int ret;
+
+    ret = link_ctl_update(ops, ctx, PCI_EXP_LNKCTL_LD, retrain ? PCI_EXP_LNKCTL_RL : 0);
+    if (ret)
+        return ret;
+    return ops->wait_link(ctx, true, timeout_ms);
+}
@@ -0,0 +1,219 @@
+#include <linux/module.h>
+#include <linux/pci.h>
+#include <linux/jiffies.h>
+#include "include/anarchy_device.h"
+#include "include/common.h"
+#include "include/pcie_state.h"
+#include "include/link_policy.h"
+#include "include/module_params.h"
+
+/*
+ * Demand thresholds, as percent of a speed's capacity. Stepping up needs
+ * the current speed above UP_PCT; stepping down needs demand to fit under
+ * DOWN_PCT of the lower speed, so a change never lands right at the other
+ * threshold.
+ */
+#define POLICY_UP_PCT           70
+#define POLICY_DOWN_PCT         40
+
+/* Consecutive samples that must agree before acting */
+#define POLICY_UP_VOTES         3
+#define POLICY_DOWN_VOTES       10
+#define POLICY_ERR_VOTES        2
+
+/* Minimum time between two speed changes */
+#define POLICY_DWELL_MS         5000
+
+/* Corrected errors per second that count as a replay storm */
+#define POLICY_ERR_RATE_HIGH    10
+
+/* Error-free time before a lowered ceiling is raised one step */
+#define POLICY_ERR_QUIET_MS     60000
+
+/* Training time allowed for a policy-driven speed change */
+#define POLICY_TRAIN_TIMEOUT_MS 1000
+
+/* Correctable errors that indicate link-level replays */
+#define POLICY_COR_REPLAY_MASK  (PCI_ERR_COR_RCVR | PCI_ERR_COR_BAD_TLP | \
+                                 PCI_ERR_COR_BAD_DLLP | PCI_ERR_COR_REP_ROLL | \
+                                 PCI_ERR_COR_REP_TIMER)
+
+/*
+ * New replay-class corrected errors since the last sample: correctable
+ * errors reported through anarchy_pcie_handle_error() plus replay status
+ * bits that were clear at the previous sample. The status register is
+ * only read; clearing it belongs to the AER driver, which does so after
+ * logging each error, so with native AER every error shows up as a fresh
+ * bit. With firmware-first handling a bit may stay set and then counts
+ * once.
+ */
+static u32 anarchy_link_policy_new_errors(struct anarchy_device *adev)
+{
+    struct anarchy_link_policy *pol = &adev->link_policy;
+    struct pci_dev *pdev = adev->pdev;
+    u32 count = READ_ONCE(adev->pcie_state.corrected_errors);
+    u32 errors = count - pol->last_error_count;
+    u32 status;
+
+    pol->last_error_count = count;
+
+    if (pdev->aer_cap &&
+        !pci_read_config_dword(pdev, pdev->aer_cap + PCI_ERR_COR_STATUS, &status)) {
+        status &= POLICY_COR_REPLAY_MASK;
+        errors += hweight32(status & ~pol->cor_status);
+        pol->cor_status = status;
+    }
+    return errors;
+}
+
+/*
+ * Retraining waits up to a second for the link, far too long for the
+ * telemetry subscriber that samples the policy, so it runs here.
+ */
+static void anarchy_link_policy_apply_work(struct work_struct *work)
+{
+    struct anarchy_link_policy *pol = container_of(work, struct anarchy_link_policy,
+                                                   apply_work);
+    struct anarchy_device *adev = container_of(pol, struct anarchy_device, link_policy);
+    enum anarchy_pcie_speed from = adev->pcie_state.speed;
+    enum anarchy_pcie_speed target = pol->target;
+    int ret;
+
+    ret = anarchy_pcie_set_speed(adev, target);
+    if (!ret)
+        ret = anarchy_pcie_wait_link(adev, true, POLICY_TRAIN_TIMEOUT_MS);
+    if (ret) {
+        dev_warn(adev->dev, "Link speed change gen%d -> gen%d failed: %d\n",
+                 from, target, ret);
+        anarchy_pcie_handle_error(adev, ANARCHY_PCIE_ERR_TRAINING);
+    } else {
+        anarchy_pcie_update_link_status(adev);
+        anarchy_pcie_set_state(adev, ANARCHY_PCIE_STATE_ACTIVE);
+        pol->changes++;
+        dev_info(adev->dev, "Link speed gen%d -> gen%d (%s)\n", from,
+                 adev->pcie_state.speed, pol->why);
+    }
+    smp_store_release(&pol->applying, false);
+}
+
+static void anarchy_link_policy_apply(struct anarchy_device *adev,
+                                      enum anarchy_pcie_speed target, const char *why)
+{
+    struct anarchy_link_policy *pol = &adev->link_policy;
+
+    pol->up_votes = 0;
+    pol->down_votes = 0;
+    pol->hold_until = jiffies + msecs_to_jiffies(POLICY_DWELL_MS);
+
+    pol->target = target;
+    pol->why = why;
+    pol->applying = true;
+    queue_work(system_long_wq, &pol->apply_work);
+}
+
+/*
+ * Feed one bandwidth sample (bytes/sec in the busier direction) into
+ * the policy. A speed change is queued, not waited for; samples that
+ * arrive while it runs are dropped.
+ */
+void anarchy_link_policy_sample(struct anarchy_device *adev, u64 demand_bps)
+{
+    struct anarchy_link_policy *pol = &adev->link_policy;
+    enum anarchy_pcie_speed speed = adev->pcie_state.speed;
+    u32 width = adev->pcie_state.link_width;
+    unsigned long now = jiffies;
+    unsigned int elapsed_ms;
+    u64 capacity, lower_capacity;
+    u32 errors, rate;
+
+    if (!READ_ONCE(pol->enabled) || adev->link_speed || smp_load_acquire(&pol->applying) ||
+        adev->pcie_state.state != ANARCHY_PCIE_STATE_ACTIVE)
+        return;
+
+    elapsed_ms = jiffies_to_msecs(now - pol->last_sample);
+    pol->last_sample = now;
+    if (!elapsed_ms)
+        return;
+
+    /* Corrected-error rate, EWMA with weight 1/4 */
+    errors = anarchy_link_policy_new_errors(adev);
+    rate = div_u64((u64)errors * 1000, elapsed_ms);
+    pol->err_rate = pol->err_rate - pol->err_rate / 4 + rate / 4;
+
+    if (pol->err_rate >= POLICY_ERR_RATE_HIGH) {
+        pol->quiet_since = now;
+        if (++pol->err_votes >= POLICY_ERR_VOTES && speed > ANARCHY_PCIE_GEN1) {
+            /* Errors override the dwell time, a replay storm costs more */
+            pol->err_votes = 0;
+            pol->ceiling = speed - 1;
+            anarchy_link_policy_apply(adev, speed - 1, "corrected error storm");
+        }
+        return;
+    }
+    pol->err_votes = 0;
+
+    /* Quiet long enough, allow one step more */
+    if (pol->ceiling < pol->max_speed &&
+        time_after(now, pol->quiet_since + msecs_to_jiffies(POLICY_ERR_QUIET_MS))) {
+        pol->ceiling++;
+        pol->quiet_since = now;
+    }
+
+    if (time_before(now, pol->hold_until))
+        return;
+
+    capacity = anarchy_pcie_speed_capacity(speed, width);
+    lower_capacity = speed > ANARCHY_PCIE_GEN1 ?
+                     anarchy_pcie_speed_capacity(speed - 1, width) : 0;
+    if (!capacity)
+        return;
+
+    if (demand_bps * 100 > capacity * POLICY_UP_PCT && speed < pol->ceiling) {
+        pol->down_votes = 0;
+        if (++pol->up_votes >= POLICY_UP_VOTES)
+            anarchy_link_policy_apply(adev, speed + 1, "bandwidth demand");
+    } else if (lower_capacity && demand_bps * 100 < lower_capacity * POLICY_DOWN_PCT) {
+        pol->up_votes = 0;
+        if (++pol->down_votes >= POLICY_DOWN_VOTES)
+            anarchy_link_policy_apply(adev, speed - 1, "low demand");
+    } else {
+        pol->up_votes = 0;
+        pol->down_votes = 0;
+    }
+}
+EXPORT_SYMBOL_GPL(anarchy_link_policy_sample);
+
+int anarchy_link_policy_init(struct anarchy_device *adev)
+{
+    struct anarchy_link_policy *pol = &adev->link_policy;
+    u32 lnk_cap;
+    int ret;
+
+    memset(pol, 0, sizeof(*pol));
+    INIT_WORK(&pol->apply_work, anarchy_link_policy_apply_work);
+
+    ret = pcie_capability_read_dword(adev->pdev, PCI_EXP_LNKCAP, &lnk_cap);
+    if (ret)
+        return ret;
+
+    pol->max_speed = lnk_cap & PCI_EXP_LNKCAP_SLS;
+    pol->ceiling = pol->max_speed;
+    pol->last_sample = jiffies;
+    pol->quiet_since = jiffies;
+    pol->last_error_count = READ_ONCE(adev->pcie_state.corrected_errors);
+    pol->enabled = link_policy;
+    return 0;
+}
+EXPORT_SYMBOL_GPL(anarchy_link_policy_init);
+
+/* No speed change is queued or running on return */
+void anarchy_link_policy_exit(struct anarchy_device *adev)
+{
+    struct anarchy_link_policy *pol = &adev->link_policy;
+
+    WRITE_ONCE(pol->enabled, false);
+    if (pol->apply_work.func)
+        cancel_work_sync(&pol->apply_work);
+    pol->applying = false;
+}
+EXPORT_SYMBOL_GPL(anarchy_link_policy_exit);
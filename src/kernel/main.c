@@ -16,10 +16,22 @@
 #include "include/module_params.h"
 #include "include/thunderbolt_service.h"
 
+#define CREATE_TRACE_POINTS
+#include "include/anarchy_events.h"
+
 /* Module parameters */
 int power_limit = 175;  /* Default power limit in watts */
 int num_dma_channels = 8;  /* Default number of DMA channels */
 int test_mode = 0;  /* Test mode disabled by default */
+bool link_policy = true;  /* Demand/error driven link speed */
+unsigned int telemetry_ms = 100;  /* Register sampling period */
+bool frame_governor = true;  /* Frame-aware power limit and clocks */
+unsigned int frame_boost_w;  /* Watts a frame boost may add over the profile */
+unsigned int idle_timeout_ms = 50;  /* Longest wait before the link idles */
+unsigned int trace_buf_kb = 1024;  /* Per-CPU command trace buffer */
+unsigned int ring_buffer_size;  /* Descriptors per ring, 0 = driver default */
+int dma_pio_max = -1;  /* Transfer path limits, -1 = measured at connect */
+int dma_bounce_max = -1;
 
 module_param(power_limit, int, 0644);
 MODULE_PARM_DESC(power_limit, "Power limit in watts (default: 175)");
@@ -27,6 +39,24 @@ module_param(num_dma_channels, int, 0644);
 MODULE_PARM_DESC(num_dma_channels, "Number of DMA channels (default: 8)");
 module_param(test_mode, int, 0644);
 MODULE_PARM_DESC(test_mode, "Enable test mode without Thunderbolt hardware (0=disabled, 1=enabled)");
+module_param(link_policy, bool, 0644);
+MODULE_PARM_DESC(link_policy, "Pick PCIe link speed from bandwidth demand and error rate (default: true)");
+module_param(telemetry_ms, uint, 0644);
+MODULE_PARM_DESC(telemetry_ms, "GPU/PCIe register sampling period in ms, 10-500 (default: 100)");
+module_param(frame_governor, bool, 0444);
+MODULE_PARM_DESC(frame_governor, "Boost power and clocks inside frames, relax between them (default: true)");
+module_param(frame_boost_w, uint, 0444);
+MODULE_PARM_DESC(frame_boost_w, "Watts a frame boost may draw over the profile power limit (default: 0)");
+module_param(idle_timeout_ms, uint, 0644);
+MODULE_PARM_DESC(idle_timeout_ms, "Longest idle wait before the link enters L1, 0 = never (default: 50)");
+module_param(trace_buf_kb, uint, 0644);
+MODULE_PARM_DESC(trace_buf_kb, "Per-CPU command trace buffer in KiB, allocated when tracing is enabled (default: 1024)");
+module_param(ring_buffer_size, uint, 0644);
+MODULE_PARM_DESC(ring_buffer_size, "Descriptors per DMA ring, power of two, 16-4096 (default: 32)");
+module_param(dma_pio_max, int, 0444);
+MODULE_PARM_DESC(dma_pio_max, "Largest transfer in bytes written through the PIO window, up to 4096, -1 = measure at connect (default: -1)");
+module_param(dma_bounce_max, int, 0444);
+MODULE_PARM_DESC(dma_bounce_max, "Largest transfer in bytes copied through the bounce buffer, up to 65536, -1 = measure at connect (default: -1)");
 
 /* Forward declarations */
 static void anarchy_service_shutdown(struct device *dev);
@@ -81,11 +111,8 @@ static void anarchy_service_shutdown(struct device *dev)
     if (!adev)
         return;
 
-    /* Disable performance monitoring */
-    if (adev->perf_monitor.enabled) {
-        cancel_delayed_work_sync(&adev->perf_monitor.update_work);
-        adev->perf_monitor.enabled = false;
-    }
+    /* Stop register sampling */
+    anarchy_telemetry_stop(adev);
 
     /* Power down the GPU */
     anarchy_gpu_power_down(adev);
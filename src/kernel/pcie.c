@@ -1,23 +1,101 @@
 #include <linux/module.h>
 #include <linux/pci.h>
 #include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/random.h>
 #include "include/anarchy_device.h"
 #include "include/common.h"
 #include "include/pcie_types.h"
 #include "include/pcie_forward.h"
 #include "include/pcie_recovery.h"
 #include "include/pcie_state.h"
+#include "include/dma.h"
+#include "include/chardev.h"
+#include "include/link_policy.h"
+#include "include/link_ctl.h"
 #include "pcie.h"
+#include "include/anarchy_events.h"
 
 /* PCI Express Link Status register bits */
 #define PCI_EXP_LNKSTA_DLLLA    0x2000  /* Data Link Layer Link Active */
 
+/* Link state polling: exponential back-off between these bounds */
+#define LINK_POLL_MIN_US          10
+#define LINK_POLL_MAX_US          5000
+
+/* Upper bounds for the polls that replace the old fixed sleeps */
+#define LINK_TRAIN_TIMEOUT_MS     1000
+#define LINK_DOWN_TIMEOUT_MS      100
+#define LINK_TB_SETTLE_TIMEOUT_MS 2000
+
+/* Recovery ladder back-off and rung learning */
+#define RECOVERY_BACKOFF_MIN_MS   10
+#define RECOVERY_BACKOFF_MAX_MS   2000
+#define RECOVERY_SCORE_ONE        1024  /* Score of a rung that always works */
+#define RECOVERY_SCORE_WEIGHT     8     /* EWMA weight 1/8 */
+#define RECOVERY_SKIP_SCORE       128   /* Skip rungs below ~12% success... */
+#define RECOVERY_MIN_HISTORY      4     /* ...once they have this many attempts */
+#define RECOVERY_RETRY_SKIPPED    8     /* Skipped this often, a rung runs again */
+
 /* Forward declarations */
 static void anarchy_pcie_recovery_work(struct work_struct *work);
 
+/* Every link state change goes through here so it shows up in the trace */
+void anarchy_pcie_set_state(struct anarchy_device *adev, enum anarchy_pcie_link_state state)
+{
+    struct anarchy_pcie_state *ps = &adev->pcie_state;
+
+    if (ps->state != state)
+        trace_anarchy_pcie_state(adev, ps->state, state, ps->speed, ps->link_width);
+    WRITE_ONCE(ps->state, state);
+}
+EXPORT_SYMBOL_GPL(anarchy_pcie_set_state);
+
+/*
+ * Link Disable, Retrain Link, Target Link Speed and the Link Training and
+ * DLLLA status bits belong to the downstream port above the device; in an
+ * endpoint's own capability they are reserved and read as zero. A device
+ * with no bridge above it, root complex integrated, has no link to manage
+ * and gets its own registers.
+ */
+static struct pci_dev *anarchy_pcie_link_port(struct pci_dev *pdev)
+{
+    struct pci_dev *bridge = pci_upstream_bridge(pdev);
+
+    return bridge ? bridge : pdev;
+}
+
+static int anarchy_pcie_read_ctl(void *ctx, u16 *val)
+{
+    struct anarchy_device *adev = ctx;
+
+    return pcie_capability_read_word(anarchy_pcie_link_port(adev->pdev), PCI_EXP_LNKCTL, val);
+}
+
+static int anarchy_pcie_write_ctl(void *ctx, u16 val)
+{
+    struct anarchy_device *adev = ctx;
+
+    return pcie_capability_write_word(anarchy_pcie_link_port(adev->pdev), PCI_EXP_LNKCTL, val);
+}
+
+static int anarchy_pcie_wait_ctl(void *ctx, bool up, unsigned int timeout_ms)
+{
+    return anarchy_pcie_wait_link(ctx, up, timeout_ms);
+}
+
+static const struct link_ctl_ops anarchy_pcie_link_ops = {
+    .read_ctl = anarchy_pcie_read_ctl,
+    .write_ctl = anarchy_pcie_write_ctl,
+    .wait_link = anarchy_pcie_wait_ctl,
+};
+
 static int pcie_set_link_speed(struct anarchy_device *adev, enum anarchy_pcie_speed speed)
 {
-    struct pci_dev *pdev = adev->pdev;
+    struct pci_dev *pdev = anarchy_pcie_link_port(adev->pdev);
     u16 lnk_ctrl2;
     int ret;
 
@@ -48,28 +126,65 @@ static int pcie_set_link_width(struct anarchy_device *adev, enum anarchy_pcie_wi
     return 0;
 }
 
-static int anarchy_pcie_check_link_config(struct anarchy_device *adev)
+int anarchy_pcie_update_link_status(struct anarchy_device *adev)
 {
-    struct pci_dev *pdev = adev->pdev;
     u16 lnk_stat;
     int ret;
 
-    ret = pcie_capability_read_word(pdev, PCI_EXP_LNKSTA, &lnk_stat);
+    ret = pcie_capability_read_word(adev->pdev, PCI_EXP_LNKSTA, &lnk_stat);
     if (ret)
         return ret;
 
     adev->pcie_state.speed = (lnk_stat & PCI_EXP_LNKSTA_CLS) >> 0;
     adev->pcie_state.link_width = (lnk_stat & PCI_EXP_LNKSTA_NLW) >> 4;
+    return 0;
+}
+EXPORT_SYMBOL_GPL(anarchy_pcie_update_link_status);
 
-    if (adev->pcie_state.speed < ANARCHY_PCIE_GEN4)
-        return ANARCHY_PCIE_ERR_SPEED_DOWNGRADE;
+/*
+ * Refresh speed and width after training. Running below the fastest
+ * speed is normal (the link policy lowers it on purpose); only a link
+ * that reports no negotiated width at all has failed to train.
+ */
+static int anarchy_pcie_check_link_config(struct anarchy_device *adev)
+{
+    int ret;
+
+    ret = anarchy_pcie_update_link_status(adev);
+    if (ret)
+        return ret;
 
-    if (adev->pcie_state.link_width < ANARCHY_PCIE_x8)
-        return ANARCHY_PCIE_ERR_WIDTH_DOWNGRADE;
+    if (!adev->pcie_state.link_width)
+        return -ENOLINK;
+
+    if (adev->pcie_state.link_width < ANARCHY_PCIE_x4)
+        dev_dbg(adev->dev, "PCIe link trained at x%u\n", adev->pcie_state.link_width);
 
     return 0;
 }
 
+/*
+ * Bring the link up from any state, disabled included, and check what it
+ * trained to. @retrain also retrains a link that was already up.
+ */
+static int anarchy_pcie_bring_up(struct anarchy_device *adev, bool retrain)
+{
+    int ret;
+
+    anarchy_pcie_set_state(adev, ANARCHY_PCIE_STATE_TRAINING);
+
+    ret = link_ctl_up(&anarchy_pcie_link_ops, adev, retrain, LINK_TRAIN_TIMEOUT_MS);
+    if (!ret)
+        ret = anarchy_pcie_check_link_config(adev);
+    if (ret) {
+        anarchy_pcie_set_state(adev, ANARCHY_PCIE_STATE_ERROR);
+        return ret;
+    }
+
+    anarchy_pcie_set_state(adev, ANARCHY_PCIE_STATE_ACTIVE);
+    return 0;
+}
+
 int anarchy_pcie_init(struct anarchy_device *adev)
 {
     int ret;
@@ -86,6 +201,11 @@ int anarchy_pcie_init(struct anarchy_device *adev)
         return ret;
     }
 
+    /* Without a policy the link just stays at the trained speed */
+    ret = anarchy_link_policy_init(adev);
+    if (ret)
+        dev_warn(adev->dev, "Link speed policy unavailable: %d\n", ret);
+
     return 0;
 }
 EXPORT_SYMBOL_GPL(anarchy_pcie_init);
@@ -95,8 +215,14 @@ void anarchy_pcie_exit(struct anarchy_device *adev)
     if (!adev)
         return;
 
-    /* Disable PCIe link */
-    anarchy_pcie_disable(adev);
+    /* No policy retrain may race the disable */
+    anarchy_link_policy_exit(adev);
+
+    /*
+     * Only our state goes down: a disabled port would keep the link dead
+     * for whoever binds next, and a reload trains it again anyway.
+     */
+    anarchy_pcie_disable_link(adev);
 
     /* Cleanup PCIe state */
     anarchy_pcie_cleanup_state(adev);
@@ -111,8 +237,12 @@ void anarchy_pcie_disable(struct anarchy_device *adev)
     /* Disable PCIe link */
     anarchy_pcie_disable_link(adev);
 
-    /* Wait for link to go down */
-    msleep(100);
+    if (!adev->pdev)
+        return;
+
+    /* Return as soon as the data link layer reports the link gone */
+    if (link_ctl_down(&anarchy_pcie_link_ops, adev, LINK_DOWN_TIMEOUT_MS))
+        dev_dbg(adev->dev, "PCIe link still active after disable\n");
 }
 EXPORT_SYMBOL_GPL(anarchy_pcie_disable);
 
@@ -121,124 +251,328 @@ void anarchy_pcie_disable_link(struct anarchy_device *adev)
     unsigned long flags;
 
     spin_lock_irqsave(&adev->pcie_state.recovery.recovery_lock, flags);
-    adev->pcie_state.state = ANARCHY_PCIE_STATE_LINK_DOWN;
+    anarchy_pcie_set_state(adev, ANARCHY_PCIE_STATE_LINK_DOWN);
     adev->pcie_state.recovery.last_down = jiffies;
     atomic_set(&adev->pcie_state.recovery.retries, 0);
     spin_unlock_irqrestore(&adev->pcie_state.recovery.recovery_lock, flags);
 }
 
-static void anarchy_pcie_recovery_work(struct work_struct *work)
+/*
+ * Recovery ladder, cheapest rung first. Each rung only kicks off its
+ * action; the work item then polls for the link within the rung's budget
+ * and escalates to the next rung after a jittered back-off.
+ */
+static int anarchy_pcie_rung_retrain(struct anarchy_device *adev)
+{
+    return anarchy_pcie_request_retrain(adev);
+}
+
+static int anarchy_pcie_rung_downshift(struct anarchy_device *adev)
 {
-    struct anarchy_device *adev = container_of(work, struct anarchy_device,
-                                             pcie_state.recovery.recovery_work);
+    enum anarchy_pcie_speed speed = adev->pcie_state.speed;
     int ret;
 
-    /* Attempt PCIe link recovery */
-    ret = anarchy_pcie_train_link(adev);
+    if (speed <= ANARCHY_PCIE_GEN1)
+        return -ERANGE;
+
+    ret = anarchy_pcie_set_speed(adev, speed - 1);
+    if (!ret)
+        adev->pcie_state.recovery.downshifted = true;
+    return ret;
+}
+
+/*
+ * A bus or Thunderbolt reset puts the device back to its power-on state:
+ * the registers the driver programmed are lost, and so are the descriptors
+ * the device was working on. Before the first reset of a recovery, stop
+ * register sampling and park the rings. anarchy_pcie_restore_device()
+ * undoes both once the link is back.
+ */
+static void anarchy_pcie_prepare_reset(struct anarchy_device *adev)
+{
+    struct anarchy_pcie_recovery *rec = &adev->pcie_state.recovery;
+
+    if (rec->device_reset)
+        return;
+    rec->device_reset = true;
+    anarchy_telemetry_stop(adev);
+    anarchy_ring_checkpoint(adev, &adev->tx_ring);
+    anarchy_ring_checkpoint(adev, &adev->rx_ring);
+}
+
+/*
+ * Config space comes back with pci_reset_bus(); the rest is what
+ * anarchy_device_init() programmed: the power profile and DMA setup. The
+ * parked descriptors are then replayed, oldest first.
+ */
+static void anarchy_pcie_restore_device(struct anarchy_device *adev)
+{
+    int ret, tx, rx;
+
+    ret = anarchy_power_set_profile(adev, &adev->power_profile);
     if (ret)
-        goto try_tb_recovery;
+        dev_warn(adev->dev, "power profile not restored after reset: %d\n", ret);
+    anarchy_dma_optimize_transfers(adev);
 
-    /* Wait for link */
-    msleep(100);
+    tx = anarchy_ring_restore(adev, &adev->tx_ring);
+    rx = anarchy_ring_restore(adev, &adev->rx_ring);
+    anarchy_telemetry_start(adev);
+    dev_info(adev->dev, "device state restored after reset, replayed %d TX %d RX\n", tx, rx);
+}
 
-    if (pcie_link_is_up(adev->pdev)) {
-        ret = anarchy_pcie_check_link_config(adev);
-        if (ret == 0) {
-            adev->pcie_state.state = ANARCHY_PCIE_STATE_NORMAL;
-            return;
-        }
+static int anarchy_pcie_rung_bus_reset(struct anarchy_device *adev)
+{
+    anarchy_pcie_prepare_reset(adev);
+    /* Saves and restores config space of everything below the bridge */
+    return pci_reset_bus(adev->pdev);
+}
+
+static int anarchy_pcie_rung_tb_reset(struct anarchy_device *adev)
+{
+    anarchy_pcie_prepare_reset(adev);
+    if (!tb_service_reset(adev->service))
+        return -EIO;
+
+    /* The tunnel comes back first, then the link has to be retrained */
+    anarchy_pcie_wait_link(adev, true, LINK_TB_SETTLE_TIMEOUT_MS);
+    return anarchy_pcie_request_retrain(adev);
+}
+
+static const struct anarchy_pcie_rung_desc {
+    const char *name;
+    unsigned int budget_ms;     /* Time allowed for the link to come back */
+    int (*run)(struct anarchy_device *adev);
+} pcie_rungs[ANARCHY_PCIE_RUNG_COUNT] = {
+    [ANARCHY_PCIE_RUNG_RETRAIN]   = { "retrain",   200,  anarchy_pcie_rung_retrain },
+    [ANARCHY_PCIE_RUNG_DOWNSHIFT] = { "downshift", 400,  anarchy_pcie_rung_downshift },
+    [ANARCHY_PCIE_RUNG_BUS_RESET] = { "bus-reset", 1000, anarchy_pcie_rung_bus_reset },
+    [ANARCHY_PCIE_RUNG_TB_RESET]  = { "tb-reset",  3000, anarchy_pcie_rung_tb_reset },
+};
+
+/*
+ * Start at the cheapest rung that has been worth trying on this link.
+ * Rungs with enough history and a success score below the skip threshold
+ * are passed over. A score only moves when its rung runs, so a rung that
+ * has been passed over RECOVERY_RETRY_SKIPPED times is tried again, in
+ * case the link or the dock has changed. The last rung is always tried.
+ * Called with recovery_lock held.
+ */
+static enum anarchy_pcie_rung anarchy_pcie_first_rung(struct anarchy_pcie_recovery *rec)
+{
+    struct anarchy_pcie_rung_stats *rs;
+    enum anarchy_pcie_rung rung;
+
+    for (rung = 0; rung < ANARCHY_PCIE_RUNG_TB_RESET; rung++) {
+        rs = &rec->rungs[rung];
+        if (rs->attempts < RECOVERY_MIN_HISTORY || rs->score >= RECOVERY_SKIP_SCORE ||
+            rs->skipped >= RECOVERY_RETRY_SKIPPED)
+            return rung;
+        rs->skipped++;
     }
+    return ANARCHY_PCIE_RUNG_TB_RESET;
+}
 
-try_tb_recovery:
-    /* If standard recovery failed, try Thunderbolt-specific recovery */
-    ret = tb_service_reset(adev->service);
-    if (ret) {
-        dev_err(adev->dev, "Thunderbolt service reset failed: %d\n", ret);
-        goto recovery_failed;
+/* Exponential back-off with +/-25% jitter so resets from several devices spread out */
+static unsigned long anarchy_pcie_recovery_delay(unsigned int step)
+{
+    unsigned int ms = min_t(unsigned int, RECOVERY_BACKOFF_MIN_MS << min(step, 16U),
+                            RECOVERY_BACKOFF_MAX_MS);
+
+    ms = ms - ms / 4 + get_random_u32_below(ms / 2 + 1);
+    return msecs_to_jiffies(ms);
+}
+
+static void anarchy_pcie_record_rung(struct anarchy_pcie_recovery *rec,
+                                     enum anarchy_pcie_rung rung, bool success, u32 us)
+{
+    struct anarchy_pcie_rung_stats *rs = &rec->rungs[rung];
+    unsigned long flags;
+
+    spin_lock_irqsave(&rec->recovery_lock, flags);
+    rs->attempts++;
+    rs->skipped = 0;
+    rs->total_us += us;
+    rs->score -= rs->score / RECOVERY_SCORE_WEIGHT;
+    if (success) {
+        rs->successes++;
+        rs->score += RECOVERY_SCORE_ONE / RECOVERY_SCORE_WEIGHT;
     }
+    spin_unlock_irqrestore(&rec->recovery_lock, flags);
+}
+
+static void anarchy_pcie_recovery_finish(struct anarchy_device *adev, bool success)
+{
+    struct anarchy_pcie_recovery *rec = &adev->pcie_state.recovery;
+    u32 us = ktime_us_delta(ktime_get(), rec->started);
+    unsigned long flags;
+
+    spin_lock_irqsave(&rec->recovery_lock, flags);
+    if (success) {
+        rec->recoveries++;
+        rec->total_recovery_us += us;
+        rec->last_recovery_us = us;
+        anarchy_pcie_set_state(adev, ANARCHY_PCIE_STATE_NORMAL);
+    } else {
+        rec->failures++;
+        anarchy_pcie_set_state(adev, ANARCHY_PCIE_STATE_ERROR);
+    }
+    rec->active = false;
+    atomic_set(&rec->retries, 0);
+    spin_unlock_irqrestore(&rec->recovery_lock, flags);
+
+    /* Nothing will take the parked descriptors back; stopping counts them as lost */
+    if (!success && rec->device_reset) {
+        anarchy_ring_stop(adev, &adev->rx_ring);
+        anarchy_ring_stop(adev, &adev->tx_ring);
+    }
+}
+
+static void anarchy_pcie_recovery_work(struct work_struct *work)
+{
+    struct anarchy_pcie_recovery *rec = container_of(to_delayed_work(work),
+                                                     struct anarchy_pcie_recovery,
+                                                     recovery_work);
+    struct anarchy_device *adev = container_of(rec, struct anarchy_device,
+                                               pcie_state.recovery);
+    enum anarchy_pcie_rung rung = rec->rung;
+    const struct anarchy_pcie_rung_desc *desc = &pcie_rungs[rung];
+    ktime_t start = ktime_get();
+    unsigned long flags;
+    int ret;
 
-    /* Wait for Thunderbolt link to stabilize */
-    msleep(500);
-
-    /* Try PCIe link training again */
-    ret = anarchy_pcie_train_link(adev);
-    if (ret == 0) {
-        if (pcie_link_is_up(adev->pdev)) {
-            ret = anarchy_pcie_check_link_config(adev);
-            if (ret == 0) {
-                adev->pcie_state.state = ANARCHY_PCIE_STATE_NORMAL;
-                return;
-            }
+    ret = desc->run(adev);
+    if (!ret)
+        ret = anarchy_pcie_wait_link(adev, true, desc->budget_ms);
+
+    if (ret != -ERANGE)
+        anarchy_pcie_record_rung(rec, rung, !ret, ktime_us_delta(ktime_get(), start));
+
+    if (!ret) {
+        anarchy_pcie_update_link_status(adev);
+        if (rec->downshifted) {
+            /* Whichever rung got the link back, it trained at the lowered speed */
+            adev->link_policy.ceiling = adev->pcie_state.speed;
+            adev->link_policy.quiet_since = jiffies;
         }
+        if (rec->device_reset)
+            anarchy_pcie_restore_device(adev);
+        anarchy_pcie_recovery_finish(adev, true);
+        dev_info(adev->dev, "PCIe link recovered by %s in %u us (gen%d x%u)\n",
+                 desc->name, rec->last_recovery_us, adev->pcie_state.speed,
+                 adev->pcie_state.link_width);
+        anarchy_chardev_notify(adev, ANARCHY_EVENT_LINK_UP, rung, rec->last_recovery_us);
+        return;
     }
 
-recovery_failed:
-    /* All recovery attempts failed */
-    dev_err(adev->dev, "PCIe recovery failed after Thunderbolt reset\n");
-    adev->pcie_state.state = ANARCHY_PCIE_STATE_ERROR;
+    dev_dbg(adev->dev, "PCIe recovery rung %s failed: %d\n", desc->name, ret);
+
+    if (rung < ANARCHY_PCIE_RUNG_TB_RESET) {
+        rec->rung = rung + 1;
+    } else if (atomic_inc_return(&rec->retries) < ANARCHY_PCIE_MAX_RETRIES) {
+        /* Whole ladder failed, go round again after a longer pause */
+        spin_lock_irqsave(&rec->recovery_lock, flags);
+        rec->rung = anarchy_pcie_first_rung(rec);
+        spin_unlock_irqrestore(&rec->recovery_lock, flags);
+    } else {
+        dev_err(adev->dev, "PCIe recovery failed after %d passes\n",
+                ANARCHY_PCIE_MAX_RETRIES);
+        anarchy_pcie_recovery_finish(adev, false);
+        anarchy_chardev_notify(adev, ANARCHY_EVENT_LINK_DOWN, ret, 0);
+        return;
+    }
+
+    schedule_delayed_work(&rec->recovery_work, anarchy_pcie_recovery_delay(rec->step++));
 }
 
 void anarchy_pcie_handle_error(struct anarchy_device *adev,
                              enum anarchy_pcie_error_type error)
 {
     struct anarchy_pcie_state *pcie = &adev->pcie_state;
+    struct anarchy_pcie_recovery *rec = &pcie->recovery;
     unsigned long flags;
+    bool start;
 
-    spin_lock_irqsave(&pcie->recovery.recovery_lock, flags);
-
-    if (atomic_read(&pcie->recovery.retries) >= ANARCHY_PCIE_MAX_RETRIES) {
-        pcie->state = ANARCHY_PCIE_STATE_ERROR;
-        spin_unlock_irqrestore(&pcie->recovery.recovery_lock, flags);
+    if (error == ANARCHY_PCIE_ERR_CORRECTABLE) {
+        /* Corrected by the link itself; the speed policy watches the rate */
+        WRITE_ONCE(pcie->corrected_errors, pcie->corrected_errors + 1);
         return;
     }
 
-    atomic_inc(&pcie->recovery.retries);
-    pcie->state = ANARCHY_PCIE_STATE_RECOVERY;
-    schedule_work(&pcie->recovery.recovery_work);
+    spin_lock_irqsave(&rec->recovery_lock, flags);
+    pcie->error_count++;
+    start = !rec->active;
+    if (start) {
+        /* Errors during a recovery belong to that recovery */
+        rec->active = true;
+        rec->started = ktime_get();
+        rec->step = 0;
+        rec->downshifted = false;
+        rec->device_reset = false;
+        rec->rung = anarchy_pcie_first_rung(rec);
+        atomic_set(&rec->retries, 0);
+        pcie->state = ANARCHY_PCIE_STATE_RECOVERY;
+        schedule_delayed_work(&rec->recovery_work, 0);
+    }
+    spin_unlock_irqrestore(&rec->recovery_lock, flags);
 
-    spin_unlock_irqrestore(&pcie->recovery.recovery_lock, flags);
+    anarchy_chardev_notify(adev, ANARCHY_EVENT_PCIE_ERROR, error, start ? rec->rung : 0);
 }
 
 int anarchy_pcie_train_link(struct anarchy_device *adev)
 {
-    struct pci_dev *pdev = adev->pdev;
+    return anarchy_pcie_bring_up(adev, true);
+}
+
+/*
+ * Kick off link retraining and return immediately. Callers that need the
+ * link back poll pcie_link_is_up() instead of sleeping a fixed time.
+ */
+int anarchy_pcie_request_retrain(struct anarchy_device *adev)
+{
+    struct pci_dev *port = anarchy_pcie_link_port(adev->pdev);
     u16 lnk_ctrl;
     int ret;
 
-    /* Set link state to training */
-    adev->pcie_state.state = ANARCHY_PCIE_STATE_TRAINING;
-
-    /* Read link control register */
-    ret = pcie_capability_read_word(pdev, PCI_EXP_LNKCTL, &lnk_ctrl);
+    ret = pcie_capability_read_word(port, PCI_EXP_LNKCTL, &lnk_ctrl);
     if (ret)
         return ret;
 
-    /* Initiate link training */
+    anarchy_pcie_set_state(adev, ANARCHY_PCIE_STATE_TRAINING);
     lnk_ctrl |= PCI_EXP_LNKCTL_RL;
-    ret = pcie_capability_write_word(pdev, PCI_EXP_LNKCTL, lnk_ctrl);
-    if (ret)
-        return ret;
+    return pcie_capability_write_word(port, PCI_EXP_LNKCTL, lnk_ctrl);
+}
+EXPORT_SYMBOL_GPL(anarchy_pcie_request_retrain);
 
-    /* Wait for link training to complete */
-    msleep(100);
+/* Set the target link speed (UNKNOWN = highest supported) and retrain */
+int anarchy_pcie_set_speed(struct anarchy_device *adev, enum anarchy_pcie_speed speed)
+{
+    u32 lnk_cap;
+    int ret;
 
-    /* Check link status */
-    ret = anarchy_pcie_check_link_config(adev);
-    if (ret) {
-        adev->pcie_state.state = ANARCHY_PCIE_STATE_ERROR;
-        return ret;
+    if (!adev || !adev->pdev)
+        return -EINVAL;
+
+    if (speed == ANARCHY_PCIE_SPEED_UNKNOWN) {
+        ret = pcie_capability_read_dword(adev->pdev, PCI_EXP_LNKCAP, &lnk_cap);
+        if (ret)
+            return ret;
+        speed = lnk_cap & PCI_EXP_LNKCAP_SLS;
     }
 
-    adev->pcie_state.state = ANARCHY_PCIE_STATE_ACTIVE;
-    return 0;
+    ret = pcie_set_link_speed(adev, speed);
+    if (ret)
+        return ret;
+
+    return anarchy_pcie_request_retrain(adev);
 }
+EXPORT_SYMBOL_GPL(anarchy_pcie_set_speed);
 
 bool pcie_link_is_up(struct pci_dev *pdev)
 {
     u16 lnk_stat;
     int ret;
 
-    ret = pcie_capability_read_word(pdev, PCI_EXP_LNKSTA, &lnk_stat);
+    ret = pcie_capability_read_word(anarchy_pcie_link_port(pdev), PCI_EXP_LNKSTA, &lnk_stat);
     if (ret)
         return false;
 
@@ -246,6 +580,128 @@ bool pcie_link_is_up(struct pci_dev *pdev)
 }
 EXPORT_SYMBOL_GPL(pcie_link_is_up);
 
+static void anarchy_pcie_record_link_up(struct anarchy_device *adev, u32 us, bool timed_out)
+{
+    struct anarchy_pcie_link_stats *st = &adev->pcie_state.link_stats;
+    unsigned long flags;
+    unsigned int bucket;
+
+    spin_lock_irqsave(&adev->pcie_state.recovery.recovery_lock, flags);
+    if (timed_out) {
+        st->timeouts++;
+    } else {
+        bucket = min_t(unsigned int, ilog2(us | 1), ANARCHY_PCIE_LINK_HIST_BUCKETS - 1);
+        st->hist[bucket]++;
+        st->samples++;
+        st->total_us += us;
+        st->last_us = us;
+        st->max_us = max(st->max_us, us);
+    }
+    spin_unlock_irqrestore(&adev->pcie_state.recovery.recovery_lock, flags);
+}
+
+/*
+ * Poll the downstream port until the link is up (data link layer active and
+ * training finished) or down, backing off exponentially so a fast link is
+ * noticed within microseconds and a slow one costs few config reads.
+ * Ports without DLLLA reporting fall back to the training bit alone.
+ * Time-to-link-up is recorded in the link histogram.
+ */
+int anarchy_pcie_wait_link(struct anarchy_device *adev, bool up, unsigned int timeout_ms)
+{
+    struct pci_dev *pdev = anarchy_pcie_link_port(adev->pdev);
+    unsigned int delay = LINK_POLL_MIN_US;
+    ktime_t start = ktime_get();
+    ktime_t deadline = ktime_add_ms(start, timeout_ms);
+    bool dllla_capable, active;
+    u32 lnk_cap = 0;
+    u16 lnk_stat;
+
+    pcie_capability_read_dword(pdev, PCI_EXP_LNKCAP, &lnk_cap);
+    dllla_capable = lnk_cap & PCI_EXP_LNKCAP_DLLLARC;
+
+    for (;;) {
+        if (!pcie_capability_read_word(pdev, PCI_EXP_LNKSTA, &lnk_stat)) {
+            active = !(lnk_stat & PCI_EXP_LNKSTA_LT);
+            if (dllla_capable)
+                active = active && (lnk_stat & PCI_EXP_LNKSTA_DLLLA);
+            if (active == up)
+                break;
+        }
+
+        if (ktime_after(ktime_get(), deadline)) {
+            if (up)
+                anarchy_pcie_record_link_up(adev, 0, true);
+            return -ETIMEDOUT;
+        }
+
+        usleep_range(delay, delay * 2);
+        delay = min(delay * 2, (unsigned int)LINK_POLL_MAX_US);
+    }
+
+    if (up)
+        anarchy_pcie_record_link_up(adev, ktime_us_delta(ktime_get(), start), false);
+    return 0;
+}
+EXPORT_SYMBOL_GPL(anarchy_pcie_wait_link);
+
+static int anarchy_pcie_link_hist_show(struct seq_file *m, void *unused)
+{
+    struct anarchy_device *adev = m->private;
+    struct anarchy_pcie_link_stats st;
+    unsigned long flags;
+    int i;
+
+    spin_lock_irqsave(&adev->pcie_state.recovery.recovery_lock, flags);
+    st = adev->pcie_state.link_stats;
+    spin_unlock_irqrestore(&adev->pcie_state.recovery.recovery_lock, flags);
+
+    seq_printf(m, "samples %u timeouts %u last_us %u max_us %u mean_us %llu\n",
+               st.samples, st.timeouts, st.last_us, st.max_us,
+               st.samples ? div_u64(st.total_us, st.samples) : 0);
+    for (i = 0; i < ANARCHY_PCIE_LINK_HIST_BUCKETS; i++) {
+        if (st.hist[i])
+            seq_printf(m, "%10lu us: %u\n", 1UL << i, st.hist[i]);
+    }
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(anarchy_pcie_link_hist);
+
+static int anarchy_pcie_recovery_show(struct seq_file *m, void *unused)
+{
+    struct anarchy_device *adev = m->private;
+    struct anarchy_pcie_recovery *rec = &adev->pcie_state.recovery;
+    struct anarchy_pcie_rung_stats rungs[ANARCHY_PCIE_RUNG_COUNT];
+    u32 recoveries, failures;
+    u64 total_us;
+    unsigned long flags;
+    int i;
+
+    spin_lock_irqsave(&rec->recovery_lock, flags);
+    memcpy(rungs, rec->rungs, sizeof(rungs));
+    recoveries = rec->recoveries;
+    failures = rec->failures;
+    total_us = rec->total_recovery_us;
+    spin_unlock_irqrestore(&rec->recovery_lock, flags);
+
+    seq_printf(m, "recoveries %u failures %u mttr_us %llu\n", recoveries, failures,
+               recoveries ? div_u64(total_us, recoveries) : 0);
+    seq_puts(m, "rung       attempts successes score skipped mean_us\n");
+    for (i = 0; i < ANARCHY_PCIE_RUNG_COUNT; i++)
+        seq_printf(m, "%-10s %8u %9u %5u %7u %7llu\n", pcie_rungs[i].name,
+                   rungs[i].attempts, rungs[i].successes, rungs[i].score, rungs[i].skipped,
+                   rungs[i].attempts ? div_u64(rungs[i].total_us, rungs[i].attempts) : 0);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(anarchy_pcie_recovery);
+
+void anarchy_pcie_debugfs_init(struct anarchy_device *adev, struct dentry *parent)
+{
+    debugfs_create_file("link_up_hist", 0444, parent, adev, &anarchy_pcie_link_hist_fops);
+    debugfs_create_file("recovery", 0444, parent, adev, &anarchy_pcie_recovery_fops);
+}
+EXPORT_SYMBOL_GPL(anarchy_pcie_debugfs_init);
+
 int anarchy_pcie_optimize_settings(struct anarchy_device *adev)
 {
     struct pci_dev *pdev = adev->pdev;
@@ -255,7 +711,10 @@ int anarchy_pcie_optimize_settings(struct anarchy_device *adev)
     if (!pdev)
         return -EINVAL;
 
-    /* Configure PCIe link for maximum performance */
+    /*
+     * Configure PCIe link for maximum performance. L1 comes back only
+     * while the rings are idle (runtime_pm.c); L0s and CLKPM stay off.
+     */
     ret = pci_disable_link_state(pdev, PCIE_LINK_STATE_L0S | PCIE_LINK_STATE_L1 |
                                 PCIE_LINK_STATE_CLKPM);
     if (ret)
@@ -290,10 +749,10 @@ void anarchy_pcie_cleanup_state(struct anarchy_device *adev)
         return;
 
     /* Cancel any pending work */
-    cancel_work_sync(&adev->pcie_state.recovery.recovery_work);
+    cancel_delayed_work_sync(&adev->pcie_state.recovery.recovery_work);
 
     /* Reset PCIe state */
-    adev->pcie_state.state = ANARCHY_PCIE_STATE_UNKNOWN;
+    anarchy_pcie_set_state(adev, ANARCHY_PCIE_STATE_UNKNOWN);
     adev->pcie_state.speed = ANARCHY_PCIE_GEN1;
     adev->pcie_state.link_width = ANARCHY_PCIE_x1;
 }
@@ -303,17 +762,22 @@ EXPORT_SYMBOL_GPL(anarchy_pcie_handle_error);
 
 int anarchy_pcie_init_state(struct anarchy_device *adev)
 {
+    int i;
+
     if (!adev)
         return -EINVAL;
 
     /* Initialize PCIe state */
-    adev->pcie_state.state = ANARCHY_PCIE_STATE_INIT;
+    anarchy_pcie_set_state(adev, ANARCHY_PCIE_STATE_INIT);
     adev->pcie_state.speed = ANARCHY_PCIE_GEN1;
     adev->pcie_state.link_width = ANARCHY_PCIE_x1;
 
     /* Initialize recovery work */
-    INIT_WORK(&adev->pcie_state.recovery.recovery_work,
-              anarchy_pcie_recovery_work);
+    spin_lock_init(&adev->pcie_state.recovery.recovery_lock);
+    INIT_DELAYED_WORK(&adev->pcie_state.recovery.recovery_work,
+                      anarchy_pcie_recovery_work);
+    for (i = 0; i < ANARCHY_PCIE_RUNG_COUNT; i++)
+        adev->pcie_state.recovery.rungs[i].score = RECOVERY_SCORE_ONE / 2;
 
     /* Check initial link configuration */
     return anarchy_pcie_check_link_config(adev);
@@ -322,72 +786,51 @@ EXPORT_SYMBOL_GPL(anarchy_pcie_init_state);
 
 int anarchy_pcie_enable_link(struct anarchy_device *adev)
 {
-    struct pci_dev *pdev = adev->pdev;
-    u16 lnk_ctrl;
-    int ret;
-
-    /* Set link state to training */
-    adev->pcie_state.state = ANARCHY_PCIE_STATE_TRAINING;
-
-    /* Read link control register */
-    ret = pcie_capability_read_word(pdev, PCI_EXP_LNKCTL, &lnk_ctrl);
-    if (ret)
-        return ret;
-
-    /* Enable link */
-    lnk_ctrl &= ~PCI_EXP_LNKCTL_LD;
-    ret = pcie_capability_write_word(pdev, PCI_EXP_LNKCTL, lnk_ctrl);
-    if (ret)
-        return ret;
-
-    /* Wait for link to stabilize */
-    msleep(100);
-
-    /* Check link status */
-    ret = anarchy_pcie_check_link_config(adev);
-    if (ret) {
-        adev->pcie_state.state = ANARCHY_PCIE_STATE_ERROR;
-        return ret;
-    }
-
-    adev->pcie_state.state = ANARCHY_PCIE_STATE_ACTIVE;
-    return 0;
+    return anarchy_pcie_bring_up(adev, false);
 }
 EXPORT_SYMBOL_GPL(anarchy_pcie_enable_link);
 
-u64 anarchy_pcie_get_bandwidth_usage(struct anarchy_device *adev)
+/* Usable bytes/sec of a link at @speed x @width, after encoding overhead */
+u64 anarchy_pcie_speed_capacity(enum anarchy_pcie_speed speed, u32 width)
 {
-    u32 link_width, link_speed;
-    u64 bandwidth = 0;
-
-    if (!adev || !adev->pdev)
-        return 0;
+    u64 lane;
 
-    /* Get current link width and speed */
-    pcie_capability_read_dword(adev->pdev, PCI_EXP_LNKSTA, &link_width);
-    link_width = (link_width & PCI_EXP_LNKSTA_NLW) >> PCI_EXP_LNKSTA_NLW_SHIFT;
-
-    pcie_capability_read_dword(adev->pdev, PCI_EXP_LNKSTA, &link_speed);
-    link_speed = link_speed & PCI_EXP_LNKSTA_CLS;
-
-    /* Calculate bandwidth in bytes/sec */
-    switch (link_speed) {
+    switch (speed) {
     case 1: /* 2.5 GT/s */
-        bandwidth = 250000000ULL; /* 250 MB/s per lane */
+        lane = 250000000ULL; /* 250 MB/s per lane */
         break;
     case 2: /* 5.0 GT/s */
-        bandwidth = 500000000ULL; /* 500 MB/s per lane */
+        lane = 500000000ULL; /* 500 MB/s per lane */
         break;
     case 3: /* 8.0 GT/s */
-        bandwidth = 984600000ULL; /* ~985 MB/s per lane */
+        lane = 984600000ULL; /* ~985 MB/s per lane */
         break;
     case 4: /* 16.0 GT/s */
-        bandwidth = 1969000000ULL; /* ~1.97 GB/s per lane */
+        lane = 1969000000ULL; /* ~1.97 GB/s per lane */
+        break;
+    case 5: /* 32.0 GT/s */
+        lane = 3938000000ULL; /* ~3.94 GB/s per lane */
         break;
     default:
         return 0;
     }
 
-    return bandwidth * link_width;
+    return lane * width;
+}
+EXPORT_SYMBOL_GPL(anarchy_pcie_speed_capacity);
+
+/* Capacity of the negotiated link in bytes/sec, per direction */
+u64 anarchy_pcie_get_link_capacity(struct anarchy_device *adev)
+{
+    u16 lnksta;
+
+    if (!adev || !adev->pdev)
+        return 0;
+
+    if (pcie_capability_read_word(adev->pdev, PCI_EXP_LNKSTA, &lnksta))
+        return 0;
+
+    return anarchy_pcie_speed_capacity(lnksta & PCI_EXP_LNKSTA_CLS,
+                                       (lnksta & PCI_EXP_LNKSTA_NLW) >> PCI_EXP_LNKSTA_NLW_SHIFT);
 }
-EXPORT_SYMBOL_GPL(anarchy_pcie_get_bandwidth_usage);
+EXPORT_SYMBOL_GPL(anarchy_pcie_get_link_capacity);
@@ -1,7 +1,5 @@
 #include <linux/module.h>
 #include <linux/workqueue.h>
-#include <linux/io.h>
-#include <linux/delay.h>
 #include "include/perf_monitor.h"
 #include "include/anarchy_device.h"
 #include "include/gpu_config.h"
@@ -9,6 +7,8 @@
 #include "include/perf_regs.h"
 #include "include/gpu_power.h"
 #include "include/pcie_mon.h"
+#include "include/chardev.h"
+#include "include/telemetry.h"
 
 /* Performance monitoring thresholds */
 #define PERF_UPDATE_INTERVAL_MS   1000    /* 1 second update interval */
@@ -17,58 +17,39 @@
 #define POWER_WARNING_THRESHOLD   200     /* 200W warning threshold */
 #define UTILIZATION_THRESHOLD     90      /* 90% GPU utilization */
 
-static void update_performance_stats(struct anarchy_device *adev, struct perf_state *state)
+static void perf_state_from_sample(struct anarchy_device *adev, struct perf_state *state,
+                                   const struct anarchy_telemetry_sample *s)
 {
-    if (!adev || !state)
-        return;
-
-    /* Read current state from hardware registers */
-    state->gpu_clock = readl(adev->mmio_base + GPU_CLOCK_OFFSET) / 1000; /* Convert to MHz */
-    state->mem_clock = readl(adev->mmio_base + MEM_CLOCK_OFFSET) / 1000;
-    state->power_draw = readl(adev->mmio_base + POWER_OFFSET) / 1000;    /* Convert to watts */
-    state->temperature = readl(adev->mmio_base + TEMP_OFFSET);
-    state->fan_speed = readl(adev->mmio_base + FAN_STATUS_OFFSET);
-    state->gpu_util = readl(adev->mmio_base + GPU_UTIL_OFFSET);
-    state->mem_util = readl(adev->mmio_base + MEM_UTIL_OFFSET);
-    state->vram_used = readl(adev->mmio_base + VRAM_USED_OFFSET) / 1024; /* Convert to MB */
-
-    /* Get PCIe bandwidth utilization */
-    state->pcie_util = anarchy_pcie_get_bandwidth_usage(adev);
+    state->gpu_clock = s->gpu_clock;
+    state->mem_clock = s->mem_clock;
+    state->power_draw = s->power_draw;
+    state->temperature = s->temperature;
+    state->fan_speed = s->fan_speed;
+    state->gpu_util = s->gpu_util;
+    state->mem_util = s->mem_util;
+    state->vram_used = s->vram_used;
+
+    /* PCIe utilization from the bandwidth sampler */
+    state->pcie_util = anarchy_bandwidth_get_utilization(adev);
 }
 
-static void perf_monitor_work(struct work_struct *work)
+/* Telemetry subscriber: event reporting only, the snapshot is telemetry's */
+static void perf_monitor_sample(struct anarchy_device *adev,
+                                struct anarchy_telemetry_sub *sub,
+                                const struct anarchy_telemetry_sample *sample)
 {
-    struct perf_monitor *monitor = container_of(to_delayed_work(work),
-                                              struct perf_monitor,
-                                              update_work);
-    struct anarchy_device *adev = monitor->adev;
-    struct perf_state state;
-    unsigned long flags;
-    
-    if (!monitor->enabled)
-        return;
-        
-    /* Update performance metrics */
-    update_performance_stats(adev, &state);
-    
-    spin_lock_irqsave(&monitor->lock, flags);
-    monitor->current_state = state;
-    
-    /* Check thermal throttling */
-    if (state.temperature >= TEMP_CRITICAL_THRESHOLD) {
-        anarchy_power_set_power_limit(adev, GPU_POWER_LIMIT_MIN);
-    } else if (state.temperature <= TEMP_WARNING_THRESHOLD) {
-        /* Restore normal power limit */
-        anarchy_power_set_power_limit(adev, adev->power_profile.power_limit);
-    }
-    
-    spin_unlock_irqrestore(&monitor->lock, flags);
-    
-    /* Schedule next update if still enabled */
-    if (monitor->enabled) {
-        schedule_delayed_work(&monitor->update_work,
-                            msecs_to_jiffies(monitor->update_interval));
-    }
+    struct perf_monitor *monitor = container_of(sub, struct perf_monitor, sub);
+    bool was_critical = monitor->last_temperature >= TEMP_CRITICAL_THRESHOLD;
+    bool critical = sample->temperature >= TEMP_CRITICAL_THRESHOLD;
+
+    monitor->last_temperature = sample->temperature;
+
+    /* Fan and power limit are left to the thermal controller (thermal.c) */
+
+    /* Tell subscribers when the critical threshold is crossed either way */
+    if (was_critical != critical)
+        anarchy_chardev_notify(adev, ANARCHY_EVENT_THERMAL, sample->temperature,
+                               critical);
 }
 
 /* Initialize performance monitoring */
@@ -83,10 +64,12 @@ int anarchy_perf_init(struct anarchy_device *adev)
     monitor->adev = adev;
     monitor->enabled = false;
     monitor->update_interval = PERF_UPDATE_INTERVAL_MS;
-    
-    /* Initialize work queue */
-    INIT_DELAYED_WORK(&monitor->update_work, perf_monitor_work);
-    spin_lock_init(&monitor->lock);
+    monitor->last_temperature = 0;
+
+    monitor->sub.name = "perf";
+    monitor->sub.interval_ms = monitor->update_interval;
+    monitor->sub.fn = perf_monitor_sample;
+    INIT_LIST_HEAD(&monitor->sub.node);
     
     return 0;
 }
@@ -100,11 +83,12 @@ int anarchy_perf_start(struct anarchy_device *adev)
         return -EINVAL;
         
     monitor = &adev->perf_monitor;
+    if (monitor->enabled)
+        return 0;
+
     monitor->enabled = true;
-    
-    /* Schedule first update */
-    return schedule_delayed_work(&monitor->update_work,
-                               msecs_to_jiffies(monitor->update_interval));
+    anarchy_telemetry_subscribe(adev, &monitor->sub);
+    return 0;
 }
 
 /* Stop performance monitoring */
@@ -116,31 +100,34 @@ void anarchy_perf_stop(struct anarchy_device *adev)
         return;
         
     monitor = &adev->perf_monitor;
+    if (!monitor->enabled)
+        return;
+
     monitor->enabled = false;
-    cancel_delayed_work_sync(&monitor->update_work);
+    anarchy_telemetry_unsubscribe(adev, &monitor->sub);
 }
 
 /* Get current performance state */
 int anarchy_perf_get_state(struct anarchy_device *adev, struct perf_state *state)
 {
-    struct perf_monitor *monitor;
-    unsigned long flags;
+    struct anarchy_telemetry_sample sample;
+    int ret;
     
     if (!adev || !state)
         return -EINVAL;
-        
-    monitor = &adev->perf_monitor;
-    
-    spin_lock_irqsave(&monitor->lock, flags);
-    *state = monitor->current_state;
-    spin_unlock_irqrestore(&monitor->lock, flags);
-    
+
+    ret = anarchy_telemetry_get(adev, &sample);
+    if (ret) {
+        memset(state, 0, sizeof(*state));
+        return ret;
+    }
+
+    perf_state_from_sample(adev, state, &sample);
     return 0;
 }
 
 int init_performance_monitoring(struct anarchy_device *adev)
 {
-    struct perf_monitor *monitor = &adev->perf_monitor;
     int ret;
 
     ret = anarchy_perf_init(adev);
@@ -164,19 +151,11 @@ void cleanup_performance_monitoring(struct anarchy_device *adev)
 
 void anarchy_perf_exit(struct anarchy_device *adev)
 {
-    struct perf_monitor *monitor;
-
     if (!adev)
         return;
 
-    monitor = &adev->perf_monitor;
-
     /* Stop monitoring if still running */
-    if (monitor->enabled)
-        anarchy_perf_stop(adev);
-
-    /* Cancel and flush any pending work */
-    cancel_delayed_work_sync(&monitor->update_work);
+    anarchy_perf_stop(adev);
 }
 EXPORT_SYMBOL_GPL(anarchy_perf_exit);
 
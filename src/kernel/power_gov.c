@@ -0,0 +1,227 @@
+#include <linux/module.h>
+#include <linux/io.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include "include/anarchy_device.h"
+#include "include/gpu_emu.h"
+#include "include/gpu_offsets.h"
+#include "include/module_params.h"
+#include "include/power_mgmt.h"
+#include "include/power_gov.h"
+
+static const char * const frame_gov_level_names[] = {
+    [FRAME_GOV_IDLE] = "idle",
+    [FRAME_GOV_RUN] = "run",
+    [FRAME_GOV_BOOST] = "boost",
+    [FRAME_GOV_RELAX] = "relax",
+};
+
+static u64 power_gov_now_us(void)
+{
+    return div_u64(ktime_get_ns(), NSEC_PER_USEC);
+}
+
+/* Called with pg->lock held */
+static void power_gov_arm(struct anarchy_power_gov *pg)
+{
+    u64 next = frame_gov_next_event(&pg->gov);
+
+    if (next)
+        hrtimer_start(&pg->timer, ns_to_ktime(next * NSEC_PER_USEC),
+                      HRTIMER_MODE_ABS);
+}
+
+static enum hrtimer_restart power_gov_timer(struct hrtimer *timer)
+{
+    struct anarchy_power_gov *pg = container_of(timer, struct anarchy_power_gov, timer);
+    enum frame_gov_level old;
+    unsigned long flags;
+    bool changed;
+    u64 next;
+
+    spin_lock_irqsave(&pg->lock, flags);
+    old = pg->gov.level;
+    changed = frame_gov_tick(&pg->gov, power_gov_now_us()) != old;
+    next = frame_gov_next_event(&pg->gov);
+    if (next)
+        hrtimer_set_expires(timer, ns_to_ktime(next * NSEC_PER_USEC));
+    spin_unlock_irqrestore(&pg->lock, flags);
+
+    if (changed)
+        queue_work(system_highpri_wq, &pg->apply_work);
+    return next ? HRTIMER_RESTART : HRTIMER_NORESTART;
+}
+
+/* Register writes happen here, never under pg->lock */
+static void power_gov_apply_work(struct work_struct *work)
+{
+    struct anarchy_power_gov *pg = container_of(work, struct anarchy_power_gov,
+                                                apply_work);
+    struct anarchy_device *adev = container_of(pg, struct anarchy_device, power_gov);
+    unsigned int power, clock;
+    unsigned long flags;
+
+    spin_lock_irqsave(&pg->lock, flags);
+    power = frame_gov_power(&pg->gov, pg->ceiling, pg->throttled);
+    clock = frame_gov_clock(&pg->gov);
+    spin_unlock_irqrestore(&pg->lock, flags);
+
+    if (power != pg->applied_power &&
+        !anarchy_power_set_power_limit(adev, power))
+        pg->applied_power = power;
+    if (pg->clock_control && clock != pg->applied_clock &&
+        !anarchy_gpu_set_clocks(adev, clock, pg->mem_clock))
+        pg->applied_clock = clock;
+}
+
+void anarchy_power_gov_frame(struct anarchy_device *adev)
+{
+    struct anarchy_power_gov *pg = &adev->power_gov;
+    enum frame_gov_level old;
+    unsigned long flags;
+    bool changed;
+
+    if (!READ_ONCE(pg->enabled))
+        return;
+
+    spin_lock_irqsave(&pg->lock, flags);
+    /* Rechecked under the lock so nothing arms the timer after exit */
+    if (!pg->enabled) {
+        spin_unlock_irqrestore(&pg->lock, flags);
+        return;
+    }
+    old = pg->gov.level;
+    changed = frame_gov_sync(&pg->gov, power_gov_now_us()) != old;
+    power_gov_arm(pg);
+    spin_unlock_irqrestore(&pg->lock, flags);
+
+    if (changed)
+        queue_work(system_highpri_wq, &pg->apply_work);
+}
+EXPORT_SYMBOL_GPL(anarchy_power_gov_frame);
+
+void anarchy_power_gov_set_ceiling(struct anarchy_device *adev, unsigned int limit,
+                                   bool throttled)
+{
+    struct anarchy_power_gov *pg = &adev->power_gov;
+    unsigned long flags;
+
+    spin_lock_irqsave(&pg->lock, flags);
+    pg->ceiling = limit;
+    pg->throttled = throttled;
+    spin_unlock_irqrestore(&pg->lock, flags);
+
+    queue_work(system_highpri_wq, &pg->apply_work);
+}
+EXPORT_SYMBOL_GPL(anarchy_power_gov_set_ceiling);
+
+/* Telemetry subscriber: utilization sizes the render window */
+static void power_gov_sample(struct anarchy_device *adev, struct anarchy_telemetry_sub *sub,
+                             const struct anarchy_telemetry_sample *sample)
+{
+    struct anarchy_power_gov *pg = container_of(sub, struct anarchy_power_gov, sub);
+    unsigned long flags;
+
+    spin_lock_irqsave(&pg->lock, flags);
+    frame_gov_util(&pg->gov, sample->gpu_util);
+    spin_unlock_irqrestore(&pg->lock, flags);
+}
+
+static int anarchy_frame_gov_show(struct seq_file *m, void *unused)
+{
+    struct anarchy_device *adev = m->private;
+    struct anarchy_power_gov *pg = &adev->power_gov;
+    struct frame_gov gov;
+    unsigned int ceiling;
+    unsigned long flags;
+    bool throttled;
+
+    spin_lock_irqsave(&pg->lock, flags);
+    gov = pg->gov;
+    ceiling = pg->ceiling;
+    throttled = pg->throttled;
+    spin_unlock_irqrestore(&pg->lock, flags);
+
+    seq_printf(m, "enabled %d level %s\n", READ_ONCE(pg->enabled),
+               frame_gov_level_names[gov.level]);
+    seq_printf(m, "period_us %u jitter_us %u util %u frames %u\n",
+               gov.period_us, gov.jitter_us, gov.util, gov.frames);
+    seq_printf(m, "windows %llu boosts %llu rescues %llu late %llu\n",
+               gov.windows, gov.boosts, gov.rescues, gov.late_frames);
+    seq_printf(m, "ceiling %u throttled %d power %u clock %u\n", ceiling, throttled,
+               pg->applied_power, pg->applied_clock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(anarchy_frame_gov);
+
+void anarchy_power_gov_debugfs_init(struct anarchy_device *adev, struct dentry *parent)
+{
+    debugfs_create_file("frame_gov", 0444, parent, adev, &anarchy_frame_gov_fops);
+}
+EXPORT_SYMBOL_GPL(anarchy_power_gov_debugfs_init);
+
+int anarchy_power_gov_init(struct anarchy_device *adev)
+{
+    struct anarchy_power_gov *pg = &adev->power_gov;
+    struct frame_gov_params params;
+    u32 gpu_clock;
+
+    spin_lock_init(&pg->lock);
+    hrtimer_init(&pg->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+    pg->timer.function = power_gov_timer;
+    INIT_WORK(&pg->apply_work, power_gov_apply_work);
+
+    /* Boosts and relaxes are relative to what the profile runs at now */
+    pg->ceiling = adev->power_profile.power_limit;
+    pg->throttled = false;
+    pg->applied_power = pg->ceiling;
+
+    gpu_clock = readl(adev->mmio_base + GPU_CLOCK_OFFSET) / 1000;
+    pg->mem_clock = readl(adev->mmio_base + MEM_CLOCK_OFFSET) / 1000;
+    pg->clock_control = gpu_clock >= MIN_GPU_CLOCK && gpu_clock <= MAX_GPU_CLOCK;
+    pg->applied_clock = gpu_clock;
+
+    frame_gov_default_params(&params);
+    params.power_min = GPU_POWER_LIMIT_MIN;
+    /* Boosting past the profile limit is the user's call */
+    params.boost_w = frame_boost_w;
+    params.power_max = min_t(u32, pg->ceiling + frame_boost_w, GPU_POWER_LIMIT_MAX);
+    if (pg->clock_control) {
+        params.clock_base = gpu_clock;
+        params.clock_boost = min_t(u32, gpu_clock * 4 / 3, MAX_GPU_CLOCK);
+        params.clock_relax = max_t(u32, gpu_clock * 2 / 3, MIN_GPU_CLOCK);
+    }
+    frame_gov_init(&pg->gov, &params);
+
+    pg->sub.name = "frame_gov";
+    pg->sub.interval_ms = 0;
+    pg->sub.fn = power_gov_sample;
+    anarchy_telemetry_subscribe(adev, &pg->sub);
+
+    WRITE_ONCE(pg->enabled, frame_governor);
+    return 0;
+}
+EXPORT_SYMBOL_GPL(anarchy_power_gov_init);
+
+void anarchy_power_gov_exit(struct anarchy_device *adev)
+{
+    struct anarchy_power_gov *pg = &adev->power_gov;
+    unsigned long flags;
+
+    spin_lock_irqsave(&pg->lock, flags);
+    WRITE_ONCE(pg->enabled, false);
+    spin_unlock_irqrestore(&pg->lock, flags);
+
+    anarchy_telemetry_unsubscribe(adev, &pg->sub);
+    hrtimer_cancel(&pg->timer);
+
+    /* Back to the ceiling and base clock */
+    spin_lock_irqsave(&pg->lock, flags);
+    frame_gov_init(&pg->gov, &pg->gov.p);
+    spin_unlock_irqrestore(&pg->lock, flags);
+
+    cancel_work_sync(&pg->apply_work);
+    power_gov_apply_work(&pg->apply_work);
+}
+EXPORT_SYMBOL_GPL(anarchy_power_gov_exit);
@@ -8,15 +8,10 @@
 #include "include/gpu_power.h"
 #include "include/power_mgmt.h"
 #include "include/gpu_offsets.h"
+#include "include/anarchy_events.h"
 
 /* Power limits are defined in power_mgmt.h */
 
-/* Clock limits in MHz */
-#define MIN_GPU_CLOCK        300
-#define MAX_GPU_CLOCK        2640
-#define MIN_MEM_CLOCK        810
-#define MAX_MEM_CLOCK        21000
-
 static int apply_power_profile(struct anarchy_device *adev, struct power_profile *profile)
 {
     u32 reg;
@@ -91,6 +86,9 @@ int anarchy_power_set_profile(struct anarchy_device *adev, struct power_profile
     if (!adev || !profile)
         return -EINVAL;
 
+    /* Sleeps while the new profile latches, never call under a spinlock */
+    might_sleep();
+
     ret = apply_power_profile(adev, profile);
     if (ret)
         return ret;
@@ -141,6 +139,7 @@ int anarchy_power_set_power_limit(struct anarchy_device *adev, unsigned int limi
         return -EINVAL;
 
     /* Update power limit */
+    trace_anarchy_power_limit(adev, adev->power_profile.power_limit, limit);
     writel(limit, adev->mmio_base + PWR_LIMIT_OFFSET);
     writel(1, adev->mmio_base + PWR_CTRL_OFFSET); /* Apply changes */
 
@@ -0,0 +1,501 @@
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/capability.h>
+#include <linux/delay.h>
+#include <linux/log2.h>
+#include <linux/kref.h>
+#include <linux/hrtimer.h>
+#include "include/queue.h"
+#include "include/ring.h"
+#include "include/common.h"
+
+/* Defaults when setup leaves a size at zero */
+#define QUEUE_DEFAULT_ENTRIES   128
+#define QUEUE_DEFAULT_IDLE_MS   10
+
+/*
+ * While the DMA ring has no free descriptor the poll thread waits for one
+ * a slice at a time; after the timeout the head SQE completes with
+ * -EAGAIN so the submitter sees the back-pressure instead of a stall.
+ */
+#define QUEUE_BUSY_SLICE_US     100
+#define QUEUE_BUSY_TIMEOUT_US   (10 * USEC_PER_MSEC)
+
+/* Nothing interrupts on write-back, completion waiters reap this often */
+#define QUEUE_REAP_POLL_NS      (20 * NSEC_PER_USEC)
+
+/*
+ * Kernel-private view of the indices. The shared headers are writable by
+ * userspace, so masks, sizes and the driver-owned indices are never read
+ * back from them.
+ */
+struct anarchy_queue_priv {
+    struct anarchy_queue q;
+    struct kref ref;                /* The queue and each op in flight */
+    atomic_t inflight;              /* Ops whose CQE is still due */
+    spinlock_t cq_lock;             /* CQEs are posted from the reaper */
+    u32 sq_entries;
+    u32 cq_entries;
+    u32 sq_head;
+    u32 cq_tail;
+    struct anarchy_queue_op *op;    /* Head SQE while it is partly queued */
+};
+
+#define to_priv(_q) container_of(_q, struct anarchy_queue_priv, q)
+
+/*
+ * One consumed SQE. Every page of it shares @xfer, so the ring calls back
+ * once per page; the CQE is posted when the last one completes.
+ */
+struct anarchy_queue_op {
+    struct anarchy_transfer xfer;
+    struct anarchy_queue_priv *p;
+    u64 cookie;
+    u64 data_offset;
+    u32 size;
+    u32 queued;                     /* Bytes handed to the ring */
+    u64 start_ns;
+    atomic_t pages;                 /* Outstanding, plus one until fully queued */
+    int status;                     /* First error, 0 = none */
+};
+
+static u32 anarchy_queue_cq_count(struct anarchy_queue_priv *p)
+{
+    return READ_ONCE(p->cq_tail) - smp_load_acquire(&p->q.cq->head);
+}
+
+bool anarchy_queue_cq_ready(struct anarchy_queue *q)
+{
+    return anarchy_queue_cq_count(to_priv(q)) != 0;
+}
+
+static bool anarchy_queue_sq_pending(struct anarchy_queue_priv *p)
+{
+    return smp_load_acquire(&p->q.sq->tail) != p->sq_head;
+}
+
+static void anarchy_queue_release(struct kref *ref)
+{
+    struct anarchy_queue_priv *p = container_of(ref, struct anarchy_queue_priv, ref);
+
+    vfree(p->q.mem);
+    kfree(p);
+}
+
+static void anarchy_queue_complete(struct anarchy_queue_priv *p, u64 cookie, s32 result)
+{
+    struct anarchy_cqe *cqe;
+    unsigned long flags;
+
+    spin_lock_irqsave(&p->cq_lock, flags);
+    if (p->cq_tail - smp_load_acquire(&p->q.cq->head) >= p->cq_entries) {
+        /* Reader fell behind, count the loss instead of overwriting */
+        WRITE_ONCE(p->q.cq->dropped, READ_ONCE(p->q.cq->dropped) + 1);
+    } else {
+        cqe = &p->q.cqes[p->cq_tail & (p->cq_entries - 1)];
+        cqe->cookie = cookie;
+        cqe->result = result;
+        cqe->flags = 0;
+        p->cq_tail++;
+        smp_store_release(&p->q.cq->tail, p->cq_tail);
+    }
+    spin_unlock_irqrestore(&p->cq_lock, flags);
+
+    wake_up_interruptible(&p->q.cq_wait);
+}
+
+static void anarchy_queue_op_put(struct anarchy_queue_op *op)
+{
+    struct anarchy_queue_priv *p = op->p;
+    int status;
+
+    if (!atomic_dec_and_test(&op->pages))
+        return;
+
+    status = READ_ONCE(op->status);
+    if (!status)
+        anarchy_ring_account_latency(&p->q.adev->tx_ring, op->start_ns);
+    anarchy_queue_complete(p, op->cookie, status ? status : (s32)op->size);
+    kfree(op);
+    atomic_dec(&p->inflight);
+    kref_put(&p->ref, anarchy_queue_release);
+}
+
+/* Ring callback, once per page */
+static void anarchy_queue_op_done(struct anarchy_transfer *xfer, int status)
+{
+    struct anarchy_queue_op *op = container_of(xfer, struct anarchy_queue_op, xfer);
+
+    if (status)
+        cmpxchg(&op->status, 0, status);
+    anarchy_queue_op_put(op);
+}
+
+/* Feed the head SQE to the TX ring page by page; resumes after -EBUSY */
+static int anarchy_queue_submit_one(struct anarchy_queue_priv *p,
+                                    const struct anarchy_sqe *sqe)
+{
+    struct anarchy_device *adev = p->q.adev;
+    struct anarchy_queue_op *op = p->op;
+    size_t chunk;
+    int ret;
+
+    if (!op) {
+        if (!sqe->size || sqe->flags != ANARCHY_DMA_TO_DEVICE)
+            return -EINVAL;
+        if (sqe->data_offset > p->q.data_size ||
+            sqe->size > p->q.data_size - sqe->data_offset)
+            return -EINVAL;
+
+        op = kzalloc(sizeof(*op), GFP_KERNEL);
+        if (!op)
+            return -ENOMEM;
+        op->xfer.done = anarchy_queue_op_done;
+        op->p = p;
+        op->cookie = sqe->cookie;
+        op->data_offset = sqe->data_offset;
+        op->size = sqe->size;
+        op->start_ns = ktime_get_ns();
+        atomic_set(&op->pages, 1);
+        atomic_inc(&p->inflight);
+        kref_get(&p->ref);
+        p->op = op;
+    }
+
+    /* Resumed from @op, userspace may have rewritten the slot meanwhile */
+    while (op->queued < op->size) {
+        chunk = min_t(size_t, op->size - op->queued, PAGE_SIZE);
+        atomic_inc(&op->pages);
+        ret = anarchy_ring_transfer(adev, &adev->tx_ring,
+                                    p->q.data + op->data_offset + op->queued,
+                                    chunk, &op->xfer);
+        if (ret) {
+            atomic_dec(&op->pages);
+            return ret;
+        }
+        op->queued += chunk;
+    }
+    return 0;
+}
+
+/*
+ * The head SQE is consumed. Its CQE follows once the pages it queued
+ * complete, right away when it queued none. Caller holds drain_lock.
+ */
+static void anarchy_queue_finish(struct anarchy_queue_priv *p, u64 cookie, int ret)
+{
+    struct anarchy_queue_op *op = p->op;
+
+    if (ret)
+        atomic_inc(&p->q.adev->tx_ring.transfer_errors);
+    if (!op) {
+        anarchy_queue_complete(p, cookie, ret);
+        return;
+    }
+
+    if (ret)
+        cmpxchg(&op->status, 0, ret);
+    p->op = NULL;
+    anarchy_queue_op_put(op);
+}
+
+/* Give up on the head SQE with @err; what it already queued still completes */
+static void anarchy_queue_fail_head(struct anarchy_queue_priv *p, int err)
+{
+    u64 cookie;
+
+    if (!anarchy_queue_sq_pending(p))
+        return;
+
+    cookie = READ_ONCE(p->q.sqes[p->sq_head & (p->sq_entries - 1)].cookie);
+    anarchy_queue_finish(p, cookie, err);
+    p->sq_head++;
+    smp_store_release(&p->q.sq->head, p->sq_head);
+}
+
+/*
+ * Consume up to @max SQEs (0 = all pending). Stops early when the DMA ring
+ * is full so the remaining entries stay queued. Caller holds drain_lock.
+ */
+static unsigned int anarchy_queue_drain(struct anarchy_queue_priv *p, unsigned int max)
+{
+    struct anarchy_sqe sqe;
+    unsigned int done = 0;
+    u32 tail;
+    int ret;
+
+    tail = smp_load_acquire(&p->q.sq->tail);
+    if (tail - p->sq_head > p->sq_entries) {
+        /* Userspace moved tail past what it could have filled */
+        WRITE_ONCE(p->q.sq->dropped, READ_ONCE(p->q.sq->dropped) + 1);
+        tail = p->sq_head + p->sq_entries;
+    }
+
+    /* Only real work keeps the link out of idle, not polling */
+    if (p->sq_head == tail || anarchy_rpm_get(p->q.adev))
+        return 0;
+
+    while (p->sq_head != tail && (!max || done < max)) {
+        /* Snapshot the entry, userspace may rewrite the slot at any time */
+        memcpy(&sqe, &p->q.sqes[p->sq_head & (p->sq_entries - 1)], sizeof(sqe));
+
+        ret = anarchy_queue_submit_one(p, &sqe);
+        if (ret == -EBUSY)
+            break;
+
+        anarchy_queue_finish(p, sqe.cookie, ret);
+        p->sq_head++;
+        done++;
+    }
+
+    anarchy_rpm_put(p->q.adev);
+
+    if (done)
+        smp_store_release(&p->q.sq->head, p->sq_head);
+    return done;
+}
+
+static int anarchy_queue_sq_thread(void *arg)
+{
+    struct anarchy_queue_priv *p = arg;
+    struct anarchy_queue *q = &p->q;
+    struct anarchy_ring *ring = &q->adev->tx_ring;
+    unsigned long idle_until = jiffies + msecs_to_jiffies(q->sq_idle_ms);
+    u64 busy_until = 0;
+    unsigned int done;
+    int ret;
+
+    while (!kthread_should_stop()) {
+        /* The thread is the reaper for what it submitted */
+        if (atomic_read(&p->inflight))
+            anarchy_ring_reap(q->adev, ring, 0);
+
+        mutex_lock(&q->drain_lock);
+        done = anarchy_queue_drain(p, 0);
+        mutex_unlock(&q->drain_lock);
+
+        if (done) {
+            idle_until = jiffies + msecs_to_jiffies(q->sq_idle_ms);
+            busy_until = 0;
+            cond_resched();
+            continue;
+        }
+
+        if (anarchy_queue_sq_pending(p)) {
+            /* Ring full or paused: wait for a credit, but not forever */
+            if (!busy_until)
+                busy_until = ktime_get_ns() + QUEUE_BUSY_TIMEOUT_US * NSEC_PER_USEC;
+            ret = anarchy_ring_wait_credits(q->adev, ring, 1, QUEUE_BUSY_SLICE_US);
+            if (ret == -EIO || ktime_get_ns() >= busy_until) {
+                mutex_lock(&q->drain_lock);
+                anarchy_queue_fail_head(p, ret == -EIO ? -EIO : -EAGAIN);
+                mutex_unlock(&q->drain_lock);
+                busy_until = 0;
+            }
+            continue;
+        }
+
+        /* Stay up while completions are due, nothing else reaps them */
+        if (time_before(jiffies, idle_until) || atomic_read(&p->inflight)) {
+            cond_resched();
+            continue;
+        }
+
+        /*
+         * Going to sleep. Publish NEED_WAKEUP before the final check so a
+         * submitter either sees the flag or we see its new tail.
+         */
+        WRITE_ONCE(q->sq->flags, READ_ONCE(q->sq->flags) | ANARCHY_SQ_NEED_WAKEUP);
+        smp_mb();
+        if (!anarchy_queue_sq_pending(p))
+            wait_event_interruptible(q->sq_wait,
+                                     anarchy_queue_sq_pending(p) || kthread_should_stop());
+        WRITE_ONCE(q->sq->flags, READ_ONCE(q->sq->flags) & ~ANARCHY_SQ_NEED_WAKEUP);
+        idle_until = jiffies + msecs_to_jiffies(q->sq_idle_ms);
+    }
+    return 0;
+}
+
+struct anarchy_queue *anarchy_queue_create(struct anarchy_device *adev,
+                                           struct anarchy_ioc_queue_setup *setup)
+{
+    struct anarchy_queue_priv *p;
+    struct anarchy_queue *q;
+    size_t sqes_off, cqes_off, data_off;
+    u32 entries, data_size;
+    int ret;
+
+    if (setup->flags & ~ANARCHY_QUEUE_SQPOLL)
+        return ERR_PTR(-EINVAL);
+
+    entries = setup->sq_entries ? setup->sq_entries : QUEUE_DEFAULT_ENTRIES;
+    if (!is_power_of_2(entries) || entries > ANARCHY_QUEUE_MAX_ENTRIES)
+        return ERR_PTR(-EINVAL);
+
+    data_size = setup->data_size ? setup->data_size : entries * PAGE_SIZE;
+    if (data_size > ANARCHY_QUEUE_MAX_DATA)
+        return ERR_PTR(-EINVAL);
+    data_size = PAGE_ALIGN(data_size);
+
+    /* A poll thread burns a CPU on the caller's behalf */
+    if ((setup->flags & ANARCHY_QUEUE_SQPOLL) && !capable(CAP_SYS_NICE))
+        return ERR_PTR(-EPERM);
+
+    p = kzalloc(sizeof(*p), GFP_KERNEL);
+    if (!p)
+        return ERR_PTR(-ENOMEM);
+    q = &p->q;
+    kref_init(&p->ref);
+    atomic_set(&p->inflight, 0);
+    spin_lock_init(&p->cq_lock);
+
+    p->sq_entries = entries;
+    p->cq_entries = entries * 2;
+
+    /* Ring headers share the first cache lines, arrays follow, data is page aligned */
+    sqes_off = 2 * sizeof(struct anarchy_queue_ring);
+    cqes_off = sqes_off + entries * sizeof(struct anarchy_sqe);
+    data_off = PAGE_ALIGN(cqes_off + p->cq_entries * sizeof(struct anarchy_cqe));
+
+    q->mem_size = data_off + data_size;
+    q->mem = vmalloc_user(q->mem_size);
+    if (!q->mem) {
+        ret = -ENOMEM;
+        goto err_free;
+    }
+
+    q->adev = adev;
+    q->sq = q->mem;
+    q->cq = q->mem + sizeof(struct anarchy_queue_ring);
+    q->sqes = q->mem + sqes_off;
+    q->cqes = q->mem + cqes_off;
+    q->data = q->mem + data_off;
+    q->data_size = data_size;
+    q->flags = setup->flags;
+    q->sq_idle_ms = setup->sq_idle_ms ? setup->sq_idle_ms : QUEUE_DEFAULT_IDLE_MS;
+    init_waitqueue_head(&q->sq_wait);
+    init_waitqueue_head(&q->cq_wait);
+    mutex_init(&q->drain_lock);
+
+    q->sq->mask = entries - 1;
+    q->sq->entries = entries;
+    q->cq->mask = p->cq_entries - 1;
+    q->cq->entries = p->cq_entries;
+
+    if (q->flags & ANARCHY_QUEUE_SQPOLL) {
+        q->sq_thread = kthread_run(anarchy_queue_sq_thread, p, "anarchy-sqpoll");
+        if (IS_ERR(q->sq_thread)) {
+            ret = PTR_ERR(q->sq_thread);
+            goto err_vfree;
+        }
+    }
+
+    setup->sq_entries = entries;
+    setup->cq_entries = p->cq_entries;
+    setup->sq_idle_ms = q->sq_idle_ms;
+    setup->data_size = data_size;
+    setup->sq_ring_off = 0;
+    setup->cq_ring_off = sizeof(struct anarchy_queue_ring);
+    setup->sqes_off = sqes_off;
+    setup->cqes_off = cqes_off;
+    setup->data_off = data_off;
+    setup->mmap_size = q->mem_size;
+    return q;
+
+err_vfree:
+    vfree(q->mem);
+err_free:
+    kfree(p);
+    return ERR_PTR(ret);
+}
+
+/*
+ * Stop feeding the device: the poll thread exits and a partly queued head
+ * SQE is cancelled. The mapping stays valid until anarchy_queue_destroy().
+ */
+void anarchy_queue_shutdown(struct anarchy_queue *q)
+{
+    struct anarchy_queue_priv *p;
+
+    if (!q)
+        return;
+    p = to_priv(q);
+
+    if (q->sq_thread) {
+        kthread_stop(q->sq_thread);
+        q->sq_thread = NULL;
+    }
+
+    mutex_lock(&q->drain_lock);
+    if (p->op)
+        anarchy_queue_finish(p, 0, -ECANCELED);
+    mutex_unlock(&q->drain_lock);
+}
+
+/* Ops still in flight hold the memory until their last page completes */
+void anarchy_queue_destroy(struct anarchy_queue *q)
+{
+    if (!q)
+        return;
+
+    anarchy_queue_shutdown(q);
+    kref_put(&to_priv(q)->ref, anarchy_queue_release);
+}
+
+int anarchy_queue_mmap(struct anarchy_queue *q, struct vm_area_struct *vma)
+{
+    if (vma->vm_pgoff || vma->vm_end - vma->vm_start > PAGE_ALIGN(q->mem_size))
+        return -EINVAL;
+
+    return remap_vmalloc_range(vma, q->mem, 0);
+}
+
+int anarchy_queue_enter(struct anarchy_queue *q, struct anarchy_ioc_queue_enter *enter)
+{
+    struct anarchy_queue_priv *p = to_priv(q);
+    u32 min_complete;
+    int ret;
+
+    if (enter->flags & ~(ANARCHY_ENTER_GETEVENTS | ANARCHY_ENTER_SQ_WAKEUP))
+        return -EINVAL;
+
+    enter->submitted = 0;
+    if (q->flags & ANARCHY_QUEUE_SQPOLL) {
+        if (enter->flags & ANARCHY_ENTER_SQ_WAKEUP)
+            wake_up(&q->sq_wait);
+    } else {
+        mutex_lock(&q->drain_lock);
+        enter->submitted = anarchy_queue_drain(p, enter->to_submit);
+        mutex_unlock(&q->drain_lock);
+    }
+
+    if (!(enter->flags & ANARCHY_ENTER_GETEVENTS) || !enter->min_complete)
+        return 0;
+
+    /* CQEs only appear as the ring is reaped, so reap while waiting */
+    min_complete = min(enter->min_complete, p->cq_entries);
+    for (;;) {
+        /* The device is going, see anarchy_chardev_unregister() */
+        if (READ_ONCE(q->adev->unplugged))
+            return -ENODEV;
+        if (atomic_read(&p->inflight))
+            anarchy_ring_reap(q->adev, &q->adev->tx_ring, 0);
+        if (anarchy_queue_cq_count(p) >= min_complete)
+            return 0;
+
+        if (atomic_read(&p->inflight))
+            ret = wait_event_interruptible_hrtimeout(q->cq_wait,
+                        anarchy_queue_cq_count(p) >= min_complete,
+                        ns_to_ktime(QUEUE_REAP_POLL_NS));
+        else
+            ret = wait_event_interruptible(q->cq_wait,
+                        anarchy_queue_cq_count(p) >= min_complete ||
+                        atomic_read(&p->inflight) || READ_ONCE(q->adev->unplugged));
+        if (ret == -ERESTARTSYS)
+            return ret;
+    }
+}
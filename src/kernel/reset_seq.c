@@ -0,0 +1,64 @@
+#include "include/reset_seq.h"
+
+/*
+ * Acknowledgements range from a few microseconds (reset bits latching)
+ * to milliseconds (power state changes). Polling starts tight and backs
+ * off, so fast steps are not rounded up to a slow step's interval and
+ * slow ones do not flood the link with reads.
+ */
+#define RESET_POLL_MIN_US   10
+#define RESET_POLL_MAX_US   1000
+
+static int reset_step_wait(const struct reset_step *step, const struct reset_ops *ops,
+                           void *ctx, u64 start, unsigned int *polls)
+{
+    unsigned int interval = RESET_POLL_MIN_US;
+    u32 val;
+    int ret;
+
+    for (;;) {
+        ret = ops->read(ctx, step->poll_reg, &val);
+        (*polls)++;
+        if (ret)
+            return ret;
+        if ((val & step->mask) == step->expect)
+            return 0;
+        if (ops->now_us(ctx) - start >= step->timeout_us)
+            return -ETIMEDOUT;
+
+        ops->wait_us(ctx, interval);
+        interval *= 2;
+        if (interval > RESET_POLL_MAX_US)
+            interval = RESET_POLL_MAX_US;
+    }
+}
+
+int reset_seq_run(const struct reset_step *steps, unsigned int n,
+                  const struct reset_ops *ops, void *ctx, struct reset_result *res)
+{
+    u64 begin, start;
+    unsigned int i;
+    int ret = 0;
+
+    if (n > RESET_SEQ_MAX_STEPS)
+        return -EINVAL;
+
+    res->polls = 0;
+    begin = ops->now_us(ctx);
+
+    for (i = 0; i < n; i++) {
+        const struct reset_step *step = &steps[i];
+
+        start = ops->now_us(ctx);
+        ret = ops->write(ctx, step->reg, step->val);
+        if (!ret && step->mask)
+            ret = reset_step_wait(step, ops, ctx, start, &res->polls);
+        res->step_us[i] = ops->now_us(ctx) - start;
+        if (ret)
+            break;
+    }
+
+    res->step = i;
+    res->total_us = ops->now_us(ctx) - begin;
+    return ret;
+}
@@ -3,25 +3,35 @@
 #include <linux/pci.h>
 #include <linux/io.h>
 #include <linux/delay.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include "include/ring.h"
 #include "include/anarchy_device.h"
 #include "include/common.h"
+#include "include/gpu_emu.h"
+#include "include/ring_pool.h"
+#include "../../include/anarchy-ioctl.h"
+#include "include/anarchy_events.h"
 
-/* DMA descriptor structure */
+/* DMA descriptor structure, the device writes @status back when done */
 struct dma_desc {
     dma_addr_t addr;
     u32 size;
     u32 flags;
     u32 next;
+    u32 status;
 };
 
+#define RING_DESC_DONE         BIT(0)
+#define RING_DESC_ERROR        BIT(1)
+
 /* DMA ring buffer */
 struct dma_ring {
+    struct anarchy_ring_pool pool;  /* Descriptors and buffers */
     struct dma_desc *descs;
     dma_addr_t desc_dma;
-    void **buffers;
-    dma_addr_t *buffer_dmas;
+    struct dma_desc *saved;         /* In-flight descriptors at the last checkpoint */
+    struct anarchy_transfer **xfers; /* Callback owner per descriptor, may be NULL */
     unsigned int size;
     unsigned int head;
     unsigned int tail;
@@ -35,63 +45,98 @@ struct dma_ring {
 #define RING_DMA_START         0x104
 #define RING_STATUS            0x108
 
-static int setup_dma_ring(struct anarchy_device *adev, struct anarchy_ring *ring)
+/* Descriptors per ring when no size has been configured */
+#define RING_DEFAULT_SIZE      32
+
+/* Descriptors retired per tail update */
+#define RING_REAP_BATCH        16
+
+/* A credit waiter reaps itself this often, nothing interrupts on write-back */
+#define RING_CREDIT_POLL_NS    5000
+
+/* Submitted and not completed yet, called with dma->lock held */
+static unsigned int dma_ring_in_flight(const struct dma_ring *dma)
 {
-    struct dma_ring *dma;
-    int i;
+    return (dma->head + dma->size - dma->tail) % dma->size;
+}
 
-    dma = kzalloc(sizeof(*dma), GFP_KERNEL);
-    if (!dma)
-        return -ENOMEM;
+static void dma_ring_kick(struct anarchy_device *adev, struct dma_ring *dma,
+                          unsigned int idx)
+{
+    writel(dma->desc_dma + idx * sizeof(struct dma_desc),
+           adev->mmio_base + RING_DMA_DESC_ADDR);
+    writel(1, adev->mmio_base + RING_DMA_START);
+}
 
-    /* Allocate DMA descriptors */
-    dma->size = 32;
-    dma->descs = dma_alloc_coherent(&adev->pdev->dev,
-                                   dma->size * sizeof(struct dma_desc),
-                                   &dma->desc_dma, GFP_KERNEL);
-    if (!dma->descs) {
-        kfree(dma);
-        return -ENOMEM;
-    }
+/* Depth for a requested size, a power of two up to what the config ioctl accepts */
+static unsigned int dma_ring_entries(unsigned int size)
+{
+    if (!size)
+        return RING_DEFAULT_SIZE;
+    return clamp_t(unsigned int, roundup_pow_of_two(size), 2, ANARCHY_CFG_MAX_RING_SIZE);
+}
 
-    /* Allocate DMA buffers */
-    dma->buffers = kcalloc(dma->size, sizeof(void *), GFP_KERNEL);
-    dma->buffer_dmas = kcalloc(dma->size, sizeof(dma_addr_t), GFP_KERNEL);
-    if (!dma->buffers || !dma->buffer_dmas) {
-        if (dma->buffers)
-            kfree(dma->buffers);
-        if (dma->buffer_dmas)
-            kfree(dma->buffer_dmas);
-        dma_free_coherent(&adev->pdev->dev,
-                         dma->size * sizeof(struct dma_desc),
-                         dma->descs, dma->desc_dma);
-        kfree(dma);
+/* Descriptor, buffer and checkpoint storage for @size entries */
+static int dma_ring_alloc(struct anarchy_device *adev, struct dma_ring *dma,
+                          unsigned int size)
+{
+    int node = anarchy_ring_pool_node(adev->pdev);
+    unsigned int i;
+    int ret;
+
+    ret = anarchy_ring_pool_create(&dma->pool, &adev->pdev->dev, node, size,
+                                   sizeof(struct dma_desc));
+    if (ret)
+        return ret;
+
+    dma->saved = kvzalloc_node(size * sizeof(struct dma_desc), GFP_KERNEL, node);
+    dma->xfers = kvzalloc_node(size * sizeof(*dma->xfers), GFP_KERNEL, node);
+    if (!dma->saved || !dma->xfers) {
+        kvfree(dma->saved);
+        kvfree(dma->xfers);
+        anarchy_ring_pool_destroy(&dma->pool);
         return -ENOMEM;
     }
 
-    /* Initialize DMA buffers */
-    for (i = 0; i < dma->size; i++) {
-        dma->buffers[i] = dma_alloc_coherent(&adev->pdev->dev, PAGE_SIZE,
-                                            &dma->buffer_dmas[i], GFP_KERNEL);
-        if (!dma->buffers[i]) {
-            while (--i >= 0) {
-                dma_free_coherent(&adev->pdev->dev, PAGE_SIZE,
-                                dma->buffers[i], dma->buffer_dmas[i]);
-            }
-            kfree(dma->buffers);
-            kfree(dma->buffer_dmas);
-            dma_free_coherent(&adev->pdev->dev,
-                             dma->size * sizeof(struct dma_desc),
-                             dma->descs, dma->desc_dma);
-            kfree(dma);
-            return -ENOMEM;
-        }
+    dma->descs = dma->pool.descs;
+    dma->desc_dma = dma->pool.desc_dma;
+    dma->size = size;
+    dma->head = 0;
+    dma->tail = 0;
 
-        /* Initialize descriptor */
-        dma->descs[i].addr = dma->buffer_dmas[i];
+    for (i = 0; i < size; i++) {
+        dma->descs[i].addr = anarchy_ring_pool_buf_dma(&dma->pool, i);
         dma->descs[i].size = PAGE_SIZE;
         dma->descs[i].flags = 0;
-        dma->descs[i].next = (i + 1) % dma->size;
+        dma->descs[i].next = (i + 1) % size;
+        dma->descs[i].status = 0;
+    }
+    return 0;
+}
+
+static void dma_ring_free(struct dma_ring *dma)
+{
+    kvfree(dma->xfers);
+    dma->xfers = NULL;
+    kvfree(dma->saved);
+    dma->saved = NULL;
+    anarchy_ring_pool_destroy(&dma->pool);
+    dma->descs = NULL;
+}
+
+static int setup_dma_ring(struct anarchy_device *adev, struct anarchy_ring *ring)
+{
+    struct dma_ring *dma;
+    int ret;
+
+    dma = kzalloc(sizeof(*dma), GFP_KERNEL);
+    if (!dma)
+        return -ENOMEM;
+
+    ret = dma_ring_alloc(adev, dma, dma_ring_entries(adev->ring_buffer_size));
+    if (ret) {
+        kfree(dma);
+        return ret;
     }
 
     spin_lock_init(&dma->lock);
@@ -102,31 +147,11 @@ static int setup_dma_ring(struct anarchy_device *adev, struct anarchy_ring *ring
 static void cleanup_dma_ring(struct anarchy_device *adev, struct anarchy_ring *ring)
 {
     struct dma_ring *dma = ring->dma;
-    int i;
 
     if (!dma)
         return;
 
-    /* Free DMA buffers */
-    if (dma->buffers && dma->buffer_dmas) {
-        for (i = 0; i < dma->size; i++) {
-            if (dma->buffers[i]) {
-                dma_free_coherent(&adev->pdev->dev, PAGE_SIZE,
-                                dma->buffers[i], dma->buffer_dmas[i]);
-            }
-        }
-    }
-
-    kfree(dma->buffers);
-    kfree(dma->buffer_dmas);
-
-    /* Free DMA descriptors */
-    if (dma->descs) {
-        dma_free_coherent(&adev->pdev->dev,
-                         dma->size * sizeof(struct dma_desc),
-                         dma->descs, dma->desc_dma);
-    }
-
+    dma_ring_free(dma);
     kfree(dma);
     ring->dma = NULL;
 }
@@ -142,6 +167,12 @@ static int submit_dma_transfer(struct anarchy_device *adev,
 
     spin_lock_irqsave(&dma->lock, flags);
 
+    /* A checkpoint may have paused the ring since the caller looked */
+    if (ring->state != ANARCHY_RING_STATE_RUNNING) {
+        ret = ring->state == ANARCHY_RING_STATE_PAUSED ? -EBUSY : -EIO;
+        goto unlock;
+    }
+
     /* Check if ring is full */
     next_head = (dma->head + 1) % dma->size;
     if (next_head == dma->tail) {
@@ -150,20 +181,28 @@ static int submit_dma_transfer(struct anarchy_device *adev,
     }
 
     /* Copy data to DMA buffer */
-    memcpy(dma->buffers[dma->head], transfer->buffer,
+    memcpy(anarchy_ring_pool_buf(&dma->pool, dma->head), transfer->buffer,
            min_t(size_t, transfer->size, PAGE_SIZE));
+    if (ring->is_tx)
+        dma_sync_single_for_device(dma->pool.dev,
+                                   anarchy_ring_pool_buf_dma(&dma->pool, dma->head),
+                                   PAGE_SIZE, DMA_TO_DEVICE);
 
     /* Update descriptor */
     dma->descs[dma->head].size = transfer->size;
     dma->descs[dma->head].flags = transfer->flags;
+    dma->descs[dma->head].status = 0;
+    dma->xfers[dma->head] = transfer->done ? transfer : NULL;
+    atomic_inc(&ring->pending);
 
-    /* Start DMA transfer */
+    /* Start DMA transfer, the descriptor must be visible first */
     if (ring->is_tx) {
-        writel(dma->desc_dma + dma->head * sizeof(struct dma_desc),
-               adev->mmio_base + RING_DMA_DESC_ADDR);
-        writel(1, adev->mmio_base + RING_DMA_START);
+        dma_wmb();
+        dma_ring_kick(adev, dma, dma->head);
     }
 
+    trace_anarchy_ring_submit(adev, ring->is_tx, dma->head, transfer->size,
+                              dma_ring_in_flight(dma) + 1);
     dma->head = next_head;
 
 unlock:
@@ -191,10 +230,15 @@ int anarchy_ring_init(struct anarchy_device *adev, struct anarchy_ring *ring)
     init_waitqueue_head(&ring->wait);
 
     /* Initialize statistics */
-    atomic_set(&ring->bytes_transferred, 0);
+    atomic64_set(&ring->bytes_transferred, 0);
     atomic_set(&ring->transfer_errors, 0);
     atomic_set(&ring->error_count, 0);
     atomic_set(&ring->pending, 0);
+    atomic64_set(&ring->completed, 0);
+    atomic64_set(&ring->latency_ns, 0);
+    atomic_set(&ring->credit_waits, 0);
+    atomic_set(&ring->replayed, 0);
+    atomic_set(&ring->lost, 0);
 
     /* Setup DMA ring */
     ret = setup_dma_ring(adev, ring);
@@ -234,14 +278,165 @@ int anarchy_ring_start(struct anarchy_device *adev, struct anarchy_ring *ring, b
 
 void anarchy_ring_stop(struct anarchy_device *adev, struct anarchy_ring *ring)
 {
+    struct anarchy_transfer *transfer;
+    struct dma_ring *dma;
+    unsigned long flags;
+    unsigned int i, head, tail, lost;
+
     if (!adev || !ring)
         return;
 
-    ring->state = ANARCHY_RING_STATE_STOPPED;
+    dma = ring->dma;
+    if (dma) {
+        spin_lock_irqsave(&dma->lock, flags);
+        ring->state = ANARCHY_RING_STATE_STOPPED;
+        head = dma->head;
+        tail = dma->tail;
+        lost = dma_ring_in_flight(dma);
+        spin_unlock_irqrestore(&dma->lock, flags);
+
+        /* Nothing can submit or reap a stopped ring, fail what it dropped */
+        for (i = tail; i != head; i = (i + 1) % dma->size) {
+            transfer = dma->xfers[i];
+            dma->xfers[i] = NULL;
+            if (transfer)
+                transfer->done(transfer, -EIO);
+        }
+
+        spin_lock_irqsave(&dma->lock, flags);
+        atomic_add(lost, &ring->lost);
+        atomic_sub(lost, &ring->pending);
+        dma->head = 0;
+        dma->tail = 0;
+        spin_unlock_irqrestore(&dma->lock, flags);
+        wake_up_all(&ring->wait);
+    } else {
+        ring->state = ANARCHY_RING_STATE_STOPPED;
+    }
     ring->head = 0;
     ring->tail = 0;
 }
 
+int anarchy_ring_checkpoint(struct anarchy_device *adev, struct anarchy_ring *ring)
+{
+    struct dma_ring *dma;
+    unsigned long flags;
+    unsigned int i, n;
+
+    if (!adev || !ring || !ring->dma)
+        return -EINVAL;
+
+    /* Whatever already landed is retired now and never replayed */
+    anarchy_ring_reap(adev, ring, 0);
+
+    dma = ring->dma;
+    spin_lock_irqsave(&dma->lock, flags);
+    if (ring->state != ANARCHY_RING_STATE_RUNNING) {
+        spin_unlock_irqrestore(&dma->lock, flags);
+        return 0;
+    }
+
+    /*
+     * The buffers are host memory and survive; the descriptors may not.
+     * Ones written back since the reap above keep DONE in the copy.
+     */
+    n = 0;
+    for (i = dma->tail; i != dma->head; i = (i + 1) % dma->size) {
+        dma->saved[i] = dma->descs[i];
+        dma->saved[i].status = READ_ONCE(dma->descs[i].status);
+        if (!(dma->saved[i].status & RING_DESC_DONE))
+            n++;
+    }
+    ring->state = ANARCHY_RING_STATE_PAUSED;
+    spin_unlock_irqrestore(&dma->lock, flags);
+
+    return n;
+}
+
+int anarchy_ring_restore(struct anarchy_device *adev, struct anarchy_ring *ring)
+{
+    struct dma_ring *dma;
+    unsigned long flags;
+    unsigned int i, n;
+
+    if (!adev || !ring || !ring->dma)
+        return -EINVAL;
+
+    dma = ring->dma;
+    spin_lock_irqsave(&dma->lock, flags);
+    if (ring->state != ANARCHY_RING_STATE_PAUSED) {
+        spin_unlock_irqrestore(&dma->lock, flags);
+        return 0;
+    }
+
+    n = 0;
+    for (i = dma->tail; i != dma->head; i = (i + 1) % dma->size) {
+        /* Completed before the GPU went down, the reap below retires it */
+        if ((dma->saved[i].status | READ_ONCE(dma->descs[i].status)) & RING_DESC_DONE) {
+            dma->descs[i].status = dma->saved[i].status | RING_DESC_DONE;
+            continue;
+        }
+        dma->descs[i] = dma->saved[i];
+        dma->descs[i].addr = anarchy_ring_pool_buf_dma(&dma->pool, i);
+        dma->descs[i].next = (i + 1) % dma->size;
+        dma->descs[i].status = 0;
+        n++;
+        /* Oldest first, so the device sees the original order */
+        if (ring->is_tx) {
+            dma_wmb();
+            dma_ring_kick(adev, dma, i);
+        }
+    }
+    ring->state = ANARCHY_RING_STATE_RUNNING;
+    spin_unlock_irqrestore(&dma->lock, flags);
+
+    anarchy_ring_reap(adev, ring, 0);
+    atomic_add(n, &ring->replayed);
+    return n;
+}
+
+int anarchy_ring_resize(struct anarchy_device *adev, struct anarchy_ring *ring,
+                        unsigned int size)
+{
+    struct dma_ring *dma, next, old;
+    unsigned long flags;
+    int ret;
+
+    if (!adev || !ring || !ring->dma)
+        return -EINVAL;
+
+    dma = ring->dma;
+    size = dma_ring_entries(size);
+    if (size == dma->size)
+        return 0;
+
+    ret = dma_ring_alloc(adev, &next, size);
+    if (ret)
+        return ret;
+
+    spin_lock_irqsave(&dma->lock, flags);
+    if (dma_ring_in_flight(dma)) {
+        spin_unlock_irqrestore(&dma->lock, flags);
+        dma_ring_free(&next);
+        return -EBUSY;
+    }
+    old.pool = dma->pool;
+    old.saved = dma->saved;
+    old.xfers = dma->xfers;
+    dma->pool = next.pool;
+    dma->descs = next.descs;
+    dma->desc_dma = next.desc_dma;
+    dma->saved = next.saved;
+    dma->xfers = next.xfers;
+    dma->size = next.size;
+    dma->head = 0;
+    dma->tail = 0;
+    spin_unlock_irqrestore(&dma->lock, flags);
+
+    dma_ring_free(&old);
+    return 0;
+}
+
 int anarchy_ring_transfer(struct anarchy_device *adev, struct anarchy_ring *ring,
                          void *data, size_t size, struct anarchy_transfer *transfer)
 {
@@ -250,6 +445,8 @@ int anarchy_ring_transfer(struct anarchy_device *adev, struct anarchy_ring *ring
     if (!adev || !ring || !data || !size || !transfer)
         return -EINVAL;
 
+    if (ring->state == ANARCHY_RING_STATE_PAUSED)
+        return -EBUSY;
     if (ring->state != ANARCHY_RING_STATE_RUNNING)
         return -EIO;
 
@@ -258,28 +455,187 @@ int anarchy_ring_transfer(struct anarchy_device *adev, struct anarchy_ring *ring
     transfer->size = size;
     transfer->flags = 0;
 
-    /* Submit DMA transfer */
+    /* Submit DMA transfer, a full ring gets one reap before we give up */
     ret = submit_dma_transfer(adev, ring, transfer);
+    if (ret == -EBUSY && anarchy_ring_reap(adev, ring, 0) > 0)
+        ret = submit_dma_transfer(adev, ring, transfer);
     if (ret)
         return ret;
 
-    atomic_inc(&ring->pending);
+    atomic64_add(size, &ring->bytes_transferred);
+
+    /* TX rings feed the GPU, RX rings drain it */
+    if (ring->is_tx)
+        anarchy_gpu_emu_dma(adev, size, 0);
+    else
+        anarchy_gpu_emu_dma(adev, 0, size);
+    anarchy_trace_xfer(adev, ring->is_tx ? ANARCHY_TRACE_RING_TX : ANARCHY_TRACE_RING_RX, size);
     return 0;
 }
 
+int anarchy_ring_reap(struct anarchy_device *adev, struct anarchy_ring *ring,
+                      unsigned int budget)
+{
+    struct anarchy_transfer *done[RING_REAP_BATCH];
+    int status[RING_REAP_BATCH];
+    struct dma_ring *dma;
+    unsigned long flags;
+    unsigned int i, n, idx, reaped = 0;
+    int pending;
+    u32 st;
+
+    if (!adev || !ring || !ring->dma)
+        return -EINVAL;
+
+    dma = ring->dma;
+    if (!budget)
+        budget = UINT_MAX;
+
+    while (reaped < budget) {
+        n = 0;
+        spin_lock_irqsave(&dma->lock, flags);
+        pending = atomic_read(&ring->pending);
+        for (idx = dma->tail; idx != dma->head && n < RING_REAP_BATCH && reaped + n < budget;
+             idx = (idx + 1) % dma->size) {
+            st = READ_ONCE(dma->descs[idx].status);
+            if (!(st & RING_DESC_DONE))
+                break;
+            /* Nothing else in the descriptor is read before its status */
+            dma_rmb();
+
+            done[n] = dma->xfers[idx];
+            status[n] = st & RING_DESC_ERROR ? -EIO : 0;
+            dma->xfers[idx] = NULL;
+            dma->descs[idx].status = 0;
+            trace_anarchy_ring_complete(adev, ring->is_tx, idx, pending - n - 1);
+            n++;
+        }
+        /* Completions are in order, one tail update frees the whole batch */
+        dma->tail = idx;
+        spin_unlock_irqrestore(&dma->lock, flags);
+
+        if (!n)
+            break;
+        atomic_sub(n, &ring->pending);
+        atomic64_add(n, &ring->completed);
+        wake_up(&ring->wait);
+
+        for (i = 0; i < n; i++) {
+            if (status[i]) {
+                atomic_inc(&ring->transfer_errors);
+                atomic_inc(&ring->error_count);
+            }
+            if (done[i])
+                done[i]->done(done[i], status[i]);
+        }
+        reaped += n;
+        if (n < RING_REAP_BATCH)
+            break;
+    }
+    return reaped;
+}
+
+/* Racy on purpose, two completions racing only lose one sample */
+void anarchy_ring_account_latency(struct anarchy_ring *ring, u64 start_ns)
+{
+    u64 ns = ktime_get_ns() - start_ns;
+    u64 avg = atomic64_read(&ring->latency_ns);
+
+    atomic64_set(&ring->latency_ns, avg ? avg - (avg >> 3) + (ns >> 3) : max_t(u64, ns, 1));
+}
+
+unsigned int anarchy_ring_credits(struct anarchy_ring *ring)
+{
+    struct dma_ring *dma = ring->dma;
+    unsigned long flags;
+    unsigned int credits;
+
+    if (!dma)
+        return 0;
+    spin_lock_irqsave(&dma->lock, flags);
+    credits = dma->size - 1 - dma_ring_in_flight(dma);
+    spin_unlock_irqrestore(&dma->lock, flags);
+    return credits;
+}
+
+int anarchy_ring_wait_credits(struct anarchy_device *adev, struct anarchy_ring *ring,
+                              unsigned int credits, unsigned int timeout_us)
+{
+    unsigned int avail;
+    bool waited = false;
+    u64 deadline;
+    int ret;
+
+    if (!adev || !ring || !ring->dma || !credits)
+        return -EINVAL;
+    if (credits >= ring->dma->size)
+        return -E2BIG;
+
+    deadline = ktime_get_ns() + (u64)timeout_us * NSEC_PER_USEC;
+    for (;;) {
+        anarchy_ring_reap(adev, ring, 0);
+
+        /* A paused ring comes back after the reset, wait it out */
+        if (ring->state != ANARCHY_RING_STATE_RUNNING &&
+            ring->state != ANARCHY_RING_STATE_PAUSED)
+            return -EIO;
+
+        avail = anarchy_ring_credits(ring);
+        if (avail >= credits && ring->state == ANARCHY_RING_STATE_RUNNING)
+            return avail;
+        if (ktime_get_ns() >= deadline)
+            return -ETIMEDOUT;
+
+        if (!waited) {
+            atomic_inc(&ring->credit_waits);
+            waited = true;
+        }
+        ret = wait_event_interruptible_hrtimeout(ring->wait,
+                    READ_ONCE(ring->state) != ANARCHY_RING_STATE_RUNNING ||
+                    anarchy_ring_credits(ring) >= credits,
+                    ns_to_ktime(RING_CREDIT_POLL_NS));
+        if (ret == -ERESTARTSYS)
+            return -EINTR;
+    }
+}
+
 void anarchy_ring_complete(struct anarchy_device *adev, struct anarchy_ring *ring,
                          struct anarchy_transfer *transfer)
 {
-    if (!adev || !ring || !transfer)
+    struct dma_ring *dma;
+    unsigned long flags;
+    unsigned int idx;
+
+    if (!adev || !ring || !transfer || !ring->dma)
         return;
 
-    atomic_dec(&ring->pending);
-    wake_up(&ring->wait);
+    /*
+     * Software completion for rings the device does not write back, the
+     * RX frames from the Thunderbolt callback: retire the oldest open one.
+     */
+    dma = ring->dma;
+    spin_lock_irqsave(&dma->lock, flags);
+    for (idx = dma->tail; idx != dma->head; idx = (idx + 1) % dma->size) {
+        if (!(dma->descs[idx].status & RING_DESC_DONE)) {
+            dma->descs[idx].status = RING_DESC_DONE;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&dma->lock, flags);
+
+    anarchy_ring_reap(adev, ring, 0);
 }
 
 EXPORT_SYMBOL_GPL(anarchy_ring_init);
 EXPORT_SYMBOL_GPL(anarchy_ring_cleanup);
+EXPORT_SYMBOL_GPL(anarchy_ring_resize);
 EXPORT_SYMBOL_GPL(anarchy_ring_start);
 EXPORT_SYMBOL_GPL(anarchy_ring_stop);
 EXPORT_SYMBOL_GPL(anarchy_ring_transfer);
 EXPORT_SYMBOL_GPL(anarchy_ring_complete);
+EXPORT_SYMBOL_GPL(anarchy_ring_reap);
+EXPORT_SYMBOL_GPL(anarchy_ring_account_latency);
+EXPORT_SYMBOL_GPL(anarchy_ring_credits);
+EXPORT_SYMBOL_GPL(anarchy_ring_wait_credits);
+EXPORT_SYMBOL_GPL(anarchy_ring_checkpoint);
+EXPORT_SYMBOL_GPL(anarchy_ring_restore);
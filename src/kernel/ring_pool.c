@@ -0,0 +1,111 @@
+#include <linux/slab.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/log2.h>
+#include <linux/pci.h>
+#include <linux/dma-mapping.h>
+#include "include/ring_pool.h"
+
+static void ring_pool_free_slabs(struct anarchy_ring_pool *pool, unsigned int n)
+{
+    size_t bytes = PAGE_SIZE << pool->slab_order;
+
+    while (n--) {
+        dma_unmap_page(pool->dev, pool->slabs[n].dma, bytes, DMA_BIDIRECTIONAL);
+        __free_pages(pool->slabs[n].page, pool->slab_order);
+    }
+}
+
+static int ring_pool_alloc_slabs(struct anarchy_ring_pool *pool)
+{
+    struct anarchy_ring_slab *slab;
+    size_t bytes = PAGE_SIZE << pool->slab_order;
+    unsigned int i;
+
+    for (i = 0; i < pool->nr_slabs; i++) {
+        slab = &pool->slabs[i];
+        /* Fail fast, a smaller order is the fallback, not reclaim */
+        slab->page = alloc_pages_node(pool->node,
+                                      GFP_KERNEL | __GFP_ZERO | __GFP_COMP |
+                                      (pool->slab_order ? __GFP_NOWARN | __GFP_NORETRY : 0),
+                                      pool->slab_order);
+        if (!slab->page)
+            goto err;
+
+        slab->cpu = page_address(slab->page);
+        slab->dma = dma_map_page(pool->dev, slab->page, 0, bytes, DMA_BIDIRECTIONAL);
+        if (dma_mapping_error(pool->dev, slab->dma)) {
+            __free_pages(slab->page, pool->slab_order);
+            goto err;
+        }
+    }
+    return 0;
+
+err:
+    ring_pool_free_slabs(pool, i);
+    return -ENOMEM;
+}
+
+int anarchy_ring_pool_create(struct anarchy_ring_pool *pool, struct device *dev, int node,
+                             unsigned int entries, size_t desc_size)
+{
+    unsigned int order;
+
+    if (!entries)
+        return -EINVAL;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->dev = dev;
+    pool->node = node;
+    pool->entries = entries;
+
+    pool->desc_bytes = entries * desc_size;
+    pool->descs = dma_alloc_coherent(dev, pool->desc_bytes, &pool->desc_dma, GFP_KERNEL);
+    if (!pool->descs)
+        return -ENOMEM;
+
+    /* Biggest slabs first, halve them until the allocator can satisfy us */
+    order = min_t(unsigned int, order_base_2(entries), ANARCHY_RING_POOL_SLAB_ORDER);
+    for (;;) {
+        pool->slab_order = order;
+        pool->nr_slabs = DIV_ROUND_UP(entries, 1U << order);
+        pool->slabs = kcalloc_node(pool->nr_slabs, sizeof(*pool->slabs), GFP_KERNEL, node);
+        if (pool->slabs && !ring_pool_alloc_slabs(pool))
+            return 0;
+
+        kfree(pool->slabs);
+        pool->slabs = NULL;
+        if (!order--)
+            break;
+    }
+
+    dma_free_coherent(dev, pool->desc_bytes, pool->descs, pool->desc_dma);
+    pool->descs = NULL;
+    return -ENOMEM;
+}
+
+void anarchy_ring_pool_destroy(struct anarchy_ring_pool *pool)
+{
+    if (pool->slabs) {
+        ring_pool_free_slabs(pool, pool->nr_slabs);
+        kfree(pool->slabs);
+        pool->slabs = NULL;
+    }
+    if (pool->descs) {
+        dma_free_coherent(pool->dev, pool->desc_bytes, pool->descs, pool->desc_dma);
+        pool->descs = NULL;
+    }
+}
+
+int anarchy_ring_pool_node(struct pci_dev *pdev)
+{
+    int node;
+
+    /* Tunnelled endpoints often carry no node, the controller's bridges do */
+    for (; pdev; pdev = pci_upstream_bridge(pdev)) {
+        node = dev_to_node(&pdev->dev);
+        if (node != NUMA_NO_NODE)
+            return node;
+    }
+    return NUMA_NO_NODE;
+}
@@ -0,0 +1,222 @@
+#include <linux/module.h>
+#include <linux/pci.h>
+#include <linux/io.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include "include/anarchy_device.h"
+#include "include/gpu_offsets.h"
+#include "include/module_params.h"
+#include "include/telemetry.h"
+#include "include/runtime_pm.h"
+
+/*
+ * Submissions come in bursts: short gaps inside a burst, long ones
+ * between. The predictor averages the short gaps and waits a little more
+ * than twice that before going idle, so a burst keeps the link up while
+ * the end of one drops it within a couple of gaps. Waking up again before
+ * the break-even time means the guess was wrong and the timeout backs off.
+ */
+#define RPM_BREAK_EVEN_US       2000
+#define RPM_TIMEOUT_MIN_US      500
+#define RPM_TIMEOUT_SLACK_US    250
+#define RPM_PENALTY_MAX         8
+
+static const unsigned int rpm_lat_bounds_us[ANARCHY_RPM_LAT_BUCKETS] = {
+    10, 50, 100, 250, 500, 1000, 5000, UINT_MAX
+};
+
+static unsigned int anarchy_rpm_max_us(void)
+{
+    return READ_ONCE(idle_timeout_ms) * USEC_PER_MSEC;
+}
+
+/* Called with rpm->lock held */
+static void anarchy_rpm_update_timeout(struct anarchy_rpm *rpm)
+{
+    unsigned int max = anarchy_rpm_max_us();
+    u64 timeout;
+
+    timeout = ((u64)rpm->gap_avg_us * 2 + RPM_TIMEOUT_SLACK_US) * rpm->penalty;
+    rpm->timeout_us = clamp_t(u64, timeout, RPM_TIMEOUT_MIN_US, max ? max : RPM_TIMEOUT_MIN_US);
+}
+
+static void anarchy_rpm_idle_work(struct work_struct *work)
+{
+    struct anarchy_rpm *rpm = container_of(to_delayed_work(work), struct anarchy_rpm,
+                                           idle_work);
+    struct anarchy_device *adev = container_of(rpm, struct anarchy_device, rpm);
+
+    mutex_lock(&rpm->lock);
+    if (rpm->usage || rpm->idle || !anarchy_rpm_max_us())
+        goto out;
+
+    /*
+     * Every sampling read pulls the link back out of L1, so sampling drops
+     * to the thermal loop's own period rather than stopping: fan and power
+     * limit keep following the temperature while the link idles.
+     */
+    anarchy_telemetry_set_idle(adev, true);
+    if (rpm->l1_capable && pci_enable_link_state(adev->pdev, PCIE_LINK_STATE_L1))
+        rpm->l1_capable = false;
+
+    rpm->idle = true;
+    rpm->idle_start_ns = ktime_get_ns();
+    rpm->entries++;
+out:
+    mutex_unlock(&rpm->lock);
+}
+
+/*
+ * Called with rpm->lock held. The latency recorded is the ASPM disable
+ * plus one register read: a read is non-posted, so it cannot complete
+ * until the link is back in L0, and it covers the L1 exit the first
+ * submission would otherwise pay.
+ */
+static void anarchy_rpm_resume(struct anarchy_device *adev, struct anarchy_rpm *rpm)
+{
+    u64 start = ktime_get_ns(), idle_ns, lat_ns;
+    unsigned int i;
+
+    /* No retraining: the link only left L0 through ASPM */
+    if (rpm->l1_capable)
+        pci_disable_link_state(adev->pdev, PCIE_LINK_STATE_L1);
+    if (adev->mmio_base)
+        readl(adev->mmio_base + GPU_CLOCK_OFFSET);
+    lat_ns = ktime_get_ns() - start;
+
+    anarchy_telemetry_set_idle(adev, false);
+    rpm->idle = false;
+
+    if (lat_ns > rpm->resume_max_ns)
+        rpm->resume_max_ns = lat_ns;
+    for (i = 0; i < ANARCHY_RPM_LAT_BUCKETS - 1; i++)
+        if (lat_ns < (u64)rpm_lat_bounds_us[i] * NSEC_PER_USEC)
+            break;
+    rpm->resume_hist[i]++;
+
+    idle_ns = start - rpm->idle_start_ns;
+    rpm->idle_ns += idle_ns;
+    if (idle_ns < (u64)RPM_BREAK_EVEN_US * NSEC_PER_USEC) {
+        rpm->early_wakeups++;
+        rpm->penalty = min(rpm->penalty * 2, RPM_PENALTY_MAX);
+    } else if (rpm->penalty > 1) {
+        rpm->penalty--;
+    }
+}
+
+int anarchy_rpm_get(struct anarchy_device *adev)
+{
+    struct anarchy_rpm *rpm = &adev->rpm;
+    u64 gap_us;
+
+    might_sleep();
+    cancel_delayed_work(&rpm->idle_work);
+
+    mutex_lock(&rpm->lock);
+    if (!rpm->usage++ && rpm->busy_end_ns) {
+        gap_us = div_u64(ktime_get_ns() - rpm->busy_end_ns, NSEC_PER_USEC);
+        if (gap_us < anarchy_rpm_max_us())
+            rpm->gap_avg_us = rpm->gap_avg_us - rpm->gap_avg_us / 8 + (u32)gap_us / 8;
+        if (rpm->idle)
+            anarchy_rpm_resume(adev, rpm);
+        anarchy_rpm_update_timeout(rpm);
+    }
+    mutex_unlock(&rpm->lock);
+    return 0;
+}
+EXPORT_SYMBOL_GPL(anarchy_rpm_get);
+
+void anarchy_rpm_put(struct anarchy_device *adev)
+{
+    struct anarchy_rpm *rpm = &adev->rpm;
+    unsigned int timeout_us = 0;
+
+    mutex_lock(&rpm->lock);
+    if (!WARN_ON(!rpm->usage) && !--rpm->usage) {
+        rpm->busy_end_ns = ktime_get_ns();
+        timeout_us = anarchy_rpm_max_us() ? rpm->timeout_us : 0;
+    }
+    mutex_unlock(&rpm->lock);
+
+    if (timeout_us)
+        mod_delayed_work(system_wq, &rpm->idle_work, usecs_to_jiffies(timeout_us));
+}
+EXPORT_SYMBOL_GPL(anarchy_rpm_put);
+
+static int anarchy_rpm_show(struct seq_file *m, void *unused)
+{
+    struct anarchy_device *adev = m->private;
+    struct anarchy_rpm *rpm = &adev->rpm;
+    u64 idle_ns, now = ktime_get_ns();
+    unsigned int i;
+
+    mutex_lock(&rpm->lock);
+    idle_ns = rpm->idle_ns + (rpm->idle ? now - rpm->idle_start_ns : 0);
+    seq_printf(m, "state %s usage %u l1 %d\n", rpm->idle ? "idle" : "active",
+               rpm->usage, rpm->l1_capable);
+    seq_printf(m, "timeout_us %u gap_avg_us %u penalty %u max_us %u\n",
+               rpm->timeout_us, rpm->gap_avg_us, rpm->penalty, anarchy_rpm_max_us());
+    seq_printf(m, "entries %llu early_wakeups %llu idle_ms %llu\n", rpm->entries,
+               rpm->early_wakeups, div_u64(idle_ns, NSEC_PER_MSEC));
+    /* ASPM disable to the first register read completing */
+    seq_printf(m, "resume_max_ns %llu\n", rpm->resume_max_ns);
+    for (i = 0; i < ANARCHY_RPM_LAT_BUCKETS; i++) {
+        if (rpm_lat_bounds_us[i] == UINT_MAX)
+            seq_printf(m, "resume_us >%u %llu\n", rpm_lat_bounds_us[i - 1],
+                       rpm->resume_hist[i]);
+        else
+            seq_printf(m, "resume_us <%u %llu\n", rpm_lat_bounds_us[i],
+                       rpm->resume_hist[i]);
+    }
+    mutex_unlock(&rpm->lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(anarchy_rpm);
+
+void anarchy_rpm_debugfs_init(struct anarchy_device *adev, struct dentry *parent)
+{
+    debugfs_create_file("runtime_pm", 0444, parent, adev, &anarchy_rpm_fops);
+}
+EXPORT_SYMBOL_GPL(anarchy_rpm_debugfs_init);
+
+int anarchy_rpm_init(struct anarchy_device *adev)
+{
+    struct anarchy_rpm *rpm = &adev->rpm;
+    u32 lnkcap = 0;
+
+    mutex_init(&rpm->lock);
+    INIT_DELAYED_WORK(&rpm->idle_work, anarchy_rpm_idle_work);
+    rpm->usage = 1;                 /* Dropped once the device is ready */
+    rpm->idle = false;
+    rpm->busy_end_ns = 0;
+    rpm->gap_avg_us = 0;
+    rpm->penalty = 1;
+    rpm->entries = 0;
+    rpm->early_wakeups = 0;
+    rpm->idle_ns = 0;
+    rpm->resume_max_ns = 0;
+    memset(rpm->resume_hist, 0, sizeof(rpm->resume_hist));
+    anarchy_rpm_update_timeout(rpm);
+
+    /* Without L1 idling still cuts the sampling traffic */
+    if (adev->pdev)
+        pcie_capability_read_dword(adev->pdev, PCI_EXP_LNKCAP, &lnkcap);
+    rpm->l1_capable = !!(lnkcap & PCI_EXP_LNKCAP_ASPM_L1);
+    return 0;
+}
+EXPORT_SYMBOL_GPL(anarchy_rpm_init);
+
+void anarchy_rpm_exit(struct anarchy_device *adev)
+{
+    struct anarchy_rpm *rpm = &adev->rpm;
+
+    cancel_delayed_work_sync(&rpm->idle_work);
+
+    mutex_lock(&rpm->lock);
+    if (rpm->idle)
+        anarchy_rpm_resume(adev, rpm);
+    mutex_unlock(&rpm->lock);
+}
+EXPORT_SYMBOL_GPL(anarchy_rpm_exit);
@@ -1,6 +1,7 @@
 #include <linux/module.h>
 #include <linux/device.h>
 #include <linux/thunderbolt.h>
+#include <linux/debugfs.h>
 #include "include/service_probe.h"
 #include "include/anarchy_device.h"
 #include "include/common.h"
@@ -15,6 +16,11 @@
 #include "include/pcie.h"
 #include "include/anarchy_driver.h"
 #include "include/module_params.h"
+#include "include/chardev.h"
+#include "include/bandwidth.h"
+#include "include/telemetry.h"
+#include "include/power_gov.h"
+#include "include/runtime_pm.h"
 
 /* Service probe callback */
 int anarchy_service_probe(struct tb_service *svc, const struct tb_service_id *id)
@@ -32,14 +38,20 @@ int anarchy_service_probe(struct tb_service *svc, const struct tb_service_id *id
     adev->service = svc;
     adev->state = ANARCHY_DEVICE_STATE_INITIALIZING;
     adev->flags = 0;
+    adev->ring_buffer_size = ring_buffer_size;
     mutex_init(&adev->lock);
-    atomic_set(&adev->ref_count, 1);
+    kref_init(&adev->ref);
+    ret = init_srcu_struct(&adev->chardev_srcu);
+    if (ret) {
+        kfree(adev);
+        return ret;
+    }
 
     /* Allocate and initialize device */
     adev->dev = kzalloc(sizeof(struct device), GFP_KERNEL);
     if (!adev->dev) {
         ret = -ENOMEM;
-        goto err_free_adev;
+        goto err_put;
     }
 
     device_initialize(adev->dev);
@@ -53,21 +65,39 @@ int anarchy_service_probe(struct tb_service *svc, const struct tb_service_id *id
     /* Initialize device subsystems */
     ret = anarchy_device_init(adev);
     if (ret)
-        goto err_free_dev;
+        goto err_put;
 
     /* Register device */
     ret = device_add(adev->dev);
     if (ret)
         goto err_cleanup;
 
+    /* Expose the control interface */
+    ret = anarchy_chardev_register(adev);
+    if (ret)
+        goto err_del;
+
+    /* Diagnostics only, failures are not fatal */
+    adev->debugfs_dir = debugfs_create_dir(dev_name(adev->dev), NULL);
+    if (!IS_ERR_OR_NULL(adev->debugfs_dir)) {
+        anarchy_pcie_debugfs_init(adev, adev->debugfs_dir);
+        anarchy_bandwidth_debugfs_init(adev, adev->debugfs_dir);
+        anarchy_telemetry_debugfs_init(adev, adev->debugfs_dir);
+        anarchy_power_gov_debugfs_init(adev, adev->debugfs_dir);
+        anarchy_rpm_debugfs_init(adev, adev->debugfs_dir);
+        anarchy_trace_debugfs_init(adev, adev->debugfs_dir);
+        anarchy_dma_path_debugfs_init(adev, adev->debugfs_dir);
+        anarchy_upload_debugfs_init(adev, adev->debugfs_dir);
+    }
+
     return 0;
 
+err_del:
+    device_del(adev->dev);
 err_cleanup:
     anarchy_device_exit(adev);
-err_free_dev:
-    kfree(adev->dev);
-err_free_adev:
-    kfree(adev);
+err_put:
+    anarchy_device_put(adev);
     return ret;
 }
 EXPORT_SYMBOL_GPL(anarchy_service_probe);
@@ -81,15 +111,16 @@ void anarchy_service_remove(struct tb_service *svc)
     if (!adev)
         return;
 
-    /* Unregister device */
+    /* Unregister control interface and device */
+    debugfs_remove_recursive(adev->debugfs_dir);
+    anarchy_chardev_unregister(adev);
     device_del(adev->dev);
 
     /* Cleanup device */
     anarchy_device_exit(adev);
 
-    /* Free device structures */
-    kfree(adev->dev);
-    kfree(adev);
+    /* Freed here unless a control file is still open */
+    anarchy_device_put(adev);
 }
 EXPORT_SYMBOL_GPL(anarchy_service_remove);
 
@@ -0,0 +1,73 @@
+#include <linux/module.h>
+#include <linux/ktime.h>
+#include <linux/thunderbolt.h>
+#include "include/chardev.h"
+#include "include/anarchy_device.h"
+#include "include/pcie_state.h"
+#include "include/ring.h"
+#include "include/perf_monitor.h"
+#include "include/bandwidth.h"
+
+/*
+ * Rate of the XDomain link, per-lane speed times the lanes it runs on,
+ * and its depth: the route string holds one byte per switch on the way.
+ */
+static void anarchy_fill_tb_stats(struct anarchy_device *adev, struct anarchy_ioc_stats *st)
+{
+    struct tb_xdomain *xd;
+
+    if (!adev->service)
+        return;
+
+    strscpy(st->tb_device_path, dev_name(&adev->service->dev), sizeof(st->tb_device_path));
+    xd = tb_service_parent(adev->service);
+    if (!xd)
+        return;
+    st->tb_link_speed = xd->link_speed * xd->link_width;
+    st->tb_hop_count = DIV_ROUND_UP(fls64(xd->route), 8);
+}
+
+void anarchy_fill_stats(struct anarchy_device *adev, struct anarchy_ioc_stats *st)
+{
+    struct perf_state perf;
+
+    memset(st, 0, sizeof(*st));
+    st->timestamp_ns = ktime_get_ns();
+
+    if (pcie_link_is_up(adev->pdev))
+        st->flags |= ANARCHY_STATS_LINK_UP;
+    if (adev->flags & ANARCHY_DEVICE_FLAG_CONNECTED)
+        st->flags |= ANARCHY_STATS_CONNECTED;
+    if (adev->thermal_profile.throttling)
+        st->flags |= ANARCHY_STATS_THROTTLING;
+
+    st->tx_bytes = atomic64_read(&adev->tx_ring.bytes_transferred);
+    st->rx_bytes = atomic64_read(&adev->rx_ring.bytes_transferred);
+    st->tx_pending = atomic_read(&adev->tx_ring.pending);
+    st->rx_pending = atomic_read(&adev->rx_ring.pending);
+    st->transfer_errors = atomic_read(&adev->tx_ring.transfer_errors) +
+                          atomic_read(&adev->rx_ring.transfer_errors);
+    st->dma_channels = adev->dma_channels;
+    st->ring_size = adev->ring_buffer_size;
+    st->latency_ns = min_t(u64, atomic64_read(&adev->tx_ring.latency_ns), U32_MAX);
+
+    st->link_speed = adev->pcie_state.speed;
+    st->link_width = adev->pcie_state.link_width;
+    st->pcie_errors = adev->pcie_state.error_count;
+    anarchy_bandwidth_get_rates(adev, &st->pcie_rx_rate, &st->pcie_tx_rate);
+
+    if (!anarchy_perf_get_state(adev, &perf)) {
+        st->pcie_utilization = perf.pcie_util;
+        st->gpu_utilization = perf.gpu_util;
+        st->mem_utilization = perf.mem_util;
+        st->temperature = perf.temperature;
+        st->fan_speed = perf.fan_speed;
+        st->power_draw = perf.power_draw;
+        st->gpu_clock = perf.gpu_clock;
+    }
+
+    st->tb_errors = atomic_read(&adev->tx_ring.error_count) +
+                    atomic_read(&adev->rx_ring.error_count);
+    anarchy_fill_tb_stats(adev, st);
+}
+EXPORT_SYMBOL_GPL(anarchy_fill_stats);
@@ -0,0 +1,272 @@
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/io.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include "include/anarchy_device.h"
+#include "include/gpu_config.h"
+#include "include/gpu_offsets.h"
+#include "include/module_params.h"
+#include "include/telemetry.h"
+#include "include/thermal.h"
+
+/*
+ * The PCIe byte counters wrap after ~0.86 s at 5 GB/s, so the period is
+ * capped well below that for the consumers' single-wrap deltas to hold.
+ * Idle sampling and a late work item leave longer gaps; a sample further
+ * than TELEMETRY_GAP_MS from the last one is flagged for the consumers
+ * to take a new baseline instead of a delta.
+ */
+#define TELEMETRY_MS_MIN    10
+#define TELEMETRY_MS_MAX    500
+#define TELEMETRY_GAP_MS    750
+
+unsigned int anarchy_telemetry_interval_ms(void)
+{
+    return clamp_t(unsigned int, READ_ONCE(telemetry_ms), TELEMETRY_MS_MIN,
+                   TELEMETRY_MS_MAX);
+}
+EXPORT_SYMBOL_GPL(anarchy_telemetry_interval_ms);
+
+/* While the link idles, sample only as often as the thermal loop runs */
+static unsigned int anarchy_telemetry_next_ms(struct anarchy_telemetry *tel)
+{
+    return READ_ONCE(tel->idle) ? THERMAL_MONITOR_INTERVAL :
+                                  anarchy_telemetry_interval_ms();
+}
+
+/* Every register the monitors use, back to back */
+static void anarchy_telemetry_read(struct anarchy_device *adev,
+                                   struct anarchy_telemetry_sample *s)
+{
+    void __iomem *mmio = adev->mmio_base;
+    u64 start = ktime_get_ns();
+
+    s->gpu_clock = readl(mmio + GPU_CLOCK_OFFSET) / 1000;
+    s->mem_clock = readl(mmio + MEM_CLOCK_OFFSET) / 1000;
+    s->gpu_util = readl(mmio + GPU_UTIL_OFFSET);
+    s->mem_util = readl(mmio + MEM_UTIL_OFFSET);
+    s->vram_used = readl(mmio + VRAM_USED_OFFSET) / 1024;
+    s->temperature = readl(mmio + TEMP_OFFSET);
+    s->power_draw = readl(mmio + POWER_OFFSET) / 1000;
+    s->fan_speed = readl(mmio + FAN_STATUS_OFFSET);
+    s->pcie_rx_counter = readl(mmio + PCIE_RX_COUNTER_OFFSET);
+    s->pcie_tx_counter = readl(mmio + PCIE_TX_COUNTER_OFFSET);
+
+    s->timestamp_ns = ktime_get_ns();
+    s->read_ns = s->timestamp_ns - start;
+}
+
+static void anarchy_telemetry_work(struct work_struct *work)
+{
+    struct anarchy_telemetry *tel = container_of(to_delayed_work(work),
+                                                 struct anarchy_telemetry, work);
+    struct anarchy_device *adev = container_of(tel, struct anarchy_device, telemetry);
+    struct anarchy_telemetry_sample *sample, *old;
+    struct anarchy_telemetry_sub *sub;
+
+    sample = kzalloc(sizeof(*sample), GFP_KERNEL);
+    if (!sample)
+        goto out;
+
+    anarchy_telemetry_read(adev, sample);
+    sample->seq = ++tel->samples;
+    tel->read_total_ns += sample->read_ns;
+    if (sample->read_ns > tel->read_max_ns)
+        tel->read_max_ns = sample->read_ns;
+
+    /* Only this work replaces the pointer */
+    old = rcu_dereference_protected(tel->current_sample, true);
+    sample->counter_gap = !old || sample->timestamp_ns - old->timestamp_ns >
+                                  (u64)TELEMETRY_GAP_MS * NSEC_PER_MSEC;
+    rcu_assign_pointer(tel->current_sample, sample);
+    if (old)
+        kfree_rcu(old, rcu);
+
+    /* The sample stays valid here: only the next run of this work frees it */
+    mutex_lock(&tel->sub_lock);
+    list_for_each_entry(sub, &tel->subs, node) {
+        if (sample->timestamp_ns < sub->next_ns)
+            continue;
+        sub->next_ns = sample->timestamp_ns +
+                       (u64)sub->interval_ms * NSEC_PER_MSEC;
+        sub->calls++;
+        sub->fn(adev, sub, sample);
+    }
+    mutex_unlock(&tel->sub_lock);
+
+out:
+    if (READ_ONCE(tel->running))
+        schedule_delayed_work(&tel->work,
+                              msecs_to_jiffies(anarchy_telemetry_next_ms(tel)));
+}
+
+void anarchy_telemetry_subscribe(struct anarchy_device *adev,
+                                 struct anarchy_telemetry_sub *sub)
+{
+    struct anarchy_telemetry *tel = &adev->telemetry;
+
+    sub->next_ns = 0;
+    sub->calls = 0;
+    mutex_lock(&tel->sub_lock);
+    list_add_tail(&sub->node, &tel->subs);
+    mutex_unlock(&tel->sub_lock);
+}
+EXPORT_SYMBOL_GPL(anarchy_telemetry_subscribe);
+
+/* On return the callback is not running and will not run again */
+void anarchy_telemetry_unsubscribe(struct anarchy_device *adev,
+                                   struct anarchy_telemetry_sub *sub)
+{
+    struct anarchy_telemetry *tel = &adev->telemetry;
+
+    mutex_lock(&tel->sub_lock);
+    list_del_init(&sub->node);
+    mutex_unlock(&tel->sub_lock);
+}
+EXPORT_SYMBOL_GPL(anarchy_telemetry_unsubscribe);
+
+int anarchy_telemetry_get(struct anarchy_device *adev,
+                          struct anarchy_telemetry_sample *out)
+{
+    struct anarchy_telemetry_sample *s;
+    int ret = -ENODATA;
+
+    rcu_read_lock();
+    s = rcu_dereference(adev->telemetry.current_sample);
+    if (s) {
+        *out = *s;
+        ret = 0;
+    }
+    rcu_read_unlock();
+    return ret;
+}
+EXPORT_SYMBOL_GPL(anarchy_telemetry_get);
+
+#ifdef CONFIG_DEBUG_FS
+
+static int anarchy_telemetry_show(struct seq_file *m, void *unused)
+{
+    struct anarchy_device *adev = m->private;
+    struct anarchy_telemetry *tel = &adev->telemetry;
+    struct anarchy_telemetry_sample s;
+    struct anarchy_telemetry_sub *sub;
+
+    seq_printf(m, "interval_ms %u idle %d samples %llu read_avg_ns %llu read_max_ns %u\n",
+               anarchy_telemetry_next_ms(tel), READ_ONCE(tel->idle), tel->samples,
+               tel->samples ? div64_u64(tel->read_total_ns, tel->samples) : 0,
+               tel->read_max_ns);
+
+    mutex_lock(&tel->sub_lock);
+    list_for_each_entry(sub, &tel->subs, node)
+        seq_printf(m, "sub %-10s interval_ms %u calls %llu\n", sub->name,
+                   sub->interval_ms, sub->calls);
+    mutex_unlock(&tel->sub_lock);
+
+    if (!anarchy_telemetry_get(adev, &s))
+        seq_printf(m, "last seq %llu ts %llu temp %u power %u fan %u gpu %u mem %u "
+                   "rx %u tx %u\n", s.seq, s.timestamp_ns, s.temperature,
+                   s.power_draw, s.fan_speed, s.gpu_util, s.mem_util,
+                   s.pcie_rx_counter, s.pcie_tx_counter);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(anarchy_telemetry);
+
+static void anarchy_hold_stat_show(struct seq_file *m, const char *name,
+                                   const struct anarchy_hold_stat *s)
+{
+    seq_printf(m, "%-10s %10llu %8llu %8llu %10llu %8llu\n", name, s->count,
+               s->count ? div64_u64(s->total_ns, s->count) : 0, s->max_ns,
+               s->irqoff_count, s->irqoff_max_ns);
+}
+
+/* Lock hold times of the subscribers, to keep an eye on irq-off time */
+static int anarchy_lock_hold_show(struct seq_file *m, void *unused)
+{
+    struct anarchy_device *adev = m->private;
+
+    seq_printf(m, "%-10s %10s %8s %8s %10s %8s\n", "lock", "count", "avg_ns",
+               "max_ns", "irqoff", "max_ns");
+    anarchy_hold_stat_show(m, "thermal", &adev->thermal_profile.hold);
+    anarchy_hold_stat_show(m, "bandwidth", &adev->bandwidth.hold);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(anarchy_lock_hold);
+
+void anarchy_telemetry_debugfs_init(struct anarchy_device *adev, struct dentry *parent)
+{
+    debugfs_create_file("telemetry", 0444, parent, adev, &anarchy_telemetry_fops);
+    debugfs_create_file("lock_hold", 0444, parent, adev, &anarchy_lock_hold_fops);
+}
+
+#else
+
+void anarchy_telemetry_debugfs_init(struct anarchy_device *adev, struct dentry *parent)
+{
+}
+
+#endif /* CONFIG_DEBUG_FS */
+EXPORT_SYMBOL_GPL(anarchy_telemetry_debugfs_init);
+
+int anarchy_telemetry_init(struct anarchy_device *adev)
+{
+    struct anarchy_telemetry *tel = &adev->telemetry;
+
+    RCU_INIT_POINTER(tel->current_sample, NULL);
+    INIT_DELAYED_WORK(&tel->work, anarchy_telemetry_work);
+    mutex_init(&tel->sub_lock);
+    INIT_LIST_HEAD(&tel->subs);
+    tel->running = false;
+    tel->idle = false;
+    tel->samples = 0;
+    tel->read_max_ns = 0;
+    tel->read_total_ns = 0;
+    return 0;
+}
+EXPORT_SYMBOL_GPL(anarchy_telemetry_init);
+
+/* Subscribers added before this see the first sample */
+void anarchy_telemetry_start(struct anarchy_device *adev)
+{
+    struct anarchy_telemetry *tel = &adev->telemetry;
+
+    WRITE_ONCE(tel->running, true);
+    schedule_delayed_work(&tel->work, 0);
+}
+EXPORT_SYMBOL_GPL(anarchy_telemetry_start);
+
+void anarchy_telemetry_stop(struct anarchy_device *adev)
+{
+    struct anarchy_telemetry *tel = &adev->telemetry;
+
+    WRITE_ONCE(tel->running, false);
+    cancel_delayed_work_sync(&tel->work);
+}
+EXPORT_SYMBOL_GPL(anarchy_telemetry_stop);
+
+void anarchy_telemetry_set_idle(struct anarchy_device *adev, bool idle)
+{
+    struct anarchy_telemetry *tel = &adev->telemetry;
+
+    WRITE_ONCE(tel->idle, idle);
+    /* Back to full rate with a fresh sample rather than one up to a second old */
+    if (!idle && READ_ONCE(tel->running))
+        mod_delayed_work(system_wq, &tel->work, 0);
+}
+EXPORT_SYMBOL_GPL(anarchy_telemetry_set_idle);
+
+void anarchy_telemetry_exit(struct anarchy_device *adev)
+{
+    struct anarchy_telemetry *tel = &adev->telemetry;
+    struct anarchy_telemetry_sample *old;
+
+    anarchy_telemetry_stop(adev);
+
+    old = rcu_dereference_protected(tel->current_sample, true);
+    RCU_INIT_POINTER(tel->current_sample, NULL);
+    if (old)
+        kfree_rcu(old, rcu);
+}
+EXPORT_SYMBOL_GPL(anarchy_telemetry_exit);
@@ -8,90 +8,84 @@
 #include "include/thermal.h"
 #include "include/anarchy_device.h"
 #include "include/thermal_forward.h"
-
-/* Thermal thresholds */
-#define P16_FAN_MIN_SPEED    30  /* 30% minimum */
-#define P16_FAN_MAX_SPEED    100 /* 100% maximum */
-#define P16_TEMP_TARGET      75  /* 75°C target */
-#define P16_TEMP_CRITICAL    87  /* 87°C critical */
-#define P16_TEMP_WARNING     80  /* 80°C warning */
-#define THERMAL_UPDATE_INTERVAL_MS 1000
-
-/* Fan speed steps (percentage) */
-static const int fan_speed_steps[] = {
-    30,  /* Silent - minimum speed */
-    40,  /* Very low */
-    50,  /* Low */
-    60,  /* Medium */
-    70,  /* Medium high */
-    80,  /* High */
-    90,  /* Very high */
-    100  /* Maximum */
-};
-
-static void adjust_thermal_profile(struct anarchy_device *adev, int temp)
+#include "include/thermal_ctl.h"
+#include "include/telemetry.h"
+#include "include/anarchy_events.h"
+
+/*
+ * Applies the published targets. Kept apart from sampling so register
+ * writes (which may sleep) never run under the profile lock. The applied
+ * values belong to this work alone; sampling queues it unconditionally
+ * and it returns early when nothing moved.
+ */
+static void thermal_actuate_work(struct work_struct *work)
 {
-    struct power_profile profile;
-    int i, target_fan_speed;
-    
-    /* Get current power profile */
-    anarchy_power_get_profile(adev, &profile);
-
-    /* Adjust fan speed based on temperature */
-    if (temp >= THERMAL_THRESHOLD_CRITICAL) {
-        /* Emergency cooling */
-        target_fan_speed = fan_speed_steps[7]; /* Maximum */
-        profile.power_limit = 150; /* Drop to base TGP */
-        profile.dynamic_control = false;
-    } else if (temp >= THERMAL_THRESHOLD_WARNING) {
-        /* Aggressive cooling */
-        target_fan_speed = fan_speed_steps[6]; /* Very high */
-        profile.power_limit = 175; /* Reduced power limit */
-    } else if (temp >= THERMAL_THRESHOLD_NORMAL) {
-        /* Gradual fan speed increase */
-        for (i = 0; i < ARRAY_SIZE(fan_speed_steps); i++) {
-            if (temp < (THERMAL_THRESHOLD_NORMAL + (i * 2000))) { /* Convert to millidegrees */
-                target_fan_speed = fan_speed_steps[i];
-                break;
-            }
-        }
-    } else {
-        /* Normal operation */
-        target_fan_speed = fan_speed_steps[2]; /* Low speed */
-        profile.dynamic_control = true;
+    struct thermal_profile *profile = container_of(work, struct thermal_profile,
+                                                 actuate_work);
+    struct anarchy_device *adev = container_of(profile, struct anarchy_device,
+                                             thermal_profile);
+    unsigned int fan, power_limit, seq;
+    bool throttling;
+    int temp;
+
+    do {
+        seq = read_seqbegin(&profile->lock);
+        fan = profile->target_fan_speed;
+        power_limit = profile->target_power_limit;
+        throttling = profile->throttling;
+        temp = profile->current_temp;
+    } while (read_seqretry(&profile->lock, seq));
+
+    if (fan == profile->applied_fan && power_limit == profile->applied_power_limit)
+        return;
+
+    trace_anarchy_thermal_action(adev, temp, fan, power_limit, throttling);
+
+    /* A failed write is retried when the target moves, not on every sample */
+    if (fan != profile->applied_fan) {
+        if (anarchy_power_set_fan_speed(adev, fan))
+            dev_warn(&adev->pdev->dev, "Failed to set fan speed %u\n", fan);
+        profile->applied_fan = fan;
     }
-
-    /* Update fan speed if changed */
-    if (profile.fan_speed != target_fan_speed) {
-        profile.fan_speed = target_fan_speed;
-        anarchy_power_set_profile(adev, &profile);
+    /* The frame governor works within this limit and writes it */
+    if (power_limit != profile->applied_power_limit) {
+        anarchy_power_gov_set_ceiling(adev, power_limit, throttling);
+        profile->applied_power_limit = power_limit;
     }
 }
 
-static void thermal_update_work(struct work_struct *work)
+/* Telemetry subscriber: run the controller and publish its targets */
+static void thermal_sample(struct anarchy_device *adev, struct anarchy_telemetry_sub *sub,
+                           const struct anarchy_telemetry_sample *sample)
 {
-    struct thermal_profile *profile = container_of(to_delayed_work(work),
-                                                 struct thermal_profile,
-                                                 update_work);
-    struct anarchy_device *adev = container_of(profile, struct anarchy_device,
-                                             thermal_profile);
-    struct perf_state perf_state;
-    unsigned long flags;
-    u32 temp;
-
-    /* Get current performance state which includes temperature */
-    anarchy_perf_get_state(adev, &perf_state);
-    temp = perf_state.temperature;
-
-    spin_lock_irqsave(&profile->lock, flags);
-    
+    struct thermal_profile *profile = container_of(sub, struct thermal_profile, sub);
+    unsigned int dt_ms;
+    int temp;
+    u64 start;
+
+    /* Telemetry reports whole degrees, the thermal code works in millidegrees */
+    temp = sample->temperature * 1000;
+
+    /* The controller belongs to this callback, only its outputs are shared */
+    dt_ms = profile->last_sample_ns ?
+            div_u64(sample->timestamp_ns - profile->last_sample_ns, NSEC_PER_MSEC) : 0;
+    profile->last_sample_ns = sample->timestamp_ns;
+    profile->last_update = jiffies;
+    thermal_ctl_step(&profile->ctl, temp, sample->power_draw, dt_ms);
+
+    write_seqlock(&profile->lock);
+    start = anarchy_hold_begin();
     profile->current_temp = temp;
-    if (temp > profile->max_temp) {
+    if (temp > profile->max_temp)
         profile->max_temp = temp;
-    }
+    profile->target_fan_speed = profile->ctl.fan;
+    profile->target_power_limit = profile->ctl.power_limit;
+    profile->throttling = profile->ctl.power_limit < profile->ctl.p.power_max;
+    anarchy_hold_end(&profile->hold, start);
+    write_sequnlock(&profile->lock);
 
-    /* Adjust thermal profile based on temperature */
-    adjust_thermal_profile(adev, temp);
+    /* The work compares against what it applied; a pending one just picks this up */
+    queue_work(profile->wq, &profile->actuate_work);
 
     /* Check thresholds and trigger callbacks if needed */
     if (temp >= profile->critical_threshold) {
@@ -101,19 +95,13 @@ static void thermal_update_work(struct work_struct *work)
         if (profile->warning_callback)
             profile->warning_callback(adev);
     }
-
-    spin_unlock_irqrestore(&profile->lock, flags);
-
-    /* Reschedule if monitoring is still enabled */
-    if (profile->monitoring_enabled) {
-        queue_delayed_work(profile->wq, &profile->update_work,
-                          msecs_to_jiffies(THERMAL_MONITOR_INTERVAL));
-    }
 }
 
 int init_thermal_monitoring(struct anarchy_device *adev)
 {
     struct thermal_profile *profile = &adev->thermal_profile;
+    struct thermal_ctl_params params;
+    struct power_profile power;
 
     /* Initialize thermal profile */
     profile->monitoring_enabled = false;
@@ -121,8 +109,32 @@ int init_thermal_monitoring(struct anarchy_device *adev)
     profile->max_temp = 0;
     profile->warning_threshold = THERMAL_THRESHOLD_WARNING;
     profile->critical_threshold = THERMAL_THRESHOLD_CRITICAL;
-    profile->target_fan_speed = fan_speed_steps[2]; /* Start at low speed */
-    spin_lock_init(&profile->lock);
+    profile->throttling = false;
+    profile->last_update = jiffies;
+    profile->last_sample_ns = 0;
+    seqlock_init(&profile->lock);
+    memset(&profile->hold, 0, sizeof(profile->hold));
+
+    /*
+     * The controller drives the fan itself, so firmware fan control goes
+     * off. Whatever limit is configured now is the ceiling it gives back to.
+     */
+    anarchy_power_get_profile(adev, &power);
+    power.dynamic_control = false;
+    anarchy_power_set_profile(adev, &power);
+
+    thermal_ctl_default_params(&params);
+    params.target_mc = THERMAL_THRESHOLD_TARGET;
+    params.power_target_mc = THERMAL_THRESHOLD_WARNING;
+    params.critical_mc = THERMAL_THRESHOLD_CRITICAL;
+    params.power_min = GPU_POWER_LIMIT_MIN;
+    params.power_max = clamp_t(u32, power.power_limit, GPU_POWER_LIMIT_MIN,
+                               GPU_POWER_LIMIT_MAX);
+    thermal_ctl_init(&profile->ctl, &params);
+    profile->target_fan_speed = profile->ctl.fan;
+    profile->target_power_limit = profile->ctl.power_limit;
+    profile->applied_fan = power.fan_speed;
+    profile->applied_power_limit = power.power_limit;
 
     /* Create workqueue */
     profile->wq = create_singlethread_workqueue("anarchy_thermal");
@@ -131,13 +143,14 @@ int init_thermal_monitoring(struct anarchy_device *adev)
         return -ENOMEM;
     }
 
-    /* Initialize work */
-    INIT_DELAYED_WORK(&profile->update_work, thermal_update_work);
+    INIT_WORK(&profile->actuate_work, thermal_actuate_work);
 
     /* Start monitoring */
+    profile->sub.name = "thermal";
+    profile->sub.interval_ms = THERMAL_MONITOR_INTERVAL;
+    profile->sub.fn = thermal_sample;
     profile->monitoring_enabled = true;
-    queue_delayed_work(profile->wq, &profile->update_work,
-                      msecs_to_jiffies(THERMAL_MONITOR_INTERVAL));
+    anarchy_telemetry_subscribe(adev, &profile->sub);
 
     return 0;
 }
@@ -147,8 +160,11 @@ void cleanup_thermal_monitoring(struct anarchy_device *adev)
     struct thermal_profile *profile = &adev->thermal_profile;
 
     /* Stop monitoring */
+    if (!profile->monitoring_enabled)
+        return;
     profile->monitoring_enabled = false;
-    cancel_delayed_work_sync(&profile->update_work);
+    anarchy_telemetry_unsubscribe(adev, &profile->sub);
+    cancel_work_sync(&profile->actuate_work);
 
     /* Destroy workqueue */
     if (profile->wq) {
@@ -0,0 +1,154 @@
+#include "include/thermal_ctl.h"
+
+/*
+ * Two PI loops on the temperature projected horizon_ms ahead (current
+ * slope plus a feed-forward term for power steps), so they react while the
+ * die is still heating rather than once it is hot. The fan loop holds
+ * target_mc. The power loop holds the higher power_target_mc and only
+ * winds up while the fan is already at fan_max, so the GPU loses power
+ * only once the cooler has nothing left; the cut then moves at a bounded
+ * slew so the GPU never sees a step.
+ */
+
+#define EFFORT_MAX          1000
+#define INTEGRAL_SCALE      1000
+
+/* Longest gap treated as one step, longer ones restart the slope */
+#define MAX_STEP_MS         10000
+
+static int ctl_clamp(int v, int lo, int hi)
+{
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+/* Move @cur toward @target by at most @rate per second */
+static unsigned int ctl_slew(unsigned int cur, unsigned int target,
+                             unsigned int rate, unsigned int dt_ms)
+{
+    unsigned int step = rate * dt_ms / 1000;
+
+    if (!step)
+        step = 1;
+    if (target > cur)
+        return target - cur > step ? cur + step : target;
+    return cur - target > step ? cur - step : target;
+}
+
+void thermal_ctl_default_params(struct thermal_ctl_params *p)
+{
+    p->target_mc = 75000;
+    p->power_target_mc = 80000;
+    p->critical_mc = 87000;
+    p->horizon_ms = 5000;
+    p->rth_mc_per_w = 30;
+    p->kp = 80;
+    p->ki = 10;
+    p->fan_share = 600;
+    p->fan_min = 30;
+    p->fan_max = 100;
+    p->fan_slew = 25;
+    p->power_min = 50;
+    p->power_max = 175;
+    p->power_margin = 10;
+    p->power_slew = 8;
+    p->power_slew_critical = 30;
+}
+
+void thermal_ctl_init(struct thermal_ctl *ctl, const struct thermal_ctl_params *p)
+{
+    ctl->p = *p;
+    ctl->primed = false;
+    ctl->last_mc = 0;
+    ctl->slope = 0;
+    ctl->power_avg = 0;
+    ctl->integral = 0;
+    ctl->effort = 0;
+    ctl->power_integral = 0;
+    ctl->power_effort = 0;
+    ctl->predicted_mc = 0;
+    ctl->fan = p->fan_min;
+    ctl->power_limit = p->power_max;
+}
+
+/*
+ * One PI step toward @setpoint_mc; the integral stops growing while the
+ * output is saturated or @hold is set, and may still shrink.
+ */
+static int ctl_pi(const struct thermal_ctl_params *p, int *integral, int setpoint_mc,
+                  int predicted_mc, bool hold, unsigned int dt_ms)
+{
+    int error = predicted_mc - setpoint_mc;
+    int pterm = p->kp * error / 1000;
+    int effort = pterm + *integral / INTEGRAL_SCALE;
+
+    if (!((effort >= EFFORT_MAX || hold) && error > 0) && !(effort <= 0 && error < 0))
+        *integral += p->ki * error / 100 * (int)dt_ms / 10;
+    *integral = ctl_clamp(*integral, 0, EFFORT_MAX * INTEGRAL_SCALE);
+
+    return ctl_clamp(pterm + *integral / INTEGRAL_SCALE, 0, EFFORT_MAX);
+}
+
+static void thermal_ctl_actuate(struct thermal_ctl *ctl, unsigned int power_w,
+                                int temp_mc, unsigned int dt_ms)
+{
+    const struct thermal_ctl_params *p = &ctl->p;
+    unsigned int fan_target, power_target, top, rate;
+
+    /* Fan reaches fan_max at fan_share effort */
+    fan_target = p->fan_min + (p->fan_max - p->fan_min) *
+                 (unsigned int)ctl_clamp(ctl->effort, 0, p->fan_share) / p->fan_share;
+    ctl->fan = ctl_slew(ctl->fan, fan_target, p->fan_slew, dt_ms);
+
+    /*
+     * Cuts are measured from just above the current draw: lowering a
+     * limit the GPU is not using buys nothing.
+     */
+    power_target = p->power_max;
+    if (ctl->power_effort > 0) {
+        top = power_w + p->power_margin;
+        if (top > p->power_max)
+            top = p->power_max;
+        if (top < p->power_min)
+            top = p->power_min;
+        power_target = top - (top - p->power_min) * (unsigned int)ctl->power_effort /
+                       EFFORT_MAX;
+    }
+
+    rate = temp_mc >= p->critical_mc ? p->power_slew_critical : p->power_slew;
+    ctl->power_limit = ctl_slew(ctl->power_limit, power_target, rate, dt_ms);
+}
+
+void thermal_ctl_step(struct thermal_ctl *ctl, int temp_mc, unsigned int power_w,
+                      unsigned int dt_ms)
+{
+    const struct thermal_ctl_params *p = &ctl->p;
+    int rate;
+
+    if (!ctl->primed || !dt_ms || dt_ms > MAX_STEP_MS) {
+        ctl->primed = true;
+        ctl->last_mc = temp_mc;
+        ctl->slope = 0;
+        ctl->power_avg = power_w;
+        if (!dt_ms || dt_ms > MAX_STEP_MS)
+            dt_ms = 1000;
+    }
+
+    /* Slope EWMA (1/4) and slow power average (1/16) */
+    rate = (temp_mc - ctl->last_mc) * 1000 / (int)dt_ms;
+    ctl->slope += (rate - ctl->slope) / 4;
+    ctl->last_mc = temp_mc;
+    ctl->power_avg = ctl->power_avg - ctl->power_avg / 16 + power_w / 16;
+
+    /* Where the die will be: current slope, plus a fresh power step */
+    ctl->predicted_mc = temp_mc + ctl->slope * (int)(p->horizon_ms / 100) / 10 +
+                        ((int)power_w - (int)ctl->power_avg) * p->rth_mc_per_w;
+
+    ctl->effort = ctl_pi(p, &ctl->integral, p->target_mc, ctl->predicted_mc, false, dt_ms);
+
+    /* Power only winds up once the fan has nothing left to give */
+    ctl->power_effort = ctl_pi(p, &ctl->power_integral, p->power_target_mc,
+                               ctl->predicted_mc, ctl->fan < p->fan_max, dt_ms);
+    if (ctl->fan < p->fan_max && temp_mc < p->critical_mc)
+        ctl->power_effort = 0;
+    thermal_ctl_actuate(ctl, power_w, temp_mc, dt_ms);
+}
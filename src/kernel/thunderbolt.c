@@ -48,7 +48,7 @@ int anarchy_tb_init(struct anarchy_device *adev)
     u32 val;
     int ret;
 
-    /* Map Thunderbolt registers */
+    /* Map Thunderbolt registers, uncached: reads and writes have side effects */
     adev->mmio_base = pci_iomap(adev->pdev, 2, 0);
     if (!adev->mmio_base) {
         dev_err(adev->dev, "Failed to map Thunderbolt registers\n");
@@ -71,6 +71,11 @@ int anarchy_tb_init(struct anarchy_device *adev)
         goto err_unmap;
     }
 
+    /* Bulk data goes through separate write-combined mappings */
+    ret = anarchy_upload_map(adev);
+    if (ret)
+        goto err_unmap;
+
     dev_info(adev->dev, "Thunderbolt interface initialized\n");
     return 0;
 
@@ -94,7 +99,8 @@ void anarchy_tb_fini(struct anarchy_device *adev)
     val &= ~TB_CONTROL_ENABLE;
     tb_write32(adev, TB_CONTROL, val);
 
-    /* Unmap registers */
+    /* Unmap apertures and registers */
+    anarchy_upload_unmap(adev);
     pci_iounmap(adev->pdev, adev->mmio_base);
     adev->mmio_base = NULL;
 
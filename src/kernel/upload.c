@@ -0,0 +1,265 @@
+#include <linux/module.h>
+#include <linux/pci.h>
+#include <linux/slab.h>
+#include <linux/io.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include "include/anarchy_device.h"
+#include "include/dma_path.h"
+#include "include/upload.h"
+
+/* BAR 2 offset of the PIO window, see dma_path.c */
+#define UPLOAD_PIO_WINDOW       0x30000
+
+#define UPLOAD_BENCH_REPS       3
+
+static const char * const upload_mode_names[ANARCHY_UPLOAD_MODES] = {
+    [ANARCHY_UPLOAD_UC] = "uc",
+    [ANARCHY_UPLOAD_WC] = "wc",
+    [ANARCHY_UPLOAD_WC_NT] = "wc+nt",
+};
+
+const char *anarchy_upload_mode_name(enum anarchy_upload_mode mode)
+{
+    return mode < ANARCHY_UPLOAD_MODES ? upload_mode_names[mode] : "unknown";
+}
+EXPORT_SYMBOL_GPL(anarchy_upload_mode_name);
+
+#ifdef CONFIG_X86_64
+/*
+ * MOVNTI needs no FPU state, so this runs in any context. Eight of them
+ * fill a write-combining buffer, which then leaves as one full line.
+ */
+static __always_inline void upload_stream8(void __iomem *dst, const void *src)
+{
+    u64 val;
+
+    memcpy(&val, src, sizeof(val));
+    asm volatile("movnti %1, %0" : "=m" (*(u64 __force *)dst) : "r" (val));
+}
+#endif
+
+void anarchy_memcpy_toio_nt(void __iomem *dst, const void *src, size_t len)
+{
+#ifdef CONFIG_X86_64
+    size_t head = min_t(size_t, len, -(unsigned long)dst & 7);
+    u8 __iomem *d = dst;
+    const u8 *s = src;
+
+    memcpy_toio(d, s, head);
+    d += head;
+    s += head;
+    len -= head;
+
+    for (; len >= 64; len -= 64, d += 64, s += 64) {
+        upload_stream8(d, s);
+        upload_stream8(d + 8, s + 8);
+        upload_stream8(d + 16, s + 16);
+        upload_stream8(d + 24, s + 24);
+        upload_stream8(d + 32, s + 32);
+        upload_stream8(d + 40, s + 40);
+        upload_stream8(d + 48, s + 48);
+        upload_stream8(d + 56, s + 56);
+    }
+    for (; len >= 8; len -= 8, d += 8, s += 8)
+        upload_stream8(d, s);
+    memcpy_toio(d, s, len);
+#else
+    memcpy_toio(dst, src, len);
+#endif
+    /* Streaming stores are weakly ordered, drain them before any doorbell */
+    wmb();
+}
+EXPORT_SYMBOL_GPL(anarchy_memcpy_toio_nt);
+
+int anarchy_upload(struct anarchy_device *adev, u64 offset, const void *src, size_t len)
+{
+    struct anarchy_upload *up;
+    u64 start;
+
+    if (!adev || !src)
+        return -EINVAL;
+    up = &adev->upload;
+    if (!up->fb)
+        return -ENODEV;
+    if (offset > up->fb_size || len > up->fb_size - offset)
+        return -ERANGE;
+
+    start = ktime_get_ns();
+    if (up->fb_wc)
+        anarchy_memcpy_toio_nt(up->fb + offset, src, len);
+    else
+        memcpy_toio(up->fb + offset, src, len);
+    atomic64_add(len, &up->bytes);
+    atomic64_add(ktime_get_ns() - start, &up->ns);
+    return 0;
+}
+EXPORT_SYMBOL_GPL(anarchy_upload);
+
+/*
+ * Overwrites the top of the aperture, which the driver leaves alone. The
+ * read back at the end only returns once every posted write ahead of it
+ * reached the device, so the time covers delivery, not just the stores.
+ */
+int anarchy_upload_bench(struct anarchy_device *adev, enum anarchy_upload_mode mode,
+                         u64 *mbps)
+{
+    struct anarchy_upload *up = &adev->upload;
+    resource_size_t off;
+    void __iomem *dst;
+    u64 t, best = U64_MAX;
+    unsigned int rep;
+    void *src;
+
+    if (mode >= ANARCHY_UPLOAD_MODES || !mbps)
+        return -EINVAL;
+    if (!up->fb || up->fb_size < ANARCHY_UPLOAD_BENCH_SIZE)
+        return -ENODEV;
+    if (mode != ANARCHY_UPLOAD_UC && !up->fb_wc)
+        return -EOPNOTSUPP;
+
+    off = up->fb_size - ANARCHY_UPLOAD_BENCH_SIZE;
+    if (mode == ANARCHY_UPLOAD_UC)
+        dst = pci_iomap_range(adev->pdev, ANARCHY_FB_BAR, off, ANARCHY_UPLOAD_BENCH_SIZE);
+    else
+        dst = up->fb + off;
+    if (!dst)
+        return -ENOMEM;
+
+    src = kvmalloc(ANARCHY_UPLOAD_BENCH_SIZE, GFP_KERNEL);
+    if (!src) {
+        if (mode == ANARCHY_UPLOAD_UC)
+            pci_iounmap(adev->pdev, dst);
+        return -ENOMEM;
+    }
+    memset(src, 0xa5, ANARCHY_UPLOAD_BENCH_SIZE);
+
+    for (rep = 0; rep < UPLOAD_BENCH_REPS; rep++) {
+        t = ktime_get_ns();
+        if (mode == ANARCHY_UPLOAD_WC_NT) {
+            anarchy_memcpy_toio_nt(dst, src, ANARCHY_UPLOAD_BENCH_SIZE);
+        } else {
+            memcpy_toio(dst, src, ANARCHY_UPLOAD_BENCH_SIZE);
+            wmb();
+        }
+        readl(dst);
+        best = min(best, ktime_get_ns() - t);
+    }
+
+    kvfree(src);
+    if (mode == ANARCHY_UPLOAD_UC)
+        pci_iounmap(adev->pdev, dst);
+
+    *mbps = div64_u64((u64)ANARCHY_UPLOAD_BENCH_SIZE * 1000, max_t(u64, best, 1));
+    up->bench_mbps[mode] = *mbps;
+    return 0;
+}
+EXPORT_SYMBOL_GPL(anarchy_upload_bench);
+
+int anarchy_upload_map(struct anarchy_device *adev)
+{
+    struct anarchy_upload *up = &adev->upload;
+    struct pci_dev *pdev = adev->pdev;
+    resource_size_t len = pci_resource_len(pdev, ANARCHY_FB_BAR);
+    unsigned long flags = pci_resource_flags(pdev, ANARCHY_FB_BAR);
+
+    memset(up, 0, sizeof(*up));
+
+    /* The PIO window sits in the register BAR, alias just that page */
+    up->pio = pci_iomap_wc_range(pdev, 2, UPLOAD_PIO_WINDOW, ANARCHY_DMA_PIO_WINDOW_SIZE);
+
+    if (!len || !(flags & IORESOURCE_MEM)) {
+        dev_info(adev->dev, "no framebuffer BAR, uploads go through DMA\n");
+        return 0;
+    }
+
+    /* Write combining is only safe where reads have no side effects */
+    up->fb_wc = flags & IORESOURCE_PREFETCH;
+    up->fb = up->fb_wc ? pci_iomap_wc(pdev, ANARCHY_FB_BAR, 0) :
+                         pci_iomap(pdev, ANARCHY_FB_BAR, 0);
+    if (!up->fb) {
+        dev_err(adev->dev, "failed to map the framebuffer BAR\n");
+        anarchy_upload_unmap(adev);
+        return -ENOMEM;
+    }
+    up->fb_size = len;
+    dev_info(adev->dev, "framebuffer aperture %llu MiB, %s\n",
+             (unsigned long long)len >> 20, up->fb_wc ? "write-combined" : "uncached");
+    return 0;
+}
+EXPORT_SYMBOL_GPL(anarchy_upload_map);
+
+void anarchy_upload_unmap(struct anarchy_device *adev)
+{
+    struct anarchy_upload *up = &adev->upload;
+
+    if (up->fb)
+        pci_iounmap(adev->pdev, up->fb);
+    if (up->pio)
+        pci_iounmap(adev->pdev, up->pio);
+    up->fb = NULL;
+    up->pio = NULL;
+    up->fb_size = 0;
+}
+EXPORT_SYMBOL_GPL(anarchy_upload_unmap);
+
+#ifdef CONFIG_DEBUG_FS
+
+static int anarchy_upload_stats_show(struct seq_file *m, void *unused)
+{
+    struct anarchy_device *adev = m->private;
+    struct anarchy_upload *up = &adev->upload;
+    u64 bytes = atomic64_read(&up->bytes), ns = atomic64_read(&up->ns);
+    unsigned int mode;
+
+    seq_printf(m, "aperture %llu wc %d pio_wc %d\n", (unsigned long long)up->fb_size,
+               up->fb_wc, !!up->pio);
+    seq_printf(m, "bytes %llu mbps %llu\n", bytes,
+               ns ? div64_u64(bytes * 1000, ns) : 0);
+    for (mode = 0; mode < ANARCHY_UPLOAD_MODES; mode++)
+        seq_printf(m, "bench_%s_mbps %llu\n", upload_mode_names[mode], up->bench_mbps[mode]);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(anarchy_upload_stats);
+
+/* Runs every mode on read, a zero-copy DMA of 64 KiB for scale */
+static int anarchy_upload_bench_show(struct seq_file *m, void *unused)
+{
+    struct anarchy_device *adev = m->private;
+    u64 dma_ns = adev->dma_path.probe_ns[ANARCHY_DMA_PATH_ZEROCOPY][ANARCHY_DMA_PATH_PROBES - 1];
+    unsigned int mode;
+    u64 mbps;
+    int ret;
+
+    seq_printf(m, "%-6s %10s\n", "mode", "MB/s");
+    for (mode = 0; mode < ANARCHY_UPLOAD_MODES; mode++) {
+        ret = anarchy_upload_bench(adev, mode, &mbps);
+        if (ret)
+            seq_printf(m, "%-6s %10d\n", upload_mode_names[mode], ret);
+        else
+            seq_printf(m, "%-6s %10llu\n", upload_mode_names[mode], mbps);
+    }
+    if (dma_ns)
+        seq_printf(m, "%-6s %10llu\n", "dma",
+                   div64_u64((u64)ANARCHY_DMA_BOUNCE_SIZE * 1000, dma_ns));
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(anarchy_upload_bench);
+
+void anarchy_upload_debugfs_init(struct anarchy_device *adev, struct dentry *parent)
+{
+    struct dentry *dir = debugfs_create_dir("upload", parent);
+
+    debugfs_create_file("stats", 0444, dir, adev, &anarchy_upload_stats_fops);
+    debugfs_create_file("bench", 0400, dir, adev, &anarchy_upload_bench_fops);
+}
+
+#else
+
+void anarchy_upload_debugfs_init(struct anarchy_device *adev, struct dentry *parent)
+{
+}
+
+#endif /* CONFIG_DEBUG_FS */
+EXPORT_SYMBOL_GPL(anarchy_upload_debugfs_init);
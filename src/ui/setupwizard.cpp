@@ -30,7 +30,7 @@ HardwareCheckPage::HardwareCheckPage(Device *device, QWidget *parent)
     
     thunderboltStatus = new QLabel(tr("Checking Thunderbolt connection..."));
     gpuStatus = new QLabel(tr("Checking GPU..."));
-    driverStatus = new QLabel(tr("Checking NVIDIA drivers..."));
+    driverStatus = new QLabel(tr("Checking anarchy-egpu driver..."));
 
     layout->addWidget(thunderboltStatus);
     layout->addWidget(gpuStatus);
@@ -45,9 +45,12 @@ HardwareCheckPage::HardwareCheckPage(Device *device, QWidget *parent)
 
 void HardwareCheckPage::checkHardware()
 {
+    DeviceStats stats;
+    QString driverVer;
+    const bool probed = device->probeHardware(stats, driverVer);
+
     // Check Thunderbolt connection
-    QString tbStatus = device->readFromSysfs("thunderbolt/status");
-    if (!tbStatus.isEmpty()) {
+    if (probed && !stats.tbDevicePath.isEmpty()) {
         thunderboltStatus->setText(tr("✓ Thunderbolt connection detected"));
         thunderboltStatus->setStyleSheet("color: green");
     } else {
@@ -58,9 +61,8 @@ void HardwareCheckPage::checkHardware()
         return;
     }
 
-    // Check GPU presence
-    QString gpuState = device->readFromSysfs("gpu/power_state");
-    if (!gpuState.isEmpty()) {
+    // Check GPU presence, only a state the driver reported counts
+    if (probed && (stats.gpuState == "Active" || stats.gpuState == "Throttled")) {
         gpuStatus->setText(tr("✓ NVIDIA GPU detected"));
         gpuStatus->setStyleSheet("color: green");
     } else {
@@ -71,13 +73,12 @@ void HardwareCheckPage::checkHardware()
         return;
     }
 
-    // Check driver status
-    QString driverVer = device->readFromSysfs("driver_version");
+    // Check driver status, the version is the kernel module's, not NVIDIA's
     if (!driverVer.isEmpty()) {
-        driverStatus->setText(tr("✓ NVIDIA drivers loaded (version %1)").arg(driverVer));
+        driverStatus->setText(tr("✓ anarchy-egpu driver loaded (version %1)").arg(driverVer));
         driverStatus->setStyleSheet("color: green");
     } else {
-        driverStatus->setText(tr("✗ NVIDIA drivers not loaded"));
+        driverStatus->setText(tr("✗ anarchy-egpu driver not loaded"));
         driverStatus->setStyleSheet("color: red");
         hardwareReady = false;
         emit completeChanged();
@@ -116,7 +117,7 @@ PerformanceConfigPage::PerformanceConfigPage(Device *device, QWidget *parent)
     QHBoxLayout *ringLayout = new QHBoxLayout;
     QLabel *ringLabel = new QLabel(tr("Ring Buffer Size:"));
     ringBufferSize = new QSpinBox;
-    ringBufferSize->setRange(16, 1024);
+    ringBufferSize->setRange(16, 4096);
     ringBufferSize->setValue(256);
     ringBufferSize->setSingleStep(16);
     ringBufferSize->setToolTip(tr("Size of the DMA ring buffer in pages"));
@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""Compare benchmark results against checked-in baselines.
+
+    bench_compare.py [--threshold PCT] [--cpu-threshold PCT] [--alpha P]
+                     BASELINE RESULT
+
+BASELINE and RESULT are JSON files written by perf_suite or
+device_stats_bench, or directories holding them (matched by file name).
+A benchmark regresses when its mean moved the wrong way by more than the
+threshold and Welch's t-test says the move is significant at --alpha.
+"cpu" benchmarks depend on the host and get their own, looser threshold;
+"sim" benchmarks run in simulated time and only move with the code.
+When the two files were recorded with a different "cpus" in their config,
+multi-threaded "cpu" results are not comparable; that is reported, not
+failed, and the baseline should be re-recorded on the host that checks it.
+
+Exits 1 on any regression, on a baseline benchmark missing from the
+results or on a result file with no baseline, 0 otherwise.
+"""
+
+import argparse
+import json
+import math
+import sys
+from pathlib import Path
+
+
+def betacf(a, b, x):
+    """Continued fraction for the incomplete beta function."""
+    tiny = 1e-300
+    qab, qap, qam = a + b, a + 1.0, a - 1.0
+    c, d = 1.0, 1.0 - qab * x / qap
+    d = 1.0 / (d if abs(d) > tiny else tiny)
+    h = d
+    for m in range(1, 300):
+        m2 = 2 * m
+        aa = m * (b - m) * x / ((qam + m2) * (a + m2))
+        d = 1.0 + aa * d
+        d = 1.0 / (d if abs(d) > tiny else tiny)
+        c = 1.0 + aa / c
+        c = c if abs(c) > tiny else tiny
+        h *= d * c
+        aa = -(a + m) * (qab + m) * x / ((a + m2) * (qap + m2))
+        d = 1.0 + aa * d
+        d = 1.0 / (d if abs(d) > tiny else tiny)
+        c = 1.0 + aa / c
+        c = c if abs(c) > tiny else tiny
+        delta = d * c
+        h *= delta
+        if abs(delta - 1.0) < 1e-12:
+            break
+    return h
+
+
+def betainc(a, b, x):
+    """Regularized incomplete beta I_x(a, b)."""
+    if x <= 0.0:
+        return 0.0
+    if x >= 1.0:
+        return 1.0
+    lbeta = math.lgamma(a + b) - math.lgamma(a) - math.lgamma(b)
+    front = math.exp(lbeta + a * math.log(x) + b * math.log(1.0 - x))
+    if x < (a + 1.0) / (a + b + 2.0):
+        return front * betacf(a, b, x) / a
+    return 1.0 - front * betacf(b, a, 1.0 - x) / b
+
+
+def mean_var(samples):
+    n = len(samples)
+    mean = sum(samples) / n
+    var = sum((s - mean) ** 2 for s in samples) / (n - 1) if n > 1 else 0.0
+    return mean, var
+
+
+def welch_p(a, b):
+    """Two-sided p-value of Welch's t-test for equal means."""
+    ma, va = mean_var(a)
+    mb, vb = mean_var(b)
+    se2 = va / len(a) + vb / len(b)
+    if se2 == 0.0:
+        # Deterministic results: any difference is real
+        return 1.0 if ma == mb else 0.0
+    t = (ma - mb) / math.sqrt(se2)
+    df = se2 ** 2 / ((va / len(a)) ** 2 / (len(a) - 1) + (vb / len(b)) ** 2 / (len(b) - 1))
+    return betainc(df / 2.0, 0.5, df / (df + t * t))
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    return data.get("config", {}), {b["name"]: b for b in data["benchmarks"]}
+
+
+def pairs(baseline, result):
+    base, res = Path(baseline), Path(result)
+    if base.is_dir():
+        for b in sorted(base.glob("*.json")):
+            yield b, res / b.name
+        for r in sorted(res.glob("*.json")):
+            if not (base / r.name).exists():
+                yield base / r.name, r
+    else:
+        yield base, res
+
+
+def compare(base_file, res_file, args):
+    failed = False
+    if not base_file.exists():
+        print(f"{res_file.name}: no baseline, run 'make baseline' and commit it")
+        return True
+    if not res_file.exists():
+        print(f"{base_file.name}: no results at {res_file}")
+        return True
+    (base_cfg, base), (res_cfg, res) = load(base_file), load(res_file)
+
+    print(f"{base_file.name}")
+    if base_cfg.get("cpus") != res_cfg.get("cpus"):
+        print(f"  note: baseline recorded on {base_cfg.get('cpus', '?')} CPUs, results on "
+              f"{res_cfg.get('cpus', '?')}; multi-threaded cpu results do not compare")
+    print(f"  {'benchmark':<22} {'unit':<5} {'baseline':>12} {'result':>12} {'change':>8} "
+          f"{'p':>8}  verdict")
+    for name, b in base.items():
+        r = res.get(name)
+        if r is None:
+            print(f"  {name:<22} missing from the results")
+            failed = True
+            continue
+        mb, _ = mean_var(b["samples"])
+        mr, _ = mean_var(r["samples"])
+        change = (mr - mb) / mb * 100.0 if mb else 0.0
+        worse = change if b["better"] == "lower" else -change
+        p = welch_p(b["samples"], r["samples"])
+        limit = args.cpu_threshold if b["kind"] == "cpu" else args.threshold
+        if p < args.alpha and worse > limit:
+            verdict = "REGRESSION"
+            failed = True
+        elif p < args.alpha and worse < -limit:
+            verdict = "improved"
+        else:
+            verdict = "ok"
+        print(f"  {name:<22} {b['unit']:<5} {mb:>12.4g} {mr:>12.4g} {change:>+7.1f}% "
+              f"{p:>8.2g}  {verdict}")
+    for name in res:
+        if name not in base:
+            print(f"  {name:<22} new, not in the baseline")
+    return failed
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare benchmark results with baselines")
+    parser.add_argument("baseline", help="baseline JSON file or directory")
+    parser.add_argument("result", help="result JSON file or directory")
+    parser.add_argument("--threshold", type=float, default=5.0,
+                        help="regression threshold for sim benchmarks, percent")
+    parser.add_argument("--cpu-threshold", type=float, default=40.0,
+                        help="regression threshold for cpu benchmarks, percent")
+    parser.add_argument("--alpha", type=float, default=0.01,
+                        help="significance level of the t-test")
+    args = parser.parse_args()
+
+    failed = False
+    for base_file, res_file in pairs(args.baseline, args.result):
+        failed |= compare(base_file, res_file, args)
+    if failed:
+        print("FAIL: benchmark regression")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
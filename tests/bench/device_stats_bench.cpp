@@ -0,0 +1,98 @@
+/*
+ * Cost of Device::calculateStats() over the performance history, results
+ * as JSON for bench_compare.py (same layout as perf_suite).
+ *
+ *   device_stats_bench [-n repetitions] [-o file]
+ *
+ * Device recomputes min/max/avg/stddev of four histories on every
+ * monitoring tick; a history holds up to an hour of points, 3600 at the
+ * default 1 s interval and 36000 at the 100 ms minimum.
+ */
+#include <QDateTime>
+#include <QVector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include "device.h"
+
+static const int historySizes[] = { 60, 3600, 36000 };
+static const int callsPerSample = 200;
+
+static double nowNs()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char **argv)
+{
+    const char *out = nullptr;
+    int reps = 10;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:o:")) != -1) {
+        switch (opt) {
+        case 'n':
+            reps = atoi(optarg);
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n repetitions] [-o file]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (reps < 2) {
+        fprintf(stderr, "need at least two repetitions\n");
+        return 2;
+    }
+
+    // Never connected, calculateStats() only reads its argument
+    Device device(new ControlPlane());
+    QVector<QVector<double>> samples;
+    volatile double sink = 0;
+
+    for (int size : historySizes) {
+        QVector<DeviceStats::PerformancePoint> history;
+        const QDateTime start = QDateTime::currentDateTime();
+        history.reserve(size);
+        for (int i = 0; i < size; i++) {
+            DeviceStats::PerformancePoint point;
+            point.timestamp = start.addMSecs(i * 100);
+            point.value = 2000.0 + (i * 7919 % 1000) / 10.0;
+            history.append(point);
+        }
+
+        QVector<double> perCall;
+        for (int rep = 0; rep < reps; rep++) {
+            const double t0 = nowNs();
+            for (int i = 0; i < callsPerSample; i++)
+                sink = sink + device.calculateStats(history).stdDev;
+            perCall.append((nowNs() - t0) / callsPerSample);
+        }
+        samples.append(perCall);
+    }
+
+    FILE *f = out ? fopen(out, "w") : stdout;
+    if (!f) {
+        perror(out);
+        return 2;
+    }
+    fprintf(f, "{\n  \"suite\": \"device_stats\",\n");
+    fprintf(f, "  \"config\": {\"repetitions\": %d},\n", reps);
+    fprintf(f, "  \"benchmarks\": [\n");
+    for (int s = 0; s < samples.size(); s++) {
+        fprintf(f, "    {\"name\": \"device_stats_ns_%d\", \"unit\": \"ns\", \"better\": \"lower\", "
+                "\"kind\": \"cpu\", \"samples\": [", historySizes[s]);
+        for (int r = 0; r < reps; r++)
+            fprintf(f, "%s%.6g", r ? ", " : "", samples[s][r]);
+        fprintf(f, "]}%s\n", s + 1 < samples.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    if (f != stdout)
+        fclose(f);
+    return 0;
+}
@@ -0,0 +1,811 @@
+/*
+ * Driver benchmark suite, results as JSON for bench_compare.py.
+ *
+ *   perf_suite [-n repetitions] [-o file] [-s seed]
+ *
+ * Builds ring.c, dma.c, dma_device.c, command_proc.c, gpu_emu.c and the
+ * stats path (stats.c, telemetry.c, perf_monitor.c, bandwidth.c) against
+ * tests/common/kshim with the simulated TB4 engine (see tests/sim/dma_sim). Each benchmark is repeated and every repetition is
+ * one sample, so the comparison can tell noise from a regression. A CPU
+ * sample is the fastest of several rounds, which keeps most of the
+ * interference from other tasks out of it; a traced pair comes from the
+ * round with the median traced/untraced ratio instead.
+ *
+ *   ring_submit_ns      CPU time per ring submission plus its completion
+ *   ring_submit_traced_ns  the same with the traffic trace on (cmd_trace.c),
+ *                       interleaved with it; the suite fails when the
+ *                       median round has the trace adding
+ *                       BENCH_TRACE_MAX_PCT or more
+ *   ring_gbps           ring throughput in simulated time, 4 KiB transfers
+ *   dma_gbps_<size>     anarchy_dma_transfer() throughput, 64 B to 64 MiB,
+ *                       simulated time
+ *   cmd_batch_ns        CPU time per batched process_game_command()
+ *   cmd_batch_traced_ns the same with the traffic trace on, payloads hashed
+ *                       but not sampled, checked like ring_submit_traced_ns
+ *   cmd_nosync_us       simulated time per NOSYNC command
+ *   stats_get_ns        CPU time per ANARCHY_IOC_GET_STATS: the driver's
+ *                       anarchy_fill_stats() (stats.c) over a published
+ *                       telemetry sample, plus a kernel entry and the
+ *                       copy out; the link-up config read is not modelled
+ *   mmio_read_ns        CPU time per emulated register read (gpu_emu.c),
+ *                       after a check of the power limit latch
+ *   mmio_read_mops_<n>  emulated register reads per second from n threads,
+ *                       while another keeps writing and moving time on; the
+ *                       suite fails when they do not scale with the CPUs
+ *                       the host has, which the results record as "cpus"
+ *   upload_<copy>_gbps  64 MiB copies with memcpy_toio() and with the
+ *                       streaming anarchy_memcpy_toio_nt() (upload.c);
+ *                       host memory stands in for the BAR, so this
+ *                       compares the stores, not UC against WC, which
+ *                       debugfs upload/bench measures on the device
+ *
+ * "cpu" results depend on the host, "sim" results only on the code and
+ * the engine model.
+ */
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "dma_engine.h"
+#include "include/anarchy_device.h"
+#include "include/bandwidth.h"
+#include "include/cmd_trace.h"
+#include "include/command_proc.h"
+#include "include/dma.h"
+#include "include/gpu_emu.h"
+#include "include/telemetry.h"
+#include "include/upload.h"
+/* Last: the uapi header's ANARCHY_DMA_TO_DEVICE would shadow dma_types.h's */
+#include "include/chardev.h"
+
+#define BENCH_PAGE          4096
+#define BENCH_RING_SIZE     256
+#define BENCH_RING_OPS      200000
+#define BENCH_MAX_DMA       (64u << 20)
+#define BENCH_COMMANDS      2048    /* Per round */
+#define BENCH_NOSYNC        256
+#define BENCH_STATS_OPS     200000
+#define BENCH_MMIO_OPS      1000000
+#define BENCH_MMIO_THREADS  4
+#define BENCH_ROUNDS        5
+#define BENCH_MAX_RESULTS   32
+#define BENCH_DRAIN_BYTES   (64u << 10)
+#define BENCH_TRACE_BLOCK   16      /* Operations between trace switches */
+#define BENCH_TRACE_DRAIN   1024    /* Ring blocks between drains, a quarter buffer */
+#define BENCH_UPLOAD        (64u << 20)     /* Well past the last level cache */
+#define BENCH_TRACE_MAX_PCT 2.0     /* Tracing must stay cheap enough to leave on */
+#define BENCH_MMIO_MIN_SCALE 0.5    /* Of linear, over the CPUs the readers have */
+#define BENCH_ALPHA         0.01    /* As bench_compare.py's --alpha */
+
+struct bench_result {
+    char name[32];
+    const char *unit;
+    const char *better;             /* "lower" or "higher" */
+    const char *kind;               /* "cpu" or "sim" */
+    double *samples;
+};
+
+static struct bench_result results[BENCH_MAX_RESULTS];
+static unsigned int nr_results;
+static unsigned int reps = 10;
+static unsigned int seed = 1;
+static unsigned int cpus;
+static struct dma_engine_config cfg;
+
+/* Not under test, the suite only needs the symbols */
+unsigned int trace_buf_kb = 1024;   /* The driver's default */
+unsigned int telemetry_ms = 100;
+int dma_pio_max = -1, dma_bounce_max = -1;
+
+void anarchy_power_gov_frame(struct anarchy_device *adev)
+{
+}
+
+void anarchy_chardev_notify(struct anarchy_device *adev, u32 type, u64 data0, u64 data1)
+{
+}
+
+/* The sampled link is always up, the config read is not modelled */
+bool pcie_link_is_up(struct pci_dev *pdev)
+{
+    return true;
+}
+
+u64 anarchy_pcie_get_link_capacity(struct anarchy_device *adev)
+{
+    return 5000000000ULL;
+}
+
+void anarchy_link_policy_sample(struct anarchy_device *adev, u64 demand_bps)
+{
+}
+
+static u64 wall_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct bench_result *result(const char *name, const char *unit, const char *better,
+                                   const char *kind)
+{
+    struct bench_result *res;
+    unsigned int i;
+
+    for (i = 0; i < nr_results; i++) {
+        if (!strcmp(results[i].name, name))
+            return &results[i];
+    }
+    if (nr_results == BENCH_MAX_RESULTS)
+        abort();
+    res = &results[nr_results++];
+    snprintf(res->name, sizeof(res->name), "%s", name);
+    res->unit = unit;
+    res->better = better;
+    res->kind = kind;
+    res->samples = calloc(reps, sizeof(double));
+    if (!res->samples)
+        abort();
+    return res;
+}
+
+struct bench_dev {
+    struct pci_dev pdev;
+    struct anarchy_device adev;
+    struct dma_engine *engine;
+    bool traced;
+};
+
+static int bench_dev_init(struct bench_dev *bd, unsigned int ring_size, unsigned int rep,
+                          bool traced)
+{
+    memset(bd, 0, sizeof(*bd));
+    bd->pdev.dev.init_name = "bench";
+    bd->adev.pdev = &bd->pdev;
+    bd->adev.dev = &bd->pdev.dev;
+    bd->adev.dma_channels = 4;
+    bd->adev.ring_buffer_size = ring_size;
+
+    cfg.seed = seed * 1103515245u + rep;
+    bd->engine = dma_engine_create(&cfg);
+    if (!bd->engine)
+        return -ENOMEM;
+    bd->adev.mmio_base = dma_engine_bar(bd->engine);
+
+    bd->traced = traced;
+    if (traced) {
+        anarchy_trace_init(&bd->adev);
+        if (anarchy_trace_enable(&bd->adev, true)) {
+            dma_engine_destroy(bd->engine);
+            return -ENOMEM;
+        }
+    }
+    return 0;
+}
+
+static void bench_dev_exit(struct bench_dev *bd)
+{
+    if (bd->traced)
+        anarchy_trace_exit(&bd->adev);
+    dma_engine_destroy(bd->engine);
+}
+
+/*
+ * Consume the trace between timed blocks, as a reader on another CPU
+ * keeping up with it would
+ */
+static void bench_trace_drain(struct bench_dev *bd)
+{
+    static char buf[BENCH_DRAIN_BYTES];
+
+    if (bd->traced) {
+        while (anarchy_trace_drain(&bd->adev, buf, sizeof(buf)))
+            ;
+    }
+}
+
+/* What the completion interrupt would do, once the engine raised one */
+static void ring_reap(struct bench_dev *bd)
+{
+    if (dma_engine_poll(bd->engine, NULL, NULL))
+        anarchy_ring_reap(&bd->adev, &bd->adev.tx_ring, 0);
+}
+
+/*
+ * Traced benchmarks switch the trace off, on, on, off, ... every
+ * BENCH_TRACE_BLOCK operations and add up each side's time over a round,
+ * so both sides see the same state, the same spell of noise and, for
+ * commands, the same chain: how fast it walks depends on where the
+ * allocator put it, which changes from round to round.
+ */
+static bool bench_block_traced(unsigned int block)
+{
+    return ((block + 1) >> 1) & 1;
+}
+
+/* Traced/untraced time of every round of one benchmark */
+struct trace_overhead {
+    const char *name;
+    double *ratio;
+    unsigned int n;
+};
+
+static struct trace_overhead ring_trace = { "ring_submit_traced_ns" };
+static struct trace_overhead cmd_trace = { "cmd_batch_traced_ns" };
+
+/*
+ * Keep every round's ratio for trace_overhead_ok() and return the round
+ * with the median ratio as the samples: its sides ran through the same
+ * spell of noise and, for commands, over the same chain layout, which
+ * the fastest round of each side need not have.
+ */
+static const u64 *bench_trace_rounds(struct trace_overhead *to, u64 ns[][2])
+{
+    unsigned int i, j, order[BENCH_ROUNDS];
+
+    if (!to->ratio)
+        to->ratio = calloc(reps * BENCH_ROUNDS, sizeof(double));
+    if (!to->ratio)
+        abort();
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        to->ratio[to->n++] = (double)ns[i][1] / ns[i][0];
+        for (j = i; j && ns[i][1] * ns[order[j - 1]][0] < ns[order[j - 1]][1] * ns[i][0]; j--)
+            order[j] = order[j - 1];
+        order[j] = i;
+    }
+    return ns[order[BENCH_ROUNDS / 2]];
+}
+
+static int bench_ring(unsigned int rep)
+{
+    static char page[BENCH_PAGE];
+    struct anarchy_transfer xfer = { 0 };
+    struct dma_engine_stats st;
+    struct bench_dev bd;
+    unsigned int sent = 0, block = 0, chunk = BENCH_RING_OPS / BENCH_ROUNDS;
+    u64 t0, v0, next, ns[BENCH_ROUNDS][2] = { { 0 } };
+    const u64 *mid;
+    bool traced;
+    int ret;
+
+    if (bench_dev_init(&bd, BENCH_RING_SIZE, rep, true))
+        return -ENOMEM;
+    if (anarchy_ring_init(&bd.adev, &bd.adev.tx_ring)) {
+        bench_dev_exit(&bd);
+        return -ENOMEM;
+    }
+    anarchy_ring_start(&bd.adev, &bd.adev.tx_ring, true);
+    anarchy_trace_enable(&bd.adev, false);
+
+    t0 = wall_ns();
+    v0 = kshim_now_ns();
+    while (sent < BENCH_RING_OPS || dma_engine_outstanding(bd.engine)) {
+        ring_reap(&bd);
+        if (sent < BENCH_RING_OPS) {
+            ret = anarchy_ring_transfer(&bd.adev, &bd.adev.tx_ring, page, sizeof(page), &xfer);
+            if (!ret) {
+                if (++sent % BENCH_TRACE_BLOCK)
+                    continue;
+                traced = bench_block_traced(block++);
+                ns[(sent - 1) / chunk][traced] += wall_ns() - t0;
+                if (block % BENCH_TRACE_DRAIN == 0)
+                    bench_trace_drain(&bd);
+                anarchy_trace_enable(&bd.adev, bench_block_traced(block));
+                t0 = wall_ns();
+                continue;
+            }
+            if (ret != -EBUSY)
+                break;
+        }
+        next = dma_engine_next_done_ns(bd.engine);
+        if (next > kshim_now_ns())
+            kshim_advance_ns(next - kshim_now_ns());
+    }
+    mid = bench_trace_rounds(&ring_trace, ns);
+    result("ring_submit_ns", "ns", "lower", "cpu")->samples[rep] = mid[0] * 2.0 / chunk;
+    result("ring_submit_traced_ns", "ns", "lower", "cpu")->samples[rep] = mid[1] * 2.0 / chunk;
+    dma_engine_get_stats(bd.engine, &st);
+    result("ring_gbps", "Gbps", "higher", "sim")->samples[rep] =
+        st.bytes * 8.0 / (kshim_now_ns() - v0);
+
+    anarchy_ring_cleanup(&bd.adev, &bd.adev.tx_ring);
+    bench_dev_exit(&bd);
+    return sent == BENCH_RING_OPS ? 0 : -EIO;
+}
+
+static int bench_dma(unsigned int rep, char *buf)
+{
+    struct dma_engine_stats st;
+    struct bench_dev bd;
+    char name[32];
+    unsigned int size, n, i;
+    dma_addr_t addr;
+    u64 v0;
+
+    for (size = 64; size <= BENCH_MAX_DMA; size *= 4) {
+        if (bench_dev_init(&bd, 0, rep, false))
+            return -ENOMEM;
+        n = clamp(BENCH_MAX_DMA / size, 4u, 64u);
+        v0 = kshim_now_ns();
+        for (i = 0; i < n; i++) {
+            addr = anarchy_dma_transfer(&bd.adev, buf, size);
+            if (!addr) {
+                bench_dev_exit(&bd);
+                return -EIO;
+            }
+            anarchy_dma_cleanup(&bd.adev, addr, size);
+        }
+        dma_engine_get_stats(bd.engine, &st);
+        snprintf(name, sizeof(name), "dma_gbps_%u", size);
+        result(name, "Gbps", "higher", "sim")->samples[rep] =
+            st.bytes * 8.0 / (kshim_now_ns() - v0);
+        bench_dev_exit(&bd);
+    }
+    return 0;
+}
+
+/* Traced and untraced blocks as in bench_ring() */
+static int bench_commands(unsigned int rep)
+{
+    static char data[BENCH_PAGE];
+    struct command_batch batch = {
+        .category = CMD_CAT_TEXTURE,
+        .data = data,
+        .total_size = sizeof(data),
+    };
+    struct bench_dev bd;
+    unsigned int i, round, block;
+    u64 t0, v0, ns[BENCH_ROUNDS][2] = { { 0 } };
+    const u64 *mid;
+    bool traced;
+    int ret = 0;
+
+    if (bench_dev_init(&bd, 0, rep, true))
+        return -ENOMEM;
+
+    /* Batches only grow, so every round starts from an empty processor */
+    for (round = 0; round < BENCH_ROUNDS && !ret; round++) {
+        ret = init_command_processor(&bd.adev);
+        if (ret)
+            break;
+        for (block = 0; block < BENCH_COMMANDS / BENCH_TRACE_BLOCK && !ret; block++) {
+            traced = bench_block_traced(block);
+            anarchy_trace_enable(&bd.adev, traced);
+            t0 = wall_ns();
+            for (i = 0; i < BENCH_TRACE_BLOCK && !ret; i++)
+                ret = process_game_command(&bd.adev, &batch);
+            ns[round][traced] += wall_ns() - t0;
+        }
+        bench_trace_drain(&bd);
+        if (round + 1 < BENCH_ROUNDS)
+            cleanup_command_processor(&bd.adev);
+    }
+    if (ret)
+        goto out;
+    mid = bench_trace_rounds(&cmd_trace, ns);
+    result("cmd_batch_ns", "ns", "lower", "cpu")->samples[rep] = mid[0] * 2.0 / BENCH_COMMANDS;
+    result("cmd_batch_traced_ns", "ns", "lower", "cpu")->samples[rep] =
+        mid[1] * 2.0 / BENCH_COMMANDS;
+
+    anarchy_trace_enable(&bd.adev, false);
+    batch.flags = CMD_FLAG_NOSYNC;
+    v0 = kshim_now_ns();
+    for (i = 0; i < BENCH_NOSYNC && !ret; i++)
+        ret = process_game_command(&bd.adev, &batch);
+    result("cmd_nosync_us", "us", "lower", "sim")->samples[rep] =
+        (kshim_now_ns() - v0) / 1000.0 / BENCH_NOSYNC;
+
+out:
+    cleanup_command_processor(&bd.adev);
+    bench_dev_exit(&bd);
+    return ret;
+}
+
+/* What a stats poller sees: a published telemetry sample and idle rings */
+static int bench_stats(unsigned int rep)
+{
+    struct anarchy_ioc_stats stats, user;
+    struct anarchy_telemetry_sample sample;
+    struct bench_dev bd;
+    unsigned int i, round, n = BENCH_STATS_OPS / BENCH_ROUNDS;
+    u64 t0, best = U64_MAX;
+    int ret = 0;
+
+    if (bench_dev_init(&bd, 0, rep, false))
+        return -ENOMEM;
+    anarchy_telemetry_init(&bd.adev);
+    init_bandwidth_monitoring(&bd.adev);
+    anarchy_telemetry_start(&bd.adev);
+    kshim_run_work();
+    anarchy_telemetry_stop(&bd.adev);
+    if (anarchy_telemetry_get(&bd.adev, &sample))
+        ret = -EIO;
+
+    for (round = 0; round < BENCH_ROUNDS && !ret; round++) {
+        t0 = wall_ns();
+        for (i = 0; i < n; i++) {
+            /* Pay for the kernel entry the real ioctl would make, as queue_bench */
+            syscall(SYS_getppid);
+            anarchy_fill_stats(&bd.adev, &stats);
+            stats.size = sizeof(stats);
+            memcpy(&user, &stats, stats.size);
+        }
+        best = min(best, wall_ns() - t0);
+        if (!(user.flags & ANARCHY_STATS_LINK_UP) || user.temperature != sample.temperature)
+            ret = -EIO;
+    }
+    result("stats_get_ns", "ns", "lower", "cpu")->samples[rep] = (double)best / n;
+
+    cleanup_bandwidth_monitoring(&bd.adev);
+    anarchy_telemetry_exit(&bd.adev);
+    bench_dev_exit(&bd);
+    return ret;
+}
+
+/* Every emulated register the driver can read */
+static const u32 mmio_regs[] = {
+    GPU_EMU_CLOCK_OFFSET, GPU_EMU_MEM_OFFSET, GPU_EMU_POWER_OFFSET, GPU_EMU_TEMP_OFFSET,
+    GPU_EMU_FAN_OFFSET, GPU_UTIL_OFFSET, MEM_UTIL_OFFSET, VRAM_USED_OFFSET,
+    GPU_PCIE_RX_COUNTER, GPU_PCIE_TX_COUNTER, PWR_LIMIT_OFFSET, PWR_LIMIT_UPDATE,
+};
+
+struct mmio_run {
+    struct gpu_emu_interface *emu;
+    unsigned int ops;
+    bool stop;
+    int ret;
+};
+
+static void *mmio_reader(void *arg)
+{
+    struct mmio_run *run = arg;
+    unsigned int i;
+    u32 val;
+
+    for (i = 0; i < run->ops; i++) {
+        if (anarchy_gpu_emu_handle_mmio(run->emu, mmio_regs[i % ARRAY_SIZE(mmio_regs)],
+                                        &val, false)) {
+            run->ret = -EIO;
+            break;
+        }
+        /* The writer only ever sets these two */
+        if (mmio_regs[i % ARRAY_SIZE(mmio_regs)] == GPU_EMU_FAN_OFFSET &&
+            val != 30 && val != 70) {
+            run->ret = -EIO;
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void *mmio_writer(void *arg)
+{
+    struct mmio_run *run = arg;
+    u32 fan;
+
+    for (fan = 30; !__atomic_load_n(&run->stop, __ATOMIC_RELAXED); fan = 100 - fan) {
+        if (anarchy_gpu_emu_handle_mmio(run->emu, GPU_EMU_FAN_OFFSET, &fan, true))
+            run->ret = -EIO;
+        /* Stale the published state so readers also take the refresh path */
+        kshim_advance_ns(GPU_EMU_SYNC_NS);
+        sched_yield();
+    }
+    return NULL;
+}
+
+/* The limit only moves when applied, the draw cannot be written */
+static int mmio_check(struct gpu_emu_interface *emu)
+{
+    u32 status, val;
+
+    if (anarchy_gpu_emu_handle_mmio(emu, PWR_LIMIT_UPDATE, &status, false))
+        return -EIO;
+    val = GPU_POWER_LIMIT_MIN;
+    if (anarchy_gpu_emu_handle_mmio(emu, PWR_LIMIT_OFFSET, &val, true) ||
+        anarchy_gpu_emu_handle_mmio(emu, PWR_LIMIT_OFFSET, &val, false) ||
+        val != GPU_POWER_LIMIT_MIN)
+        return -EIO;
+    if (anarchy_gpu_emu_handle_mmio(emu, PWR_LIMIT_UPDATE, &val, false) || val != status)
+        return -EIO;
+    val = GPU_EMU_LIMIT_APPLY;
+    if (anarchy_gpu_emu_handle_mmio(emu, PWR_LIMIT_UPDATE, &val, true) ||
+        anarchy_gpu_emu_handle_mmio(emu, PWR_LIMIT_UPDATE, &val, false) ||
+        val != GPU_POWER_LIMIT_MIN)
+        return -EIO;
+    val = GPU_POWER_LIMIT_MAX + 1;
+    if (anarchy_gpu_emu_handle_mmio(emu, PWR_LIMIT_OFFSET, &val, true) != -EINVAL)
+        return -EIO;
+    val = 100;
+    if (anarchy_gpu_emu_handle_mmio(emu, GPU_EMU_POWER_OFFSET, &val, true) != -EPERM)
+        return -EIO;
+    return 0;
+}
+
+static int bench_mmio(unsigned int rep)
+{
+    struct mmio_run runs[BENCH_MMIO_THREADS], wr = { 0 };
+    pthread_t readers[BENCH_MMIO_THREADS], writer;
+    struct bench_dev bd;
+    unsigned int n, i, round;
+    char name[32];
+    u64 t0, best;
+    int ret;
+
+    if (bench_dev_init(&bd, 0, rep, false))
+        return -ENOMEM;
+    ret = anarchy_gpu_emu_init(&bd.adev);
+    if (!ret)
+        ret = anarchy_gpu_emu_start(&bd.adev);
+    if (!ret)
+        ret = mmio_check(bd.adev.gpu_emu);
+    if (ret)
+        goto out;
+    wr.emu = bd.adev.gpu_emu;
+
+    best = U64_MAX;
+    runs[0] = (struct mmio_run){ .emu = wr.emu, .ops = BENCH_MMIO_OPS / BENCH_ROUNDS };
+    for (round = 0; round < BENCH_ROUNDS && !ret; round++) {
+        t0 = wall_ns();
+        mmio_reader(&runs[0]);
+        best = min(best, wall_ns() - t0);
+        ret = runs[0].ret;
+    }
+    result("mmio_read_ns", "ns", "lower", "cpu")->samples[rep] =
+        (double)best / (BENCH_MMIO_OPS / BENCH_ROUNDS);
+
+    for (n = 1; n <= BENCH_MMIO_THREADS && !ret; n *= 2) {
+        best = U64_MAX;
+        for (round = 0; round < BENCH_ROUNDS && !ret; round++) {
+            wr.stop = false;
+            pthread_create(&writer, NULL, mmio_writer, &wr);
+            t0 = wall_ns();
+            for (i = 0; i < n; i++) {
+                runs[i] = (struct mmio_run){ .emu = wr.emu, .ops = BENCH_MMIO_OPS / BENCH_ROUNDS };
+                pthread_create(&readers[i], NULL, mmio_reader, &runs[i]);
+            }
+            for (i = 0; i < n; i++) {
+                pthread_join(readers[i], NULL);
+                ret = ret ? ret : runs[i].ret;
+            }
+            best = min(best, wall_ns() - t0);
+            __atomic_store_n(&wr.stop, true, __ATOMIC_RELAXED);
+            pthread_join(writer, NULL);
+            ret = ret ? ret : wr.ret;
+        }
+        snprintf(name, sizeof(name), "mmio_read_mops_%u", n);
+        result(name, "Mops", "higher", "cpu")->samples[rep] =
+            (double)n * (BENCH_MMIO_OPS / BENCH_ROUNDS) * 1000.0 / best;
+    }
+
+out:
+    anarchy_gpu_emu_exit(&bd.adev);
+    bench_dev_exit(&bd);
+    return ret;
+}
+
+/* Odd lengths and offsets take the head and tail paths of the copy */
+static int upload_check(char *dst, const char *src)
+{
+    static const unsigned int offs[] = { 0, 1, 7, 8, 63 };
+    static const unsigned int lens[] = { 0, 1, 7, 8, 63, 64, 65, 4095, 4096 };
+    unsigned int i, j;
+
+    for (i = 0; i < ARRAY_SIZE(offs); i++) {
+        for (j = 0; j < ARRAY_SIZE(lens); j++) {
+            memset(dst, 0, lens[j] + 128);
+            anarchy_memcpy_toio_nt(dst + offs[i], src + 3, lens[j]);
+            if (memcmp(dst + offs[i], src + 3, lens[j]) || dst[offs[i] + lens[j]]) {
+                fprintf(stderr, "streaming copy of %u B at +%u is wrong\n", lens[j], offs[i]);
+                return -EIO;
+            }
+        }
+    }
+    return 0;
+}
+
+static int bench_upload(unsigned int rep, const char *src)
+{
+    unsigned int round;
+    u64 t0, plain = U64_MAX, nt = U64_MAX;
+    char *dst = aligned_alloc(4096, BENCH_UPLOAD);
+    int ret;
+
+    if (!dst)
+        return -ENOMEM;
+    ret = upload_check(dst, src);
+
+    for (round = 0; round < BENCH_ROUNDS && !ret; round++) {
+        t0 = wall_ns();
+        memcpy_toio(dst, src, BENCH_UPLOAD);
+        wmb();
+        plain = min(plain, wall_ns() - t0);
+
+        t0 = wall_ns();
+        anarchy_memcpy_toio_nt(dst, src, BENCH_UPLOAD);
+        nt = min(nt, wall_ns() - t0);
+    }
+    if (!ret && memcmp(dst, src, BENCH_UPLOAD))
+        ret = -EIO;
+    result("upload_memcpy_gbps", "Gbps", "higher", "cpu")->samples[rep] =
+        BENCH_UPLOAD * 8.0 / plain;
+    result("upload_nt_gbps", "Gbps", "higher", "cpu")->samples[rep] = BENCH_UPLOAD * 8.0 / nt;
+    free(dst);
+    return ret;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* P(X >= k) for X ~ Binomial(n, 1/2) */
+static double sign_test_p(unsigned int k, unsigned int n)
+{
+    double c = 1.0, p = 0.0, half = 1.0;
+    unsigned int i;
+
+    for (i = 0; i < n; i++)
+        half /= 2;
+    for (i = 0; i <= n; i++) {
+        if (i >= k)
+            p += c * half;
+        c = c * (n - i) / (i + 1);
+    }
+    return p;
+}
+
+/*
+ * Both sides of a round ran interleaved on one device, so a round's ratio
+ * cancels whatever the host did to it. The check is on the median ratio
+ * of all rounds of all repetitions, which a burst of other work hitting
+ * one side of a few rounds does not move.
+ */
+static bool trace_overhead_ok(struct trace_overhead *to)
+{
+    unsigned int i, over = 0;
+    double pct;
+    bool ok;
+
+    for (i = 0; i < to->n; i++)
+        over += to->ratio[i] > 1.0 + BENCH_TRACE_MAX_PCT / 100.0;
+    qsort(to->ratio, to->n, sizeof(double), cmp_double);
+    pct = ((to->ratio[(to->n - 1) / 2] + to->ratio[to->n / 2]) / 2 - 1) * 100.0;
+    ok = pct < BENCH_TRACE_MAX_PCT;
+    fprintf(stderr, "%s: trace overhead %+.2f%% median of %u rounds, %u over %.0f%%%s\n",
+            to->name, pct, to->n, over, BENCH_TRACE_MAX_PCT, ok ? "" : " FAIL");
+    free(to->ratio);
+    return ok;
+}
+
+/*
+ * Each repetition's mmio_read_mops_<n> over its own mmio_read_mops_1
+ * should grow with n for as long as the readers have a CPU each, the
+ * writer keeping one; it fails when significantly more than half the
+ * repetitions fall under BENCH_MMIO_MIN_SCALE of that. With one CPU
+ * (or two) the readers share it, so all this asks is that retries
+ * against the writer do not eat the throughput.
+ */
+static bool mmio_scaling_ok(void)
+{
+    const double *one = result("mmio_read_mops_1", "Mops", "higher", "cpu")->samples;
+    unsigned int n, r, under, lanes;
+    double ratio[reps], want, p;
+    bool ok = true;
+    char name[32];
+
+    for (n = 2; n <= BENCH_MMIO_THREADS; n *= 2) {
+        snprintf(name, sizeof(name), "mmio_read_mops_%u", n);
+        lanes = min_t(unsigned int, n, cpus > 2 ? cpus - 1 : 1);
+        want = lanes * BENCH_MMIO_MIN_SCALE;
+        for (r = 0, under = 0; r < reps; r++) {
+            ratio[r] = result(name, "Mops", "higher", "cpu")->samples[r] / one[r];
+            under += ratio[r] < want;
+        }
+        qsort(ratio, reps, sizeof(double), cmp_double);
+        p = sign_test_p(under, reps);
+        fprintf(stderr, "%s: %.2fx one reader on %u CPU%s, %u/%u under %.2fx (p %.2g)%s\n",
+                name, (ratio[(reps - 1) / 2] + ratio[reps / 2]) / 2, cpus, cpus == 1 ? "" : "s",
+                under, reps, want, p, p >= BENCH_ALPHA ? "" : " FAIL");
+        ok &= p >= BENCH_ALPHA;
+    }
+    return ok;
+}
+
+static void write_json(FILE *f)
+{
+    unsigned int i, r;
+
+    fprintf(f, "{\n  \"suite\": \"perf_suite\",\n");
+    fprintf(f, "  \"config\": {\"repetitions\": %u, \"seed\": %u, \"link_mbps\": %llu, "
+            "\"latency_ns\": %u, \"jitter_ns\": %u, \"cpus\": %u},\n", reps, seed,
+            (unsigned long long)cfg.link_mbps, cfg.latency_ns, cfg.jitter_ns, cpus);
+    fprintf(f, "  \"benchmarks\": [\n");
+    for (i = 0; i < nr_results; i++) {
+        fprintf(f, "    {\"name\": \"%s\", \"unit\": \"%s\", \"better\": \"%s\", "
+                "\"kind\": \"%s\", \"samples\": [", results[i].name, results[i].unit,
+                results[i].better, results[i].kind);
+        for (r = 0; r < reps; r++)
+            fprintf(f, "%s%.6g", r ? ", " : "", results[i].samples[r]);
+        fprintf(f, "]}%s\n", i + 1 < nr_results ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+int main(int argc, char **argv) {
+    const char *out = NULL;
+    unsigned int rep;
+    FILE *f = stdout;
+    char *buf;
+    bool checks_ok;
+    int opt, ret = 0;
+
+    dma_engine_default_config(&cfg);
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    while ((opt = getopt(argc, argv, "n:o:s:")) != -1) {
+        switch (opt) {
+        case 'n':
+            reps = strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n repetitions] [-o file] [-s seed]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (reps < 2) {
+        fprintf(stderr, "need at least two repetitions\n");
+        return 2;
+    }
+
+    buf = malloc(BENCH_MAX_DMA);
+    if (!buf)
+        return 2;
+    memset(buf, 0x5a, BENCH_MAX_DMA);
+
+    /* Interleave the benchmarks so a noisy spell hits all of them a little */
+    for (rep = 0; rep < reps && !ret; rep++) {
+        ret = bench_ring(rep);
+        if (!ret)
+            ret = bench_dma(rep, buf);
+        if (!ret)
+            ret = bench_commands(rep);
+        if (!ret)
+            ret = bench_stats(rep);
+        if (!ret)
+            ret = bench_mmio(rep);
+        if (!ret)
+            ret = bench_upload(rep, buf);
+    }
+    free(buf);
+    if (ret) {
+        fprintf(stderr, "benchmark failed in repetition %u: %d\n", rep, ret);
+        return 1;
+    }
+
+    checks_ok = trace_overhead_ok(&ring_trace);
+    checks_ok &= trace_overhead_ok(&cmd_trace);
+    checks_ok &= mmio_scaling_ok();
+
+    if (out) {
+        f = fopen(out, "w");
+        if (!f) {
+            perror(out);
+            return 2;
+        }
+    }
+    write_json(f);
+    if (f != stdout)
+        fclose(f);
+    return checks_ok ? 0 : 1;
+}
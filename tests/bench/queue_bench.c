@@ -0,0 +1,315 @@
+/*
+ * Transfers/sec and per-transfer latency of the shared SQ/CQ path against
+ * one ANARCHY_IOC_SUBMIT_DMA per transfer.
+ *
+ *   queue_bench [-d device] [-n transfers] [-s size] [-q depth]
+ *
+ * Runs against the real device when it can be opened, otherwise against
+ * the userspace mock driver. The mock charges one real syscall per ioctl
+ * so the kernel entry cost is still part of the comparison, but copies
+ * and ring work are only approximations of the driver's.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "anarchy-ioctl-mock.h"
+#include "anarchy-queue.h"
+
+#define DEFAULT_DEVICE     "/dev/anarchy-egpu"
+#define DEFAULT_TRANSFERS  100000
+#define DEFAULT_SIZE       4096
+#define DEFAULT_DEPTH      64
+
+struct bench_dev {
+    int fd;
+    struct anarchy_mock_driver *mock;
+    void *map;
+    size_t map_size;
+};
+
+struct bench_result {
+    const char *mode;
+    double seconds;
+    unsigned long done;
+    unsigned long errors;
+    unsigned long enters;
+    double p50_us;
+    double p99_us;
+};
+
+static const char *device_path = DEFAULT_DEVICE;
+static unsigned long transfers = DEFAULT_TRANSFERS;
+static uint32_t transfer_size = DEFAULT_SIZE;
+static uint32_t depth = DEFAULT_DEPTH;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bench_open(struct bench_dev *dev) {
+    memset(dev, 0, sizeof(*dev));
+    dev->fd = open(device_path, O_RDWR | O_CLOEXEC);
+    if (dev->fd >= 0)
+        return 0;
+
+    dev->mock = anarchy_mock_create();
+    return dev->mock ? 0 : -1;
+}
+
+static void bench_close(struct bench_dev *dev) {
+    if (dev->mock) {
+        anarchy_mock_destroy(dev->mock);
+        return;
+    }
+    if (dev->map)
+        munmap(dev->map, dev->map_size);
+    close(dev->fd);
+}
+
+static int bench_ioctl(struct bench_dev *dev, unsigned long request, void *arg) {
+    if (dev->mock) {
+        /* Pay for the kernel entry the real ioctl would make */
+        syscall(SYS_getppid);
+        return anarchy_mock_ioctl(dev->mock, request, arg);
+    }
+    return ioctl(dev->fd, request, arg);
+}
+
+static void *bench_map(struct bench_dev *dev, size_t size) {
+    if (dev->mock)
+        return anarchy_mock_queue_map(dev->mock, NULL);
+
+    dev->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, dev->fd, 0);
+    if (dev->map == MAP_FAILED) {
+        dev->map = NULL;
+        return NULL;
+    }
+    dev->map_size = size;
+    return dev->map;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void summarize(struct bench_result *res, uint64_t *latencies, unsigned long count) {
+    if (!count)
+        return;
+
+    qsort(latencies, count, sizeof(*latencies), compare_u64);
+    res->p50_us = latencies[count / 2] / 1000.0;
+    res->p99_us = latencies[(count * 99) / 100] / 1000.0;
+}
+
+static int bench_ioctl_path(struct bench_result *res, const uint8_t *payload,
+                            uint64_t *latencies) {
+    struct anarchy_ioc_dma dma;
+    struct bench_dev dev;
+    uint64_t start, t0;
+    unsigned long i;
+
+    if (bench_open(&dev))
+        return -1;
+
+    memset(&dma, 0, sizeof(dma));
+    dma.addr = (uint64_t)(uintptr_t)payload;
+    dma.size = transfer_size;
+    dma.flags = ANARCHY_DMA_TO_DEVICE;
+
+    start = now_ns();
+    for (i = 0; i < transfers; i++) {
+        dma.cookie = i;
+        t0 = now_ns();
+        if (bench_ioctl(&dev, ANARCHY_IOC_SUBMIT_DMA, &dma))
+            res->errors++;
+        latencies[i] = now_ns() - t0;
+        res->enters++;
+    }
+    res->seconds = (now_ns() - start) / 1e9;
+    res->done = transfers;
+    summarize(res, latencies, transfers);
+
+    bench_close(&dev);
+    return 0;
+}
+
+static int bench_queue_path(struct bench_result *res, const uint8_t *payload,
+                            uint64_t *latencies, uint32_t flags) {
+    struct anarchy_ioc_queue_setup setup;
+    struct anarchy_ioc_queue_enter enter;
+    struct anarchy_uqueue uq;
+    struct anarchy_sqe *sqe;
+    struct anarchy_cqe *cqe;
+    struct bench_dev dev;
+    uint64_t *submitted_at, start;
+    unsigned long queued = 0, done = 0;
+    uint32_t batch, slot = 0, slots;
+    void *mem;
+    int ret = -1;
+
+    if (bench_open(&dev))
+        return -1;
+
+    memset(&setup, 0, sizeof(setup));
+    setup.sq_entries = depth;
+    setup.flags = flags;
+    setup.data_size = depth * ((transfer_size + 4095) & ~4095U);
+    if (bench_ioctl(&dev, ANARCHY_IOC_QUEUE_SETUP, &setup)) {
+        fprintf(stderr, "%s: queue setup failed: %s\n", res->mode, strerror(errno));
+        goto out;
+    }
+
+    mem = bench_map(&dev, setup.mmap_size);
+    if (!mem) {
+        fprintf(stderr, "%s: mmap failed: %s\n", res->mode, strerror(errno));
+        goto out;
+    }
+    anarchy_uqueue_bind(&uq, mem, &setup);
+    slots = setup.data_size / transfer_size;
+
+    submitted_at = calloc(transfers, sizeof(*submitted_at));
+    if (!submitted_at)
+        goto out;
+
+    start = now_ns();
+    while (done < transfers) {
+        /* Fill whatever the SQ has room for */
+        batch = 0;
+        while (queued < transfers && (sqe = anarchy_sq_get(&uq))) {
+            memcpy(uq.data + (uint64_t)slot * transfer_size, payload, transfer_size);
+            sqe->data_offset = (uint64_t)slot * transfer_size;
+            sqe->size = transfer_size;
+            sqe->flags = ANARCHY_DMA_TO_DEVICE;
+            sqe->cookie = queued;
+            submitted_at[queued++] = now_ns();
+            slot = (slot + 1) % slots;
+            batch++;
+        }
+        if (batch)
+            anarchy_sq_commit(&uq);
+
+        if (anarchy_sq_needs_enter(&uq)) {
+            memset(&enter, 0, sizeof(enter));
+            enter.flags = ANARCHY_ENTER_GETEVENTS;
+            if (flags & ANARCHY_QUEUE_SQPOLL)
+                enter.flags |= ANARCHY_ENTER_SQ_WAKEUP;
+            enter.min_complete = anarchy_sq_pending(&uq) ? 1 : 0;
+            if (bench_ioctl(&dev, ANARCHY_IOC_QUEUE_ENTER, &enter) && errno != EAGAIN)
+                break;
+            res->enters++;
+        }
+
+        batch = 0;
+        while ((cqe = anarchy_cq_peek(&uq))) {
+            if (cqe->result < 0)
+                res->errors++;
+            latencies[done++] = now_ns() - submitted_at[cqe->cookie];
+            batch++;
+            anarchy_cq_advance(&uq, 1);
+        }
+        if (!batch && !(flags & ANARCHY_QUEUE_SQPOLL) && !anarchy_sq_pending(&uq) &&
+            queued == done)
+            break;
+        if (!batch)
+            sched_yield();
+    }
+    res->seconds = (now_ns() - start) / 1e9;
+    res->done = done;
+    summarize(res, latencies, done);
+    free(submitted_at);
+    ret = 0;
+
+out:
+    bench_close(&dev);
+    return ret;
+}
+
+static void print_result(const struct bench_result *res) {
+    double rate = res->seconds > 0 ? res->done / res->seconds : 0;
+
+    printf("%-14s %12.0f %10.1f %9.2f %9.2f %10lu %8lu\n",
+           res->mode, rate, rate * transfer_size / (1024.0 * 1024.0),
+           res->p50_us, res->p99_us, res->enters, res->errors);
+}
+
+int main(int argc, char **argv) {
+    struct bench_result results[3];
+    struct bench_dev probe;
+    uint64_t *latencies;
+    uint8_t *payload;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "d:n:s:q:")) != -1) {
+        switch (opt) {
+        case 'd':
+            device_path = optarg;
+            break;
+        case 'n':
+            transfers = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            transfer_size = strtoul(optarg, NULL, 0);
+            break;
+        case 'q':
+            depth = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-d device] [-n transfers] [-s size] [-q depth]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    if (!transfers || !transfer_size || transfer_size > 1024 * 1024 ||
+        !depth || (depth & (depth - 1))) {
+        fprintf(stderr, "invalid parameters\n");
+        return 1;
+    }
+
+    payload = malloc(transfer_size);
+    latencies = calloc(transfers, sizeof(*latencies));
+    if (!payload || !latencies)
+        return 1;
+    memset(payload, 0xA5, transfer_size);
+
+    if (bench_open(&probe))
+        return 1;
+    printf("backend: %s, %lu transfers of %u bytes, queue depth %u\n",
+           probe.mock ? "userspace mock" : device_path, transfers, transfer_size, depth);
+    bench_close(&probe);
+
+    memset(results, 0, sizeof(results));
+    results[0].mode = "ioctl";
+    results[1].mode = "queue";
+    results[2].mode = "queue-sqpoll";
+
+    printf("%-14s %12s %10s %9s %9s %10s %8s\n",
+           "mode", "xfers/s", "MB/s", "p50 us", "p99 us", "syscalls", "errors");
+    if (!bench_ioctl_path(&results[0], payload, latencies))
+        print_result(&results[0]);
+    if (!bench_queue_path(&results[1], payload, latencies, 0))
+        print_result(&results[1]);
+    if (!bench_queue_path(&results[2], payload, latencies, ANARCHY_QUEUE_SQPOLL))
+        print_result(&results[2]);
+
+    for (i = 0; i < 3; i++)
+        if (results[i].errors)
+            return 1;
+
+    free(latencies);
+    free(payload);
+    return 0;
+}
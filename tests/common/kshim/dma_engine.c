@@ -0,0 +1,280 @@
+#include "dma_engine.h"
+
+/* Mirrors src/kernel/ring.c */
+#define RING_DMA_DESC_ADDR  0x100
+#define RING_DMA_START      0x104
+
+struct sim_desc {
+    dma_addr_t addr;
+    u32 size;
+    u32 flags;
+    u32 next;
+    u32 status;
+};
+#define SIM_DESC_DONE       BIT(0)
+#define SIM_DESC_ERROR      BIT(1)
+
+/* Mirrors src/kernel/dma_device.c */
+#define DMA_DEV_CTRL_REG    0x20000
+#define DMA_DEV_STATUS_REG  0x20004
+#define DMA_DEV_ADDR_REG    0x20008
+#define DMA_DEV_SIZE_REG    0x2000C
+#define DMA_DEV_PIO_LEN_REG 0x2001C
+#define DMA_CTRL_START      BIT(0)
+#define DMA_CTRL_COMPLETE   BIT(1)
+#define DMA_CTRL_ERROR      BIT(2)
+
+/* Mirrors src/kernel/dma_path.c */
+#define DMA_PIO_WINDOW      0x30000
+#define DMA_PIO_WINDOW_SIZE 4096
+
+#define ENGINE_QUEUE        4096    /* Outstanding ring transfers */
+
+struct dma_engine {
+    struct dma_engine_config cfg;
+    u32 *regs;
+    unsigned int rng;
+    u64 link_free_ns;               /* Link busy until */
+    u64 last_done_ns;               /* Completions stay in order */
+
+    struct dma_engine_completion queue[ENGINE_QUEUE];
+    struct sim_desc *desc[ENGINE_QUEUE]; /* Where each entry's status goes */
+    unsigned int head, tail;        /* Free running */
+    unsigned int wb;                /* Written back, head <= wb <= tail */
+
+    /* DMA device front end */
+    u64 dev_done_ns;
+    bool dev_active;
+    bool dev_error;
+
+    struct dma_engine_stats stats;
+};
+
+void dma_engine_default_config(struct dma_engine_config *cfg)
+{
+    cfg->link_mbps = 40000;
+    cfg->latency_ns = 2000;         /* TLP round trip through two retimers */
+    cfg->jitter_ns = 500;
+    cfg->mmio_read_ns = 1000;
+    cfg->mmio_write_ns = 100;
+    cfg->bar_size = 1 << 20;
+    cfg->seed = 1;
+}
+
+static u32 engine_rand(struct dma_engine *e)
+{
+    e->rng = e->rng * 1103515245u + 12345u;
+    return e->rng >> 8;
+}
+
+/* Serialize @bytes on the link and return when they land */
+static u64 engine_schedule(struct dma_engine *e, u32 bytes)
+{
+    u64 now = kshim_now_ns(), start, wire, done;
+
+    start = max(now, e->link_free_ns);
+    wire = DIV_ROUND_UP((u64)bytes * 8000, e->cfg.link_mbps);
+    e->link_free_ns = start + wire;
+
+    done = e->link_free_ns + e->cfg.latency_ns;
+    if (e->cfg.jitter_ns)
+        done += engine_rand(e) % (e->cfg.jitter_ns + 1);
+    done = max(done, e->last_done_ns);
+    e->last_done_ns = done;
+
+    e->stats.transfers++;
+    e->stats.bytes += bytes;
+    e->stats.busy_ns += wire;
+    return done;
+}
+
+static void engine_ring_kick(struct dma_engine *e)
+{
+    dma_addr_t desc_iova = e->regs[RING_DMA_DESC_ADDR / 4];
+    struct dma_engine_completion *c;
+    struct sim_desc *desc;
+
+    /* Completions nobody polled for go once their descriptor has them */
+    if (e->tail - e->head == ENGINE_QUEUE && e->head != e->wb)
+        e->head++;
+    if (e->tail - e->head == ENGINE_QUEUE) {
+        e->stats.errors++;
+        return;
+    }
+
+    desc = kshim_dma_to_virt(desc_iova, sizeof(*desc));
+    e->desc[e->tail % ENGINE_QUEUE] = desc;
+    c = &e->queue[e->tail++ % ENGINE_QUEUE];
+    c->desc = desc_iova;
+    c->kick_ns = kshim_now_ns();
+    c->error = false;
+
+    if (!desc || !kshim_dma_to_virt(desc->addr, desc->size)) {
+        e->stats.errors++;
+        c->error = true;
+        c->bytes = 0;
+        c->done_ns = max(c->kick_ns + e->cfg.latency_ns, e->last_done_ns);
+        e->last_done_ns = c->done_ns;
+        kshim_mmio_tick_at(c->done_ns);
+        return;
+    }
+    c->bytes = desc->size;
+    c->done_ns = engine_schedule(e, desc->size);
+    kshim_mmio_tick_at(c->done_ns);
+}
+
+/* Set the status word of every descriptor that has finished by @now */
+static u64 engine_writeback(struct dma_engine *e, u64 now)
+{
+    struct dma_engine_completion *c;
+    struct sim_desc *desc;
+
+    while (e->wb != e->tail && e->queue[e->wb % ENGINE_QUEUE].done_ns <= now) {
+        desc = e->desc[e->wb % ENGINE_QUEUE];
+        c = &e->queue[e->wb++ % ENGINE_QUEUE];
+        if (desc)
+            __atomic_store_n(&desc->status, SIM_DESC_DONE | (c->error ? SIM_DESC_ERROR : 0),
+                             __ATOMIC_RELEASE);
+    }
+    return e->wb != e->tail ? e->queue[e->wb % ENGINE_QUEUE].done_ns : U64_MAX;
+}
+
+static u64 engine_tick(void *ctx, u64 now_ns)
+{
+    return engine_writeback(ctx, now_ns);
+}
+
+static void engine_dev_start(struct dma_engine *e)
+{
+    u32 addr = e->regs[DMA_DEV_ADDR_REG / 4];
+    u32 size = e->regs[DMA_DEV_SIZE_REG / 4];
+
+    e->dev_active = true;
+    e->dev_error = !size || !kshim_dma_to_virt(addr, size);
+    if (e->dev_error) {
+        e->stats.errors++;
+        e->dev_done_ns = kshim_now_ns() + e->cfg.latency_ns;
+        return;
+    }
+    e->dev_done_ns = engine_schedule(e, size);
+}
+
+/* The data already crossed the link one register write at a time */
+static void engine_pio_take(struct dma_engine *e, u32 len)
+{
+    if (!len || len > DMA_PIO_WINDOW_SIZE) {
+        e->stats.errors++;
+        return;
+    }
+    e->stats.pio_transfers++;
+    e->stats.pio_bytes += len;
+}
+
+static u32 engine_read(void *ctx, u64 offset)
+{
+    struct dma_engine *e = ctx;
+    u32 val;
+
+    kshim_advance_ns(e->cfg.mmio_read_ns);
+    e->stats.reads++;
+
+    if (offset == DMA_DEV_STATUS_REG) {
+        if (!e->dev_active || kshim_now_ns() < e->dev_done_ns)
+            return 0;
+        return e->dev_error ? DMA_CTRL_ERROR : DMA_CTRL_COMPLETE;
+    }
+
+    val = e->regs[offset / 4];
+    return val;
+}
+
+static void engine_write(void *ctx, u64 offset, u32 val)
+{
+    struct dma_engine *e = ctx;
+
+    kshim_advance_ns(e->cfg.mmio_write_ns);
+    e->stats.writes++;
+    e->regs[offset / 4] = val;
+
+    if (offset == RING_DMA_START && val)
+        engine_ring_kick(e);
+    else if (offset == DMA_DEV_CTRL_REG && (val & DMA_CTRL_START))
+        engine_dev_start(e);
+    else if (offset == DMA_DEV_PIO_LEN_REG)
+        engine_pio_take(e, val);
+}
+
+static const struct kshim_mmio_ops engine_mmio_ops = {
+    .read = engine_read,
+    .write = engine_write,
+    .tick = engine_tick,
+};
+
+struct dma_engine *dma_engine_create(const struct dma_engine_config *cfg)
+{
+    struct dma_engine *e = calloc(1, sizeof(*e));
+
+    if (!e)
+        return NULL;
+    e->cfg = *cfg;
+    e->regs = calloc(cfg->bar_size / 4, sizeof(u32));
+    if (!e->regs || !cfg->link_mbps) {
+        free(e->regs);
+        free(e);
+        return NULL;
+    }
+    e->rng = cfg->seed;
+    kshim_set_mmio(e->regs, cfg->bar_size, &engine_mmio_ops, e);
+    return e;
+}
+
+void dma_engine_destroy(struct dma_engine *e)
+{
+    if (!e)
+        return;
+    kshim_set_mmio(NULL, 0, NULL, NULL);
+    free(e->regs);
+    free(e);
+}
+
+void __iomem *dma_engine_bar(struct dma_engine *e)
+{
+    return e->regs;
+}
+
+void dma_engine_set_reg(struct dma_engine *e, u32 offset, u32 val)
+{
+    e->regs[offset / 4] = val;
+}
+
+unsigned int dma_engine_poll(struct dma_engine *e,
+                             void (*fn)(void *ctx, const struct dma_engine_completion *c),
+                             void *ctx)
+{
+    unsigned int n = 0;
+
+    kshim_mmio_tick_at(engine_writeback(e, kshim_now_ns()));
+    while (e->head != e->tail && e->queue[e->head % ENGINE_QUEUE].done_ns <= kshim_now_ns()) {
+        struct dma_engine_completion c = e->queue[e->head++ % ENGINE_QUEUE];
+
+        if (fn)
+            fn(ctx, &c);
+        n++;
+    }
+    return n;
+}
+
+u64 dma_engine_next_done_ns(const struct dma_engine *e)
+{
+    return e->head != e->tail ? e->queue[e->head % ENGINE_QUEUE].done_ns : 0;
+}
+
+unsigned int dma_engine_outstanding(const struct dma_engine *e)
+{
+    return e->tail - e->head;
+}
+
+void dma_engine_get_stats(const struct dma_engine *e, struct dma_engine_stats *st)
+{
+    *st = e->stats;
+}
@@ -0,0 +1,83 @@
+#ifndef KSHIM_DMA_ENGINE_H
+#define KSHIM_DMA_ENGINE_H
+
+#include "kshim.h"
+
+/*
+ * Simulated eGPU behind the kshim MMIO hooks. BAR0 is a plain register
+ * file except for the three front ends the driver uses:
+ *
+ *   TX ring     RING_DMA_DESC_ADDR/RING_DMA_START (src/kernel/ring.c) kick
+ *               one descriptor; once it lands the engine sets DONE (and
+ *               ERROR) in the descriptor's status word as virtual time
+ *               passes, and dma_engine_poll() reports it in submission order
+ *   DMA device  DMA_DEV_ADDR/SIZE/CTRL (src/kernel/dma_device.c) start a
+ *               single transfer; DMA_DEV_STATUS reads COMPLETE once done
+ *   PIO window  data stored into DMA_PIO_WINDOW (src/kernel/dma_path.c) is
+ *               taken by a write of its length to DMA_DEV_PIO_LEN
+ *
+ * Transfers share one link. Each is serialized at link_mbps, then lands
+ * latency_ns plus up to jitter_ns later, never ahead of an earlier one.
+ * Register reads cost a non-posted round trip, writes a posted one.
+ */
+
+struct dma_engine_config {
+    u64 link_mbps;              /* 40000 for a TB4/USB4 tunnel */
+    u32 latency_ns;             /* Kick to completion on an idle link */
+    u32 jitter_ns;              /* Uniform extra latency per transfer */
+    u32 mmio_read_ns;
+    u32 mmio_write_ns;
+    u32 bar_size;
+    unsigned int seed;
+};
+
+struct dma_engine_stats {
+    u64 transfers;
+    u64 bytes;
+    u64 errors;                 /* Descriptor or buffer not mapped */
+    u64 reads;
+    u64 writes;
+    u64 busy_ns;                /* Link time spent moving data */
+    u64 pio_transfers;          /* Taken from the PIO window */
+    u64 pio_bytes;
+};
+
+/* One finished transfer */
+struct dma_engine_completion {
+    dma_addr_t desc;            /* Descriptor IOVA, 0 for the DMA device */
+    u32 bytes;
+    u64 kick_ns;
+    u64 done_ns;
+    bool error;
+};
+
+struct dma_engine;
+
+void dma_engine_default_config(struct dma_engine_config *cfg);
+
+/* Creates the engine and routes kshim MMIO to it */
+struct dma_engine *dma_engine_create(const struct dma_engine_config *cfg);
+void dma_engine_destroy(struct dma_engine *e);
+
+/* BAR0 mapping to put in adev->mmio_base */
+void __iomem *dma_engine_bar(struct dma_engine *e);
+
+/* Preset a register, e.g. an ID the driver reads back */
+void dma_engine_set_reg(struct dma_engine *e, u32 offset, u32 val);
+
+/*
+ * Report ring completions due at the current time, oldest first, and
+ * return how many. Their descriptors are written back by then; @fn may
+ * be NULL when only the write-back matters.
+ */
+unsigned int dma_engine_poll(struct dma_engine *e,
+                             void (*fn)(void *ctx, const struct dma_engine_completion *c),
+                             void *ctx);
+
+/* When the oldest outstanding ring transfer completes, 0 if none */
+u64 dma_engine_next_done_ns(const struct dma_engine *e);
+unsigned int dma_engine_outstanding(const struct dma_engine *e);
+
+void dma_engine_get_stats(const struct dma_engine *e, struct dma_engine_stats *st);
+
+#endif /* KSHIM_DMA_ENGINE_H */
@@ -0,0 +1,343 @@
+#include "kshim.h"
+
+int kshim_verbose;
+
+static u64 now_ns;
+
+void kshim_log(int level, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (level > kshim_verbose)
+        return;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+static void kshim_mmio_tick(u64 now);
+
+/* Time */
+
+u64 kshim_now_ns(void)
+{
+    return __atomic_load_n(&now_ns, __ATOMIC_RELAXED);
+}
+
+void kshim_advance_ns(u64 ns)
+{
+    kshim_mmio_tick(__atomic_add_fetch(&now_ns, ns, __ATOMIC_RELAXED));
+}
+
+/* MMIO */
+
+static struct {
+    const volatile char *base;
+    u64 size;
+    const struct kshim_mmio_ops *ops;
+    void *ctx;
+    u64 tick_ns;                    /* Next ops->tick, U64_MAX when idle */
+} mmio = { .tick_ns = U64_MAX };
+
+void kshim_set_mmio(void __iomem *base, u64 size, const struct kshim_mmio_ops *ops, void *ctx)
+{
+    mmio.base = base;
+    mmio.size = size;
+    mmio.ops = ops;
+    mmio.ctx = ctx;
+    mmio.tick_ns = U64_MAX;
+}
+
+void kshim_mmio_tick_at(u64 ns)
+{
+    mmio.tick_ns = min(mmio.tick_ns, ns);
+}
+
+/* Let the device write back whatever finished by @now */
+static void kshim_mmio_tick(u64 now)
+{
+    if (now >= mmio.tick_ns && mmio.ops && mmio.ops->tick)
+        mmio.tick_ns = mmio.ops->tick(mmio.ctx, now);
+}
+
+static u64 mmio_offset(const volatile void __iomem *addr)
+{
+    u64 off = (const volatile char *)addr - mmio.base;
+
+    if (!mmio.ops || (const volatile char *)addr < mmio.base || off + 4 > mmio.size) {
+        fprintf(stderr, "kshim: MMIO access outside the BAR at %p\n", (const void *)addr);
+        abort();
+    }
+    return off;
+}
+
+u32 kshim_readl(const volatile void __iomem *addr)
+{
+    return mmio.ops->read(mmio.ctx, mmio_offset(addr));
+}
+
+void kshim_writel(u32 val, volatile void __iomem *addr)
+{
+    mmio.ops->write(mmio.ctx, mmio_offset(addr), val);
+}
+
+/*
+ * DMA mappings. Descriptors carry 32-bit addresses, so IOVAs are handed
+ * out first-fit below 4G with a guard page between mappings; an access
+ * that strays off a mapping then finds nothing rather than a neighbour.
+ */
+#define IOVA_BASE   0x10000000ULL
+#define IOVA_LIMIT  0xF0000000ULL
+#define MAX_MAPS    65536
+
+struct kshim_map {
+    dma_addr_t iova;
+    u64 len;                        /* Page aligned, excluding the guard */
+    void *cpu;
+};
+
+static struct kshim_map maps[MAX_MAPS];   /* Sorted by iova */
+static unsigned int nr_maps;
+static pthread_mutex_t maps_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static dma_addr_t iova_insert(void *cpu, size_t size)
+{
+    u64 len = ALIGN((u64)size, PAGE_SIZE), start = IOVA_BASE;
+    dma_addr_t iova = 0;
+    unsigned int i;
+
+    pthread_mutex_lock(&maps_lock);
+    if (nr_maps == MAX_MAPS)
+        goto out;
+    for (i = 0; i <= nr_maps; i++) {
+        u64 end = i < nr_maps ? maps[i].iova : IOVA_LIMIT;
+
+        if (end >= start && end - start >= len + PAGE_SIZE) {
+            memmove(&maps[i + 1], &maps[i], (nr_maps - i) * sizeof(maps[0]));
+            maps[i].iova = start;
+            maps[i].len = len;
+            maps[i].cpu = cpu;
+            nr_maps++;
+            iova = start;
+            break;
+        }
+        if (i < nr_maps)
+            start = maps[i].iova + maps[i].len + PAGE_SIZE;
+    }
+out:
+    pthread_mutex_unlock(&maps_lock);
+    return iova;
+}
+
+static int iova_find(dma_addr_t addr)
+{
+    int lo = 0, hi = (int)nr_maps - 1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+
+        if (addr < maps[mid].iova)
+            hi = mid - 1;
+        else if (addr >= maps[mid].iova + maps[mid].len)
+            lo = mid + 1;
+        else
+            return mid;
+    }
+    return -1;
+}
+
+static void *iova_remove(dma_addr_t iova)
+{
+    void *cpu = NULL;
+    int i;
+
+    pthread_mutex_lock(&maps_lock);
+    i = iova_find(iova);
+    if (i >= 0 && maps[i].iova == iova) {
+        cpu = maps[i].cpu;
+        memmove(&maps[i], &maps[i + 1], (nr_maps - i - 1) * sizeof(maps[0]));
+        nr_maps--;
+    }
+    pthread_mutex_unlock(&maps_lock);
+    if (!cpu)
+        fprintf(stderr, "kshim: unmapping unknown IOVA 0x%llx\n", (unsigned long long)iova);
+    return cpu;
+}
+
+void *kshim_dma_to_virt(dma_addr_t addr, size_t len)
+{
+    void *cpu = NULL;
+    int i;
+
+    pthread_mutex_lock(&maps_lock);
+    i = iova_find(addr);
+    if (i >= 0 && addr + len <= maps[i].iova + maps[i].len)
+        cpu = (char *)maps[i].cpu + (addr - maps[i].iova);
+    pthread_mutex_unlock(&maps_lock);
+    return cpu;
+}
+
+unsigned int kshim_dma_mappings(void)
+{
+    return nr_maps;
+}
+
+void *dma_alloc_coherent(struct device *dev, size_t size, dma_addr_t *handle, gfp_t gfp)
+{
+    void *cpu = aligned_alloc(PAGE_SIZE, ALIGN(size, PAGE_SIZE));
+
+    if (!cpu)
+        return NULL;
+    memset(cpu, 0, size);
+    *handle = iova_insert(cpu, size);
+    if (!*handle) {
+        free(cpu);
+        return NULL;
+    }
+    return cpu;
+}
+
+void dma_free_coherent(struct device *dev, size_t size, void *cpu, dma_addr_t handle)
+{
+    if (iova_remove(handle) == cpu)
+        free(cpu);
+}
+
+unsigned int kshim_dma_map_ns;
+
+dma_addr_t dma_map_single(struct device *dev, void *cpu, size_t size,
+                          enum dma_data_direction dir)
+{
+    u64 off = (uintptr_t)cpu & (PAGE_SIZE - 1);
+    dma_addr_t iova;
+
+    kshim_advance_ns(kshim_dma_map_ns);
+
+    /* Keep the offset into the page, like an IOMMU would */
+    iova = iova_insert((char *)cpu - off, size + off);
+    return iova ? iova + off : 0;
+}
+
+void dma_unmap_single(struct device *dev, dma_addr_t addr, size_t size,
+                      enum dma_data_direction dir)
+{
+    kshim_advance_ns(kshim_dma_map_ns);
+    iova_remove(addr & ~(dma_addr_t)(PAGE_SIZE - 1));
+}
+
+/* Work */
+
+struct workqueue_struct {
+    char name[32];
+};
+
+static struct workqueue_struct system_wqs[3] = {
+    { "events" }, { "events_highpri" }, { "events_unbound" },
+};
+struct workqueue_struct *system_wq = &system_wqs[0];
+struct workqueue_struct *system_highpri_wq = &system_wqs[1];
+struct workqueue_struct *system_unbound_wq = &system_wqs[2];
+
+static LIST_HEAD(work_list);
+static pthread_mutex_t work_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct workqueue_struct *alloc_workqueue(const char *fmt, unsigned int flags, int max_active, ...)
+{
+    struct workqueue_struct *wq = calloc(1, sizeof(*wq));
+
+    if (wq)
+        snprintf(wq->name, sizeof(wq->name), "%s", fmt);
+    return wq;
+}
+
+void destroy_workqueue(struct workqueue_struct *wq)
+{
+    kshim_run_work();
+    if (wq < system_wqs || wq >= system_wqs + ARRAY_SIZE(system_wqs))
+        free(wq);
+}
+
+void flush_workqueue(struct workqueue_struct *wq)
+{
+    kshim_run_work();
+}
+
+static bool work_queue_at(struct work_struct *work, u64 due, bool modify)
+{
+    bool queued;
+
+    pthread_mutex_lock(&work_lock);
+    queued = work->pending;
+    if (!queued) {
+        work->pending = true;
+        work->due_ns = due;
+        list_add_tail(&work->entry, &work_list);
+    } else if (modify) {
+        work->due_ns = due;
+    }
+    pthread_mutex_unlock(&work_lock);
+    return !queued;
+}
+
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work)
+{
+    return work_queue_at(work, kshim_now_ns(), false);
+}
+
+bool queue_delayed_work(struct workqueue_struct *wq, struct delayed_work *dw, unsigned long delay)
+{
+    return work_queue_at(&dw->work, kshim_now_ns() + delay * NSEC_PER_MSEC, false);
+}
+
+bool mod_delayed_work(struct workqueue_struct *wq, struct delayed_work *dw, unsigned long delay)
+{
+    return !work_queue_at(&dw->work, kshim_now_ns() + delay * NSEC_PER_MSEC, true);
+}
+
+bool cancel_work_sync(struct work_struct *work)
+{
+    bool was;
+
+    pthread_mutex_lock(&work_lock);
+    was = work->pending;
+    if (was) {
+        list_del_init(&work->entry);
+        work->pending = false;
+    }
+    pthread_mutex_unlock(&work_lock);
+    return was;
+}
+
+bool cancel_delayed_work(struct delayed_work *dw)
+{
+    return cancel_work_sync(&dw->work);
+}
+
+bool cancel_delayed_work_sync(struct delayed_work *dw)
+{
+    return cancel_work_sync(&dw->work);
+}
+
+unsigned int kshim_run_work(void)
+{
+    struct work_struct *work, *found;
+    unsigned int ran = 0;
+
+    for (;;) {
+        found = NULL;
+        pthread_mutex_lock(&work_lock);
+        list_for_each_entry(work, &work_list, entry) {
+            if (work->due_ns <= kshim_now_ns()) {
+                found = work;
+                list_del_init(&work->entry);
+                work->pending = false;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&work_lock);
+        if (!found)
+            return ran;
+        found->func(found);
+        ran++;
+    }
+}
@@ -0,0 +1,662 @@
+#ifndef KSHIM_H
+#define KSHIM_H
+
+/*
+ * Just enough of the kernel API to build driver files from src/kernel
+ * into a normal userspace binary. Every <linux/...> header the driver
+ * includes resolves to this file (see linux/).
+ *
+ * Time is virtual: ktime_get_ns() only moves when something waits
+ * (udelay, msleep, poll loops), when MMIO costs time on the simulated
+ * link, or when the harness calls kshim_advance_ns(). Runs are therefore
+ * reproducible on any machine. MMIO and DMA addresses are routed to the
+ * device registered with kshim_set_mmio(), see dma_engine.h.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Kernel-internal errno values userspace never sees */
+#ifndef ERESTARTSYS
+#define ERESTARTSYS 512
+#endif
+
+/* Types */
+typedef int8_t s8;
+typedef uint8_t u8;
+typedef int16_t s16;
+typedef uint16_t u16;
+typedef int32_t s32;
+typedef uint32_t u32;
+typedef long long s64;
+typedef unsigned long long u64;
+typedef uint64_t dma_addr_t;
+typedef uint64_t phys_addr_t;
+typedef uint64_t resource_size_t;
+typedef s64 ktime_t;
+typedef unsigned int gfp_t;
+
+#define __iomem
+#define __rcu
+#define __user
+#define __force
+#define __must_check
+#define __always_unused __attribute__((unused))
+#define __maybe_unused __attribute__((unused))
+#define __packed __attribute__((packed))
+#define __aligned(x) __attribute__((aligned(x)))
+#define __init
+#define __exit
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+/* Module glue */
+#define THIS_MODULE NULL
+#define EXPORT_SYMBOL(sym)
+#define EXPORT_SYMBOL_GPL(sym)
+#define MODULE_LICENSE(x)
+#define MODULE_AUTHOR(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_VERSION(x)
+#define MODULE_PARM_DESC(name, desc)
+#define module_param(name, type, perm)
+#define module_param_named(name, var, type, perm)
+
+/* Helpers */
+#define BIT(n) (1UL << (n))
+#define BIT_ULL(n) (1ULL << (n))
+#define U32_MAX ((u32)~0U)
+#define U64_MAX ((u64)~0ULL)
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+#define ALIGN(x, a) (((x) + (a) - 1) & ~((__typeof__(x))(a) - 1))
+#define is_power_of_2(n) ((n) != 0 && ((n) & ((n) - 1)) == 0)
+static inline unsigned long roundup_pow_of_two(unsigned long n)
+{
+    return n <= 1 ? 1 : 1UL << (64 - __builtin_clzl(n - 1));
+}
+#define ilog2(n) (63 - __builtin_clzl((unsigned long)(n)))
+#define order_base_2(n) ((n) <= 1 ? 0 : ilog2((n) - 1) + 1)
+static inline int fls64(u64 x) { return x ? 64 - __builtin_clzll(x) : 0; }
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (1UL << PAGE_SHIFT)
+#define NSEC_PER_USEC 1000ULL
+#define NSEC_PER_MSEC 1000000ULL
+#define NSEC_PER_SEC 1000000000ULL
+#define USEC_PER_MSEC 1000UL
+#define USEC_PER_SEC 1000000UL
+#define MSEC_PER_SEC 1000UL
+#define HZ 1000
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min3(a, b, c) min(min(a, b), c)
+#define min_t(t, a, b) ((t)(a) < (t)(b) ? (t)(a) : (t)(b))
+#define max_t(t, a, b) ((t)(a) > (t)(b) ? (t)(a) : (t)(b))
+#define clamp(v, lo, hi) min(max(v, lo), hi)
+#define clamp_t(t, v, lo, hi) min_t(t, max_t(t, v, lo), hi)
+#define swap(a, b) do { __typeof__(a) __t = (a); (a) = (b); (b) = __t; } while (0)
+#define container_of(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define READ_ONCE(x) (*(volatile __typeof__(x) *)&(x))
+#define WRITE_ONCE(x, v) (*(volatile __typeof__(x) *)&(x) = (v))
+#define barrier() __asm__ __volatile__("" ::: "memory")
+#define smp_mb() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define smp_rmb() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define smp_wmb() __atomic_thread_fence(__ATOMIC_RELEASE)
+/* As on x86, wmb() also orders non-temporal stores */
+#ifdef __x86_64__
+#define CONFIG_X86_64 1
+#define wmb() __asm__ __volatile__("sfence" ::: "memory")
+#else
+#define wmb() smp_wmb()
+#endif
+#define rmb() smp_rmb()
+#define dma_wmb() smp_wmb()
+#define dma_rmb() smp_rmb()
+#define smp_load_acquire(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define smp_store_release(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define L1_CACHE_BYTES 64
+#define prefetchw(p) __builtin_prefetch(p, 1)
+
+#define BUILD_BUG_ON(cond) _Static_assert(!(cond), #cond)
+#define WARN_ON(cond) ({ bool __c = !!(cond); \
+    if (__c) kshim_log(0, "WARN_ON(%s) at %s:%d\n", #cond, __FILE__, __LINE__); __c; })
+#define WARN_ON_ONCE(cond) WARN_ON(cond)
+#define BUG_ON(cond) do { if (cond) abort(); } while (0)
+#define might_sleep() do { } while (0)
+
+static inline u64 div_u64(u64 n, u32 d) { return n / d; }
+static inline s64 div_s64(s64 n, s32 d) { return n / d; }
+static inline u64 div64_u64(u64 n, u64 d) { return n / d; }
+static inline u64 mul_u64_u64_div_u64(u64 a, u64 b, u64 c)
+{
+    return (unsigned __int128)a * b / c;
+}
+static inline bool IS_ERR_OR_NULL(const void *p)
+{
+    return !p || (unsigned long)p >= (unsigned long)-4095;
+}
+
+/* Logging: errors always, the rest with kshim_verbose */
+extern int kshim_verbose;
+void kshim_log(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+#define KERN_ERR ""
+#define KERN_WARNING ""
+#define KERN_INFO ""
+#define KERN_DEBUG ""
+#define printk(fmt, ...) kshim_log(1, fmt, ##__VA_ARGS__)
+#define pr_err(fmt, ...) kshim_log(0, fmt, ##__VA_ARGS__)
+#define pr_warn(fmt, ...) kshim_log(1, fmt, ##__VA_ARGS__)
+#define pr_info(fmt, ...) kshim_log(2, fmt, ##__VA_ARGS__)
+#define pr_debug(fmt, ...) kshim_log(3, fmt, ##__VA_ARGS__)
+#define dev_err(dev, fmt, ...) kshim_log(0, fmt, ##__VA_ARGS__)
+#define dev_warn(dev, fmt, ...) kshim_log(1, fmt, ##__VA_ARGS__)
+#define dev_info(dev, fmt, ...) kshim_log(2, fmt, ##__VA_ARGS__)
+#define dev_dbg(dev, fmt, ...) kshim_log(3, fmt, ##__VA_ARGS__)
+
+/* Memory */
+#define GFP_KERNEL 0u
+#define GFP_ATOMIC 1u
+#define GFP_NOWAIT 2u
+#define __GFP_ZERO 0x100u
+#define __GFP_COMP 0x200u
+#define __GFP_NOWARN 0x400u
+#define __GFP_NORETRY 0x800u
+
+static inline void *kmalloc(size_t size, gfp_t gfp)
+{
+    return (gfp & __GFP_ZERO) ? calloc(1, size) : malloc(size);
+}
+static inline void *kzalloc(size_t size, gfp_t gfp) { return calloc(1, size); }
+static inline void *kcalloc(size_t n, size_t size, gfp_t gfp) { return calloc(n, size); }
+static inline void *kcalloc_node(size_t n, size_t size, gfp_t gfp, int node)
+{
+    return calloc(n, size);
+}
+static inline void *kmalloc_array(size_t n, size_t size, gfp_t gfp) { return calloc(n, size); }
+static inline void *kvzalloc(size_t size, gfp_t gfp) { return calloc(1, size); }
+static inline void *kvmalloc(size_t size, gfp_t gfp) { return malloc(size); }
+static inline void kfree(const void *p) { free((void *)p); }
+static inline void kvfree(const void *p) { free((void *)p); }
+static inline void *kvmalloc_node(size_t size, gfp_t gfp, int node) { return malloc(size); }
+static inline void *kvzalloc_node(size_t size, gfp_t gfp, int node) { return calloc(1, size); }
+static inline void *kmemdup(const void *src, size_t len, gfp_t gfp)
+{
+    void *p = malloc(len);
+
+    if (p)
+        memcpy(p, src, len);
+    return p;
+}
+/* Truncates like the kernel's: always terminated, -E2BIG if cut short */
+static inline long strscpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strnlen(src, size);
+
+    if (!size)
+        return -E2BIG;
+    if (len == size) {
+        memcpy(dst, src, size - 1);
+        dst[size - 1] = '\0';
+        return -E2BIG;
+    }
+    memcpy(dst, src, len + 1);
+    return len;
+}
+
+/* Atomics */
+typedef struct { int counter; } atomic_t;
+typedef struct { s64 counter; } atomic64_t;
+
+#define ATOMIC_INIT(i) { (i) }
+#define atomic_read(v) __atomic_load_n(&(v)->counter, __ATOMIC_RELAXED)
+#define atomic_set(v, i) __atomic_store_n(&(v)->counter, (i), __ATOMIC_RELAXED)
+#define atomic_add(i, v) ((void)__atomic_add_fetch(&(v)->counter, (i), __ATOMIC_SEQ_CST))
+#define atomic_sub(i, v) ((void)__atomic_sub_fetch(&(v)->counter, (i), __ATOMIC_SEQ_CST))
+#define atomic_inc(v) atomic_add(1, v)
+#define atomic_dec(v) atomic_sub(1, v)
+#define atomic_inc_return(v) __atomic_add_fetch(&(v)->counter, 1, __ATOMIC_SEQ_CST)
+#define atomic_dec_return(v) __atomic_sub_fetch(&(v)->counter, 1, __ATOMIC_SEQ_CST)
+#define atomic_dec_and_test(v) (atomic_dec_return(v) == 0)
+#define atomic_xchg(v, i) __atomic_exchange_n(&(v)->counter, (i), __ATOMIC_SEQ_CST)
+#define atomic64_read(v) atomic_read(v)
+#define atomic64_set(v, i) atomic_set(v, i)
+#define atomic64_add(i, v) atomic_add(i, v)
+#define atomic64_inc(v) atomic_inc(v)
+#define atomic64_xchg(v, i) atomic_xchg(v, i)
+
+/* Bit locks */
+#define test_and_set_bit_lock(nr, addr) \
+    ((__atomic_fetch_or((addr), BIT(nr), __ATOMIC_ACQUIRE) & BIT(nr)) != 0)
+#define clear_bit_unlock(nr, addr) ((void)__atomic_fetch_and((addr), ~BIT(nr), __ATOMIC_RELEASE))
+
+/* Locks; there are no interrupts, so the irq variants only lock */
+typedef struct { pthread_mutex_t m; } spinlock_t;
+typedef spinlock_t raw_spinlock_t;
+struct mutex { pthread_mutex_t m; };
+
+#define spin_lock_init(l) pthread_mutex_init(&(l)->m, NULL)
+#define spin_lock(l) pthread_mutex_lock(&(l)->m)
+#define spin_unlock(l) pthread_mutex_unlock(&(l)->m)
+#define spin_trylock(l) (pthread_mutex_trylock(&(l)->m) == 0)
+#define spin_lock_bh(l) spin_lock(l)
+#define spin_unlock_bh(l) spin_unlock(l)
+#define spin_lock_irq(l) spin_lock(l)
+#define spin_unlock_irq(l) spin_unlock(l)
+#define spin_lock_irqsave(l, flags) do { (flags) = 0; spin_lock(l); } while (0)
+#define spin_unlock_irqrestore(l, flags) do { (void)(flags); spin_unlock(l); } while (0)
+#define spin_trylock_irqsave(l, flags) ({ (flags) = 0; spin_trylock(l); })
+#define mutex_init(l) pthread_mutex_init(&(l)->m, NULL)
+#define mutex_lock(l) pthread_mutex_lock(&(l)->m)
+#define mutex_unlock(l) pthread_mutex_unlock(&(l)->m)
+#define mutex_trylock(l) (pthread_mutex_trylock(&(l)->m) == 0)
+#define mutex_destroy(l) pthread_mutex_destroy(&(l)->m)
+#define lockdep_assert_held(l) do { } while (0)
+#define irqs_disabled() 0
+#define local_irq_save(flags) do { (flags) = 0; } while (0)
+#define local_irq_restore(flags) do { (void)(flags); } while (0)
+
+/*
+ * One CPU. Per-CPU data is only safe for single-threaded callers, which
+ * is how the sims and benchmarks drive it.
+ */
+#define nr_cpu_ids 1u
+#define for_each_possible_cpu(cpu) for ((cpu) = 0; (cpu) < 1; (cpu)++)
+#define smp_processor_id() 0
+#define raw_smp_processor_id() 0
+#define cpu_to_node(cpu) 0
+#define preempt_disable() do { } while (0)
+#define preempt_enable() do { } while (0)
+#define __percpu
+#define alloc_percpu(type) ((type *)calloc(1, sizeof(type)))
+#define free_percpu(p) free(p)
+#define per_cpu_ptr(p, cpu) ((void)(cpu), (p))
+#define this_cpu_ptr(p) (p)
+#define get_cpu_ptr(p) (p)
+#define put_cpu_ptr(p) do { } while (0)
+
+typedef struct { unsigned int sequence; spinlock_t lock; } seqlock_t;
+typedef struct { unsigned int sequence; } seqcount_t;
+#define seqlock_init(sl) do { (sl)->sequence = 0; spin_lock_init(&(sl)->lock); } while (0)
+#define seqcount_init(s) do { (s)->sequence = 0; } while (0)
+
+static inline unsigned int read_seqcount_begin(const seqcount_t *s)
+{
+    unsigned int seq;
+
+    while ((seq = __atomic_load_n(&s->sequence, __ATOMIC_ACQUIRE)) & 1)
+        ;
+    return seq;
+}
+
+static inline int read_seqcount_retry(const seqcount_t *s, unsigned int start)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&s->sequence, __ATOMIC_RELAXED) != start;
+}
+
+static inline void write_seqcount_begin(seqcount_t *s)
+{
+    __atomic_store_n(&s->sequence, s->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void write_seqcount_end(seqcount_t *s)
+{
+    __atomic_store_n(&s->sequence, s->sequence + 1, __ATOMIC_RELEASE);
+}
+
+/* Lists */
+struct list_head { struct list_head *next, *prev; };
+struct hlist_node { struct hlist_node *next, **pprev; };
+#define LIST_HEAD_INIT(name) { &(name), &(name) }
+#define LIST_HEAD(name) struct list_head name = LIST_HEAD_INIT(name)
+static inline void INIT_LIST_HEAD(struct list_head *l) { l->next = l; l->prev = l; }
+static inline bool list_empty(const struct list_head *l) { return l->next == l; }
+static inline void list_add_tail(struct list_head *n, struct list_head *h)
+{
+    n->prev = h->prev;
+    n->next = h;
+    h->prev->next = n;
+    h->prev = n;
+}
+static inline void list_add(struct list_head *n, struct list_head *h)
+{
+    n->next = h->next;
+    n->prev = h;
+    h->next->prev = n;
+    h->next = n;
+}
+static inline void list_del(struct list_head *n)
+{
+    n->prev->next = n->next;
+    n->next->prev = n->prev;
+    n->next = n->prev = NULL;
+}
+static inline void list_del_init(struct list_head *n)
+{
+    list_del(n);
+    INIT_LIST_HEAD(n);
+}
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+#define list_first_entry(h, type, member) list_entry((h)->next, type, member)
+#define list_for_each_entry(pos, head, member)                                   \
+    for (pos = list_entry((head)->next, __typeof__(*pos), member);               \
+         &pos->member != (head);                                                 \
+         pos = list_entry(pos->member.next, __typeof__(*pos), member))
+#define list_for_each_entry_safe(pos, n, head, member)                           \
+    for (pos = list_entry((head)->next, __typeof__(*pos), member),               \
+         n = list_entry(pos->member.next, __typeof__(*pos), member);             \
+         &pos->member != (head);                                                 \
+         pos = n, n = list_entry(n->member.next, __typeof__(*n), member))
+
+/* RCU, single copy semantics are enough here */
+struct rcu_head { struct rcu_head *next; void (*func)(struct rcu_head *); };
+#define rcu_read_lock() do { } while (0)
+#define rcu_read_unlock() do { } while (0)
+#define rcu_dereference(p) READ_ONCE(p)
+#define rcu_dereference_protected(p, c) (p)
+#define rcu_access_pointer(p) READ_ONCE(p)
+#define rcu_assign_pointer(p, v) smp_store_release(&(p), (v))
+#define RCU_INIT_POINTER(p, v) ((p) = (v))
+#define synchronize_rcu() do { } while (0)
+#define kfree_rcu(p, field) kfree(p)
+
+/* SRCU has nothing to wait for with one thread; krefs are plain counts */
+struct srcu_struct { int unused; };
+static inline int init_srcu_struct(struct srcu_struct *ssp) { return 0; }
+#define cleanup_srcu_struct(ssp) do { } while (0)
+#define srcu_read_lock(ssp) 0
+#define srcu_read_unlock(ssp, idx) do { (void)(idx); } while (0)
+#define synchronize_srcu(ssp) do { } while (0)
+
+struct kref { atomic_t refcount; };
+static inline void kref_init(struct kref *kref) { atomic_set(&kref->refcount, 1); }
+static inline void kref_get(struct kref *kref) { atomic_inc(&kref->refcount); }
+static inline int kref_put(struct kref *kref, void (*release)(struct kref *kref))
+{
+    if (!atomic_dec_and_test(&kref->refcount))
+        return 0;
+    release(kref);
+    return 1;
+}
+
+/* Time */
+u64 kshim_now_ns(void);
+void kshim_advance_ns(u64 ns);
+static inline u64 ktime_get_ns(void) { return kshim_now_ns(); }
+static inline u64 ktime_get_raw_ns(void) { return kshim_now_ns(); }
+static inline ktime_t ktime_get(void) { return (ktime_t)kshim_now_ns(); }
+static inline ktime_t ktime_get_boottime(void) { return ktime_get(); }
+static inline s64 ktime_to_ns(ktime_t t) { return t; }
+static inline s64 ktime_to_us(ktime_t t) { return t / 1000; }
+static inline s64 ktime_to_ms(ktime_t t) { return t / 1000000; }
+static inline ktime_t ns_to_ktime(u64 ns) { return (ktime_t)ns; }
+static inline ktime_t ktime_sub(ktime_t a, ktime_t b) { return a - b; }
+static inline ktime_t ktime_add_ns(ktime_t t, u64 ns) { return t + (ktime_t)ns; }
+static inline s64 ktime_us_delta(ktime_t a, ktime_t b) { return (a - b) / 1000; }
+static inline s64 ktime_ms_delta(ktime_t a, ktime_t b) { return (a - b) / 1000000; }
+static inline bool ktime_after(ktime_t a, ktime_t b) { return a > b; }
+static inline bool ktime_before(ktime_t a, ktime_t b) { return a < b; }
+
+#define jiffies ((unsigned long)(kshim_now_ns() / NSEC_PER_MSEC))
+static inline unsigned long msecs_to_jiffies(unsigned int ms) { return ms; }
+static inline unsigned long usecs_to_jiffies(unsigned int us) { return DIV_ROUND_UP(us, 1000); }
+static inline unsigned int jiffies_to_msecs(unsigned long j) { return j; }
+#define time_after(a, b) ((long)((b) - (a)) < 0)
+#define time_before(a, b) time_after(b, a)
+#define time_after_eq(a, b) ((long)((a) - (b)) >= 0)
+#define time_before_eq(a, b) time_after_eq(b, a)
+
+static inline void ndelay(unsigned long ns) { kshim_advance_ns(ns); }
+static inline void udelay(unsigned long us) { kshim_advance_ns(us * NSEC_PER_USEC); }
+static inline void mdelay(unsigned long ms) { kshim_advance_ns(ms * NSEC_PER_MSEC); }
+static inline void msleep(unsigned int ms) { kshim_advance_ns(ms * NSEC_PER_MSEC); }
+static inline void usleep_range(unsigned long lo, unsigned long hi) { udelay(lo); }
+static inline void fsleep(unsigned long us) { udelay(us); }
+static inline void cpu_relax(void) { }
+static inline void cond_resched(void) { }
+
+/* MMIO, dispatched to the simulated device; each access costs link time */
+struct kshim_mmio_ops {
+    u32 (*read)(void *ctx, u64 offset);
+    void (*write)(void *ctx, u64 offset, u32 val);
+    /* Optional, once time reaches the kshim_mmio_tick_at() deadline; returns the next */
+    u64 (*tick)(void *ctx, u64 now_ns);
+};
+void kshim_set_mmio(void __iomem *base, u64 size, const struct kshim_mmio_ops *ops, void *ctx);
+void kshim_mmio_tick_at(u64 ns);
+u32 kshim_readl(const volatile void __iomem *addr);
+void kshim_writel(u32 val, volatile void __iomem *addr);
+#define readl(addr) kshim_readl(addr)
+#define writel(val, addr) kshim_writel((u32)(val), addr)
+#define readl_relaxed(addr) readl(addr)
+#define writel_relaxed(val, addr) writel(val, addr)
+#define ioread32(addr) readl(addr)
+#define iowrite32(val, addr) writel(val, addr)
+static inline void __iowrite32_copy(void __iomem *to, const void *from, size_t count)
+{
+    u32 __iomem *dst = to;
+    const u32 *src = from;
+    size_t i;
+
+    for (i = 0; i < count; i++)
+        writel(src[i], dst + i);
+}
+
+/* Bulk copies only ever target host memory standing in for a BAR */
+#define memcpy_toio(dst, src, len) memcpy((void __force *)(dst), src, len)
+
+#define read_poll_timeout(op, val, cond, sleep_us, timeout_us, sleep_before_read, args...) \
+({                                                                               \
+    u64 __deadline = kshim_now_ns() + (u64)(timeout_us) * NSEC_PER_USEC;         \
+    if (sleep_before_read)                                                       \
+        udelay(sleep_us);                                                        \
+    for (;;) {                                                                   \
+        (val) = op(args);                                                        \
+        if (cond)                                                                \
+            break;                                                               \
+        if ((timeout_us) && kshim_now_ns() > __deadline) {                       \
+            (val) = op(args);                                                    \
+            break;                                                               \
+        }                                                                        \
+        udelay((sleep_us) ? (sleep_us) : 1);                                     \
+    }                                                                            \
+    (cond) ? 0 : -ETIMEDOUT;                                                     \
+})
+#define readx_poll_timeout(op, addr, val, cond, sleep_us, timeout_us) \
+    read_poll_timeout(op, val, cond, sleep_us, timeout_us, false, addr)
+#define readl_poll_timeout(addr, val, cond, delay_us, timeout_us) \
+    readx_poll_timeout(kshim_readl, addr, val, cond, delay_us, timeout_us)
+#define readl_poll_timeout_atomic readl_poll_timeout
+
+/* Devices */
+struct device {
+    const char *init_name;
+    void *driver_data;
+};
+struct pci_dev {
+    struct device dev;
+    u16 vendor;
+    u16 device;
+    int mps;                        /* Max payload, bytes */
+    int readrq;                     /* Max read request, bytes */
+};
+static inline void *dev_get_drvdata(const struct device *dev) { return dev->driver_data; }
+static inline void dev_set_drvdata(struct device *dev, void *data) { dev->driver_data = data; }
+static inline const char *dev_name(const struct device *dev) { return dev->init_name; }
+static inline int pcie_get_mps(struct pci_dev *pdev) { return pdev->mps; }
+static inline int pcie_get_readrq(struct pci_dev *pdev) { return pdev->readrq; }
+/* The simulated device sits directly on the root bus */
+static inline struct pci_dev *pci_upstream_bridge(struct pci_dev *pdev) { return NULL; }
+/* BARs other than the registers handed to kshim_set_mmio() do not exist */
+#define IORESOURCE_MEM      0x00000200
+#define IORESOURCE_PREFETCH 0x00002000
+static inline resource_size_t pci_resource_len(struct pci_dev *pdev, int bar) { return 0; }
+static inline unsigned long pci_resource_flags(struct pci_dev *pdev, int bar) { return 0; }
+static inline void __iomem *pci_iomap(struct pci_dev *pdev, int bar, unsigned long max)
+{
+    return NULL;
+}
+#define pci_iomap_wc pci_iomap
+static inline void __iomem *pci_iomap_range(struct pci_dev *pdev, int bar,
+                                            unsigned long off, unsigned long max)
+{
+    return NULL;
+}
+#define pci_iomap_wc_range pci_iomap_range
+static inline void pci_iounmap(struct pci_dev *pdev, void __iomem *addr) { }
+static inline void __iomem *ioremap_wc(resource_size_t phys, size_t size) { return NULL; }
+static inline void iounmap(volatile void __iomem *addr) { }
+
+struct dentry;
+struct file_operations;
+struct miscdevice {
+    int minor;
+    const char *name;
+    const struct file_operations *fops;
+};
+
+/* Thunderbolt, only ever used through pointers here */
+struct tb_port;
+struct tb_ring;
+/* A service with no XDomain parent, as in test mode */
+struct tb_xdomain {
+    unsigned int link_speed;        /* Gb/s per lane */
+    unsigned int link_width;        /* Lanes */
+    u64 route;
+};
+struct tb_service {
+    struct device dev;
+};
+static inline struct tb_xdomain *tb_service_parent(struct tb_service *svc) { return NULL; }
+
+/* DMA: coherent and streaming mappings get an IOVA below 4G */
+enum dma_data_direction {
+    DMA_BIDIRECTIONAL = 0,
+    DMA_TO_DEVICE = 1,
+    DMA_FROM_DEVICE = 2,
+    DMA_NONE = 3,
+};
+void *dma_alloc_coherent(struct device *dev, size_t size, dma_addr_t *handle, gfp_t gfp);
+void dma_free_coherent(struct device *dev, size_t size, void *cpu, dma_addr_t handle);
+dma_addr_t dma_map_single(struct device *dev, void *cpu, size_t size,
+                          enum dma_data_direction dir);
+void dma_unmap_single(struct device *dev, dma_addr_t addr, size_t size,
+                      enum dma_data_direction dir);
+static inline int dma_mapping_error(struct device *dev, dma_addr_t addr) { return addr == 0; }
+
+/* Pages: a struct page pointer is the address of the memory itself */
+struct page;
+#define NUMA_NO_NODE (-1)
+#define dev_to_node(dev) NUMA_NO_NODE
+static inline struct page *alloc_pages_node(int node, gfp_t gfp, unsigned int order)
+{
+    void *p = aligned_alloc(PAGE_SIZE, PAGE_SIZE << order);
+
+    if (p && (gfp & __GFP_ZERO))
+        memset(p, 0, PAGE_SIZE << order);
+    return p;
+}
+static inline void __free_pages(struct page *page, unsigned int order) { free(page); }
+static inline void *page_address(const struct page *page) { return (void *)page; }
+static inline dma_addr_t dma_map_page(struct device *dev, struct page *page, size_t off,
+                                      size_t size, enum dma_data_direction dir)
+{
+    return dma_map_single(dev, (char *)page_address(page) + off, size, dir);
+}
+#define dma_unmap_page(dev, addr, size, dir) dma_unmap_single(dev, addr, size, dir)
+/* Host and device share one coherent memory here */
+#define dma_sync_single_for_device(dev, addr, size, dir) do { } while (0)
+#define dma_sync_single_for_cpu(dev, addr, size, dir) do { } while (0)
+
+/* Host memory behind @addr, NULL if nothing is mapped there */
+void *kshim_dma_to_virt(dma_addr_t addr, size_t len);
+unsigned int kshim_dma_mappings(void);
+
+/* Virtual time each streaming map and unmap takes, IOMMU and IOTLB work; 0 by default */
+extern unsigned int kshim_dma_map_ns;
+
+/* Work: queued items run on the next kshim_run_work() */
+struct workqueue_struct;
+struct work_struct;
+typedef void (*work_func_t)(struct work_struct *work);
+struct work_struct {
+    struct list_head entry;
+    work_func_t func;
+    bool pending;
+    u64 due_ns;
+};
+struct delayed_work {
+    struct work_struct work;
+};
+#define WQ_HIGHPRI (1u << 4)
+#define WQ_UNBOUND (1u << 1)
+#define WQ_MEM_RECLAIM (1u << 3)
+#define WQ_FREEZABLE (1u << 2)
+extern struct workqueue_struct *system_wq;
+extern struct workqueue_struct *system_highpri_wq;
+extern struct workqueue_struct *system_unbound_wq;
+#define INIT_WORK(w, fn) \
+    do { INIT_LIST_HEAD(&(w)->entry); (w)->func = (fn); (w)->pending = false; } while (0)
+#define INIT_DELAYED_WORK(dw, fn) INIT_WORK(&(dw)->work, fn)
+#define to_delayed_work(w) container_of(w, struct delayed_work, work)
+struct workqueue_struct *alloc_workqueue(const char *fmt, unsigned int flags, int max_active, ...);
+#define create_singlethread_workqueue(name) alloc_workqueue(name, 0, 1)
+#define alloc_ordered_workqueue(name, flags) alloc_workqueue(name, flags, 1)
+void destroy_workqueue(struct workqueue_struct *wq);
+void flush_workqueue(struct workqueue_struct *wq);
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work);
+bool queue_delayed_work(struct workqueue_struct *wq, struct delayed_work *dw, unsigned long delay);
+bool mod_delayed_work(struct workqueue_struct *wq, struct delayed_work *dw, unsigned long delay);
+bool cancel_work_sync(struct work_struct *work);
+bool cancel_delayed_work(struct delayed_work *dw);
+bool cancel_delayed_work_sync(struct delayed_work *dw);
+#define schedule_work(w) queue_work(system_wq, w)
+#define schedule_delayed_work(dw, d) queue_delayed_work(system_wq, dw, d)
+#define flush_work(w) kshim_run_work()
+/* Run everything due at the current virtual time; returns items run */
+unsigned int kshim_run_work(void);
+
+/* Wait queues and completions; the harness is the only other party */
+typedef struct { int unused; } wait_queue_head_t;
+#define init_waitqueue_head(wq) do { (void)(wq); } while (0)
+#define wake_up(wq) do { (void)(wq); } while (0)
+#define wake_up_interruptible(wq) do { (void)(wq); } while (0)
+#define wake_up_all(wq) do { (void)(wq); } while (0)
+/* Nobody else can wake us, so the wait always runs to its timeout */
+#define wait_event_interruptible_hrtimeout(wq, cond, timeout) ({            \
+    if (!(cond))                                                            \
+        kshim_advance_ns(ktime_to_ns(timeout));                             \
+    (cond) ? 0 : -ETIME;                                                    \
+})
+struct completion { unsigned int done; };
+#define init_completion(c) ((c)->done = 0)
+#define complete(c) ((c)->done++)
+#define complete_all(c) ((c)->done = UINT_MAX)
+
+/* hrtimers are not run; nothing built here arms one */
+enum hrtimer_restart { HRTIMER_NORESTART, HRTIMER_RESTART };
+enum hrtimer_mode { HRTIMER_MODE_ABS, HRTIMER_MODE_REL };
+struct hrtimer {
+    enum hrtimer_restart (*function)(struct hrtimer *);
+    ktime_t expires;
+};
+
+/* Tracepoints compile to empty inlines; the header is never instantiated */
+#define TP_PROTO(args...) args
+#define TP_ARGS(args...) args
+#define TRACE_EVENT(name, proto, args, tstruct, assign, print) \
+    static inline void trace_##name(proto) {}
+
+#endif /* KSHIM_H */
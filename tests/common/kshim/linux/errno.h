@@ -0,0 +1,3 @@
+/* libc includes this one too, so chain to the real header first */
+#include_next <linux/errno.h>
+#include "../kshim.h"
@@ -0,0 +1,3 @@
+/* See kshim.h, the _IO* encoding is the real one so numbers match the driver */
+#include "../kshim.h"
+#include <asm/ioctl.h>
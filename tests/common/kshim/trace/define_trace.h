@@ -0,0 +1 @@
+/* See kshim.h, nothing to instantiate */
@@ -0,0 +1,625 @@
+#include "anarchy-ioctl-mock.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Shared SQ/CQ state, the driver's anarchy_queue equivalent */
+struct mock_queue {
+    void *mem;
+    size_t mem_size;
+    struct anarchy_queue_ring *sq;
+    struct anarchy_queue_ring *cq;
+    struct anarchy_sqe *sqes;
+    struct anarchy_cqe *cqes;
+    uint8_t *data;
+    uint32_t data_size;
+    uint32_t sq_entries;
+    uint32_t cq_entries;
+    uint32_t sq_head;
+    uint32_t cq_tail;
+    uint32_t flags;
+    uint32_t sq_idle_ms;
+
+    /* SQPOLL emulation */
+    pthread_t thread;
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t sq_cond;
+    pthread_cond_t cq_cond;
+};
+
+struct anarchy_mock_driver {
+    /* ABI */
+    uint32_t abi_major;
+
+    /* Configuration in effect */
+    struct anarchy_ioc_config config;
+    uint32_t fail_field;
+
+    /* Device state */
+    bool link_up;
+    bool connected;
+    uint64_t tx_bytes;
+    uint32_t transfer_errors;
+    int temperature;
+    uint32_t gpu_utilization;
+    uint32_t power_draw;
+    uint32_t pcie_errors;
+
+    /* Event subscription */
+    uint32_t event_mask;
+    bool overflow;
+    struct anarchy_ioc_event events[MOCK_EVENT_QUEUE_LEN];
+    unsigned int event_head;
+    unsigned int event_count;
+
+    /* Stand-ins for the bounce page and a descriptor buffer */
+    uint8_t bounce[MOCK_DMA_PAGE];
+    uint8_t desc_buffer[MOCK_DMA_PAGE];
+
+    struct mock_queue *queue;
+};
+
+static uint64_t mock_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct anarchy_mock_driver *anarchy_mock_create(void) {
+    struct anarchy_mock_driver *drv = calloc(1, sizeof(*drv));
+    if (!drv)
+        return NULL;
+
+    drv->abi_major = ANARCHY_ABI_MAJOR;
+    drv->config.valid = ANARCHY_CFG_ALL;
+    drv->config.dma_channels = 8;
+    drv->config.ring_size = 256;
+    drv->config.link_speed = 0;
+    drv->config.tb_timeout_ms = 1000;
+    drv->link_up = true;
+    drv->connected = true;
+    drv->temperature = 45;
+    return drv;
+}
+
+static void mock_queue_destroy(struct mock_queue *q);
+
+void anarchy_mock_destroy(struct anarchy_mock_driver *drv) {
+    if (drv)
+        mock_queue_destroy(drv->queue);
+    free(drv);
+}
+
+void anarchy_mock_post_event(struct anarchy_mock_driver *drv, uint32_t type,
+                             uint64_t data0, uint64_t data1) {
+    struct anarchy_ioc_event *ev;
+
+    if (!drv || !(drv->event_mask & type))
+        return;
+
+    if (drv->event_count == MOCK_EVENT_QUEUE_LEN) {
+        drv->overflow = true;
+        return;
+    }
+
+    ev = &drv->events[(drv->event_head + drv->event_count) % MOCK_EVENT_QUEUE_LEN];
+    memset(ev, 0, sizeof(*ev));
+    ev->type = type;
+    ev->timestamp_ns = mock_now_ns();
+    ev->data[0] = data0;
+    ev->data[1] = data1;
+    drv->event_count++;
+}
+
+static int mock_fail(int err) {
+    errno = err;
+    return -1;
+}
+
+/* Same rules as the driver's cfg_validate() */
+static int mock_validate(const struct anarchy_ioc_config *cfg, uint32_t *failed) {
+    if (cfg->valid & ~ANARCHY_CFG_ALL) {
+        *failed = cfg->valid & ~ANARCHY_CFG_ALL;
+        return -1;
+    }
+    if ((cfg->valid & ANARCHY_CFG_DMA_CHANNELS) &&
+        (cfg->dma_channels < ANARCHY_CFG_MIN_DMA_CHANNELS ||
+         cfg->dma_channels > ANARCHY_CFG_MAX_DMA_CHANNELS)) {
+        *failed = ANARCHY_CFG_DMA_CHANNELS;
+        return -1;
+    }
+    if ((cfg->valid & ANARCHY_CFG_RING_SIZE) &&
+        (cfg->ring_size < ANARCHY_CFG_MIN_RING_SIZE ||
+         cfg->ring_size > ANARCHY_CFG_MAX_RING_SIZE ||
+         (cfg->ring_size & (cfg->ring_size - 1)))) {
+        *failed = ANARCHY_CFG_RING_SIZE;
+        return -1;
+    }
+    if ((cfg->valid & ANARCHY_CFG_LINK_SPEED) &&
+        cfg->link_speed > ANARCHY_CFG_MAX_LINK_SPEED) {
+        *failed = ANARCHY_CFG_LINK_SPEED;
+        return -1;
+    }
+    if ((cfg->valid & ANARCHY_CFG_TB_TIMEOUT) &&
+        (cfg->tb_timeout_ms < ANARCHY_CFG_MIN_TB_TIMEOUT ||
+         cfg->tb_timeout_ms > ANARCHY_CFG_MAX_TB_TIMEOUT)) {
+        *failed = ANARCHY_CFG_TB_TIMEOUT;
+        return -1;
+    }
+    return 0;
+}
+
+static int mock_apply_config(struct anarchy_mock_driver *drv, struct anarchy_ioc_config *cfg) {
+    struct anarchy_ioc_config next = drv->config;
+    uint32_t ready_us = MOCK_READY_US_BASE;
+
+    cfg->failed_field = 0;
+    cfg->ready_time_us = 0;
+
+    if (mock_validate(cfg, &cfg->failed_field))
+        return mock_fail(EINVAL);
+
+    if (cfg->valid & drv->fail_field) {
+        /* Injected apply failure: nothing changes, as after a rollback */
+        cfg->failed_field = drv->fail_field;
+        drv->fail_field = 0;
+        return mock_fail(EIO);
+    }
+
+    if (cfg->valid & ANARCHY_CFG_DMA_CHANNELS)
+        next.dma_channels = cfg->dma_channels;
+    if (cfg->valid & ANARCHY_CFG_RING_SIZE) {
+        if (cfg->ring_size != next.ring_size)
+            ready_us += MOCK_READY_US_RING_REBUILD;
+        next.ring_size = cfg->ring_size;
+    }
+    if (cfg->valid & ANARCHY_CFG_LINK_SPEED) {
+        if (cfg->link_speed != next.link_speed)
+            ready_us += MOCK_READY_US_RETRAIN;
+        next.link_speed = cfg->link_speed;
+    }
+    if (cfg->valid & ANARCHY_CFG_TB_TIMEOUT)
+        next.tb_timeout_ms = cfg->tb_timeout_ms;
+
+    if (!drv->link_up) {
+        /* Readiness wait times out, the driver rolls everything back */
+        cfg->failed_field = cfg->valid;
+        return mock_fail(ETIMEDOUT);
+    }
+
+    drv->config = next;
+    cfg->ready_time_us = ready_us;
+    anarchy_mock_post_event(drv, ANARCHY_EVENT_CONFIG_CHANGED, cfg->valid, ready_us);
+    return 0;
+}
+
+static int mock_get_stats(struct anarchy_mock_driver *drv, struct anarchy_ioc_stats *user) {
+    struct anarchy_ioc_stats st;
+    uint32_t size = user->size;
+
+    if (size < offsetof(struct anarchy_ioc_stats, timestamp_ns) + sizeof(st.timestamp_ns))
+        return mock_fail(EINVAL);
+
+    memset(&st, 0, sizeof(st));
+    st.timestamp_ns = mock_now_ns();
+    if (drv->link_up)
+        st.flags |= ANARCHY_STATS_LINK_UP;
+    if (drv->connected)
+        st.flags |= ANARCHY_STATS_CONNECTED;
+    if (drv->temperature >= MOCK_TEMP_CRITICAL)
+        st.flags |= ANARCHY_STATS_THROTTLING;
+
+    st.tx_bytes = __atomic_load_n(&drv->tx_bytes, __ATOMIC_RELAXED);
+    st.transfer_errors = __atomic_load_n(&drv->transfer_errors, __ATOMIC_RELAXED);
+    st.dma_channels = drv->config.dma_channels;
+    st.ring_size = drv->config.ring_size;
+    st.link_speed = drv->config.link_speed ? drv->config.link_speed : ANARCHY_CFG_MAX_LINK_SPEED;
+    st.link_width = 4;
+    st.pcie_errors = drv->pcie_errors;
+    st.gpu_utilization = drv->gpu_utilization;
+    st.temperature = drv->temperature;
+    st.power_draw = drv->power_draw;
+    st.tb_link_speed = 40;
+    st.tb_hop_count = 1;
+    strncpy(st.tb_device_path, "0-1", sizeof(st.tb_device_path) - 1);
+
+    st.size = size < sizeof(st) ? size : sizeof(st);
+    memcpy(user, &st, st.size);
+    return 0;
+}
+
+/* One descriptor's worth of data into the ring, like anarchy_ring_transfer() */
+static int mock_ring_transfer(struct anarchy_mock_driver *drv, const void *data, size_t size) {
+    if (!drv->link_up)
+        return -EIO;
+
+    memcpy(drv->desc_buffer, data, size);
+    __atomic_fetch_add(&drv->tx_bytes, size, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static int mock_submit_dma(struct anarchy_mock_driver *drv, const struct anarchy_ioc_dma *req) {
+    const uint8_t *src = (const uint8_t *)(uintptr_t)req->addr;
+    size_t done = 0, chunk;
+
+    if (!req->size || req->flags != ANARCHY_DMA_TO_DEVICE || !req->addr)
+        return mock_fail(EINVAL);
+
+    /* Page-sized copy_from_user() into the bounce buffer, then the ring */
+    while (done < req->size) {
+        chunk = req->size - done < MOCK_DMA_PAGE ? req->size - done : MOCK_DMA_PAGE;
+        memcpy(drv->bounce, src + done, chunk);
+        if (mock_ring_transfer(drv, drv->bounce, chunk)) {
+            __atomic_fetch_add(&drv->transfer_errors, 1, __ATOMIC_RELAXED);
+            return mock_fail(EIO);
+        }
+        done += chunk;
+    }
+
+    anarchy_mock_post_event(drv, ANARCHY_EVENT_DMA_COMPLETE, req->cookie, req->size);
+    return 0;
+}
+
+static uint32_t mock_cq_count(struct mock_queue *q) {
+    return q->cq_tail - __atomic_load_n(&q->cq->head, __ATOMIC_ACQUIRE);
+}
+
+static bool mock_sq_pending(struct mock_queue *q) {
+    return __atomic_load_n(&q->sq->tail, __ATOMIC_ACQUIRE) != q->sq_head;
+}
+
+static void mock_queue_complete(struct mock_queue *q, uint64_t cookie, int32_t result) {
+    struct anarchy_cqe *cqe;
+
+    if (mock_cq_count(q) >= q->cq_entries) {
+        q->cq->dropped++;
+        return;
+    }
+
+    cqe = &q->cqes[q->cq_tail & (q->cq_entries - 1)];
+    cqe->cookie = cookie;
+    cqe->result = result;
+    cqe->flags = 0;
+    q->cq_tail++;
+    __atomic_store_n(&q->cq->tail, q->cq_tail, __ATOMIC_RELEASE);
+}
+
+/* Same rules as anarchy_queue_drain(); caller holds q->lock */
+static unsigned int mock_queue_drain(struct anarchy_mock_driver *drv, unsigned int max) {
+    struct mock_queue *q = drv->queue;
+    struct anarchy_sqe sqe;
+    unsigned int done = 0;
+    size_t offset, chunk;
+    uint32_t tail;
+    int ret;
+
+    tail = __atomic_load_n(&q->sq->tail, __ATOMIC_ACQUIRE);
+    if (tail - q->sq_head > q->sq_entries) {
+        q->sq->dropped++;
+        tail = q->sq_head + q->sq_entries;
+    }
+
+    while (q->sq_head != tail && (!max || done < max)) {
+        memcpy(&sqe, &q->sqes[q->sq_head & (q->sq_entries - 1)], sizeof(sqe));
+
+        ret = 0;
+        if (!sqe.size || sqe.flags != ANARCHY_DMA_TO_DEVICE ||
+            sqe.data_offset > q->data_size || sqe.size > q->data_size - sqe.data_offset)
+            ret = -EINVAL;
+
+        for (offset = 0; !ret && offset < sqe.size; offset += chunk) {
+            chunk = sqe.size - offset < MOCK_DMA_PAGE ? sqe.size - offset : MOCK_DMA_PAGE;
+            ret = mock_ring_transfer(drv, q->data + sqe.data_offset + offset, chunk);
+        }
+        if (ret)
+            __atomic_fetch_add(&drv->transfer_errors, 1, __ATOMIC_RELAXED);
+
+        mock_queue_complete(q, sqe.cookie, ret ? ret : (int32_t)sqe.size);
+        q->sq_head++;
+        done++;
+    }
+
+    if (done) {
+        __atomic_store_n(&q->sq->head, q->sq_head, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&q->cq_cond);
+    }
+    return done;
+}
+
+static void *mock_queue_sq_thread(void *arg) {
+    struct anarchy_mock_driver *drv = arg;
+    struct mock_queue *q = drv->queue;
+    uint64_t idle_until = mock_now_ns() + q->sq_idle_ms * 1000000ULL;
+
+    pthread_mutex_lock(&q->lock);
+    while (!q->stop) {
+        if (mock_queue_drain(drv, 0)) {
+            idle_until = mock_now_ns() + q->sq_idle_ms * 1000000ULL;
+            /* Let QUEUE_ENTER waiters in between batches */
+            pthread_mutex_unlock(&q->lock);
+            pthread_mutex_lock(&q->lock);
+            continue;
+        }
+
+        if (mock_now_ns() < idle_until) {
+            pthread_mutex_unlock(&q->lock);
+            sched_yield();
+            pthread_mutex_lock(&q->lock);
+            continue;
+        }
+
+        __atomic_fetch_or(&q->sq->flags, ANARCHY_SQ_NEED_WAKEUP, __ATOMIC_SEQ_CST);
+        while (!q->stop && !mock_sq_pending(q))
+            pthread_cond_wait(&q->sq_cond, &q->lock);
+        __atomic_fetch_and(&q->sq->flags, ~ANARCHY_SQ_NEED_WAKEUP, __ATOMIC_SEQ_CST);
+        idle_until = mock_now_ns() + q->sq_idle_ms * 1000000ULL;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return NULL;
+}
+
+static void mock_queue_destroy(struct mock_queue *q) {
+    if (!q)
+        return;
+
+    if (q->flags & ANARCHY_QUEUE_SQPOLL) {
+        pthread_mutex_lock(&q->lock);
+        q->stop = true;
+        pthread_cond_signal(&q->sq_cond);
+        pthread_mutex_unlock(&q->lock);
+        pthread_join(q->thread, NULL);
+    }
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->sq_cond);
+    pthread_cond_destroy(&q->cq_cond);
+    free(q->mem);
+    free(q);
+}
+
+/* Layout and limits follow anarchy_queue_create() */
+static int mock_queue_setup(struct anarchy_mock_driver *drv, struct anarchy_ioc_queue_setup *setup) {
+    struct mock_queue *q;
+    uint32_t entries, data_size;
+    size_t sqes_off, cqes_off, data_off;
+
+    if (drv->queue)
+        return mock_fail(EBUSY);
+    if (setup->flags & ~ANARCHY_QUEUE_SQPOLL)
+        return mock_fail(EINVAL);
+
+    entries = setup->sq_entries ? setup->sq_entries : MOCK_QUEUE_DEFAULT_ENTRIES;
+    if ((entries & (entries - 1)) || entries > ANARCHY_QUEUE_MAX_ENTRIES)
+        return mock_fail(EINVAL);
+
+    data_size = setup->data_size ? setup->data_size : entries * MOCK_DMA_PAGE;
+    if (data_size > ANARCHY_QUEUE_MAX_DATA)
+        return mock_fail(EINVAL);
+    data_size = (data_size + MOCK_DMA_PAGE - 1) & ~(MOCK_DMA_PAGE - 1);
+
+    q = calloc(1, sizeof(*q));
+    if (!q)
+        return mock_fail(ENOMEM);
+
+    q->sq_entries = entries;
+    q->cq_entries = entries * 2;
+    sqes_off = 2 * sizeof(struct anarchy_queue_ring);
+    cqes_off = sqes_off + entries * sizeof(struct anarchy_sqe);
+    data_off = (cqes_off + q->cq_entries * sizeof(struct anarchy_cqe) + MOCK_DMA_PAGE - 1) &
+               ~(size_t)(MOCK_DMA_PAGE - 1);
+
+    q->mem_size = data_off + data_size;
+    q->mem = aligned_alloc(MOCK_DMA_PAGE, q->mem_size);
+    if (!q->mem) {
+        free(q);
+        return mock_fail(ENOMEM);
+    }
+    memset(q->mem, 0, q->mem_size);
+
+    q->sq = q->mem;
+    q->cq = (struct anarchy_queue_ring *)((uint8_t *)q->mem + sizeof(struct anarchy_queue_ring));
+    q->sqes = (struct anarchy_sqe *)((uint8_t *)q->mem + sqes_off);
+    q->cqes = (struct anarchy_cqe *)((uint8_t *)q->mem + cqes_off);
+    q->data = (uint8_t *)q->mem + data_off;
+    q->data_size = data_size;
+    q->flags = setup->flags;
+    q->sq_idle_ms = setup->sq_idle_ms ? setup->sq_idle_ms : MOCK_QUEUE_DEFAULT_IDLE_MS;
+    q->sq->mask = entries - 1;
+    q->sq->entries = entries;
+    q->cq->mask = q->cq_entries - 1;
+    q->cq->entries = q->cq_entries;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->sq_cond, NULL);
+    pthread_cond_init(&q->cq_cond, NULL);
+
+    drv->queue = q;
+    if ((q->flags & ANARCHY_QUEUE_SQPOLL) &&
+        pthread_create(&q->thread, NULL, mock_queue_sq_thread, drv)) {
+        q->flags &= ~ANARCHY_QUEUE_SQPOLL;
+        mock_queue_destroy(q);
+        drv->queue = NULL;
+        return mock_fail(EAGAIN);
+    }
+
+    setup->sq_entries = entries;
+    setup->cq_entries = q->cq_entries;
+    setup->sq_idle_ms = q->sq_idle_ms;
+    setup->data_size = data_size;
+    setup->sq_ring_off = 0;
+    setup->cq_ring_off = sizeof(struct anarchy_queue_ring);
+    setup->sqes_off = sqes_off;
+    setup->cqes_off = cqes_off;
+    setup->data_off = data_off;
+    setup->mmap_size = q->mem_size;
+    return 0;
+}
+
+/*
+ * Unlike the driver, waiting for completions without a poll thread cannot
+ * block (nothing else would produce them), so it fails with EAGAIN.
+ */
+static int mock_queue_enter(struct anarchy_mock_driver *drv, struct anarchy_ioc_queue_enter *enter) {
+    struct mock_queue *q = drv->queue;
+    uint32_t min_complete;
+    int ret = 0;
+
+    if (!q)
+        return mock_fail(ENXIO);
+    if (enter->flags & ~(ANARCHY_ENTER_GETEVENTS | ANARCHY_ENTER_SQ_WAKEUP))
+        return mock_fail(EINVAL);
+
+    min_complete = enter->min_complete < q->cq_entries ? enter->min_complete : q->cq_entries;
+    enter->submitted = 0;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->flags & ANARCHY_QUEUE_SQPOLL) {
+        if (enter->flags & ANARCHY_ENTER_SQ_WAKEUP)
+            pthread_cond_signal(&q->sq_cond);
+        if (enter->flags & ANARCHY_ENTER_GETEVENTS)
+            while (mock_cq_count(q) < min_complete)
+                pthread_cond_wait(&q->cq_cond, &q->lock);
+    } else {
+        enter->submitted = mock_queue_drain(drv, enter->to_submit);
+        if ((enter->flags & ANARCHY_ENTER_GETEVENTS) && mock_cq_count(q) < min_complete)
+            ret = -1;
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return ret ? mock_fail(EAGAIN) : 0;
+}
+
+void *anarchy_mock_queue_map(struct anarchy_mock_driver *drv, size_t *size) {
+    if (!drv || !drv->queue)
+        return NULL;
+    if (size)
+        *size = drv->queue->mem_size;
+    return drv->queue->mem;
+}
+
+int anarchy_mock_ioctl(struct anarchy_mock_driver *drv, unsigned long request, void *arg) {
+    struct anarchy_ioc_version *ver;
+    struct anarchy_ioc_reset *rst;
+
+    if (!drv || !arg)
+        return mock_fail(EFAULT);
+
+    /* Stats are matched by number so larger or smaller structs still work */
+    if (_IOC_TYPE(request) == ANARCHY_IOC_MAGIC &&
+        _IOC_NR(request) == _IOC_NR(ANARCHY_IOC_GET_STATS))
+        return mock_get_stats(drv, arg);
+
+    switch (request) {
+    case ANARCHY_IOC_GET_VERSION:
+        ver = arg;
+        memset(ver, 0, sizeof(*ver));
+        ver->major = drv->abi_major;
+        ver->minor = ANARCHY_ABI_MINOR;
+        ver->features = ANARCHY_FEAT_CONFIG | ANARCHY_FEAT_STATS |
+                        ANARCHY_FEAT_DMA | ANARCHY_FEAT_EVENTS |
+                        ANARCHY_FEAT_QUEUES;
+        strncpy(ver->driver_version, "1.0-mock", sizeof(ver->driver_version) - 1);
+        return 0;
+
+    case ANARCHY_IOC_APPLY_CONFIG:
+        return mock_apply_config(drv, arg);
+
+    case ANARCHY_IOC_GET_CONFIG:
+        memcpy(arg, &drv->config, sizeof(drv->config));
+        return 0;
+
+    case ANARCHY_IOC_RESET:
+        rst = arg;
+        if (!drv->link_up)
+            return mock_fail(ETIMEDOUT);
+        rst->ready_time_us = MOCK_READY_US_BASE + MOCK_READY_US_RETRAIN;
+        anarchy_mock_post_event(drv, ANARCHY_EVENT_RESET, rst->ready_time_us, 0);
+        return 0;
+
+    case ANARCHY_IOC_SUBMIT_DMA:
+        return mock_submit_dma(drv, arg);
+
+    case ANARCHY_IOC_SUBSCRIBE:
+        drv->event_mask = *(uint32_t *)arg;
+        return 0;
+
+    case ANARCHY_IOC_QUEUE_SETUP:
+        return mock_queue_setup(drv, arg);
+
+    case ANARCHY_IOC_QUEUE_ENTER:
+        return mock_queue_enter(drv, arg);
+
+    default:
+        return mock_fail(ENOTTY);
+    }
+}
+
+/* Non-blocking read of whole event records, like an O_NONBLOCK fd */
+ssize_t anarchy_mock_read(struct anarchy_mock_driver *drv, void *buf, size_t len) {
+    struct anarchy_ioc_event *out = buf;
+    size_t done = 0;
+
+    if (!drv || !buf)
+        return mock_fail(EFAULT);
+    if (len < sizeof(*out))
+        return mock_fail(EINVAL);
+
+    while ((done + 1) * sizeof(*out) <= len) {
+        if (drv->overflow) {
+            memset(&out[done], 0, sizeof(*out));
+            out[done].type = ANARCHY_EVENT_OVERFLOW;
+            out[done].timestamp_ns = mock_now_ns();
+            drv->overflow = false;
+        } else if (drv->event_count) {
+            out[done] = drv->events[drv->event_head];
+            drv->event_head = (drv->event_head + 1) % MOCK_EVENT_QUEUE_LEN;
+            drv->event_count--;
+        } else {
+            break;
+        }
+        done++;
+    }
+
+    if (!done)
+        return mock_fail(EAGAIN);
+    return done * sizeof(*out);
+}
+
+void anarchy_mock_set_link(struct anarchy_mock_driver *drv, bool up) {
+    if (!drv || drv->link_up == up)
+        return;
+
+    drv->link_up = up;
+    if (!up)
+        drv->pcie_errors++;
+    anarchy_mock_post_event(drv, up ? ANARCHY_EVENT_LINK_UP : ANARCHY_EVENT_LINK_DOWN, 0, 0);
+}
+
+void anarchy_mock_fail_apply(struct anarchy_mock_driver *drv, uint32_t field) {
+    if (drv)
+        drv->fail_field = field;
+}
+
+void anarchy_mock_set_gpu(struct anarchy_mock_driver *drv, int temperature,
+                          uint32_t utilization, uint32_t power_draw) {
+    bool was_critical;
+
+    if (!drv)
+        return;
+
+    was_critical = drv->temperature >= MOCK_TEMP_CRITICAL;
+    drv->temperature = temperature;
+    drv->gpu_utilization = utilization;
+    drv->power_draw = power_draw;
+
+    if (was_critical != (temperature >= MOCK_TEMP_CRITICAL))
+        anarchy_mock_post_event(drv, ANARCHY_EVENT_THERMAL, temperature, !was_critical);
+}
+
+void anarchy_mock_set_abi_major(struct anarchy_mock_driver *drv, uint32_t major) {
+    if (drv)
+        drv->abi_major = major;
+}
@@ -0,0 +1,54 @@
+#ifndef MOCK_IOCTL_H
+#define MOCK_IOCTL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "anarchy-ioctl.h"
+
+/*
+ * Userspace stand-in for the /dev/anarchy-egpu control interface. Follows
+ * the ioctl(2)/read(2) conventions (0 or byte count on success, -1 with
+ * errno set on failure) and the same validation, rollback and event rules
+ * as the driver, so callers can be exercised without hardware.
+ */
+
+/* Simulated settle times reported through ready_time_us */
+#define MOCK_READY_US_BASE         200
+#define MOCK_READY_US_RETRAIN      20000
+#define MOCK_READY_US_RING_REBUILD 1500
+
+#define MOCK_EVENT_QUEUE_LEN       64
+
+/* Descriptor buffer size, PAGE_SIZE in the driver */
+#define MOCK_DMA_PAGE              4096
+
+/* Match QUEUE_DEFAULT_* in queue.c */
+#define MOCK_QUEUE_DEFAULT_ENTRIES 128
+#define MOCK_QUEUE_DEFAULT_IDLE_MS 10
+
+/* Matches TEMP_CRITICAL_THRESHOLD in perf_monitor.c */
+#define MOCK_TEMP_CRITICAL         87
+
+struct anarchy_mock_driver;
+
+struct anarchy_mock_driver *anarchy_mock_create(void);
+void anarchy_mock_destroy(struct anarchy_mock_driver *drv);
+
+int anarchy_mock_ioctl(struct anarchy_mock_driver *drv, unsigned long request, void *arg);
+ssize_t anarchy_mock_read(struct anarchy_mock_driver *drv, void *buf, size_t len);
+
+/* mmap() stand-in: the region set up by ANARCHY_IOC_QUEUE_SETUP, or NULL */
+void *anarchy_mock_queue_map(struct anarchy_mock_driver *drv, size_t *size);
+
+/* Test hooks */
+void anarchy_mock_set_link(struct anarchy_mock_driver *drv, bool up);
+void anarchy_mock_fail_apply(struct anarchy_mock_driver *drv, uint32_t field);
+void anarchy_mock_set_gpu(struct anarchy_mock_driver *drv, int temperature,
+                          uint32_t utilization, uint32_t power_draw);
+void anarchy_mock_set_abi_major(struct anarchy_mock_driver *drv, uint32_t major);
+void anarchy_mock_post_event(struct anarchy_mock_driver *drv, uint32_t type,
+                             uint64_t data0, uint64_t data1);
+
+#endif /* MOCK_IOCTL_H */
@@ -0,0 +1,378 @@
+#include "test_framework.h"
+#include "anarchy-ioctl-mock.h"
+#include "anarchy-queue.h"
+#include <errno.h>
+#include <sched.h>
+
+static struct anarchy_mock_driver *drv;
+
+void before_each(void) {
+    drv = anarchy_mock_create();
+    REQUIRE(drv != NULL);
+}
+
+void after_each(void) {
+    anarchy_mock_destroy(drv);
+    drv = NULL;
+}
+
+static struct anarchy_ioc_config full_config(void) {
+    struct anarchy_ioc_config cfg;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.valid = ANARCHY_CFG_ALL;
+    cfg.dma_channels = 12;
+    cfg.ring_size = 512;
+    cfg.link_speed = 3;
+    cfg.tb_timeout_ms = 500;
+    return cfg;
+}
+
+void test_version_handshake(void) {
+    struct anarchy_ioc_version ver;
+
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_GET_VERSION, &ver) == 0);
+    REQUIRE(ver.major == ANARCHY_ABI_MAJOR);
+    REQUIRE(ver.features & ANARCHY_FEAT_CONFIG);
+    REQUIRE(ver.features & ANARCHY_FEAT_EVENTS);
+    REQUIRE(ver.driver_version[0] != '\0');
+
+    /* Unknown requests answer like an old driver */
+    REQUIRE(anarchy_mock_ioctl(drv, _IOR(ANARCHY_IOC_MAGIC, 0x7f, __u32), &ver) == -1);
+    REQUIRE(errno == ENOTTY);
+}
+
+void test_apply_config_is_all_or_nothing(void) {
+    struct anarchy_ioc_config cfg = full_config();
+    struct anarchy_ioc_config current;
+
+    /* One bad field rejects the whole request up front */
+    cfg.ring_size = 300;
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_APPLY_CONFIG, &cfg) == -1);
+    REQUIRE(errno == EINVAL);
+    REQUIRE(cfg.failed_field == ANARCHY_CFG_RING_SIZE);
+
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_GET_CONFIG, &current) == 0);
+    REQUIRE(current.dma_channels == 8);
+    REQUIRE(current.ring_size == 256);
+
+    /* A failing step leaves the previous configuration in place */
+    cfg = full_config();
+    anarchy_mock_fail_apply(drv, ANARCHY_CFG_LINK_SPEED);
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_APPLY_CONFIG, &cfg) == -1);
+    REQUIRE(errno == EIO);
+    REQUIRE(cfg.failed_field == ANARCHY_CFG_LINK_SPEED);
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_GET_CONFIG, &current) == 0);
+    REQUIRE(current.dma_channels == 8);
+
+    /* And the same request goes through once nothing fails */
+    cfg = full_config();
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_APPLY_CONFIG, &cfg) == 0);
+    REQUIRE(cfg.ready_time_us > 0);
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_GET_CONFIG, &current) == 0);
+    REQUIRE(current.dma_channels == 12);
+    REQUIRE(current.ring_size == 512);
+    REQUIRE(current.link_speed == 3);
+    REQUIRE(current.tb_timeout_ms == 500);
+}
+
+void test_apply_config_times_out_without_link(void) {
+    struct anarchy_ioc_config cfg = full_config();
+    struct anarchy_ioc_config current;
+
+    anarchy_mock_set_link(drv, false);
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_APPLY_CONFIG, &cfg) == -1);
+    REQUIRE(errno == ETIMEDOUT);
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_GET_CONFIG, &current) == 0);
+    REQUIRE(current.ring_size == 256);
+}
+
+void test_stats_snapshot(void) {
+    struct anarchy_ioc_stats st;
+    struct anarchy_ioc_dma dma;
+    char payload[4096];
+
+    memset(&dma, 0, sizeof(dma));
+    dma.addr = (__u64)(uintptr_t)payload;
+    dma.size = sizeof(payload);
+    dma.flags = ANARCHY_DMA_TO_DEVICE;
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_SUBMIT_DMA, &dma) == 0);
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_SUBMIT_DMA, &dma) == 0);
+    anarchy_mock_set_gpu(drv, 70, 55, 180);
+
+    memset(&st, 0, sizeof(st));
+    st.size = sizeof(st);
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_GET_STATS, &st) == 0);
+    REQUIRE(st.size == sizeof(st));
+    REQUIRE(st.flags & ANARCHY_STATS_LINK_UP);
+    REQUIRE(st.tx_bytes == 2 * sizeof(payload));
+    REQUIRE(st.temperature == 70);
+    REQUIRE(st.gpu_utilization == 55);
+    REQUIRE(st.timestamp_ns != 0);
+}
+
+void test_stats_older_struct(void) {
+    /* A caller built against a shorter struct only gets its own fields */
+    struct {
+        __u32 size;
+        __u32 flags;
+        __u64 timestamp_ns;
+        __u64 tx_bytes;
+        __u64 guard;
+    } old;
+
+    memset(&old, 0, sizeof(old));
+    old.size = offsetof(struct anarchy_ioc_stats, rx_bytes);
+    old.guard = 0xdeadbeef;
+    REQUIRE(anarchy_mock_ioctl(drv, _IOWR(ANARCHY_IOC_MAGIC, 0x04, old), &old) == 0);
+    REQUIRE(old.size == offsetof(struct anarchy_ioc_stats, rx_bytes));
+    REQUIRE(old.timestamp_ns != 0);
+    REQUIRE(old.guard == 0xdeadbeef);
+}
+
+void test_event_subscription(void) {
+    struct anarchy_ioc_event events[8];
+    struct anarchy_ioc_dma dma;
+    char payload[64];
+    __u32 mask = ANARCHY_EVENT_LINK_DOWN | ANARCHY_EVENT_DMA_COMPLETE;
+    ssize_t n;
+
+    /* Nothing is queued before subscribing */
+    anarchy_mock_set_link(drv, false);
+    anarchy_mock_set_link(drv, true);
+    REQUIRE(anarchy_mock_read(drv, events, sizeof(events)) == -1);
+    REQUIRE(errno == EAGAIN);
+
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_SUBSCRIBE, &mask) == 0);
+    anarchy_mock_set_link(drv, false);
+    anarchy_mock_set_link(drv, true);  /* LINK_UP is not subscribed */
+
+    memset(&dma, 0, sizeof(dma));
+    dma.addr = (__u64)(uintptr_t)payload;
+    dma.size = sizeof(payload);
+    dma.flags = ANARCHY_DMA_TO_DEVICE;
+    dma.cookie = 42;
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_SUBMIT_DMA, &dma) == 0);
+
+    n = anarchy_mock_read(drv, events, sizeof(events));
+    REQUIRE(n == 2 * (ssize_t)sizeof(events[0]));
+    REQUIRE(events[0].type == ANARCHY_EVENT_LINK_DOWN);
+    REQUIRE(events[1].type == ANARCHY_EVENT_DMA_COMPLETE);
+    REQUIRE(events[1].data[0] == 42);
+    REQUIRE(events[1].data[1] == sizeof(payload));
+}
+
+void test_event_overflow(void) {
+    struct anarchy_ioc_event ev;
+    __u32 mask = ANARCHY_EVENT_PCIE_ERROR;
+    int i, count = 0;
+
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_SUBSCRIBE, &mask) == 0);
+    for (i = 0; i < MOCK_EVENT_QUEUE_LEN + 10; i++)
+        anarchy_mock_post_event(drv, ANARCHY_EVENT_PCIE_ERROR, i, 0);
+
+    /* The drop is reported before the queued events */
+    REQUIRE(anarchy_mock_read(drv, &ev, sizeof(ev)) == sizeof(ev));
+    REQUIRE(ev.type == ANARCHY_EVENT_OVERFLOW);
+
+    while (anarchy_mock_read(drv, &ev, sizeof(ev)) == sizeof(ev))
+        count++;
+    REQUIRE(count == MOCK_EVENT_QUEUE_LEN);
+}
+
+void test_dma_rejects_bad_requests(void) {
+    struct anarchy_ioc_dma dma;
+    char payload[16];
+
+    memset(&dma, 0, sizeof(dma));
+    dma.addr = (__u64)(uintptr_t)payload;
+    dma.flags = ANARCHY_DMA_TO_DEVICE;
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_SUBMIT_DMA, &dma) == -1);
+    REQUIRE(errno == EINVAL);
+
+    dma.size = sizeof(payload);
+    dma.flags = 0;
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_SUBMIT_DMA, &dma) == -1);
+    REQUIRE(errno == EINVAL);
+}
+
+static int setup_queue(struct anarchy_uqueue *uq, uint32_t entries, uint32_t flags) {
+    struct anarchy_ioc_queue_setup setup;
+    void *mem;
+
+    memset(&setup, 0, sizeof(setup));
+    setup.sq_entries = entries;
+    setup.flags = flags;
+    setup.sq_idle_ms = 1;
+    if (anarchy_mock_ioctl(drv, ANARCHY_IOC_QUEUE_SETUP, &setup))
+        return -1;
+
+    mem = anarchy_mock_queue_map(drv, NULL);
+    if (!mem)
+        return -1;
+    anarchy_uqueue_bind(uq, mem, &setup);
+    return 0;
+}
+
+static struct anarchy_sqe *queue_transfer(struct anarchy_sqe *sqe, uint64_t offset,
+                                          uint32_t size, uint64_t cookie) {
+    sqe->data_offset = offset;
+    sqe->size = size;
+    sqe->flags = ANARCHY_DMA_TO_DEVICE;
+    sqe->cookie = cookie;
+    return sqe;
+}
+
+void test_queue_submit_and_complete(void) {
+    struct anarchy_ioc_queue_enter enter;
+    struct anarchy_ioc_stats st;
+    struct anarchy_uqueue uq;
+    struct anarchy_cqe *cqe;
+    struct anarchy_sqe *sqe;
+    uint64_t i, expected = 0;
+    int round;
+
+    REQUIRE(setup_queue(&uq, 8, 0) == 0);
+    REQUIRE(uq.sq_entries == 8);
+
+    /* Several full rounds so the free-running indices wrap the arrays */
+    for (round = 0; round < 3; round++) {
+        for (i = 0; i < 8; i++) {
+            sqe = anarchy_sq_get(&uq);
+            REQUIRE(sqe != NULL);
+            queue_transfer(sqe, i * MOCK_DMA_PAGE, 1000 + i, round * 8 + i);
+            expected += 1000 + i;
+        }
+        REQUIRE(anarchy_sq_get(&uq) == NULL);
+        anarchy_sq_commit(&uq);
+
+        memset(&enter, 0, sizeof(enter));
+        enter.flags = ANARCHY_ENTER_GETEVENTS;
+        enter.min_complete = 8;
+        REQUIRE(anarchy_sq_needs_enter(&uq));
+        REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_QUEUE_ENTER, &enter) == 0);
+        REQUIRE(enter.submitted == 8);
+        REQUIRE(anarchy_sq_pending(&uq) == 0);
+
+        for (i = 0; i < 8; i++) {
+            cqe = anarchy_cq_peek(&uq);
+            REQUIRE(cqe != NULL);
+            REQUIRE(cqe->cookie == round * 8 + i);
+            REQUIRE(cqe->result == (int32_t)(1000 + i));
+            anarchy_cq_advance(&uq, 1);
+        }
+        REQUIRE(anarchy_cq_peek(&uq) == NULL);
+    }
+
+    memset(&st, 0, sizeof(st));
+    st.size = sizeof(st);
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_GET_STATS, &st) == 0);
+    REQUIRE(st.tx_bytes == expected);
+}
+
+void test_queue_rejects_bad_entries(void) {
+    struct anarchy_ioc_queue_enter enter;
+    struct anarchy_ioc_queue_setup again;
+    struct anarchy_uqueue uq;
+    struct anarchy_cqe *cqe;
+    int i;
+
+    /* Entry counts must be powers of two */
+    memset(&again, 0, sizeof(again));
+    again.sq_entries = 12;
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_QUEUE_SETUP, &again) == -1);
+    REQUIRE(errno == EINVAL);
+
+    REQUIRE(setup_queue(&uq, 4, 0) == 0);
+    memset(&again, 0, sizeof(again));
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_QUEUE_SETUP, &again) == -1);
+    REQUIRE(errno == EBUSY);
+
+    /* Out of the data area, empty, wrong direction */
+    queue_transfer(anarchy_sq_get(&uq), uq.data_size - 16, 32, 1);
+    queue_transfer(anarchy_sq_get(&uq), 0, 0, 2);
+    queue_transfer(anarchy_sq_get(&uq), 0, 64, 3)->flags = 0;
+    queue_transfer(anarchy_sq_get(&uq), 0, 64, 4);
+    anarchy_sq_commit(&uq);
+
+    memset(&enter, 0, sizeof(enter));
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_QUEUE_ENTER, &enter) == 0);
+    REQUIRE(enter.submitted == 4);
+
+    for (i = 1; i <= 4; i++) {
+        cqe = anarchy_cq_peek(&uq);
+        REQUIRE(cqe != NULL);
+        REQUIRE(cqe->cookie == (uint64_t)i);
+        REQUIRE(cqe->result == (i < 4 ? -EINVAL : 64));
+        anarchy_cq_advance(&uq, 1);
+    }
+
+    /* A tail that runs past the ring is clamped and counted */
+    uq.sq->tail += 100;
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_QUEUE_ENTER, &enter) == 0);
+    REQUIRE(enter.submitted == 4);
+    REQUIRE(uq.sq->dropped == 1);
+}
+
+void test_queue_sq_poll_thread(void) {
+    struct anarchy_ioc_queue_enter enter;
+    struct anarchy_uqueue uq;
+    struct anarchy_cqe *cqe;
+    int i, seen = 0;
+
+    REQUIRE(setup_queue(&uq, 16, ANARCHY_QUEUE_SQPOLL) == 0);
+
+    /* Steady state: no enter calls while the thread is polling */
+    for (i = 0; i < 64; i++) {
+        struct anarchy_sqe *sqe;
+
+        while (!(sqe = anarchy_sq_get(&uq)))
+            sched_yield();
+        queue_transfer(sqe, 0, 256, i);
+        anarchy_sq_commit(&uq);
+
+        while ((cqe = anarchy_cq_peek(&uq))) {
+            REQUIRE(cqe->cookie == (uint64_t)seen);
+            seen++;
+            anarchy_cq_advance(&uq, 1);
+        }
+    }
+
+    memset(&enter, 0, sizeof(enter));
+    enter.flags = ANARCHY_ENTER_GETEVENTS | ANARCHY_ENTER_SQ_WAKEUP;
+    enter.min_complete = 64 - seen;
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_QUEUE_ENTER, &enter) == 0);
+    while ((cqe = anarchy_cq_peek(&uq))) {
+        seen++;
+        anarchy_cq_advance(&uq, 1);
+    }
+    REQUIRE(seen == 64);
+
+    /* Once idle the thread asks to be woken, and a wakeup gets it going */
+    while (!anarchy_sq_needs_enter(&uq))
+        sched_yield();
+    queue_transfer(anarchy_sq_get(&uq), 0, 128, 99);
+    anarchy_sq_commit(&uq);
+    enter.min_complete = 1;
+    REQUIRE(anarchy_mock_ioctl(drv, ANARCHY_IOC_QUEUE_ENTER, &enter) == 0);
+    cqe = anarchy_cq_peek(&uq);
+    REQUIRE(cqe != NULL);
+    REQUIRE(cqe->cookie == 99);
+}
+
+REGISTER_TEST(version_handshake, test_version_handshake);
+REGISTER_TEST(apply_config_is_all_or_nothing, test_apply_config_is_all_or_nothing);
+REGISTER_TEST(apply_config_times_out_without_link, test_apply_config_times_out_without_link);
+REGISTER_TEST(stats_snapshot, test_stats_snapshot);
+REGISTER_TEST(stats_older_struct, test_stats_older_struct);
+REGISTER_TEST(event_subscription, test_event_subscription);
+REGISTER_TEST(event_overflow, test_event_overflow);
+REGISTER_TEST(dma_rejects_bad_requests, test_dma_rejects_bad_requests);
+REGISTER_TEST(queue_submit_and_complete, test_queue_submit_and_complete);
+REGISTER_TEST(queue_rejects_bad_entries, test_queue_rejects_bad_entries);
+REGISTER_TEST(queue_sq_poll_thread, test_queue_sq_poll_thread);
+
+int main(void) {
+    run_all_tests();
+    return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * Device (src/core) driven through ControlPlane against the userspace mock
+ * driver, so the stats path runs without hardware. Built only when Qt is
+ * installed, like device_stats_bench.
+ */
+#include <QCoreApplication>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "device.h"
+
+extern "C" {
+#include "anarchy-ioctl-mock.h"
+}
+
+#define REQUIRE(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("Test failed: %s at %s:%d\n", #condition, __FILE__, __LINE__); \
+            return false; \
+        } \
+    } while (0)
+
+// Routes every do* call to the mock; reload() stands in for a driver reload
+class MockControlPlane : public ControlPlane
+{
+public:
+    // @descriptor is what open() hands out, never passed to the kernel
+    explicit MockControlPlane(int descriptor = 3)
+        : drv(anarchy_mock_create()), descriptor(descriptor) {}
+
+    ~MockControlPlane() override
+    {
+        close();
+        anarchy_mock_destroy(drv);
+    }
+
+    void reload()
+    {
+        anarchy_mock_destroy(drv);
+        drv = anarchy_mock_create();
+    }
+
+    anarchy_mock_driver *driver() const { return drv; }
+    int closes = 0;
+
+protected:
+    int doOpen(const QString&) override { return descriptor; }
+    void doClose(int) override { closes++; }
+
+    int doIoctl(int, unsigned long request, void* arg) override
+    {
+        return anarchy_mock_ioctl(drv, request, arg);
+    }
+
+    ssize_t doRead(int, void* buffer, size_t length, bool) override
+    {
+        return anarchy_mock_read(drv, buffer, length);
+    }
+
+private:
+    anarchy_mock_driver *drv;
+    int descriptor;
+};
+
+static bool test_connect_and_probe()
+{
+    auto *cp = new MockControlPlane();
+    Device device(cp);
+    DeviceStats stats;
+    QString driverVersion;
+
+    REQUIRE(device.connect());
+    REQUIRE(device.isConnected());
+    REQUIRE(device.probeHardware(stats, driverVersion));
+    REQUIRE(!driverVersion.isEmpty());
+    REQUIRE(stats.gpuState == "Active");
+    REQUIRE(stats.tbDevicePath == "0-1");
+
+    REQUIRE(device.disconnect());
+    REQUIRE(!device.isConnected());
+    REQUIRE(cp->closes == 1);
+    return true;
+}
+
+static bool test_probe_without_link()
+{
+    auto *cp = new MockControlPlane();
+    Device device(cp);
+    DeviceStats stats;
+    QString driverVersion;
+
+    anarchy_mock_set_link(cp->driver(), false);
+    REQUIRE(!device.connect());
+    REQUIRE(device.probeHardware(stats, driverVersion));
+    REQUIRE(stats.gpuState == "Off");
+    return true;
+}
+
+static bool test_throughput_skips_counter_reset()
+{
+    static char block[1 << 20];
+    auto *cp = new MockControlPlane();
+    Device device(cp);
+    DeviceStats stats;
+    QString driverVersion;
+
+    REQUIRE(device.connect());
+    REQUIRE(device.probeHardware(stats, driverVersion));
+    REQUIRE(cp->submitDma(block, sizeof(block), 1));
+    REQUIRE(device.probeHardware(stats, driverVersion));
+    const double before = stats.txThroughput;
+    REQUIRE(before > 0.0);
+
+    // Counters restart at zero, an unsigned delta would be ~1.6e13 MB/s
+    cp->reload();
+    REQUIRE(cp->submitDma(block, 4096, 2));
+    REQUIRE(device.probeHardware(stats, driverVersion));
+    REQUIRE(stats.txThroughput == before);
+
+    // The next pair is measured again
+    REQUIRE(cp->submitDma(block, sizeof(block), 3));
+    REQUIRE(device.probeHardware(stats, driverVersion));
+    REQUIRE(stats.txThroughput > 0.0 && stats.txThroughput != before);
+    return true;
+}
+
+// A rejected setting must not ride along with the next one that succeeds
+static bool test_failed_apply_not_cached()
+{
+    auto *cp = new MockControlPlane();
+    Device device(cp);
+    anarchy_ioc_config cfg;
+
+    REQUIRE(device.connect());
+    anarchy_mock_fail_apply(cp->driver(), ANARCHY_CFG_DMA_CHANNELS);
+    device.setDMAChannels(16);
+    device.setRingBufferSize(512);
+
+    memset(&cfg, 0, sizeof(cfg));
+    REQUIRE(cp->getConfig(cfg));
+    REQUIRE(cfg.dma_channels == 8);
+    REQUIRE(cfg.ring_size == 512);
+    return true;
+}
+
+// The subclass closes through its own doClose(); the base destructor must
+// not ::close() the descriptor again, here a pipe the test still owns
+static bool test_destructor_leaves_descriptor()
+{
+    int pipefd[2];
+
+    REQUIRE(pipe(pipefd) == 0);
+    auto *cp = new MockControlPlane(pipefd[0]);
+    REQUIRE(cp->open("/dev/anarchy-egpu"));
+    REQUIRE(cp->isOpen());
+    delete cp;
+
+    REQUIRE(fcntl(pipefd[0], F_GETFD) != -1);
+    ::close(pipefd[0]);
+    ::close(pipefd[1]);
+    return true;
+}
+
+static const struct {
+    const char *name;
+    bool (*func)();
+} tests[] = {
+    { "connect_and_probe", test_connect_and_probe },
+    { "probe_without_link", test_probe_without_link },
+    { "throughput_skips_counter_reset", test_throughput_skips_counter_reset },
+    { "failed_apply_not_cached", test_failed_apply_not_cached },
+    { "destructor_leaves_descriptor", test_destructor_leaves_descriptor },
+};
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    int failed = 0;
+
+    for (const auto& test : tests) {
+        const bool ok = test.func();
+        printf("%s: %s\n", test.name, ok ? "PASS" : "FAIL");
+        failed += !ok;
+    }
+    printf("%d/%d passed\n", int(sizeof(tests) / sizeof(tests[0])) - failed,
+           int(sizeof(tests) / sizeof(tests[0])));
+    return failed ? 1 : 0;
+}
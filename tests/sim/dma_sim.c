@@ -0,0 +1,703 @@
+/*
+ * Runs the driver's DMA paths, src/kernel/ring.c, dma.c, dma_device.c and
+ * command_proc.c built unchanged against tests/common/kshim, on a
+ * simulated DMA engine behind a 40 Gbps TB4 link.
+ *
+ *   dma_sim [-v] [-n transfers] [-r ring size] [-t seconds]
+ *           [-b link Mbps] [-l latency ns] [-j jitter ns] [-s seed]
+ *
+ * Time is virtual: register accesses, sleeps and the link advance one
+ * clock, so results are the same on any machine. Five workloads:
+ *
+ *   ring      page transfers streamed through the TX ring as fast as it
+ *             takes them, completions reaped in order as they land, at
+ *             several ring depths
+ *   sustained the configured ring kept full for -t virtual seconds by a
+ *             submitter that blocks for credits and reaps for itself
+ *   dma       anarchy_dma_transfer() from 64 B to 64 MiB, each mapped,
+ *             polled to completion and unmapped
+ *   path      anarchy_dma_send() from 16 B to 256 KiB after the PIO and
+ *             bounce limits were calibrated, against mapping in place
+ *   command   NOSYNC and low latency texture batches through
+ *             process_game_command()
+ *
+ * The run fails if the ring at the configured depth, any second of the
+ * sustained run or a 64 MiB transfer moves less than 90% of the link rate,
+ * anything exceeds the link rate, the engine sees a bad descriptor or
+ * buffer, a transfer is not completed or reaped, a calibrated send is
+ * slower than mapping in place or leaves the path it was given, or a DMA
+ * mapping is left behind.
+ */
+#include <getopt.h>
+#include "dma_engine.h"
+#include "include/anarchy_device.h"
+#include "include/command_proc.h"
+#include "include/dma.h"
+#include "include/dma_path.h"
+
+#define SIM_PAGE            4096
+#define SIM_MIN_EFF         0.90
+#define SIM_MAX_DMA         (64u << 20)
+#define SIM_COMMANDS        2000
+#define SIM_PATH_SENDS      16
+#define SIM_PATH_MAX        (256u << 10)
+#define SIM_PATH_SLACK      1.05    /* Jitter between the two runs */
+#define SIM_PATH_MAP_NS     500     /* IOMMU map or unmap with IOTLB flush */
+
+static unsigned int seed = 1;
+static struct dma_engine_config cfg;
+
+/* Not under test, the sim only needs the symbols */
+unsigned int trace_buf_kb = 1024;
+int dma_pio_max = -1, dma_bounce_max = -1;
+
+void anarchy_power_gov_frame(struct anarchy_device *adev)
+{
+}
+
+struct sim_dev {
+    struct pci_dev pdev;
+    struct anarchy_device adev;
+    struct dma_engine *engine;
+};
+
+static int sim_dev_init(struct sim_dev *sd, unsigned int ring_size)
+{
+    memset(sd, 0, sizeof(*sd));
+    sd->pdev.dev.init_name = "sim";
+    sd->pdev.mps = 256;
+    sd->pdev.readrq = 512;
+    sd->adev.pdev = &sd->pdev;
+    sd->adev.dev = &sd->pdev.dev;
+    sd->adev.dma_channels = 4;
+    sd->adev.ring_buffer_size = ring_size;
+
+    sd->engine = dma_engine_create(&cfg);
+    if (!sd->engine)
+        return -ENOMEM;
+    sd->adev.mmio_base = dma_engine_bar(sd->engine);
+    return 0;
+}
+
+static void sim_dev_exit(struct sim_dev *sd)
+{
+    dma_engine_destroy(sd->engine);
+}
+
+static double link_gbps(u64 bytes, u64 ns)
+{
+    return ns ? bytes * 8.0 / ns : 0;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Ring streaming */
+
+struct ring_run {
+    struct sim_dev *sd;
+    u64 *lat_ns;
+    unsigned int done;              /* Seen by the engine */
+    unsigned int errors;
+    unsigned int reaped;            /* Seen by the driver's callbacks */
+    unsigned int failed;
+    struct anarchy_transfer xfer;   /* Outlives every submit made with it */
+};
+
+static void ring_engine_done(void *ctx, const struct dma_engine_completion *c)
+{
+    struct ring_run *run = ctx;
+
+    if (c->error)
+        run->errors++;
+    run->lat_ns[run->done++] = c->done_ns - c->kick_ns;
+}
+
+static void ring_xfer_done(struct anarchy_transfer *xfer, int status)
+{
+    struct ring_run *run = xfer->context;
+
+    run->reaped++;
+    if (status)
+        run->failed++;
+}
+
+/* What the completion interrupt would do, once the engine raised one */
+static void ring_reap(struct ring_run *run)
+{
+    if (dma_engine_poll(run->sd->engine, ring_engine_done, run))
+        anarchy_ring_reap(&run->sd->adev, &run->sd->adev.tx_ring, 0);
+}
+
+/* Jump to the next completion when the ring is full */
+static void ring_wait(struct sim_dev *sd)
+{
+    u64 next = dma_engine_next_done_ns(sd->engine), now = kshim_now_ns();
+
+    if (next > now)
+        kshim_advance_ns(next - now);
+}
+
+static int run_ring(unsigned int ring_size, unsigned int n, bool check)
+{
+    static char page[SIM_PAGE];
+    struct ring_run run = { 0 };
+    struct dma_engine_stats st;
+    struct sim_dev sd;
+    unsigned int sent = 0, maps, busy = 0;
+    u64 start, elapsed;
+    double gbps, eff;
+    int ret, failed = 0;
+
+    maps = kshim_dma_mappings();
+    if (sim_dev_init(&sd, ring_size))
+        return 1;
+    run.sd = &sd;
+    run.xfer.done = ring_xfer_done;
+    run.xfer.context = &run;
+    run.lat_ns = calloc(n, sizeof(u64));
+    if (!run.lat_ns || anarchy_ring_init(&sd.adev, &sd.adev.tx_ring)) {
+        free(run.lat_ns);
+        sim_dev_exit(&sd);
+        return 1;
+    }
+    anarchy_ring_start(&sd.adev, &sd.adev.tx_ring, true);
+
+    start = kshim_now_ns();
+    while (run.done < n) {
+        ring_reap(&run);
+        if (sent < n) {
+            ret = anarchy_ring_transfer(&sd.adev, &sd.adev.tx_ring, page, sizeof(page),
+                                        &run.xfer);
+            if (!ret) {
+                sent++;
+                continue;
+            }
+            if (ret != -EBUSY) {
+                printf("FAIL ring %u: transfer %u returned %d\n", ring_size, sent, ret);
+                failed = 1;
+                break;
+            }
+            busy++;
+        }
+        if (!dma_engine_outstanding(sd.engine))
+            break;
+        ring_wait(&sd);
+    }
+    elapsed = kshim_now_ns() - start;
+
+    dma_engine_get_stats(sd.engine, &st);
+    gbps = link_gbps(st.bytes, elapsed);
+    eff = gbps * 1000 / cfg.link_mbps;
+    qsort(run.lat_ns, run.done, sizeof(u64), cmp_u64);
+    printf("ring    %6u %9u %9.2f %6.1f%% %9.2f %9.2f %9u\n", ring_size, run.done, gbps,
+           eff * 100, run.done ? run.lat_ns[run.done / 2] / 1000.0 : 0,
+           run.done ? run.lat_ns[(u64)run.done * 99 / 100] / 1000.0 : 0, busy);
+
+    ring_reap(&run);
+    if (run.done != n || run.reaped != n || atomic_read(&sd.adev.tx_ring.pending)) {
+        printf("FAIL ring %u: %u of %u transfers completed, %u reaped, %d pending\n",
+               ring_size, run.done, n, run.reaped, atomic_read(&sd.adev.tx_ring.pending));
+        failed = 1;
+    }
+    if (run.errors || run.failed || st.errors) {
+        printf("FAIL ring %u: %u failed transfers, %llu engine errors\n", ring_size,
+               run.errors + run.failed, (unsigned long long)st.errors);
+        failed = 1;
+    }
+    if (eff > 1.0 || (check && eff < SIM_MIN_EFF)) {
+        printf("FAIL ring %u: %.2f Gbps is %.1f%% of the link\n", ring_size, gbps, eff * 100);
+        failed = 1;
+    }
+
+    anarchy_ring_cleanup(&sd.adev, &sd.adev.tx_ring);
+    if (kshim_dma_mappings() != maps) {
+        printf("FAIL ring %u: %u DMA mappings left\n", ring_size, kshim_dma_mappings() - maps);
+        failed = 1;
+    }
+    free(run.lat_ns);
+    sim_dev_exit(&sd);
+    return failed;
+}
+
+/* Submit up to @max without reaping; returns how many submits succeeded */
+static unsigned int ring_fill(struct ring_run *run, unsigned int max)
+{
+    static char page[SIM_PAGE];
+    struct sim_dev *sd = run->sd;
+    unsigned int n = 0;
+
+    while (n < max &&
+           !anarchy_ring_transfer(&sd->adev, &sd->adev.tx_ring, page, sizeof(page), &run->xfer))
+        n++;
+    return n;
+}
+
+static void ring_drain(struct ring_run *run)
+{
+    while (dma_engine_outstanding(run->sd->engine)) {
+        ring_wait(run->sd);
+        ring_reap(run);
+    }
+}
+
+/* Resize a running ring: refused while busy, keeps counters, new depth usable */
+static int run_resize(unsigned int from, unsigned int to)
+{
+    struct ring_run run = { 0 };
+    struct sim_dev sd;
+    unsigned int n, maps;
+    u64 bytes;
+    int ret, failed = 0;
+
+    maps = kshim_dma_mappings();
+    if (sim_dev_init(&sd, from))
+        return 1;
+    run.sd = &sd;
+    run.xfer.done = ring_xfer_done;
+    run.xfer.context = &run;
+    run.lat_ns = calloc(from + to, sizeof(u64));
+    if (!run.lat_ns || anarchy_ring_init(&sd.adev, &sd.adev.tx_ring)) {
+        free(run.lat_ns);
+        sim_dev_exit(&sd);
+        return 1;
+    }
+    anarchy_ring_start(&sd.adev, &sd.adev.tx_ring, true);
+
+    n = ring_fill(&run, from - 1);
+    ret = anarchy_ring_resize(&sd.adev, &sd.adev.tx_ring, to);
+    if (n != from - 1 || ret != -EBUSY) {
+        printf("FAIL resize %u: %u of %u submitted, busy resize returned %d\n", from, n,
+               from - 1, ret);
+        failed = 1;
+    }
+    ring_drain(&run);
+
+    bytes = atomic64_read(&sd.adev.tx_ring.bytes_transferred);
+    ret = anarchy_ring_resize(&sd.adev, &sd.adev.tx_ring, to);
+    n = ring_fill(&run, to - 1);
+    printf("resize  %6u -> %4u, %u submitted\n", from, to, n);
+    if (ret || n != to - 1 || sd.adev.tx_ring.state != ANARCHY_RING_STATE_RUNNING ||
+        atomic64_read(&sd.adev.tx_ring.bytes_transferred) != bytes + (u64)n * SIM_PAGE) {
+        printf("FAIL resize %u -> %u: returned %d, %u of %u submitted\n", from, to, ret, n,
+               to - 1);
+        failed = 1;
+    }
+    ring_drain(&run);
+    if (run.done != from - 1 + n || run.reaped != run.done || run.errors) {
+        printf("FAIL resize %u -> %u: %u completed, %u reaped, %u errors\n", from, to,
+               run.done, run.reaped, run.errors);
+        failed = 1;
+    }
+
+    anarchy_ring_cleanup(&sd.adev, &sd.adev.tx_ring);
+    if (kshim_dma_mappings() != maps) {
+        printf("FAIL resize %u -> %u: %u DMA mappings left\n", from, to,
+               kshim_dma_mappings() - maps);
+        failed = 1;
+    }
+    free(run.lat_ns);
+    sim_dev_exit(&sd);
+    return failed;
+}
+
+/*
+ * Sustained streaming the way a driver submitter sees it: nobody polls the
+ * engine, the submitter blocks for a credit, reaps the written back
+ * descriptors itself and carries on. Throughput is sampled every virtual
+ * second.
+ */
+struct sustained_run {
+    u64 bytes;
+    unsigned int reaped;
+    unsigned int failed;
+};
+
+static void sustained_xfer_done(struct anarchy_transfer *xfer, int status)
+{
+    struct sustained_run *run = xfer->context;
+
+    run->reaped++;
+    run->bytes += xfer->size;
+    if (status)
+        run->failed++;
+}
+
+static int run_sustained(unsigned int ring_size, unsigned int seconds)
+{
+    static char page[SIM_PAGE];
+    struct sustained_run run = { 0 };
+    struct anarchy_transfer xfer = { .done = sustained_xfer_done, .context = &run };
+    struct anarchy_ring *ring;
+    struct sim_dev sd;
+    unsigned int sent = 0, maps, windows = 0;
+    u64 start, window_end, window_bytes = 0;
+    double gbps, min_gbps = 1e9, max_gbps = 0, sum_gbps = 0;
+    int ret, failed = 0;
+
+    maps = kshim_dma_mappings();
+    if (sim_dev_init(&sd, ring_size))
+        return 1;
+    ring = &sd.adev.tx_ring;
+    if (anarchy_ring_init(&sd.adev, ring)) {
+        sim_dev_exit(&sd);
+        return 1;
+    }
+    anarchy_ring_start(&sd.adev, ring, true);
+
+    start = kshim_now_ns();
+    window_end = start + NSEC_PER_SEC;
+    while (windows < seconds) {
+        ret = anarchy_ring_wait_credits(&sd.adev, ring, 1, 1000);
+        if (ret < 0) {
+            printf("FAIL sustained: waiting for a credit returned %d after %u transfers\n",
+                   ret, sent);
+            failed = 1;
+            break;
+        }
+        ret = anarchy_ring_transfer(&sd.adev, ring, page, sizeof(page), &xfer);
+        if (ret) {
+            printf("FAIL sustained: transfer %u returned %d with a credit\n", sent, ret);
+            failed = 1;
+            break;
+        }
+        sent++;
+
+        while (kshim_now_ns() >= window_end) {
+            gbps = link_gbps(run.bytes - window_bytes, NSEC_PER_SEC);
+            min_gbps = min(min_gbps, gbps);
+            max_gbps = max(max_gbps, gbps);
+            sum_gbps += gbps;
+            window_bytes = run.bytes;
+            window_end += NSEC_PER_SEC;
+            windows++;
+        }
+    }
+
+    /* Every credit back means every transfer was reaped */
+    ret = anarchy_ring_wait_credits(&sd.adev, ring, ring_size - 1, 100000);
+    printf("sustained %4u %6us %9u %9.2f %9.2f %9.2f %9u\n", ring_size, seconds, sent,
+           min_gbps, windows ? sum_gbps / windows : 0, max_gbps,
+           atomic_read(&ring->credit_waits));
+
+    if (ret < 0 || run.reaped != sent || atomic_read(&ring->pending)) {
+        printf("FAIL sustained: %u of %u reaped, %d pending, drain returned %d\n",
+               run.reaped, sent, atomic_read(&ring->pending), ret);
+        failed = 1;
+    }
+    if (run.failed) {
+        printf("FAIL sustained: %u failed transfers\n", run.failed);
+        failed = 1;
+    }
+    if (windows && (min_gbps < cfg.link_mbps * SIM_MIN_EFF / 1000 ||
+                    max_gbps > cfg.link_mbps / 1000.0)) {
+        printf("FAIL sustained: %.2f to %.2f Gbps per second against a %.2f Gbps link\n",
+               min_gbps, max_gbps, cfg.link_mbps / 1000.0);
+        failed = 1;
+    }
+
+    anarchy_ring_cleanup(&sd.adev, ring);
+    if (kshim_dma_mappings() != maps) {
+        printf("FAIL sustained: %u DMA mappings left\n", kshim_dma_mappings() - maps);
+        failed = 1;
+    }
+    sim_dev_exit(&sd);
+    return failed;
+}
+
+/* Single transfers through the DMA device */
+
+static int run_dma(unsigned int size, unsigned int n, char *buf)
+{
+    struct dma_engine_stats st;
+    struct sim_dev sd;
+    dma_addr_t addr;
+    unsigned int i, maps, errors = 0;
+    u64 start, elapsed;
+    double gbps, eff;
+    int failed = 0;
+
+    maps = kshim_dma_mappings();
+    if (sim_dev_init(&sd, 0))
+        return 1;
+
+    start = kshim_now_ns();
+    for (i = 0; i < n; i++) {
+        addr = anarchy_dma_transfer(&sd.adev, buf, size);
+        if (!addr) {
+            errors++;
+            continue;
+        }
+        anarchy_dma_cleanup(&sd.adev, addr, size);
+    }
+    elapsed = kshim_now_ns() - start;
+
+    dma_engine_get_stats(sd.engine, &st);
+    gbps = link_gbps(st.bytes, elapsed);
+    eff = gbps * 1000 / cfg.link_mbps;
+    printf("dma  %9u %9u %9.3f %6.1f%% %9.2f\n", size, n, gbps, eff * 100,
+           elapsed / 1000.0 / n);
+
+    if (errors || st.errors) {
+        printf("FAIL dma %u: %u failed transfers, %llu engine errors\n", size, errors,
+               (unsigned long long)st.errors);
+        failed = 1;
+    }
+    if (eff > 1.0 || (size == SIM_MAX_DMA && eff < SIM_MIN_EFF)) {
+        printf("FAIL dma %u: %.2f Gbps is %.1f%% of the link\n", size, gbps, eff * 100);
+        failed = 1;
+    }
+    if (kshim_dma_mappings() != maps) {
+        printf("FAIL dma %u: %u DMA mappings left\n", size, kshim_dma_mappings() - maps);
+        failed = 1;
+    }
+    sim_dev_exit(&sd);
+    return failed;
+}
+
+/* Transfer path selection */
+
+static u64 path_send_ns(struct sim_dev *sd, const char *buf, unsigned int size,
+                        unsigned int *errors)
+{
+    unsigned int i;
+    u64 start = kshim_now_ns();
+
+    for (i = 0; i < SIM_PATH_SENDS; i++) {
+        if (anarchy_dma_send(&sd->adev, buf, size))
+            (*errors)++;
+    }
+    return (kshim_now_ns() - start) / SIM_PATH_SENDS;
+}
+
+static int run_paths(char *buf)
+{
+    struct anarchy_dma_path *path;
+    struct anarchy_dma_path_stats *st;
+    struct dma_engine_stats es;
+    struct sim_dev sd;
+    enum anarchy_dma_path_kind kind;
+    unsigned int size, i, maps, errors = 0;
+    u32 pio_max, bounce_max;
+    u64 pio_bytes, hits[ANARCHY_DMA_PATH_COUNT] = { 0 }, ns, zc_ns;
+    int failed = 0;
+
+    /* Only this workload pays for mappings, the others measure the link */
+    kshim_dma_map_ns = SIM_PATH_MAP_NS;
+    maps = kshim_dma_mappings();
+    if (sim_dev_init(&sd, 0) || anarchy_dma_path_init(&sd.adev))
+        return 1;
+    path = &sd.adev.dma_path;
+    if (anarchy_dma_path_calibrate(&sd.adev)) {
+        printf("FAIL path: calibration failed\n");
+        failed = 1;
+        goto out;
+    }
+    pio_max = path->pio_max;
+    bounce_max = path->bounce_max;
+    dma_engine_get_stats(sd.engine, &es);
+    pio_bytes = es.pio_bytes;
+
+    printf("path calibration, pio up to %u B, bounce up to %u B\n", pio_max, bounce_max);
+    printf("%-9s", "bytes");
+    for (kind = 0; kind < ANARCHY_DMA_PATH_COUNT; kind++)
+        printf(" %9s", anarchy_dma_path_name(kind));
+    printf("\n");
+    for (i = 0; i < ANARCHY_DMA_PATH_PROBES; i++) {
+        printf("%-9u", 64 << i);
+        for (kind = 0; kind < ANARCHY_DMA_PATH_COUNT; kind++)
+            printf(" %9.2f", path->probe_ns[kind][i] / 1000.0);
+        printf("\n");
+    }
+    if (!pio_max || bounce_max <= pio_max) {
+        printf("FAIL path: no size range left to PIO or the bounce buffer\n");
+        failed = 1;
+    }
+
+    printf("\n%-4s %9s %-9s %9s %9s %8s\n", "path", "bytes", "chosen", "us each",
+           "zerocopy", "speedup");
+    for (size = 16; size <= SIM_PATH_MAX; size *= 2) {
+        kind = anarchy_dma_path_select(&sd.adev, size);
+        hits[kind] += SIM_PATH_SENDS;
+        ns = path_send_ns(&sd, buf, size, &errors);
+
+        /* The same sends with every limit off */
+        path->pio_max = 0;
+        path->bounce_max = 0;
+        hits[ANARCHY_DMA_PATH_ZEROCOPY] += SIM_PATH_SENDS;
+        zc_ns = path_send_ns(&sd, buf, size, &errors);
+        path->pio_max = pio_max;
+        path->bounce_max = bounce_max;
+
+        printf("path %9u %-9s %9.2f %9.2f %7.2fx\n", size, anarchy_dma_path_name(kind),
+               ns / 1000.0, zc_ns / 1000.0, ns ? (double)zc_ns / ns : 0);
+        if (ns > zc_ns * SIM_PATH_SLACK) {
+            printf("FAIL path %u: %s takes %.2f us, mapping in place %.2f us\n", size,
+                   anarchy_dma_path_name(kind), ns / 1000.0, zc_ns / 1000.0);
+            failed = 1;
+        }
+    }
+
+    for (kind = 0; kind < ANARCHY_DMA_PATH_COUNT; kind++) {
+        st = &path->stats[kind];
+        if (atomic64_read(&st->hits) != hits[kind]) {
+            printf("FAIL path: %s sent %lld, expected %llu\n", anarchy_dma_path_name(kind),
+                   (long long)atomic64_read(&st->hits), (unsigned long long)hits[kind]);
+            failed = 1;
+        }
+    }
+    dma_engine_get_stats(sd.engine, &es);
+    if (errors || es.errors) {
+        printf("FAIL path: %u failed sends, %llu engine errors\n", errors,
+               (unsigned long long)es.errors);
+        failed = 1;
+    }
+    if (es.pio_bytes - pio_bytes != (u64)atomic64_read(&path->stats[ANARCHY_DMA_PATH_PIO].bytes)) {
+        printf("FAIL path: engine took %llu B through the PIO window, driver sent %lld B\n",
+               (unsigned long long)(es.pio_bytes - pio_bytes),
+               (long long)atomic64_read(&path->stats[ANARCHY_DMA_PATH_PIO].bytes));
+        failed = 1;
+    }
+out:
+    anarchy_dma_path_exit(&sd.adev);
+    if (kshim_dma_mappings() != maps) {
+        printf("FAIL path: %u DMA mappings left\n", kshim_dma_mappings() - maps);
+        failed = 1;
+    }
+    sim_dev_exit(&sd);
+    kshim_dma_map_ns = 0;
+    return failed;
+}
+
+/* Command submission */
+
+static int run_commands(const char *name, u32 flags, unsigned int n)
+{
+    static char data[SIM_PAGE];
+    struct command_batch batch = {
+        .category = CMD_CAT_TEXTURE,
+        .flags = flags,
+        .data = data,
+        .total_size = sizeof(data),
+    };
+    struct sim_dev sd;
+    unsigned int i, maps, errors = 0;
+    u64 start, elapsed;
+    int failed = 0;
+
+    maps = kshim_dma_mappings();
+    if (sim_dev_init(&sd, 0) || init_command_processor(&sd.adev))
+        return 1;
+
+    start = kshim_now_ns();
+    for (i = 0; i < n; i++) {
+        if (process_game_command(&sd.adev, &batch))
+            errors++;
+    }
+    elapsed = kshim_now_ns() - start;
+    printf("command %-22s %6u %9.2f\n", name, n, elapsed / 1000.0 / n);
+
+    if (errors) {
+        printf("FAIL command %s: %u of %u failed\n", name, errors, n);
+        failed = 1;
+    }
+    if (kshim_dma_mappings() != maps) {
+        printf("FAIL command %s: %u DMA mappings left\n", name, kshim_dma_mappings() - maps);
+        failed = 1;
+    }
+    cleanup_command_processor(&sd.adev);
+    sim_dev_exit(&sd);
+    return failed;
+}
+
+int main(int argc, char **argv) {
+    static const unsigned int ring_sizes[] = { 4, 8, 32, 128, 1024, 4096 };
+    unsigned int transfers = 100000, ring_size = 32, seconds = 10, size, i;
+    bool tested = false;
+    char *buf;
+    int opt, failed = 0;
+
+    dma_engine_default_config(&cfg);
+    while ((opt = getopt(argc, argv, "vn:r:t:b:l:j:s:")) != -1) {
+        switch (opt) {
+        case 'v':
+            kshim_verbose = 3;      /* Driver debug output */
+            break;
+        case 'n':
+            transfers = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            ring_size = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            seconds = strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            cfg.link_mbps = strtoull(optarg, NULL, 0);
+            break;
+        case 'l':
+            cfg.latency_ns = strtoul(optarg, NULL, 0);
+            break;
+        case 'j':
+            cfg.jitter_ns = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-v] [-n transfers] [-r ring size] [-t seconds] "
+                    "[-b link Mbps] [-l latency ns] [-j jitter ns] [-s seed]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (!transfers || ring_size < 2 || !cfg.link_mbps) {
+        fprintf(stderr, "need transfers, a ring of at least 2 and a link rate\n");
+        return 2;
+    }
+    cfg.seed = seed;
+
+    printf("link %llu Mbps, latency %u ns, jitter %u ns, MMIO read %u ns, write %u ns\n\n",
+           (unsigned long long)cfg.link_mbps, cfg.latency_ns, cfg.jitter_ns,
+           cfg.mmio_read_ns, cfg.mmio_write_ns);
+
+    printf("%-7s %6s %9s %9s %7s %9s %9s %9s\n", "path", "ring", "transfers", "Gbps", "link",
+           "p50 us", "p99 us", "ring full");
+    for (i = 0; i < ARRAY_SIZE(ring_sizes); i++) {
+        tested |= ring_sizes[i] == ring_size;
+        failed |= run_ring(ring_sizes[i], transfers, ring_sizes[i] == ring_size);
+    }
+    if (!tested)
+        failed |= run_ring(ring_size, transfers, true);
+    failed |= run_resize(32, 4096);
+    failed |= run_resize(4096, 16);
+
+    if (seconds) {
+        printf("\n%-9s %4s %7s %9s %9s %9s %9s %9s\n", "path", "ring", "time", "transfers",
+               "min Gbps", "avg Gbps", "max Gbps", "waits");
+        failed |= run_sustained(ring_size, seconds);
+    }
+
+    buf = malloc(SIM_MAX_DMA);
+    if (!buf)
+        return 2;
+    memset(buf, 0x5a, SIM_MAX_DMA);
+    printf("\n%-4s %9s %9s %9s %7s %9s\n", "path", "bytes", "transfers", "Gbps", "link",
+           "us each");
+    for (size = 64; size <= SIM_MAX_DMA; size *= 4)
+        failed |= run_dma(size, clamp(SIM_MAX_DMA / size, 4u, 64u), buf);
+
+    printf("\n");
+    failed |= run_paths(buf);
+    free(buf);
+
+    printf("\n%-30s %6s %9s\n", "path", "count", "us each");
+    failed |= run_commands("nosync", CMD_FLAG_NOSYNC, SIM_COMMANDS);
+    failed |= run_commands("nosync lowlat", CMD_FLAG_NOSYNC | CMD_FLAG_LOWLAT, SIM_COMMANDS);
+    failed |= run_commands("batched", 0, SIM_COMMANDS);
+
+    return failed;
+}
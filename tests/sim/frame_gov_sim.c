@@ -0,0 +1,272 @@
+/*
+ * Runs synthetic game frame loops through the frame governor and scores
+ * frame-time variance against average power.
+ *
+ *   frame_gov_sim [-v] [-n frames] [-s seed]
+ *
+ * Each frame starts with a sync, after which the GPU renders the frame's
+ * work (in cycles) at whatever clock the power limit allows. The next
+ * frame starts when the GPU is done or, with a frame cap, at the next cap
+ * tick. Power follows a cubic clock curve while busy and a small linear
+ * one while idle.
+ *
+ * Every scenario runs at the static profile (base clock, profile limit)
+ * and under frame_gov, on the same frames. The run fails when the
+ * governor makes frame times more variable, misses more frames, draws
+ * past the profile limit, draws more power where the static profile
+ * already made every cap, or uncapped, spends more than SIM_ENERGY_PCT
+ * extra energy per frame. Where the frames leave most of the interval
+ * idle, it also fails unless the governor saves the scenario's share of
+ * energy per frame.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "include/frame_gov.h"
+
+#define SIM_STEP_US         50
+#define SIM_UTIL_US         100000  /* Telemetry period */
+#define SIM_PROFILE_W       175     /* Profile power limit, the ceiling */
+#define SIM_CLOCK_MAX       2400.0  /* MHz the power curve is fitted to */
+#define SIM_POWER_STATIC    40.0    /* W busy at 0 MHz */
+#define SIM_POWER_DYNAMIC   180.0   /* W added at SIM_CLOCK_MAX */
+#define SIM_IDLE_BASE       15.0
+#define SIM_IDLE_PER_MHZ    0.01
+#define SIM_MISS_PCT        105     /* Frame counts as missed above this share of cap */
+#define SIM_ENERGY_PCT      1       /* Uncapped J/frame allowed over static for late tails */
+
+struct scenario {
+    const char *name;
+    unsigned int cap_us;            /* 0 = uncapped */
+    double work_us;                 /* Mean GPU time per frame at the base clock */
+    double noise;                   /* Uniform +- share of work */
+    unsigned int heavy_pct;         /* Frames with extra work */
+    double heavy_factor;
+    unsigned int save_pct;          /* J/frame the governor has to save, 0 = no claim */
+};
+
+static const struct scenario scenarios[] = {
+    /* Mostly idle behind the cap, where relaxing between windows pays off */
+    { "capped30_light",  33333,  4000, 0.20,  2, 1.6, 5 },
+    { "capped60_light",  16667,  8000, 0.20,  2, 1.6, 0 },
+    { "capped60_heavy",  16667, 14000, 0.15,  5, 1.4, 0 },
+    { "capped144",        6944,  5000, 0.25,  3, 1.5, 0 },
+    { "uncapped",            0, 10000, 0.20,  3, 1.5, 0 },
+};
+
+struct sim_score {
+    double mean_ms;
+    double stddev_ms;
+    double p99_ms;
+    double avg_w;
+    double joules_per_frame;
+    double peak_w;                  /* Highest busy draw */
+    unsigned int missed;
+};
+
+static int verbose;
+static unsigned int seed = 1;
+
+static double rnd(void) {
+    seed = seed * 1103515245u + 12345u;
+    return ((seed >> 8) & 0xffffff) / (double)0x1000000;
+}
+
+/* Highest clock the limit sustains while busy */
+static double clock_for_limit(unsigned int limit) {
+    double share = (limit - SIM_POWER_STATIC) / SIM_POWER_DYNAMIC;
+
+    if (share <= 0)
+        return 0;
+    return SIM_CLOCK_MAX * cbrt(share);
+}
+
+static double busy_power(double clock) {
+    double r = clock / SIM_CLOCK_MAX;
+
+    return SIM_POWER_STATIC + SIM_POWER_DYNAMIC * r * r * r;
+}
+
+static double idle_power(double clock) {
+    return SIM_IDLE_BASE + SIM_IDLE_PER_MHZ * clock;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void simulate(const struct scenario *sc, int governed, unsigned int frames,
+                     struct sim_score *score) {
+    struct frame_gov_params p;
+    struct frame_gov gov;
+    double *ft = calloc(frames, sizeof(*ft));
+    double energy = 0, sum = 0, sq = 0, work, clock;
+    u64 t = 1000000, frame_start, util_start = t, busy_in_period = 0;
+    unsigned int i, limit;
+
+    frame_gov_default_params(&p);
+    p.power_max = SIM_PROFILE_W + p.boost_w;
+    frame_gov_init(&gov, &p);
+    memset(score, 0, sizeof(*score));
+
+    if (verbose)
+        printf("# %s %s\nframe,ms,clock_avg\n", sc->name, governed ? "gov" : "static");
+
+    for (i = 0; i < frames; i++) {
+        double clock_sum = 0;
+        unsigned int steps = 0;
+
+        frame_start = t;
+        if (governed)
+            frame_gov_sync(&gov, t);
+
+        work = sc->work_us * p.clock_base * (1 + sc->noise * (2 * rnd() - 1));
+        if (rnd() * 100 < sc->heavy_pct)
+            work *= sc->heavy_factor;
+
+        /* Render, then wait for the cap tick */
+        for (;;) {
+            int busy = work > 0;
+
+            if (governed) {
+                frame_gov_tick(&gov, t);
+                limit = frame_gov_power(&gov, SIM_PROFILE_W, false);
+                clock = frame_gov_clock(&gov);
+            } else {
+                limit = SIM_PROFILE_W;
+                clock = p.clock_base;
+            }
+            if (clock > clock_for_limit(limit))
+                clock = clock_for_limit(limit);
+
+            if (!busy && (!sc->cap_us || t - frame_start >= sc->cap_us))
+                break;
+
+            if (busy) {
+                work -= clock * SIM_STEP_US;
+                energy += busy_power(clock) * SIM_STEP_US / 1e6;
+                if (busy_power(clock) > score->peak_w)
+                    score->peak_w = busy_power(clock);
+                busy_in_period += SIM_STEP_US;
+                clock_sum += clock;
+                steps++;
+            } else {
+                energy += idle_power(clock) * SIM_STEP_US / 1e6;
+            }
+            t += SIM_STEP_US;
+
+            if (t - util_start >= SIM_UTIL_US) {
+                if (governed)
+                    frame_gov_util(&gov, (unsigned int)(busy_in_period * 100 / (t - util_start)));
+                util_start = t;
+                busy_in_period = 0;
+            }
+        }
+
+        ft[i] = (t - frame_start) / 1000.0;
+        sum += ft[i];
+        sq += ft[i] * ft[i];
+        if (sc->cap_us && (t - frame_start) * 100 > (u64)sc->cap_us * SIM_MISS_PCT)
+            score->missed++;
+        if (verbose)
+            printf("%u,%.3f,%.0f\n", i, ft[i], steps ? clock_sum / steps : 0);
+    }
+
+    score->mean_ms = sum / frames;
+    /* Equal frame times can round the variance just below zero */
+    score->stddev_ms = sqrt(fmax(sq / frames - score->mean_ms * score->mean_ms, 0));
+    score->avg_w = energy / (sum / 1000.0);
+    score->joules_per_frame = energy / frames;
+    qsort(ft, frames, sizeof(*ft), cmp_double);
+    score->p99_ms = ft[frames * 99 / 100];
+    free(ft);
+}
+
+static void print_score(const char *scenario, const char *name, const struct sim_score *s) {
+    printf("%-16s %-7s %8.2f %9.3f %8.2f %7u %8.1f %8.3f\n", scenario, name, s->mean_ms,
+           s->stddev_ms, s->p99_ms, s->missed, s->avg_w, s->joules_per_frame);
+}
+
+int main(int argc, char **argv) {
+    struct sim_score base, gov;
+    unsigned int frames = 3000, start_seed;
+    size_t i;
+    int opt, failed = 0;
+
+    while ((opt = getopt(argc, argv, "vn:s:")) != -1) {
+        switch (opt) {
+        case 'v':
+            verbose = 1;
+            break;
+        case 'n':
+            frames = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-v] [-n frames] [-s seed]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (frames < 100) {
+        fprintf(stderr, "need at least 100 frames\n");
+        return 2;
+    }
+
+    printf("%-16s %-7s %8s %9s %8s %7s %8s %8s\n", "scenario", "policy", "mean ms",
+           "stddev ms", "p99 ms", "missed", "avg W", "J/frame");
+
+    start_seed = seed;
+    for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        const struct scenario *sc = &scenarios[i];
+
+        /* Both policies see the same frames */
+        seed = start_seed;
+        simulate(sc, 0, frames, &base);
+        seed = start_seed;
+        simulate(sc, 1, frames, &gov);
+        print_score(sc->name, "static", &base);
+        print_score(sc->name, "gov", &gov);
+
+        if (gov.stddev_ms > base.stddev_ms) {
+            printf("FAIL %s: frame time stddev %.3f ms, static %.3f ms\n", sc->name,
+                   gov.stddev_ms, base.stddev_ms);
+            failed = 1;
+        }
+        if (gov.missed > base.missed) {
+            printf("FAIL %s: %u missed frames, static %u\n", sc->name, gov.missed,
+                   base.missed);
+            failed = 1;
+        }
+        if (gov.peak_w > SIM_PROFILE_W + 0.05) {
+            printf("FAIL %s: %.1f W peak over the %u W profile limit\n", sc->name,
+                   gov.peak_w, SIM_PROFILE_W);
+            failed = 1;
+        }
+        if (sc->cap_us && !base.missed && gov.avg_w > base.avg_w) {
+            printf("FAIL %s: %.1f W with slack to spare, static %.1f W\n", sc->name,
+                   gov.avg_w, base.avg_w);
+            failed = 1;
+        }
+        /* Uncapped frames end sooner, so compare energy rather than draw */
+        if (!sc->cap_us &&
+            gov.joules_per_frame > base.joules_per_frame * (100 + SIM_ENERGY_PCT) / 100) {
+            printf("FAIL %s: %.3f J/frame, static %.3f J/frame\n", sc->name,
+                   gov.joules_per_frame, base.joules_per_frame);
+            failed = 1;
+        }
+        if (sc->save_pct &&
+            gov.joules_per_frame > base.joules_per_frame * (100 - sc->save_pct) / 100) {
+            printf("FAIL %s: %.3f J/frame, static %.3f J/frame, expected %u%% less\n",
+                   sc->name, gov.joules_per_frame, base.joules_per_frame, sc->save_pct);
+            failed = 1;
+        }
+    }
+
+    return failed;
+}
@@ -0,0 +1,330 @@
+/*
+ * Drives the emulator's GPU model with synthetic command load and checks
+ * that it behaves like a GPU with a heatsink.
+ *
+ *   gpu_model_sim [-v]
+ *
+ * Load is queued the way gpu_emu does it, as GPU time at the boost clock,
+ * and the model is advanced in 1 ms ticks. The closed-loop scenarios feed
+ * the model's temperature and power to thermal_ctl once a second and
+ * apply its fan and power limit, like thermal.c does.
+ *
+ * The run fails when the idle die does not settle at ambient plus P/G,
+ * utilization does not reach 95% within five smoothing constants of a
+ * full load step, power stays over a lowered limit, temperature jumps
+ * instead of following the RC time constant, the die overheats with or
+ * without thermal_ctl, or the PCIe counters disagree with the DMA bytes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "include/gpu_model.h"
+#include "include/thermal_ctl.h"
+
+#define SIM_TICK_NS         1000000ULL
+#define SIM_CONTROL_MS      1000    /* THERMAL_MONITOR_INTERVAL */
+#define SIM_FRAME_US        16667   /* 60 fps */
+#define SIM_CRITICAL_MC     87000
+#define SIM_MAX_JUMP_MC     2000    /* Rise allowed in the first second of full load */
+
+static int verbose;
+
+struct sim {
+    struct gpu_model m;
+    u64 now_ns;
+};
+
+struct sim_result {
+    int max_mc;
+    int final_mc;
+    u32 util_avg;                   /* Permille over the second half */
+    u32 power_avg_w;
+    u32 fan_avg;
+    double critical_s;
+};
+
+static void sim_init(struct sim *s)
+{
+    struct gpu_model_params p;
+
+    gpu_model_default_params(&p);
+    gpu_model_init(&s->m, &p);
+    s->now_ns = 0;
+    gpu_model_advance(&s->m, 0);
+}
+
+static void sim_tick(struct sim *s)
+{
+    s->now_ns += SIM_TICK_NS;
+    gpu_model_advance(&s->m, s->now_ns);
+}
+
+/* Keep the GPU fed, a queue deeper than a tick never runs dry */
+static void load_full(struct sim *s)
+{
+    if (s->m.backlog_ns < 2 * SIM_TICK_NS)
+        gpu_model_submit(&s->m, 2 * SIM_TICK_NS);
+}
+
+static double temp_c(const struct sim *s)
+{
+    return gpu_model_temp_mc(&s->m) / 1000.0;
+}
+
+/* Fan 30%, default limit, nothing queued for 20 minutes */
+static int check_idle(void)
+{
+    struct sim s;
+    double g, expect;
+    unsigned int i;
+
+    sim_init(&s);
+    for (i = 0; i < 20 * 60 * 1000; i++)
+        sim_tick(&s);
+
+    g = s.m.p.g_base + s.m.p.g_per_fan * s.m.fan;
+    expect = s.m.p.ambient_mc / 1000.0 + s.m.power_mw / g;
+    printf("%-18s %8.2f C  expected %.2f C, %u mW, util %u\n", "idle", temp_c(&s), expect,
+           s.m.power_mw, s.m.util);
+    if (s.m.util || (temp_c(&s) - expect > 1.0 || expect - temp_c(&s) > 1.0)) {
+        printf("FAIL idle: %.2f C at util %u, expected %.2f C at 0\n", temp_c(&s), s.m.util,
+               expect);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Full load from cold at a fixed 100 W limit and 60% fan: utilization
+ * ramps with the smoothing constant, power holds the limit and the die
+ * climbs along the RC curve rather than jumping.
+ */
+static int check_step(void)
+{
+    struct sim s;
+    unsigned int i, util_ms = 0, over_ms = 0, limit_mw = 100000;
+    int start_mc, rise_1s = 0, rise_tau = 0, final_rise;
+    unsigned int tau_ms;
+    double g, share;
+    int failed = 0;
+
+    sim_init(&s);
+    gpu_model_set_fan(&s.m, 60);
+    gpu_model_set_power_limit(&s.m, limit_mw);
+    start_mc = gpu_model_temp_mc(&s.m);
+    g = s.m.p.g_base + s.m.p.g_per_fan * s.m.fan;
+    tau_ms = (unsigned int)(s.m.p.heat_capacity / g * 1000);
+
+    for (i = 1; i <= 20 * 60 * 1000; i++) {
+        load_full(&s);
+        sim_tick(&s);
+        if (!util_ms && s.m.util >= 950)
+            util_ms = i;
+        /* The clock walks down a bin per millisecond, give it 100 */
+        if (i > 100 && s.m.power_mw > limit_mw)
+            over_ms++;
+        if (i == 1000)
+            rise_1s = gpu_model_temp_mc(&s.m) - start_mc;
+        if (i == tau_ms)
+            rise_tau = gpu_model_temp_mc(&s.m) - start_mc;
+    }
+    final_rise = gpu_model_temp_mc(&s.m) - start_mc;
+    share = final_rise > 0 ? (double)rise_tau / final_rise : 0;
+
+    printf("%-18s util 95%% at %u ms, +%.2f C after 1 s, %.0f%% of +%.1f C at tau %u s, "
+           "%u ms over limit, %u MHz\n", "step", util_ms, rise_1s / 1000.0, share * 100,
+           final_rise / 1000.0, tau_ms / 1000, over_ms, s.m.clock);
+
+    if (!util_ms || util_ms > 5 * s.m.p.util_tau_us / 1000) {
+        printf("FAIL step: utilization reached 95%% after %u ms, allowed %u\n", util_ms,
+               5 * s.m.p.util_tau_us / 1000);
+        failed = 1;
+    }
+    if (over_ms) {
+        printf("FAIL step: %u ms over the %u mW limit\n", over_ms, limit_mw);
+        failed = 1;
+    }
+    if (rise_1s > SIM_MAX_JUMP_MC || rise_1s <= 0) {
+        printf("FAIL step: %+.2f C in the first second, no thermal inertia\n", rise_1s / 1000.0);
+        failed = 1;
+    }
+    /* One time constant of an RC step is 1 - 1/e, 63% */
+    if (share < 0.58 || share > 0.68) {
+        printf("FAIL step: %.0f%% of the rise after one time constant, expected 63%%\n",
+               share * 100);
+        failed = 1;
+    }
+    return failed;
+}
+
+/*
+ * @work_us per @frame_us frame (0 = always busy) for @minutes, optionally
+ * under thermal_ctl with the module's defaults.
+ */
+static void run_load(struct sim *s, unsigned int frame_us, unsigned int work_us,
+                     unsigned int minutes, bool controlled, struct sim_result *r)
+{
+    struct thermal_ctl_params params;
+    struct thermal_ctl ctl;
+    unsigned int i, ticks = minutes * 60 * 1000, half = 0;
+    u64 next_frame_ns = 0, util_sum = 0, power_sum = 0, fan_sum = 0;
+
+    sim_init(s);
+    thermal_ctl_default_params(&params);
+    thermal_ctl_init(&ctl, &params);
+    if (controlled) {
+        gpu_model_set_fan(&s->m, ctl.fan);
+        gpu_model_set_power_limit(&s->m, ctl.power_limit * 1000);
+    }
+    memset(r, 0, sizeof(*r));
+    r->max_mc = gpu_model_temp_mc(&s->m);
+
+    if (verbose)
+        printf("# %s\nsecond,temp_c,power_w,clock,util,fan,limit_w\n",
+               controlled ? "thermal_ctl" : "open loop");
+
+    for (i = 1; i <= ticks; i++) {
+        if (!frame_us) {
+            load_full(s);
+        } else if (s->now_ns >= next_frame_ns) {
+            gpu_model_submit(&s->m, (u64)work_us * 1000);
+            next_frame_ns += (u64)frame_us * 1000;
+        }
+        sim_tick(s);
+
+        if (gpu_model_temp_mc(&s->m) > r->max_mc)
+            r->max_mc = gpu_model_temp_mc(&s->m);
+        if (gpu_model_temp_mc(&s->m) > SIM_CRITICAL_MC)
+            r->critical_s += SIM_TICK_NS / 1e9;
+        if (i > ticks / 2) {
+            util_sum += s->m.util;
+            power_sum += s->m.power_mw;
+            fan_sum += s->m.fan;
+            half++;
+        }
+
+        if (i % SIM_CONTROL_MS)
+            continue;
+        if (controlled) {
+            thermal_ctl_step(&ctl, gpu_model_temp_mc(&s->m), s->m.power_mw / 1000,
+                             SIM_CONTROL_MS);
+            gpu_model_set_fan(&s->m, ctl.fan);
+            gpu_model_set_power_limit(&s->m, ctl.power_limit * 1000);
+        }
+        if (verbose)
+            printf("%u,%.2f,%.1f,%u,%u,%u,%u\n", i / 1000, temp_c(s), s->m.power_mw / 1000.0,
+                   s->m.clock, s->m.util, s->m.fan, s->m.power_limit_mw / 1000);
+    }
+
+    r->final_mc = gpu_model_temp_mc(&s->m);
+    r->util_avg = util_sum / half;
+    r->power_avg_w = power_sum / half / 1000;
+    r->fan_avg = fan_sum / half;
+}
+
+static void print_result(const char *name, const struct sim *s, const struct sim_result *r)
+{
+    printf("%-18s max %6.2f C  final %6.2f C  util %5.1f%%  %3u W  fan %3u%%  %4u MHz  "
+           "critical %.1f s\n", name, r->max_mc / 1000.0, r->final_mc / 1000.0,
+           r->util_avg / 10.0, r->power_avg_w, r->fan_avg, s->m.clock, r->critical_s);
+}
+
+static int check_loads(void)
+{
+    struct sim_result r;
+    struct sim s;
+    int failed = 0;
+
+    /* Fan at 30% and 250 W: only the model's own slowdown holds the die */
+    run_load(&s, 0, 0, 20, false, &r);
+    print_result("full, open loop", &s, &r);
+    if (r.max_mc > s.m.p.slowdown_mc + 2000) {
+        printf("FAIL full, open loop: %.2f C, slowdown at %.2f C did not hold\n",
+               r.max_mc / 1000.0, s.m.p.slowdown_mc / 1000.0);
+        failed = 1;
+    }
+    if (s.m.clock >= s.m.p.boost_clock) {
+        printf("FAIL full, open loop: still at %u MHz above slowdown\n", s.m.clock);
+        failed = 1;
+    }
+
+    run_load(&s, 0, 0, 20, true, &r);
+    print_result("full, thermal_ctl", &s, &r);
+    if (r.critical_s > 0) {
+        printf("FAIL full, thermal_ctl: %.1f s above %.0f C\n", r.critical_s,
+               SIM_CRITICAL_MC / 1000.0);
+        failed = 1;
+    }
+    if (r.util_avg < 950) {
+        printf("FAIL full, thermal_ctl: utilization %.1f%% under full load\n",
+               r.util_avg / 10.0);
+        failed = 1;
+    }
+
+    /* 10 ms of boost-clock work per 60 fps frame, busy 60% at boost */
+    run_load(&s, SIM_FRAME_US, 10000, 10, true, &r);
+    print_result("frames, thermal_ctl", &s, &r);
+    if (r.critical_s > 0) {
+        printf("FAIL frames, thermal_ctl: %.1f s above %.0f C\n", r.critical_s,
+               SIM_CRITICAL_MC / 1000.0);
+        failed = 1;
+    }
+    if (r.util_avg < 550 || r.util_avg > 700) {
+        printf("FAIL frames, thermal_ctl: utilization %.1f%%, expected 60%% or a little "
+               "more when clocked down\n", r.util_avg / 10.0);
+        failed = 1;
+    }
+    if (s.m.dropped_ns) {
+        printf("FAIL frames, thermal_ctl: %llu ns of work dropped\n",
+               (unsigned long long)s.m.dropped_ns);
+        failed = 1;
+    }
+    return failed;
+}
+
+/* 6 GiB each way in 1 MiB transfers, the 32-bit counters wrap */
+static int check_pcie(void)
+{
+    struct sim s;
+    u64 rx = 0, tx = 0;
+    unsigned int i;
+
+    sim_init(&s);
+    for (i = 0; i < 6 * 1024; i++) {
+        gpu_model_dma(&s.m, 1 << 20, i & 1 ? 2 << 20 : 0);
+        rx += 1 << 20;
+        tx += i & 1 ? 2 << 20 : 0;
+    }
+    printf("%-18s rx %u tx %u after %llu/%llu bytes\n", "pcie", s.m.pcie_rx, s.m.pcie_tx,
+           (unsigned long long)rx, (unsigned long long)tx);
+    if (s.m.pcie_rx != (u32)rx || s.m.pcie_tx != (u32)tx) {
+        printf("FAIL pcie: counters %u/%u, expected %u/%u\n", s.m.pcie_rx, s.m.pcie_tx,
+               (u32)rx, (u32)tx);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int failed = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "v")) != -1) {
+        switch (opt) {
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    failed |= check_idle();
+    failed |= check_step();
+    failed |= check_loads();
+    failed |= check_pcie();
+    return failed;
+}
@@ -0,0 +1,192 @@
+/*
+ * Runs the driver's link control sequences, src/kernel/link_ctl.c,
+ * against a model of the downstream port above the GPU.
+ *
+ *   link_sim [-v]
+ *
+ * The port follows the Link Control semantics the driver relies on:
+ * Link Disable takes the link down and holds it there, clearing it lets
+ * the link train again, and Retrain Link retrains a link that is enabled
+ * but is ignored while Link Disable is set. Training takes a fixed time
+ * and the link is polled with the driver's exponential back-off in
+ * virtual time.
+ *
+ * The scenarios are the driver's call sites: probe enables an already
+ * trained link, suspend/disconnect disable it and resume/connect/retry
+ * train it again, and a port whose link never trains. The run fails if
+ * the link does not come back after a disable, Link Disable is left set,
+ * an enable retrains a link that was already up, or the dead port does
+ * not time out.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "include/link_ctl.h"
+
+#define SIM_TRAIN_US        20000   /* Disabled or retrained to DLLLA */
+#define SIM_DOWN_US         50      /* Link Disable to link down */
+#define SIM_POLL_MIN_US     10      /* LINK_POLL_MIN_US */
+#define SIM_POLL_MAX_US     5000    /* LINK_POLL_MAX_US */
+#define SIM_TIMEOUT_MS      1000    /* LINK_TRAIN_TIMEOUT_MS */
+#define SIM_DOWN_TIMEOUT_MS 100     /* LINK_DOWN_TIMEOUT_MS */
+
+static int verbose;
+
+struct port {
+    u16 ctl;
+    bool up;
+    bool dead;                  /* Never trains */
+    unsigned long long now_us;
+    unsigned long long change_at;   /* Pending transition, 0 = none */
+    bool change_up;
+    unsigned int trains;
+};
+
+static void port_advance(struct port *p)
+{
+    if (p->change_at && p->now_us >= p->change_at) {
+        p->up = p->change_up;
+        p->change_at = 0;
+    }
+}
+
+static int port_read_ctl(void *ctx, u16 *val)
+{
+    struct port *p = ctx;
+
+    *val = p->ctl;
+    return 0;
+}
+
+static int port_write_ctl(void *ctx, u16 val)
+{
+    struct port *p = ctx;
+    bool was_disabled = p->ctl & PCI_EXP_LNKCTL_LD;
+
+    port_advance(p);
+    /* Retrain Link always reads back as zero */
+    p->ctl = val & ~PCI_EXP_LNKCTL_RL;
+
+    if (val & PCI_EXP_LNKCTL_LD) {
+        p->change_at = p->now_us + SIM_DOWN_US;
+        p->change_up = false;
+    } else if (was_disabled || (val & PCI_EXP_LNKCTL_RL)) {
+        p->up = false;
+        p->trains++;
+        p->change_at = p->dead ? 0 : p->now_us + SIM_TRAIN_US;
+        p->change_up = true;
+    }
+    return 0;
+}
+
+static int port_wait_link(void *ctx, bool up, unsigned int timeout_ms)
+{
+    struct port *p = ctx;
+    unsigned long long deadline = p->now_us + timeout_ms * 1000ULL;
+    unsigned int delay = SIM_POLL_MIN_US;
+
+    for (;;) {
+        port_advance(p);
+        if (p->up == up)
+            return 0;
+        if (p->now_us > deadline)
+            return -ETIMEDOUT;
+        p->now_us += delay;
+        delay = delay * 2 < SIM_POLL_MAX_US ? delay * 2 : SIM_POLL_MAX_US;
+    }
+}
+
+static const struct link_ctl_ops port_ops = {
+    .read_ctl = port_read_ctl,
+    .write_ctl = port_write_ctl,
+    .wait_link = port_wait_link,
+};
+
+static void port_init(struct port *p, bool up)
+{
+    *p = (struct port){ .up = up };
+}
+
+static int check(const char *name, struct port *p, int ret, int want_ret, bool want_up,
+                 unsigned int want_trains)
+{
+    printf("%-22s ret %4d  link %-4s  LD %d  trains %u  at %7.3f ms\n", name, ret,
+           p->up ? "up" : "down", !!(p->ctl & PCI_EXP_LNKCTL_LD), p->trains,
+           p->now_us / 1000.0);
+
+    if (ret != want_ret) {
+        printf("FAIL %s: returned %d, expected %d\n", name, ret, want_ret);
+        return 1;
+    }
+    if (p->up != want_up) {
+        printf("FAIL %s: link %s, expected %s\n", name, p->up ? "up" : "down",
+               want_up ? "up" : "down");
+        return 1;
+    }
+    if (want_up && (p->ctl & PCI_EXP_LNKCTL_LD)) {
+        printf("FAIL %s: Link Disable still set\n", name);
+        return 1;
+    }
+    if (p->trains != want_trains) {
+        printf("FAIL %s: link trained %u times, expected %u\n", name, p->trains, want_trains);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct port p;
+    int failed = 0;
+    int opt, ret;
+
+    while ((opt = getopt(argc, argv, "v")) != -1) {
+        switch (opt) {
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    /* Probe: the link is already up and must not be retrained */
+    port_init(&p, true);
+    ret = link_ctl_up(&port_ops, &p, false, SIM_TIMEOUT_MS);
+    failed |= check("probe enable", &p, ret, 0, true, 0);
+
+    /* Suspend or disconnect, then resume, connect or a retry */
+    port_init(&p, true);
+    ret = link_ctl_down(&port_ops, &p, SIM_DOWN_TIMEOUT_MS);
+    failed |= check("disable", &p, ret, 0, false, 0);
+    ret = link_ctl_up(&port_ops, &p, true, SIM_TIMEOUT_MS);
+    failed |= check("disable, train", &p, ret, 0, true, 1);
+
+    /* A reload after a disable */
+    port_init(&p, true);
+    link_ctl_down(&port_ops, &p, SIM_DOWN_TIMEOUT_MS);
+    ret = link_ctl_up(&port_ops, &p, false, SIM_TIMEOUT_MS);
+    failed |= check("disable, enable", &p, ret, 0, true, 1);
+
+    /* Retraining a link that is up drops it and brings it back */
+    port_init(&p, true);
+    ret = link_ctl_up(&port_ops, &p, true, SIM_TIMEOUT_MS);
+    failed |= check("retrain", &p, ret, 0, true, 1);
+
+    /* The port has to ignore Retrain Link while disabled, or the above proves nothing */
+    port_init(&p, true);
+    link_ctl_down(&port_ops, &p, SIM_DOWN_TIMEOUT_MS);
+    port_write_ctl(&p, p.ctl | PCI_EXP_LNKCTL_RL);
+    ret = port_wait_link(&p, true, SIM_TIMEOUT_MS);
+    failed |= check("disable, RL only", &p, ret, -ETIMEDOUT, false, 0);
+
+    port_init(&p, false);
+    p.dead = true;
+    ret = link_ctl_up(&port_ops, &p, true, SIM_TIMEOUT_MS);
+    failed |= check("dead port", &p, ret, -ETIMEDOUT, false, 1);
+    if (verbose)
+        printf("dead port gave up after %.1f ms\n", p.now_us / 1000.0);
+
+    return failed;
+}
@@ -0,0 +1,610 @@
+/*
+ * Injects GPU hangs into a streaming DMA workload and recovers with the
+ * driver's reset, src/kernel/gpu_reset.c, reset_seq.c and the ring
+ * checkpoint in ring.c built unchanged against tests/common/kshim, next
+ * to the fixed-sleep sequence it replaced.
+ *
+ *   reset_sim [-v] [-n resets] [-s seed]
+ *
+ * A producer submits page transfers to the TX ring at a steady rate with
+ * anarchy_ring_transfer() and a model GPU, behind the ring's doorbell,
+ * completes them in order after a pipeline latency by writing the
+ * descriptor status back. The driver reaps every few microseconds while
+ * interrupts are unmasked, so some completions are always waiting to be
+ * reaped when the GPU hangs. At a random point
+ * the GPU hangs and drops whatever it had queued, and the reset runs:
+ *
+ *   legacy  stops the rings, losing in-flight transfers and anything
+ *           submitted until they restart, and sleeps through each step
+ *   polled  anarchy_gpu_reset_rings(): checkpoints the rings
+ *           (submissions retry), polls each step for its
+ *           acknowledgement and replays what the GPU had not completed
+ *           once the engine is idle
+ *
+ * Every transfer carries a sequence number in its page, so a replayed
+ * completion shows up as a duplicate. Register latencies are drawn per
+ * reset and some resets get a step that never acknowledges. The run
+ * fails if a successful polled reset loses, duplicates or reorders a
+ * transfer, replays anything but the transfers the GPU had not completed
+ * when it hung, takes a 60 Hz frame or longer, or if a stuck reset does
+ * not time out on the stuck step.
+ */
+#include <getopt.h>
+#include "include/anarchy_device.h"
+#include "include/ring.h"
+#include "include/gpu_reset.h"
+#include "../../include/anarchy-gpu.h"
+
+#define SIM_RING_SIZE       64          /* Descriptors */
+#define SIM_FIFO_SIZE       256         /* Kicked descriptors the GPU can hold */
+#define SIM_ARRIVAL_US      2           /* Mean, one page per 2 us is ~16 Gbps */
+#define SIM_XFER_US         1           /* A page at 40 Gbps, rounded up */
+#define SIM_DMA_LAT_US      40          /* Kick to completion when unloaded */
+#define SIM_REAP_US         8           /* Driver reap interval */
+#define SIM_READ_US         2           /* Config read round trip over the tunnel */
+#define SIM_WRITE_US        1
+#define SIM_FRAME_US        16667
+#define SIM_STUCK_PCT       5
+#define SIM_DRAIN_US        50000
+#define SIM_SEQ_MAX         (1u << 21)  /* Transfers one run can produce */
+
+/* Ring doorbell, mirrors src/kernel/ring.c */
+#define RING_DMA_DESC_ADDR  0x100
+#define RING_DMA_START      0x104
+#define SIM_BAR_SIZE        0x1000
+
+/* Mirrors struct dma_desc in src/kernel/ring.c */
+struct sim_desc {
+    dma_addr_t addr;
+    u32 size;
+    u32 flags;
+    u32 next;
+    u32 status;
+};
+#define SIM_DESC_DONE       BIT(0)
+
+/* Not under test, the sim only needs the symbols */
+unsigned int trace_buf_kb = 1024;
+
+#define NEVER   UINT64_MAX
+
+/* Register side of the GPU; each write schedules when it takes effect */
+struct sim_gpu {
+    u32 power_from, power_to;
+    u64 power_at;
+    bool mem_reset, eng_reset;
+    u64 mem_ack_at, eng_ack_at;
+    bool hung;
+    bool intr_masked;               /* The reaper runs off the completion interrupt */
+    u64 idle_at;                    /* Engine deasserted and back to idle */
+    int stuck;                      /* Step that never acknowledges, -1 = none */
+
+    /* Drawn per reset */
+    unsigned int d3_us, d0_us, mem_ack_us, eng_ack_us, idle_us;
+};
+
+struct sim_kick {
+    struct sim_desc *desc;
+    u32 seq;
+    u64 done_at;
+};
+
+struct sim {
+    struct pci_dev pdev;
+    struct anarchy_device adev;
+    u8 bar[SIM_BAR_SIZE];
+    u32 desc_addr;                  /* Last RING_DMA_DESC_ADDR write */
+    u8 page[PAGE_SIZE];             /* Payload, the sequence number up front */
+    struct anarchy_transfer xfer;
+    u64 next_reap;
+    struct sim_gpu gpu;
+    struct sim_kick fifo[SIM_FIFO_SIZE];
+    unsigned int fifo_head, fifo_tail;
+    u64 last_done;
+    bool producing;
+    u64 next_arrival;
+    unsigned int backlog;           /* Arrived, not accepted by the ring yet */
+    u32 next_seq;
+    u32 last_seq;                   /* Highest sequence received */
+    unsigned int received;          /* Distinct sequences */
+    unsigned int duplicated;        /* Completed a second time */
+    unsigned int reordered;         /* First completion behind a later sequence */
+    unsigned int failed_submits;    /* -EIO from a stopped ring */
+    u8 seen[SIM_SEQ_MAX / 8];
+};
+
+static u64 now_us(void) {
+    return kshim_now_ns() / NSEC_PER_USEC;
+}
+
+struct sim_stats {
+    unsigned int resets;
+    unsigned int failed;
+    unsigned int bad_timeouts;      /* Stuck step not the one reported, or late */
+    unsigned int inflight;
+    unsigned int uncompleted;       /* Accepted by the ring, not completed at the hang */
+    unsigned int replayed;
+    unsigned int bad_replays;       /* Resets replaying other than the uncompleted ones */
+    unsigned int lost;
+    unsigned int lost_failed;       /* Across failed resets, expected */
+    unsigned int duplicated;
+    unsigned int reordered;
+    unsigned int frames_max;
+    u64 *recovery_us;
+};
+
+static int verbose;
+static unsigned int seed = 1;
+
+static double rnd(void) {
+    seed = seed * 1103515245u + 12345u;
+    return ((seed >> 8) & 0xffffff) / (double)0x1000000;
+}
+
+static unsigned int rnd_range(unsigned int lo, unsigned int hi) {
+    return lo + (unsigned int)(rnd() * (hi - lo + 1));
+}
+
+static bool gpu_engine_idle(const struct sim *s) {
+    return !s->gpu.hung && !s->gpu.eng_reset && now_us() >= s->gpu.idle_at;
+}
+
+/* GPU picks up a descriptor; a hung or resetting engine ignores it */
+static void gpu_kick(struct sim *s, u32 desc_addr) {
+    struct sim_desc *desc = kshim_dma_to_virt(desc_addr, sizeof(*desc));
+    struct sim_kick *k;
+    u32 *payload;
+    u64 done;
+
+    if (!desc || !(payload = kshim_dma_to_virt(desc->addr, sizeof(*payload)))) {
+        fprintf(stderr, "reset_sim: kick of an unmapped descriptor %#x\n", desc_addr);
+        abort();
+    }
+    if (!gpu_engine_idle(s) || s->fifo_tail - s->fifo_head == SIM_FIFO_SIZE)
+        return;
+
+    done = now_us() + SIM_DMA_LAT_US;
+    if (done < s->last_done + SIM_XFER_US)
+        done = s->last_done + SIM_XFER_US;
+    s->last_done = done;
+
+    k = &s->fifo[s->fifo_tail++ % SIM_FIFO_SIZE];
+    k->desc = desc;
+    k->seq = *payload;
+    k->done_at = done;
+}
+
+static u32 sim_mmio_read(void *ctx, u64 offset) {
+    return 0;
+}
+
+static void sim_mmio_write(void *ctx, u64 offset, u32 val) {
+    struct sim *s = ctx;
+
+    if (offset == RING_DMA_DESC_ADDR)
+        s->desc_addr = val;
+    else if (offset == RING_DMA_START)
+        gpu_kick(s, s->desc_addr);
+}
+
+static const struct kshim_mmio_ops sim_mmio_ops = {
+    .read = sim_mmio_read,
+    .write = sim_mmio_write,
+};
+
+static void gpu_hang(struct sim *s) {
+    s->gpu.hung = true;
+    s->fifo_head = s->fifo_tail;
+    s->last_done = 0;
+}
+
+static void sim_step(struct sim *s) {
+    struct anarchy_ring *tx = &s->adev.tx_ring;
+    int ret;
+
+    kshim_advance_ns(NSEC_PER_USEC);
+
+    while (s->producing && now_us() >= s->next_arrival) {
+        s->backlog++;
+        s->next_arrival += rnd_range(1, 2 * SIM_ARRIVAL_US - 1);
+    }
+
+    while (s->backlog) {
+        memcpy(s->page, &s->next_seq, sizeof(s->next_seq));
+        ret = anarchy_ring_transfer(&s->adev, tx, s->page, sizeof(s->page), &s->xfer);
+        /* Paused or full, the submitter retries */
+        if (ret == -EBUSY)
+            break;
+        if (ret)
+            s->failed_submits++;
+        s->next_seq++;
+        s->backlog--;
+    }
+
+    /* In-order completions, written back into the descriptor */
+    while (s->fifo_head != s->fifo_tail && gpu_engine_idle(s) &&
+           s->fifo[s->fifo_head % SIM_FIFO_SIZE].done_at <= now_us()) {
+        struct sim_kick *k = &s->fifo[s->fifo_head++ % SIM_FIFO_SIZE];
+
+        if (k->seq >= SIM_SEQ_MAX) {
+            fprintf(stderr, "reset_sim: sequence %u past SIM_SEQ_MAX\n", k->seq);
+            abort();
+        }
+        if (s->seen[k->seq / 8] & BIT(k->seq % 8)) {
+            s->duplicated++;
+        } else {
+            s->seen[k->seq / 8] |= BIT(k->seq % 8);
+            if (s->received && k->seq < s->last_seq)
+                s->reordered++;
+            else
+                s->last_seq = k->seq;
+            s->received++;
+        }
+        __atomic_store_n(&k->desc->status, k->desc->status | SIM_DESC_DONE, __ATOMIC_RELEASE);
+    }
+
+    if (!s->gpu.intr_masked && now_us() >= s->next_reap) {
+        anarchy_ring_reap(&s->adev, tx, 0);
+        s->next_reap = now_us() + SIM_REAP_US;
+    }
+}
+
+static void sim_advance(struct sim *s, u64 us) {
+    while (us--)
+        sim_step(s);
+}
+
+static u64 gpu_after(const struct sim *s, u32 reg, u32 val, unsigned int us) {
+    const struct reset_step *st;
+
+    if (s->gpu.stuck >= 0) {
+        st = &anarchy_gpu_reset_steps[s->gpu.stuck];
+        if (st->reg == reg && st->val == val)
+            return NEVER;
+    }
+    return now_us() + us;
+}
+
+static u32 gpu_read(struct sim *s, u32 reg) {
+    struct sim_gpu *g = &s->gpu;
+    bool ack;
+
+    switch (reg) {
+    case PCI_POWER_STATUS:
+        return now_us() >= g->power_at ? g->power_to : g->power_from;
+    case GPU_MEM_CTRL_RESET:
+        ack = now_us() >= g->mem_ack_at ? g->mem_reset : !g->mem_reset;
+        return (g->mem_reset ? GPU_MEM_RESET_BIT : 0) | (ack ? GPU_MEM_RESET_ACK : 0);
+    case GPU_ENGINE_CTRL_RESET:
+        ack = now_us() >= g->eng_ack_at ? g->eng_reset : !g->eng_reset;
+        return (g->eng_reset ? GPU_ENGINE_RESET_BIT : 0) | (ack ? GPU_ENGINE_RESET_ACK : 0);
+    case GPU_STATUS_REG:
+        if (g->hung)
+            return GPU_ENGINE_ERROR;
+        return gpu_engine_idle(s) ? GPU_ENGINE_IDLE : GPU_ENGINE_RESET;
+    }
+    return 0;
+}
+
+static void gpu_write(struct sim *s, u32 reg, u32 val) {
+    struct sim_gpu *g = &s->gpu;
+
+    switch (reg) {
+    case GPU_INTR_MASK_REG:
+        g->intr_masked = val != 0;
+        break;
+    case PCI_POWER_CONTROL:
+        g->power_from = now_us() >= g->power_at ? g->power_to : g->power_from;
+        g->power_to = val;
+        g->power_at = gpu_after(s, reg, val, val == GPU_POWER_D3 ? g->d3_us : g->d0_us);
+        break;
+    case GPU_MEM_CTRL_RESET:
+        g->mem_reset = val & GPU_MEM_RESET_BIT;
+        g->mem_ack_at = gpu_after(s, reg, val, g->mem_ack_us);
+        break;
+    case GPU_ENGINE_CTRL_RESET:
+        g->eng_reset = val & GPU_ENGINE_RESET_BIT;
+        g->eng_ack_at = gpu_after(s, reg, val, g->eng_ack_us);
+        if (g->eng_reset)
+            g->hung = false;
+        else
+            g->idle_at = gpu_after(s, reg, val, g->idle_us);
+        break;
+    }
+}
+
+static int sim_read(void *ctx, u32 reg, u32 *val) {
+    struct sim *s = ctx;
+
+    sim_advance(s, SIM_READ_US);
+    *val = gpu_read(s, reg);
+    return 0;
+}
+
+static int sim_write(void *ctx, u32 reg, u32 val) {
+    struct sim *s = ctx;
+
+    sim_advance(s, SIM_WRITE_US);
+    gpu_write(s, reg, val);
+    return 0;
+}
+
+static u64 sim_now_us(void *ctx) {
+    return now_us();
+}
+
+static void sim_wait_us(void *ctx, unsigned int us) {
+    sim_advance(ctx, us);
+}
+
+static const struct reset_ops sim_ops = {
+    .read = sim_read,
+    .write = sim_write,
+    .now_us = sim_now_us,
+    .wait_us = sim_wait_us,
+};
+
+/* Poll every 10 ms until (reg & mask) == expect or the timeout */
+static void legacy_poll(struct sim *s, u32 reg, u32 mask, u32 expect, unsigned int timeout_ms) {
+    u64 end = now_us() + timeout_ms * 1000ull;
+    u32 val;
+
+    while (now_us() < end) {
+        sim_read(s, reg, &val);
+        if ((val & mask) == expect)
+            return;
+        sim_advance(s, 10000);
+    }
+}
+
+/* The sequence anarchy_gpu_reset() ran before reset_seq; never fails here */
+static int reset_legacy(struct sim *s) {
+    u32 val;
+
+    anarchy_ring_stop(&s->adev, &s->adev.tx_ring);
+
+    sim_read(s, GPU_STATUS_REG, &val);          /* Link check */
+    sim_advance(s, GPU_LINK_TIMEOUT * 1000ull);
+    sim_write(s, GPU_INTR_MASK_REG, 0xFFFFFFFF);
+    sim_write(s, PCI_POWER_CONTROL, GPU_POWER_D3);
+    sim_advance(s, 100000);
+    sim_write(s, PCI_POWER_CONTROL, GPU_POWER_D0);
+    legacy_poll(s, PCI_POWER_STATUS, GPU_POWER_STATE_MASK, GPU_POWER_D0, GPU_INIT_TIMEOUT);
+    sim_write(s, GPU_MEM_CTRL_RESET, GPU_MEM_RESET_BIT);
+    sim_advance(s, 100000);
+    sim_write(s, GPU_MEM_CTRL_RESET, 0);
+    sim_write(s, GPU_ENGINE_CTRL_RESET, GPU_ENGINE_RESET_BIT);
+    sim_advance(s, 100000);
+    sim_write(s, GPU_ENGINE_CTRL_RESET, 0);
+    anarchy_ring_start(&s->adev, &s->adev.tx_ring, true);
+    legacy_poll(s, GPU_STATUS_REG, GPU_ENGINE_STATE_MASK, GPU_ENGINE_IDLE, GPU_INIT_TIMEOUT);
+    sim_write(s, GPU_INTR_MASK_REG, 0);
+    return 0;
+}
+
+/* The link stayed up, one read finds it */
+static int sim_wait_link(void *ctx) {
+    u32 val;
+
+    return sim_read(ctx, GPU_STATUS_REG, &val);
+}
+
+static void draw_gpu(struct sim_gpu *g) {
+    memset(g, 0, sizeof(*g));
+    g->power_from = g->power_to = GPU_POWER_D0;
+    g->d3_us = rnd_range(500, 3000);
+    g->d0_us = rnd_range(1000, 6000);
+    g->mem_ack_us = rnd_range(5, 200);
+    g->eng_ack_us = rnd_range(5, 100);
+    g->idle_us = rnd_range(200, 4000);
+    g->stuck = rnd() * 100 < SIM_STUCK_PCT ? (int)rnd_range(1, anarchy_gpu_reset_nsteps - 1) : -1;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static int sim_init(struct sim *s) {
+    int ret;
+
+    memset(s, 0, sizeof(*s));
+    s->pdev.dev.init_name = "sim";
+    s->adev.pdev = &s->pdev;
+    s->adev.dev = &s->pdev.dev;
+    s->adev.mmio_base = (void __iomem *)s->bar;
+    s->adev.ring_buffer_size = SIM_RING_SIZE;
+    kshim_set_mmio(s->adev.mmio_base, sizeof(s->bar), &sim_mmio_ops, s);
+
+    ret = anarchy_ring_init(&s->adev, &s->adev.tx_ring);
+    if (!ret)
+        ret = anarchy_ring_init(&s->adev, &s->adev.rx_ring);
+    if (ret)
+        return ret;
+    anarchy_ring_start(&s->adev, &s->adev.tx_ring, true);
+    anarchy_ring_start(&s->adev, &s->adev.rx_ring, false);
+    return 0;
+}
+
+static void sim_exit(struct sim *s) {
+    anarchy_ring_cleanup(&s->adev, &s->adev.rx_ring);
+    anarchy_ring_cleanup(&s->adev, &s->adev.tx_ring);
+}
+
+static bool sim_busy(struct sim *s) {
+    return s->backlog || s->fifo_head != s->fifo_tail ||
+           anarchy_ring_credits(&s->adev.tx_ring) < SIM_RING_SIZE - 1;
+}
+
+static int run_one(bool polled, struct sim_stats *st, unsigned int idx) {
+    static struct sim s;
+    struct anarchy_gpu_reset_report rep;
+    unsigned int inflight, uncompleted, replayed = 0, arrived, lost, frames;
+    u64 start, recovery;
+    int ret;
+
+    memset(&rep, 0, sizeof(rep));
+    if (sim_init(&s))
+        return -ENOMEM;
+    draw_gpu(&s.gpu);
+    s.producing = true;
+    s.next_arrival = now_us() + 1;
+
+    /* Steady state, then the hang */
+    sim_advance(&s, rnd_range(1000, 5000));
+    inflight = s.fifo_tail - s.fifo_head;
+    /* Completions run in order and the ring takes no more once the reset checkpoints it */
+    uncompleted = s.next_seq - s.failed_submits - s.received;
+    gpu_hang(&s);
+
+    start = now_us();
+    if (polled) {
+        ret = anarchy_gpu_reset_rings(&s.adev, &sim_ops, &s, sim_wait_link, &rep);
+        replayed = rep.tx_replayed;
+    } else {
+        ret = reset_legacy(&s);
+    }
+    recovery = now_us() - start;
+
+    /* Stop producing and let everything drain */
+    s.producing = false;
+    while (sim_busy(&s) && now_us() - start < recovery + SIM_DRAIN_US)
+        sim_advance(&s, 100);
+    anarchy_ring_reap(&s.adev, &s.adev.tx_ring, 0);
+    arrived = s.next_seq + s.backlog;
+    lost = arrived > s.received ? arrived - s.received : 0;
+    frames = (unsigned int)((recovery + SIM_FRAME_US - 1) / SIM_FRAME_US);
+    sim_exit(&s);
+
+    st->resets++;
+    st->inflight += inflight;
+    if (ret) {
+        const struct reset_result *res = &rep.seq;
+
+        st->failed++;
+        st->lost_failed += lost;
+        /* Timed out on the stuck step, within its timeout plus polling slack */
+        if (s.gpu.stuck < 0 || ret != -ETIMEDOUT || res->step != (unsigned int)s.gpu.stuck ||
+            res->step_us[res->step] > anarchy_gpu_reset_steps[res->step].timeout_us + 2000)
+            st->bad_timeouts++;
+        if (verbose)
+            printf("%s reset %u: '%s' failed %d after %llu us, %u in flight, lost %u\n",
+                   polled ? "polled" : "legacy", idx, rep.failed, ret,
+                   (unsigned long long)res->step_us[res->step], inflight, lost);
+        return 0;
+    }
+
+    st->recovery_us[st->resets - st->failed - 1] = recovery;
+    st->uncompleted += uncompleted;
+    st->replayed += replayed;
+    if (polled && replayed != uncompleted)
+        st->bad_replays++;
+    st->lost += lost;
+    st->duplicated += s.duplicated;
+    st->reordered += s.reordered;
+    if (frames > st->frames_max)
+        st->frames_max = frames;
+
+    if (verbose)
+        printf("%s reset %u: %llu us, in flight %u, uncompleted %u, replayed %u, lost %u, "
+               "duplicated %u, reordered %u\n",
+               polled ? "polled" : "legacy", idx, (unsigned long long)recovery, inflight,
+               uncompleted, replayed, lost, s.duplicated, s.reordered);
+    return 0;
+}
+
+static u64 pct(const struct sim_stats *st, unsigned int p) {
+    unsigned int n = st->resets - st->failed;
+
+    return n ? st->recovery_us[(n - 1) * p / 100] : 0;
+}
+
+static void print_stats(const char *name, struct sim_stats *st) {
+    qsort(st->recovery_us, st->resets - st->failed, sizeof(u64), cmp_u64);
+    printf("%-7s %6u %6u %9.2f %9.2f %9.2f %7u %9u %9u %9u %10u %11u %5u %6u\n", name,
+           st->resets, st->failed, pct(st, 50) / 1000.0, pct(st, 99) / 1000.0,
+           pct(st, 100) / 1000.0, st->frames_max, st->inflight, st->uncompleted, st->replayed,
+           st->lost, st->lost_failed, st->duplicated, st->reordered);
+}
+
+int main(int argc, char **argv) {
+    struct sim_stats legacy, polled;
+    unsigned int resets = 200, run_seed, i;
+    int opt, failed = 0;
+
+    while ((opt = getopt(argc, argv, "vn:s:")) != -1) {
+        switch (opt) {
+        case 'v':
+            verbose = 1;
+            break;
+        case 'n':
+            resets = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-v] [-n resets] [-s seed]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (!resets) {
+        fprintf(stderr, "need at least one reset\n");
+        return 2;
+    }
+
+    memset(&legacy, 0, sizeof(legacy));
+    memset(&polled, 0, sizeof(polled));
+    legacy.recovery_us = calloc(resets, sizeof(u64));
+    polled.recovery_us = calloc(resets, sizeof(u64));
+    if (!legacy.recovery_us || !polled.recovery_us)
+        return 2;
+
+    /* Both policies see the same hangs and latencies */
+    run_seed = seed;
+    for (i = 0; i < resets; i++) {
+        run_seed = run_seed * 1103515245u + 12345u;
+        seed = run_seed;
+        if (run_one(true, &polled, i))
+            return 2;
+        seed = run_seed;
+        if (run_one(false, &legacy, i))
+            return 2;
+    }
+
+    printf("%-7s %6s %6s %9s %9s %9s %7s %9s %9s %9s %10s %11s %5s %6s\n", "policy",
+           "resets", "failed", "p50 ms", "p99 ms", "max ms", "frames", "in flight", "uncompl",
+           "replayed", "lost", "lost/failed", "dup", "reord");
+    print_stats("legacy", &legacy);
+    print_stats("polled", &polled);
+
+    if (polled.lost) {
+        printf("FAIL polled: %u transfers lost\n", polled.lost);
+        failed = 1;
+    }
+    if (polled.duplicated || polled.reordered) {
+        printf("FAIL polled: %u transfers duplicated, %u reordered\n", polled.duplicated,
+               polled.reordered);
+        failed = 1;
+    }
+    /* Replaying a completed transfer duplicates it, missing one loses it */
+    if (polled.bad_replays) {
+        printf("FAIL polled: %u resets replayed %u transfers, %u were not completed\n",
+               polled.bad_replays, polled.replayed, polled.uncompleted);
+        failed = 1;
+    }
+    if (polled.frames_max > 1) {
+        printf("FAIL polled: recovery took %u frames\n", polled.frames_max);
+        failed = 1;
+    }
+    if (polled.bad_timeouts) {
+        printf("FAIL polled: %u stuck resets not timed out on the stuck step\n",
+               polled.bad_timeouts);
+        failed = 1;
+    }
+
+    free(legacy.recovery_us);
+    free(polled.recovery_us);
+    return failed;
+}
@@ -0,0 +1,313 @@
+/*
+ * Replays temperature/power traces through the thermal controller and
+ * scores throttling and lost performance.
+ *
+ *   thermal_sim [-v] [-p power_max] trace.csv...
+ *
+ * Trace lines are "time_ms,temp_c,power_w[,ambient_c]", '#' starts a
+ * comment. The recorded power is taken as what the workload asks for and
+ * the first recorded temperature seeds the die. A lumped RC model (heat
+ * capacity plus fan-dependent conductance to ambient) then turns delivered
+ * power into temperature, so each controller sees the consequences of its
+ * own decisions.
+ *
+ * Every trace runs under the old step table from thermal.c and under
+ * thermal_ctl. The run fails when the controller spends time above the
+ * critical temperature, loses more performance, makes a bigger
+ * single-step power cut or throttles more often than the table did.
+ */
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "include/thermal_ctl.h"
+
+#define SIM_STEP_MS         100     /* Plant integration step */
+#define SIM_CONTROL_MS      1000    /* THERMAL_MONITOR_INTERVAL */
+#define SIM_DEFAULT_AMBIENT 25.0
+#define SIM_HEAT_CAPACITY   400.0   /* J/K, die + heatsink */
+#define SIM_G_BASE          1.2     /* W/K with the fan stopped */
+#define SIM_G_PER_FAN       0.035   /* W/K per fan percent */
+#define SIM_THROTTLE_PCT    95      /* Delivered below this share of demand */
+#define SIM_CRITICAL_C      87.0
+#define SIM_TARGET_C        75.0
+
+struct trace_point {
+    unsigned int time_ms;
+    double temp_c;
+    double power_w;
+    double ambient_c;
+};
+
+struct trace {
+    const char *name;
+    struct trace_point *pts;
+    size_t count;
+};
+
+struct sim_score {
+    double perf_lost_pct;
+    unsigned int throttle_events;
+    double critical_s;
+    double over_target_s;
+    double max_temp_c;
+    unsigned int max_cut_w;
+    double avg_fan;
+};
+
+/* Interface shared by the controllers under test */
+struct controller {
+    const char *name;
+    void (*reset)(struct controller *c, unsigned int power_max);
+    void (*step)(struct controller *c, double temp_c, double power_w, unsigned int dt_ms);
+    unsigned int fan;
+    unsigned int power_limit;
+    unsigned int power_max;
+    struct thermal_ctl ctl;
+};
+
+static int verbose;
+
+/* The step table thermal.c used, in the degrees it meant */
+static const unsigned int legacy_fan_steps[] = { 30, 40, 50, 60, 70, 80, 90, 100 };
+
+static void legacy_reset(struct controller *c, unsigned int power_max) {
+    c->power_max = power_max;
+    c->fan = legacy_fan_steps[2];
+    c->power_limit = power_max;
+}
+
+static void legacy_step(struct controller *c, double temp_c, double power_w,
+                        unsigned int dt_ms) {
+    size_t i;
+
+    (void)power_w;
+    (void)dt_ms;
+    if (temp_c >= 87) {
+        c->fan = 100;
+        c->power_limit = 150;
+    } else if (temp_c >= 80) {
+        c->fan = 90;
+        c->power_limit = 175;
+    } else {
+        /* perf_monitor restored the profile limit once below warning */
+        c->power_limit = c->power_max;
+        if (temp_c >= 70) {
+            for (i = 0; i < sizeof(legacy_fan_steps) / sizeof(legacy_fan_steps[0]); i++) {
+                if (temp_c < 70 + i * 2) {
+                    c->fan = legacy_fan_steps[i];
+                    break;
+                }
+            }
+        } else {
+            c->fan = legacy_fan_steps[2];
+        }
+    }
+    if (c->power_limit > c->power_max)
+        c->power_limit = c->power_max;
+}
+
+static void pid_reset(struct controller *c, unsigned int power_max) {
+    struct thermal_ctl_params p;
+
+    thermal_ctl_default_params(&p);
+    p.power_max = power_max;
+    thermal_ctl_init(&c->ctl, &p);
+    c->power_max = power_max;
+    c->fan = c->ctl.fan;
+    c->power_limit = c->ctl.power_limit;
+}
+
+static void pid_step(struct controller *c, double temp_c, double power_w,
+                     unsigned int dt_ms) {
+    thermal_ctl_step(&c->ctl, (int)lround(temp_c * 1000), (unsigned int)lround(power_w), dt_ms);
+    c->fan = c->ctl.fan;
+    c->power_limit = c->ctl.power_limit;
+}
+
+static int load_trace(const char *path, struct trace *tr) {
+    char line[256];
+    size_t cap = 0;
+    FILE *f;
+
+    f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    memset(tr, 0, sizeof(*tr));
+    tr->name = path;
+    while (fgets(line, sizeof(line), f)) {
+        struct trace_point pt = { .ambient_c = SIM_DEFAULT_AMBIENT };
+        int n;
+
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        n = sscanf(line, "%u,%lf,%lf,%lf", &pt.time_ms, &pt.temp_c, &pt.power_w, &pt.ambient_c);
+        if (n < 3)
+            continue;   /* Header row */
+
+        if (tr->count == cap) {
+            cap = cap ? cap * 2 : 256;
+            tr->pts = realloc(tr->pts, cap * sizeof(*tr->pts));
+            if (!tr->pts) {
+                fclose(f);
+                return -1;
+            }
+        }
+        tr->pts[tr->count++] = pt;
+    }
+    fclose(f);
+
+    if (tr->count < 2) {
+        fprintf(stderr, "%s: need at least two samples\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static double conductance(unsigned int fan) {
+    return SIM_G_BASE + SIM_G_PER_FAN * fan;
+}
+
+static void simulate(const struct trace *tr, struct controller *c, unsigned int power_max,
+                     struct sim_score *score) {
+    const struct trace_point *pt = &tr->pts[0];
+    unsigned int t, end = tr->pts[tr->count - 1].time_ms;
+    unsigned int last_control = 0, prev_limit;
+    double temp = pt->temp_c, demand_sum = 0, lost_sum = 0, fan_sum = 0;
+    double draw = pt->power_w;
+    int throttled = 0;
+    size_t idx = 0, steps = 0;
+
+    memset(score, 0, sizeof(*score));
+    c->reset(c, power_max);
+    c->step(c, temp, pt->power_w, SIM_CONTROL_MS);
+    score->max_temp_c = temp;
+
+    if (verbose)
+        printf("# %s %s\ntime_ms,temp_c,demand_w,delivered_w,limit_w,fan\n", tr->name, c->name);
+
+    for (t = pt->time_ms; t < end; t += SIM_STEP_MS) {
+        double delivered, demand;
+        int limited;
+
+        while (idx + 1 < tr->count && tr->pts[idx + 1].time_ms <= t)
+            idx++;
+        pt = &tr->pts[idx];
+        demand = pt->power_w;
+
+        if (t - last_control >= SIM_CONTROL_MS) {
+            prev_limit = c->power_limit;
+            /* The driver reads the draw, which the limit already caps */
+            c->step(c, temp, draw, t - last_control);
+            last_control = t;
+            if (prev_limit > c->power_limit && prev_limit - c->power_limit > score->max_cut_w)
+                score->max_cut_w = prev_limit - c->power_limit;
+        }
+
+        delivered = demand < c->power_limit ? demand : c->power_limit;
+        draw = delivered;
+        temp += (delivered - conductance(c->fan) * (temp - pt->ambient_c)) *
+                (SIM_STEP_MS / 1000.0) / SIM_HEAT_CAPACITY;
+
+        demand_sum += demand;
+        lost_sum += demand - delivered;
+        fan_sum += c->fan;
+        steps++;
+
+        limited = delivered * 100 < demand * SIM_THROTTLE_PCT;
+        if (limited && !throttled)
+            score->throttle_events++;
+        throttled = limited;
+
+        if (temp >= SIM_CRITICAL_C)
+            score->critical_s += SIM_STEP_MS / 1000.0;
+        if (temp > SIM_TARGET_C)
+            score->over_target_s += SIM_STEP_MS / 1000.0;
+        if (temp > score->max_temp_c)
+            score->max_temp_c = temp;
+
+        if (verbose && !(t % SIM_CONTROL_MS))
+            printf("%u,%.2f,%.1f,%.1f,%u,%u\n", t, temp, demand, delivered,
+                   c->power_limit, c->fan);
+    }
+
+    score->perf_lost_pct = demand_sum > 0 ? 100.0 * lost_sum / demand_sum : 0;
+    score->avg_fan = steps ? fan_sum / steps : 0;
+}
+
+static void print_score(const char *trace, const char *name, const struct sim_score *s) {
+    printf("%-28s %-8s %8.2f %9u %9.1f %9.1f %8.1f %8u %7.1f\n", trace, name,
+           s->perf_lost_pct, s->throttle_events, s->critical_s, s->over_target_s,
+           s->max_temp_c, s->max_cut_w, s->avg_fan);
+}
+
+int main(int argc, char **argv) {
+    struct controller legacy = { .name = "table", .reset = legacy_reset, .step = legacy_step };
+    struct controller pid = { .name = "ctl", .reset = pid_reset, .step = pid_step };
+    struct sim_score old_score, new_score;
+    unsigned int power_max = 250;
+    int opt, i, failed = 0;
+
+    while ((opt = getopt(argc, argv, "vp:")) != -1) {
+        switch (opt) {
+        case 'v':
+            verbose = 1;
+            break;
+        case 'p':
+            power_max = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-v] [-p power_max] trace.csv...\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-v] [-p power_max] trace.csv...\n", argv[0]);
+        return 2;
+    }
+
+    printf("%-28s %-8s %8s %9s %9s %9s %8s %8s %7s\n", "trace", "ctl", "lost %",
+           "throttle", "crit s", ">75C s", "max C", "cut W", "fan %");
+
+    for (i = optind; i < argc; i++) {
+        struct trace tr;
+        const char *base;
+
+        if (load_trace(argv[i], &tr))
+            return 2;
+        base = strrchr(tr.name, '/') ? strrchr(tr.name, '/') + 1 : tr.name;
+
+        simulate(&tr, &legacy, power_max, &old_score);
+        simulate(&tr, &pid, power_max, &new_score);
+        print_score(base, legacy.name, &old_score);
+        print_score(base, pid.name, &new_score);
+
+        if (new_score.critical_s > 0) {
+            printf("FAIL %s: %.1f s above critical\n", base, new_score.critical_s);
+            failed = 1;
+        }
+        if (new_score.perf_lost_pct > old_score.perf_lost_pct) {
+            printf("FAIL %s: %.2f%% performance lost, table lost %.2f%%\n", base,
+                   new_score.perf_lost_pct, old_score.perf_lost_pct);
+            failed = 1;
+        }
+        if (old_score.max_cut_w && new_score.max_cut_w > old_score.max_cut_w) {
+            printf("FAIL %s: %u W single-step cut, table made %u W\n", base,
+                   new_score.max_cut_w, old_score.max_cut_w);
+            failed = 1;
+        }
+        if (new_score.throttle_events > old_score.throttle_events) {
+            printf("FAIL %s: %u throttle events, table had %u\n", base,
+                   new_score.throttle_events, old_score.throttle_events);
+            failed = 1;
+        }
+        free(tr.pts);
+    }
+
+    return failed;
+}
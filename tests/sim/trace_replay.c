@@ -0,0 +1,816 @@
+/*
+ * Replays a command and DMA trace, as captured by src/kernel/cmd_trace.c,
+ * into the simulated device or a real one, and checks that replays are
+ * faithful.
+ *
+ *   trace_replay [-v] [-n frames] [-s seed] [-x speed] [-o file]
+ *                [-c other] [-d device] [trace]
+ *
+ * Without a trace file a synthetic 60 fps workload (ring uploads and
+ * readbacks, texture, shader and buffer commands, bulk DMA and a sync
+ * command per frame) is run through the driver with tracing on, and that
+ * capture is the source; -o writes it out. The source is then replayed
+ * into the kshim build of the driver, in virtual time, once at original
+ * timing and once -x times faster (default 4), each with tracing on
+ * again. A replay issues every record at its original offset divided by
+ * the speed, or as soon as the previous one returned when it is behind.
+ *
+ * Command payloads are rebuilt from the sampled bytes in the trace, so a
+ * hash can only be reproduced for commands whose sample covers the hashed
+ * prefix; the synthetic workload samples every command. DMA records that
+ * the driver issued itself for an unbatched command are not replayed, the
+ * command produces them again. The engine only models the TX side, RX
+ * ring descriptors are retired as soon as they are posted.
+ *
+ * The run fails when a re-capture differs from the source in record
+ * order, type, size, flags, category or reproducible hash, when a record
+ * of the replay at original timing lands more than SIM_SLACK_NS away from
+ * its original offset, when a replay reaches less than SIM_MIN_SPEED of
+ * the speed asked for, or when a capture lost records or a replayed
+ * submission failed.
+ *
+ * -c compares the trace against another capture and exits, -d replays it
+ * into a real device instead, as one ANARCHY_IOC_SUBMIT_DMA per record
+ * at wall clock offsets, and warns when the device does not keep up. The
+ * ioctl ABI has no command submission, so a device-side capture shows
+ * commands as DMA records.
+ */
+#include <getopt.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "dma_engine.h"
+#include "include/anarchy_device.h"
+#include "include/command_proc.h"
+#include "include/cmd_trace.h"
+#include "include/dma.h"
+#include "../../include/anarchy-ioctl.h"
+
+#define SIM_FRAME_NS        16666667ULL     /* 60 fps */
+#define SIM_PAGE            4096
+#define SIM_SLACK_NS        1000
+#define SIM_MIN_SPEED       0.9     /* Of -x, below it the replay did not keep up */
+#define SIM_MAX_XFER        (256u << 20)
+#define SIM_DRAIN_BYTES     (64u << 10)
+#define SIM_DRAIN_EVERY     64
+#define SIM_SHOW_DIFFS      5
+
+static int verbose;
+static unsigned int seed = 1;
+static struct dma_engine_config cfg;
+
+/* Not under test, the sim only needs the symbols */
+unsigned int trace_buf_kb = 1024;
+int dma_pio_max = -1, dma_bounce_max = -1;
+
+void anarchy_power_gov_frame(struct anarchy_device *adev)
+{
+}
+
+static double rnd(void) {
+    seed = seed * 1103515245u + 12345u;
+    return ((seed >> 8) & 0xffffff) / (double)0x1000000;
+}
+
+static unsigned int rnd_below(unsigned int n)
+{
+    return rnd() * n;
+}
+
+/* Traces */
+
+struct trace_ent {
+    const struct anarchy_trace_rec *rec;
+    bool derived;                   /* The driver's own transfer for the command before it */
+};
+
+struct trace {
+    struct anarchy_trace_header hdr;
+    char *buf;                      /* Records in capture order */
+    size_t len;
+    size_t cap;
+    struct trace_ent *ents;         /* In time order */
+    unsigned int n;
+};
+
+static void trace_init(struct trace *t)
+{
+    memset(t, 0, sizeof(*t));
+    t->hdr.magic = ANARCHY_TRACE_MAGIC;
+    t->hdr.version = ANARCHY_TRACE_VERSION;
+    t->hdr.record_size = sizeof(struct anarchy_trace_rec);
+    t->hdr.hash_bytes = ANARCHY_TRACE_HASH_BYTES;
+}
+
+static void trace_free(struct trace *t)
+{
+    free(t->buf);
+    free(t->ents);
+    memset(t, 0, sizeof(*t));
+}
+
+static int trace_append(struct trace *t, const void *data, size_t len)
+{
+    char *buf;
+
+    if (t->len + len > t->cap) {
+        t->cap = max(t->cap * 2, t->len + len);
+        buf = realloc(t->buf, t->cap);
+        if (!buf)
+            return -ENOMEM;
+        t->buf = buf;
+    }
+    memcpy(t->buf + t->len, data, len);
+    t->len += len;
+    return 0;
+}
+
+/* Record plus its sample, padded the way the driver pads it */
+static int trace_append_rec(struct trace *t, const struct anarchy_trace_rec *rec,
+                            const void *sample)
+{
+    static const char pad[ANARCHY_TRACE_ALIGN];
+    u32 len = anarchy_trace_rec_len(rec) - sizeof(*rec);
+
+    if (trace_append(t, rec, sizeof(*rec)) || trace_append(t, sample, rec->payload_len))
+        return -ENOMEM;
+    return trace_append(t, pad, len - rec->payload_len);
+}
+
+static int cmp_ent(const void *a, const void *b)
+{
+    const struct trace_ent *x = a, *y = b;
+
+    if (x->rec->ts_ns != y->rec->ts_ns)
+        return x->rec->ts_ns < y->rec->ts_ns ? -1 : 1;
+    /* Same timestamp, keep capture order */
+    return x->rec < y->rec ? -1 : x->rec > y->rec;
+}
+
+/*
+ * Validate the records and sort them by time. A CPU's records are in
+ * order in the buffer, that is where a command's own transfer follows it.
+ */
+static int trace_index(struct trace *t)
+{
+    const struct anarchy_trace_rec *rec, **last = NULL;
+    unsigned int max_cpu = 0, n = 0;
+    size_t pos;
+
+    for (pos = 0; pos < t->len; pos += anarchy_trace_rec_len(rec), n++) {
+        rec = (const void *)(t->buf + pos);
+        if (t->len - pos < sizeof(*rec) || rec->payload_len > ANARCHY_TRACE_MAX_SAMPLE ||
+            t->len - pos < anarchy_trace_rec_len(rec) || rec->size > SIM_MAX_XFER ||
+            rec->type < ANARCHY_TRACE_CMD || rec->type > ANARCHY_TRACE_DMA) {
+            fprintf(stderr, "bad record at byte %zu\n", pos);
+            return -EINVAL;
+        }
+        max_cpu = max_t(unsigned int, max_cpu, rec->cpu);
+    }
+
+    free(t->ents);
+    t->ents = calloc(n ? n : 1, sizeof(*t->ents));
+    last = calloc(max_cpu + 1, sizeof(*last));
+    if (!t->ents || !last) {
+        free(last);
+        return -ENOMEM;
+    }
+
+    t->n = 0;
+    for (pos = 0; pos < t->len; pos += anarchy_trace_rec_len(rec)) {
+        struct trace_ent *e = &t->ents[t->n++];
+        const struct anarchy_trace_rec *prev;
+
+        rec = (const void *)(t->buf + pos);
+        prev = last[rec->cpu];
+        e->rec = rec;
+        e->derived = rec->type == ANARCHY_TRACE_DMA && prev &&
+                     prev->type == ANARCHY_TRACE_CMD && (prev->flags & CMD_FLAG_NOSYNC) &&
+                     prev->size == rec->size;
+        last[rec->cpu] = rec;
+    }
+    free(last);
+    qsort(t->ents, t->n, sizeof(*t->ents), cmp_ent);
+    return 0;
+}
+
+static int trace_load(const char *path, struct trace *t)
+{
+    char chunk[SIM_DRAIN_BYTES];
+    FILE *f;
+    size_t n;
+    int ret = 0;
+
+    trace_init(t);
+    f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return -ENOENT;
+    }
+    if (fread(&t->hdr, sizeof(t->hdr), 1, f) != 1 || t->hdr.magic != ANARCHY_TRACE_MAGIC ||
+        t->hdr.version != ANARCHY_TRACE_VERSION ||
+        t->hdr.record_size != sizeof(struct anarchy_trace_rec)) {
+        fprintf(stderr, "%s: not a version %u trace\n", path, ANARCHY_TRACE_VERSION);
+        ret = -EINVAL;
+    }
+    while (!ret && (n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        ret = trace_append(t, chunk, n);
+    fclose(f);
+    if (!ret)
+        ret = trace_index(t);
+    if (ret)
+        trace_free(t);
+    return ret;
+}
+
+static int trace_save(const char *path, const struct trace *t)
+{
+    FILE *f = fopen(path, "wb");
+    int ret = 0;
+
+    if (!f) {
+        perror(path);
+        return -EIO;
+    }
+    if (fwrite(&t->hdr, sizeof(t->hdr), 1, f) != 1 ||
+        (t->len && fwrite(t->buf, t->len, 1, f) != 1))
+        ret = -EIO;
+    if (fclose(f))
+        ret = -EIO;
+    if (ret)
+        fprintf(stderr, "%s: write failed\n", path);
+    return ret;
+}
+
+/* A command's sample covers everything anarchy_trace_hash() looks at */
+static bool hash_reproducible(const struct anarchy_trace_rec *rec)
+{
+    return rec->type != ANARCHY_TRACE_CMD ||
+           rec->payload_len >= min_t(u32, rec->size, ANARCHY_TRACE_HASH_BYTES);
+}
+
+/* Payload for @rec in @buf: the sample, zeros up to the end of the hashed prefix */
+static void build_payload(const struct anarchy_trace_rec *rec, char *buf)
+{
+    u32 hashed = min_t(u32, rec->size, ANARCHY_TRACE_HASH_BYTES);
+
+    memcpy(buf, rec + 1, rec->payload_len);
+    if (rec->payload_len < hashed)
+        memset(buf + rec->payload_len, 0, hashed - rec->payload_len);
+}
+
+static size_t trace_max_size(const struct trace *t)
+{
+    size_t size = SIM_PAGE;
+    unsigned int i;
+
+    for (i = 0; i < t->n; i++)
+        size = max_t(size_t, size, t->ents[i].rec->size);
+    return size;
+}
+
+/* Simulated device */
+
+struct sim_dev {
+    struct pci_dev pdev;
+    struct anarchy_device adev;
+    struct dma_engine *engine;
+    struct trace *capture;
+    char drain[SIM_DRAIN_BYTES];
+};
+
+/* What the completion interrupt would do, once the engine raised one */
+static void ring_reap(struct sim_dev *sd)
+{
+    if (dma_engine_poll(sd->engine, NULL, NULL))
+        anarchy_ring_reap(&sd->adev, &sd->adev.tx_ring, 0);
+}
+
+static void sim_drain(struct sim_dev *sd)
+{
+    size_t n;
+
+    while ((n = anarchy_trace_drain(&sd->adev, sd->drain, sizeof(sd->drain))) > 0)
+        trace_append(sd->capture, sd->drain, n);
+}
+
+static int sim_dev_init(struct sim_dev *sd, struct trace *capture)
+{
+    struct anarchy_device *adev = &sd->adev;
+
+    memset(sd, 0, sizeof(*sd));
+    sd->pdev.dev.init_name = "sim";
+    sd->pdev.mps = 256;
+    sd->pdev.readrq = 512;
+    adev->pdev = &sd->pdev;
+    adev->dev = &sd->pdev.dev;
+    adev->dma_channels = 4;
+
+    sd->engine = dma_engine_create(&cfg);
+    if (!sd->engine)
+        return -ENOMEM;
+    adev->mmio_base = dma_engine_bar(sd->engine);
+
+    if (init_command_processor(adev) || anarchy_ring_init(adev, &adev->tx_ring) ||
+        anarchy_ring_init(adev, &adev->rx_ring)) {
+        dma_engine_destroy(sd->engine);
+        return -ENOMEM;
+    }
+    anarchy_ring_start(adev, &adev->tx_ring, true);
+    anarchy_ring_start(adev, &adev->rx_ring, false);
+
+    /* Sample every command's hashed prefix so replays can rebuild it */
+    sd->capture = capture;
+    trace_init(capture);
+    anarchy_trace_init(adev);
+    adev->trace.sample_every = 1;
+    adev->trace.sample_bytes = ANARCHY_TRACE_HASH_BYTES;
+    return anarchy_trace_enable(adev, true);
+}
+
+static int sim_dev_exit(struct sim_dev *sd)
+{
+    struct anarchy_device *adev = &sd->adev;
+    int cpu;
+
+    anarchy_trace_enable(adev, false);
+    sim_drain(sd);
+    for_each_possible_cpu(cpu)
+        sd->capture->hdr.lost += per_cpu_ptr(adev->trace.cpus, cpu)->lost;
+    anarchy_trace_exit(adev);
+
+    anarchy_ring_cleanup(adev, &adev->rx_ring);
+    anarchy_ring_cleanup(adev, &adev->tx_ring);
+    cleanup_command_processor(adev);
+    dma_engine_destroy(sd->engine);
+    return trace_index(sd->capture);
+}
+
+/* Let virtual time pass until @t, taking ring completions on the way */
+static void sim_wait_until(struct sim_dev *sd, u64 t)
+{
+    u64 next;
+
+    for (;;) {
+        ring_reap(sd);
+        next = dma_engine_next_done_ns(sd->engine);
+        if (!next || next > t)
+            break;
+        if (next > kshim_now_ns())
+            kshim_advance_ns(next - kshim_now_ns());
+    }
+    if (t > kshim_now_ns())
+        kshim_advance_ns(t - kshim_now_ns());
+}
+
+/* Wait for the oldest ring transfer, false when nothing is outstanding */
+static bool sim_wait_ring(struct sim_dev *sd)
+{
+    if (!dma_engine_outstanding(sd->engine))
+        return false;
+    sim_wait_until(sd, dma_engine_next_done_ns(sd->engine));
+    return true;
+}
+
+static int sim_issue(struct sim_dev *sd, const struct anarchy_trace_rec *rec, char *buf)
+{
+    struct anarchy_device *adev = &sd->adev;
+    struct anarchy_transfer xfer = { 0 };
+    struct anarchy_ring *ring;
+    struct command_batch batch;
+    dma_addr_t addr;
+    int ret;
+
+    switch (rec->type) {
+    case ANARCHY_TRACE_CMD:
+        memset(&batch, 0, sizeof(batch));
+        batch.category = rec->category;
+        batch.flags = rec->flags;
+        batch.data = buf;
+        batch.total_size = rec->size;
+        return process_game_command(adev, &batch);
+
+    case ANARCHY_TRACE_RING_TX:
+    case ANARCHY_TRACE_RING_RX:
+        ring = rec->type == ANARCHY_TRACE_RING_TX ? &adev->tx_ring : &adev->rx_ring;
+        do {
+            ret = anarchy_ring_transfer(adev, ring, buf, rec->size, &xfer);
+        } while (ret == -EBUSY && sim_wait_ring(sd));
+        if (!ret && !ring->is_tx)
+            anarchy_ring_complete(adev, ring, &xfer);
+        return ret;
+
+    case ANARCHY_TRACE_DMA:
+        addr = anarchy_dma_transfer(adev, buf, rec->size);
+        if (!addr)
+            return -EIO;
+        anarchy_dma_cleanup(adev, addr, rec->size);
+        return 0;
+    }
+    return -EINVAL;
+}
+
+struct replay_result {
+    unsigned int issued;
+    unsigned int errors;
+    u64 span_ns;                    /* First to last issue */
+    u64 lag_max_ns;                 /* Issued late because the previous one ran over */
+};
+
+static int replay_sim(const struct trace *src, double speed, struct trace *out,
+                      struct replay_result *rr)
+{
+    const struct anarchy_trace_rec *rec;
+    struct sim_dev *sd;
+    u64 t0, due, now;
+    char *buf;
+    unsigned int i;
+    int ret;
+
+    memset(rr, 0, sizeof(*rr));
+    sd = malloc(sizeof(*sd));
+    buf = malloc(trace_max_size(src));
+    if (!sd || !buf || sim_dev_init(sd, out)) {
+        free(buf);
+        free(sd);
+        return -ENOMEM;
+    }
+
+    t0 = kshim_now_ns();
+    for (i = 0; i < src->n; i++) {
+        rec = src->ents[i].rec;
+        if (src->ents[i].derived)
+            continue;
+
+        due = t0 + (u64)((rec->ts_ns - src->ents[0].rec->ts_ns) / speed);
+        now = kshim_now_ns();
+        if (now < due)
+            sim_wait_until(sd, due);
+        else
+            rr->lag_max_ns = max(rr->lag_max_ns, now - due);
+
+        build_payload(rec, buf);
+        ret = sim_issue(sd, rec, buf);
+        if (ret) {
+            if (!rr->errors && verbose)
+                printf("record %u, type %u size %u: %d\n", i, rec->type, rec->size, ret);
+            rr->errors++;
+        }
+        if (++rr->issued % SIM_DRAIN_EVERY == 0)
+            sim_drain(sd);
+    }
+    rr->span_ns = kshim_now_ns() - t0;
+    while (sim_wait_ring(sd))
+        ;
+
+    ret = sim_dev_exit(sd);
+    free(buf);
+    free(sd);
+    return ret;
+}
+
+/* Synthetic workload */
+
+static void gen_add(struct trace *t, u64 ts, u8 type, u8 category, u32 flags, u32 size)
+{
+    struct anarchy_trace_rec rec = {
+        .ts_ns = ts,
+        .type = type,
+        .category = category,
+        .flags = flags,
+        .size = size,
+    };
+    u8 sample[ANARCHY_TRACE_HASH_BYTES];
+    u32 i;
+
+    if (type == ANARCHY_TRACE_CMD) {
+        rec.payload_len = min_t(u32, size, sizeof(sample));
+        for (i = 0; i < rec.payload_len; i++)
+            sample[i] = rnd_below(256);
+        rec.hash = anarchy_trace_hash(sample, size);
+    }
+    trace_append_rec(t, &rec, sample);
+}
+
+/*
+ * One frame of a game: texture uploads through the TX ring, a couple of
+ * readbacks, draw state as commands of all kinds, every other frame a
+ * bulk transfer, and a sync command to close the frame.
+ */
+static int gen_workload(struct trace *t, unsigned int frames)
+{
+    static const u32 cmd_flags[] = {
+        CMD_FLAG_NOSYNC, CMD_FLAG_NOSYNC, CMD_FLAG_BATCH, CMD_FLAG_LOWLAT | CMD_FLAG_NOSYNC,
+    };
+    unsigned int f, i, events;
+    u64 ts;
+    u32 flags;
+    u8 cat;
+
+    trace_init(t);
+    for (f = 0; f < frames; f++) {
+        ts = f * SIM_FRAME_NS;
+        events = 24 + rnd_below(24);
+        for (i = 0; i < events; i++) {
+            ts += 5000 + rnd_below(55000);
+            switch (rnd_below(8)) {
+            case 0: case 1: case 2:
+                gen_add(t, ts, ANARCHY_TRACE_RING_TX, 0, 0, SIM_PAGE);
+                break;
+            case 3:
+                gen_add(t, ts, ANARCHY_TRACE_RING_RX, 0, 0, SIM_PAGE);
+                break;
+            default:
+                flags = cmd_flags[rnd_below(ARRAY_SIZE(cmd_flags))];
+                cat = flags & CMD_FLAG_LOWLAT ? CMD_CAT_TEXTURE :
+                      CMD_CAT_GENERAL + rnd_below(CMD_CAT_SYNC);
+                gen_add(t, ts, ANARCHY_TRACE_CMD, cat, flags, 256u << rnd_below(9));
+                break;
+            }
+        }
+        if (f & 1)
+            gen_add(t, ts += 20000, ANARCHY_TRACE_DMA, 0, 0, (64u << 10) << rnd_below(5));
+        gen_add(t, ts + 20000, ANARCHY_TRACE_CMD, CMD_CAT_SYNC, CMD_FLAG_NOSYNC, 256);
+    }
+    return trace_index(t);
+}
+
+/* Comparison */
+
+struct trace_diff {
+    unsigned int mismatches;
+    unsigned int unhashed;          /* Commands whose hash could not be rebuilt */
+    u64 skew_max_ns;                /* Replayed offset against original / speed */
+};
+
+static void trace_compare(const struct trace *a, const struct trace *b, double speed,
+                          struct trace_diff *d)
+{
+    const struct anarchy_trace_rec *x, *y;
+    u64 ox, oy;
+    unsigned int i;
+    bool same;
+
+    memset(d, 0, sizeof(*d));
+    if (a->n != b->n) {
+        printf("  %u records against %u\n", a->n, b->n);
+        d->mismatches += a->n > b->n ? a->n - b->n : b->n - a->n;
+    }
+    for (i = 0; i < min(a->n, b->n); i++) {
+        x = a->ents[i].rec;
+        y = b->ents[i].rec;
+        same = x->type == y->type && x->size == y->size && x->flags == y->flags &&
+               x->category == y->category;
+        if (!hash_reproducible(x))
+            d->unhashed++;
+        else
+            same &= x->hash == y->hash;
+        if (!same && d->mismatches++ < SIM_SHOW_DIFFS)
+            printf("  record %u: type %u size %u flags %#x cat %u hash %016llx, "
+                   "replayed type %u size %u flags %#x cat %u hash %016llx\n", i,
+                   x->type, x->size, x->flags, x->category, (unsigned long long)x->hash,
+                   y->type, y->size, y->flags, y->category, (unsigned long long)y->hash);
+
+        ox = (x->ts_ns - a->ents[0].rec->ts_ns) / speed;
+        oy = y->ts_ns - b->ents[0].rec->ts_ns;
+        d->skew_max_ns = max(d->skew_max_ns, ox > oy ? ox - oy : oy - ox);
+    }
+}
+
+static void count_types(const struct trace *t, unsigned int *count)
+{
+    unsigned int i;
+
+    memset(count, 0, (ANARCHY_TRACE_DMA + 1) * sizeof(*count));
+    for (i = 0; i < t->n; i++)
+        count[t->ents[i].rec->type]++;
+}
+
+static u64 trace_span_ns(const struct trace *t)
+{
+    return t->n ? t->ents[t->n - 1].rec->ts_ns - t->ents[0].rec->ts_ns : 0;
+}
+
+static void print_trace(const char *name, const struct trace *t)
+{
+    unsigned int count[ANARCHY_TRACE_DMA + 1];
+    u64 span = trace_span_ns(t);
+
+    count_types(t, count);
+    printf("%-10s %8u %8u %8u %8u %8u %6llu %9.2f\n", name, t->n, count[ANARCHY_TRACE_CMD],
+           count[ANARCHY_TRACE_RING_TX], count[ANARCHY_TRACE_RING_RX],
+           count[ANARCHY_TRACE_DMA], (unsigned long long)t->hdr.lost, span / 1e6);
+}
+
+/* Replay at @speed, re-capture and compare against @src */
+static int check_replay(const char *name, const struct trace *src, double speed)
+{
+    struct replay_result rr;
+    struct trace_diff d;
+    struct trace re;
+    double reached;
+    int failed = 0;
+
+    if (replay_sim(src, speed, &re, &rr)) {
+        printf("FAIL %s: replay did not run\n", name);
+        return 1;
+    }
+    print_trace(name, &re);
+    trace_compare(src, &re, speed, &d);
+    reached = rr.span_ns ? trace_span_ns(src) / (double)rr.span_ns : speed;
+    printf("           %u issued at %.2fx, lag max %.2f us, skew max %.2f us, "
+           "%u hashes not rebuilt\n", rr.issued, reached,
+           rr.lag_max_ns / 1000.0, d.skew_max_ns / 1000.0, d.unhashed);
+
+    if (d.mismatches) {
+        printf("FAIL %s: %u records differ from the source\n", name, d.mismatches);
+        failed = 1;
+    }
+    if (rr.errors) {
+        printf("FAIL %s: %u of %u submissions failed\n", name, rr.errors, rr.issued);
+        failed = 1;
+    }
+    if (re.hdr.lost) {
+        printf("FAIL %s: %llu records lost\n", name, (unsigned long long)re.hdr.lost);
+        failed = 1;
+    }
+    if (speed == 1.0 && d.skew_max_ns > SIM_SLACK_NS) {
+        printf("FAIL %s: records land up to %.2f us off their original time\n", name,
+               d.skew_max_ns / 1000.0);
+        failed = 1;
+    }
+    if (reached < speed * SIM_MIN_SPEED) {
+        printf("FAIL %s: reached %.2fx of %gx, the device model cannot keep up\n", name,
+               reached, speed);
+        failed = 1;
+    }
+    trace_free(&re);
+    return failed;
+}
+
+/* Real device */
+
+static u64 mono_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static int replay_device(const struct trace *src, const char *path, double speed)
+{
+    const struct anarchy_trace_rec *rec;
+    struct anarchy_ioc_dma dma;
+    struct timespec ts;
+    unsigned int i, issued = 0, errors = 0;
+    u64 t0, due, now, span, lag_max = 0;
+    double reached;
+    char *buf;
+    int fd;
+
+    fd = open(path, O_RDWR);
+    if (fd < 0) {
+        perror(path);
+        return 1;
+    }
+    buf = malloc(trace_max_size(src));
+    if (!buf) {
+        close(fd);
+        return 1;
+    }
+
+    t0 = mono_ns();
+    for (i = 0; i < src->n; i++) {
+        rec = src->ents[i].rec;
+        if (src->ents[i].derived)
+            continue;
+
+        due = t0 + (u64)((rec->ts_ns - src->ents[0].rec->ts_ns) / speed);
+        now = mono_ns();
+        if (now < due) {
+            ts.tv_sec = due / NSEC_PER_SEC;
+            ts.tv_nsec = due % NSEC_PER_SEC;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        } else {
+            lag_max = max(lag_max, now - due);
+        }
+
+        build_payload(rec, buf);
+        memset(&dma, 0, sizeof(dma));
+        dma.addr = (uintptr_t)buf;
+        dma.size = rec->size;
+        dma.flags = rec->type == ANARCHY_TRACE_RING_RX ? 0 : ANARCHY_DMA_TO_DEVICE;
+        dma.cookie = i;
+        if (ioctl(fd, ANARCHY_IOC_SUBMIT_DMA, &dma) < 0) {
+            if (!errors && verbose)
+                perror("ANARCHY_IOC_SUBMIT_DMA");
+            errors++;
+        }
+        issued++;
+    }
+
+    span = mono_ns() - t0;
+    reached = span ? trace_span_ns(src) / (double)span : speed;
+    printf("%s: %u submitted in %.2f ms, %.2fx, lag max %.2f us, %u failed\n", path, issued,
+           span / 1e6, reached, lag_max / 1000.0, errors);
+    if (reached < speed * SIM_MIN_SPEED)
+        printf("WARNING %s: reached %.2fx of %gx, the device did not keep up\n", path,
+               reached, speed);
+    free(buf);
+    close(fd);
+    return errors ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    const char *out = NULL, *other = NULL, *device = NULL;
+    unsigned int frames = 120;
+    double speed = 4.0;
+    struct trace src, cmp;
+    struct trace_diff d;
+    struct replay_result rr;
+    char name[32];
+    int opt, failed = 0;
+
+    dma_engine_default_config(&cfg);
+    while ((opt = getopt(argc, argv, "vn:s:x:o:c:d:")) != -1) {
+        switch (opt) {
+        case 'v':
+            verbose = 1;
+            break;
+        case 'n':
+            frames = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'x':
+            speed = strtod(optarg, NULL);
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        case 'c':
+            other = optarg;
+            break;
+        case 'd':
+            device = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-v] [-n frames] [-s seed] [-x speed] [-o file] "
+                    "[-c other] [-d device] [trace]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (argc - optind > 1 || !frames || speed <= 0) {
+        fprintf(stderr, "need at most one trace, a frame count and a positive speed\n");
+        return 2;
+    }
+    cfg.seed = seed;
+
+    printf("%-10s %8s %8s %8s %8s %8s %6s %9s\n", "trace", "records", "cmd", "ring tx",
+           "ring rx", "dma", "lost", "span ms");
+    if (optind < argc) {
+        if (trace_load(argv[optind], &src))
+            return 1;
+        print_trace("source", &src);
+    } else {
+        struct trace plan;
+
+        if (gen_workload(&plan, frames) || replay_sim(&plan, 1.0, &src, &rr)) {
+            printf("FAIL: could not capture the synthetic workload\n");
+            return 1;
+        }
+        trace_free(&plan);
+        print_trace("source", &src);
+        if (rr.errors || src.hdr.lost) {
+            printf("FAIL source: %u submissions failed, %llu records lost\n", rr.errors,
+                   (unsigned long long)src.hdr.lost);
+            failed = 1;
+        }
+        if (out && trace_save(out, &src))
+            failed = 1;
+    }
+    if (src.hdr.lost)
+        printf("warning: the source lost %llu records, replays miss them too\n",
+               (unsigned long long)src.hdr.lost);
+
+    if (other) {
+        if (trace_load(other, &cmp))
+            return 1;
+        print_trace("other", &cmp);
+        trace_compare(&src, &cmp, 1.0, &d);
+        printf("%u records differ, skew max %.2f us, %u hashes not comparable\n",
+               d.mismatches, d.skew_max_ns / 1000.0, d.unhashed);
+        return d.mismatches ? 1 : failed;
+    }
+    if (device)
+        return replay_device(&src, device, speed) | failed;
+
+    failed |= check_replay("replay 1x", &src, 1.0);
+    snprintf(name, sizeof(name), "replay %gx", speed);
+    failed |= check_replay(name, &src, speed);
+    trace_free(&src);
+    return failed;
+}